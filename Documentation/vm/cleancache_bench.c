@@ -0,0 +1,191 @@
+/*
+ * Re-read throughput of a file set under memory pressure, to compare a
+ * kernel booted with zcache.enabled=0 and zcache.enabled=1 (or any other
+ * cleancache backend against none).
+ *
+ * Usage: cleancache_bench dir [file set MB] [pressure MB] [passes]
+ *
+ * dir must be on a filesystem that uses cleancache (ext3 or ext4).  The
+ * file set is written there once, half text-like and half random data so
+ * that both compressible and incompressible pages are involved, and
+ * synced.  Then an anonymous region of the given size is populated and
+ * locked if possible, to leave less free memory than the file set needs,
+ * and the whole set is read sequentially for the given number of passes.
+ * Every pass after the first has to re-read pages that were evicted.
+ *
+ * Each pass reports MB/s and the deltas of the cleancache and zcache
+ * debugfs counters, when /sys/kernel/debug is mounted and readable.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+#define FILE_MB		16
+#define BUFLEN		(128 << 10)
+
+static const char *counters[] = {
+	"cleancache/succ_gets",
+	"cleancache/failed_gets",
+	"cleancache/puts",
+	"zcache/gets",
+	"zcache/get_misses",
+	"zcache/evictions",
+	"zcache/reject_compress_poor",
+	NULL,
+};
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static long long read_counter(const char *name)
+{
+	char path[256];
+	long long val = -1;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "/sys/kernel/debug/%s", name);
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+	if (fscanf(f, "%lld", &val) != 1)
+		val = -1;
+	fclose(f);
+	return val;
+}
+
+static void fill(char *buf, int text, unsigned long long *seed)
+{
+	static const char words[] = "the quick brown fox jumps over a lazy dog ";
+	int i;
+
+	for (i = 0; i < BUFLEN; i++) {
+		*seed = *seed * 6364136223846793005ULL + 1442695040888963407ULL;
+		buf[i] = text ? words[(*seed >> 33) % (sizeof(words) - 1)] :
+				(char)(*seed >> 33);
+	}
+}
+
+static void create_set(const char *dir, int nr_files, char *buf)
+{
+	unsigned long long seed = 1;
+	char path[4096];
+	int i, j, fd;
+
+	for (i = 0; i < nr_files; i++) {
+		snprintf(path, sizeof(path), "%s/cleancache_bench.%d", dir, i);
+		fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+		if (fd < 0) {
+			perror(path);
+			exit(1);
+		}
+		for (j = 0; j < (FILE_MB << 20) / BUFLEN; j++) {
+			fill(buf, i & 1, &seed);
+			if (write(fd, buf, BUFLEN) != BUFLEN) {
+				perror("write");
+				exit(1);
+			}
+		}
+		fsync(fd);
+		close(fd);
+	}
+}
+
+static long long read_set(const char *dir, int nr_files, char *buf)
+{
+	long long total = 0;
+	char path[4096];
+	ssize_t n;
+	int i, fd;
+
+	for (i = 0; i < nr_files; i++) {
+		snprintf(path, sizeof(path), "%s/cleancache_bench.%d", dir, i);
+		fd = open(path, O_RDONLY);
+		if (fd < 0) {
+			perror(path);
+			exit(1);
+		}
+		while ((n = read(fd, buf, BUFLEN)) > 0)
+			total += n;
+		close(fd);
+	}
+	return total;
+}
+
+int main(int argc, char **argv)
+{
+	size_t set_mb = 1024, pressure_mb = 0;
+	long long before[16], after;
+	int passes = 4, nr_files, i, j;
+	char path[4096], *buf, *hog;
+	long pagesize = sysconf(_SC_PAGESIZE);
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s dir [file set MB] [pressure MB] "
+			"[passes]\n", argv[0]);
+		exit(1);
+	}
+	if (argc > 2)
+		set_mb = strtoul(argv[2], NULL, 0);
+	if (argc > 3)
+		pressure_mb = strtoul(argv[3], NULL, 0);
+	if (argc > 4)
+		passes = atoi(argv[4]);
+	nr_files = (set_mb + FILE_MB - 1) / FILE_MB;
+
+	buf = malloc(BUFLEN);
+	if (!buf) {
+		perror("malloc");
+		exit(1);
+	}
+	create_set(argv[1], nr_files, buf);
+
+	if (pressure_mb) {
+		size_t len = pressure_mb << 20, off;
+
+		hog = mmap(NULL, len, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (hog == MAP_FAILED) {
+			perror("mmap");
+			exit(1);
+		}
+		for (off = 0; off < len; off += pagesize)
+			hog[off] = 1;
+		if (mlock(hog, len))
+			perror("mlock (pressure stays swappable)");
+	}
+
+	for (i = 0; i < passes; i++) {
+		double start, secs;
+		long long total;
+
+		for (j = 0; counters[j]; j++)
+			before[j] = read_counter(counters[j]);
+		start = now();
+		total = read_set(argv[1], nr_files, buf);
+		secs = now() - start;
+		printf("pass %d: %lld MB in %.3f s, %.0f MB/s\n", i,
+		       total >> 20, secs, (total >> 20) / secs);
+		for (j = 0; counters[j]; j++) {
+			after = read_counter(counters[j]);
+			if (before[j] >= 0 && after >= 0)
+				printf("    %-28s %lld\n", counters[j],
+				       after - before[j]);
+		}
+	}
+
+	for (i = 0; i < nr_files; i++) {
+		snprintf(path, sizeof(path), "%s/cleancache_bench.%d",
+			 argv[1], i);
+		unlink(path);
+	}
+	return 0;
+}
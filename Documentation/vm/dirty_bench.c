@@ -0,0 +1,107 @@
+/*
+ * Several dd-like writers dirtying the page cache at once, to compare
+ * dirty throttling schemes: aggregate throughput, how evenly it is shared
+ * between the writers, and how long write() stalls in
+ * balance_dirty_pages().
+ *
+ * Usage: dirty_bench dir [writers] [MB per writer] [block KB]
+ *
+ * dir should be on the disk under test, not on tmpfs.  Each writer is a
+ * separate process writing its own file sequentially with buffered
+ * write()s of the given block size.  A writer reports its throughput, and
+ * the longest and average write() time, which is dominated by the
+ * throttling pauses.  The totals include the final sync, so that dirty
+ * data left in memory does not inflate the numbers.
+ *
+ * The balance_dirty_pages and bdi_write_bandwidth tracepoints show the
+ * limits, the bandwidth estimate and every pause while this runs.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void writer(const char *dir, int id, size_t len, size_t bs)
+{
+	double start, t, lat, max_lat = 0, sum_lat = 0;
+	unsigned long nr_writes = 0;
+	char path[4096], *buf;
+	size_t done;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/dirty_bench.%d", dir, id);
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	buf = malloc(bs);
+	if (fd < 0 || !buf) {
+		perror(path);
+		exit(1);
+	}
+	memset(buf, id + 1, bs);
+
+	start = now();
+	for (done = 0; done < len; done += bs) {
+		t = now();
+		if (write(fd, buf, bs) != bs) {
+			perror("write");
+			exit(1);
+		}
+		lat = now() - t;
+		sum_lat += lat;
+		if (lat > max_lat)
+			max_lat = lat;
+		nr_writes++;
+	}
+	t = now() - start;
+	printf("writer %2d: %7.1f MB/s, write() max %7.1f ms avg %6.3f ms\n",
+	       id, (len >> 20) / t, max_lat * 1e3, sum_lat * 1e3 / nr_writes);
+	close(fd);
+	unlink(path);
+	exit(0);
+}
+
+int main(int argc, char **argv)
+{
+	size_t len = 1024UL << 20, bs = 64 << 10;
+	int nr_writers = 4, i;
+	double start, secs;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s dir [writers] [MB per writer] "
+			"[block KB]\n", argv[0]);
+		exit(1);
+	}
+	if (argc > 2)
+		nr_writers = atoi(argv[2]);
+	if (argc > 3)
+		len = strtoul(argv[3], NULL, 0) << 20;
+	if (argc > 4)
+		bs = strtoul(argv[4], NULL, 0) << 10;
+
+	sync();
+	setvbuf(stdout, NULL, _IOLBF, 0);
+	start = now();
+	for (i = 0; i < nr_writers; i++)
+		if (fork() == 0)
+			writer(argv[1], i, len, bs);
+	while (wait(NULL) > 0)
+		;
+	secs = now() - start;
+	printf("total:     %7.1f MB/s before sync\n",
+	       (double)nr_writers * (len >> 20) / secs);
+	sync();
+	secs = now() - start;
+	printf("total:     %7.1f MB/s including sync, %.1f s\n",
+	       (double)nr_writers * (len >> 20) / secs, secs);
+	return 0;
+}
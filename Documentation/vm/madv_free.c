@@ -0,0 +1,77 @@
+/*
+ * Allocator churn with MADV_FREE versus MADV_DONTNEED.
+ *
+ * Like a malloc arena that hands memory back to the kernel when a burst
+ * of objects is freed and reuses it for the next burst, each round
+ * writes every page of a 64 MB anonymous mapping and then releases the
+ * whole range with madvise().  With MADV_DONTNEED every write of the
+ * next round takes a page fault and gets a freshly zeroed page; with
+ * MADV_FREE the pages stay mapped unless reclaim took them meanwhile.
+ *
+ * Usage: madv_free [free|dontneed] [rounds]
+ *
+ * MADV_FREE behaves like MADV_DONTNEED when no swap is configured.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+#define LENGTH (64UL*1024*1024)
+
+#ifndef MADV_FREE
+#define MADV_FREE 8 /* arch specific */
+#endif
+
+int main(int argc, char **argv)
+{
+	int advice = MADV_FREE;
+	int rounds = 100;
+	long pagesize = sysconf(_SC_PAGESIZE);
+	struct timeval start, end;
+	double secs;
+	char *addr;
+	unsigned long i;
+	int r;
+
+	if (argc > 1) {
+		if (!strcmp(argv[1], "dontneed"))
+			advice = MADV_DONTNEED;
+		else if (strcmp(argv[1], "free")) {
+			fprintf(stderr, "usage: %s [free|dontneed] [rounds]\n",
+				argv[0]);
+			exit(1);
+		}
+	}
+	if (argc > 2)
+		rounds = atoi(argv[2]);
+
+	addr = mmap(NULL, LENGTH, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (addr == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+
+	gettimeofday(&start, NULL);
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < LENGTH; i += pagesize)
+			addr[i] = r;
+		if (madvise(addr, LENGTH, advice)) {
+			perror("madvise");
+			exit(1);
+		}
+	}
+	gettimeofday(&end, NULL);
+
+	secs = (end.tv_sec - start.tv_sec) +
+		(end.tv_usec - start.tv_usec) / 1e6;
+	printf("%s: %d rounds of %lu MB in %.3f s, %.0f MB/s\n",
+	       advice == MADV_FREE ? "MADV_FREE" : "MADV_DONTNEED",
+	       rounds, LENGTH >> 20, secs, rounds * (LENGTH >> 20) / secs);
+
+	munmap(addr, LENGTH);
+	return 0;
+}
@@ -0,0 +1,105 @@
+/*
+ * Time mlock() of a large anonymous region three ways:
+ *
+ *   present  the region is populated first, then mlock()ed: the cost is
+ *            moving every page to the unevictable list
+ *   fault    mlock() of an untouched region, which faults it all in
+ *   onfault  mlockall(MCL_CURRENT | MCL_ONFAULT) of an untouched region,
+ *            then touching every page; nothing is faulted in by the call
+ *
+ * munlock() is timed for the present case too.
+ *
+ * Usage: mlock_bench [gigabytes]
+ *
+ * Needs CAP_IPC_LOCK or a large enough RLIMIT_MEMLOCK.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+#ifndef MCL_ONFAULT
+#define MCL_ONFAULT 4 /* arch specific */
+#endif
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void report(const char *what, size_t len, double secs)
+{
+	printf("%-16s %8.3f s %8.2f GB/s\n", what, secs,
+	       (double)len / (1UL << 30) / secs);
+}
+
+static char *map(size_t len)
+{
+	char *addr = mmap(NULL, len, PROT_READ | PROT_WRITE,
+			  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (addr == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+	return addr;
+}
+
+static void touch(char *addr, size_t len, long pagesize)
+{
+	size_t i;
+
+	for (i = 0; i < len; i += pagesize)
+		addr[i] = 1;
+}
+
+int main(int argc, char **argv)
+{
+	size_t len = 1UL << 30;
+	long pagesize = sysconf(_SC_PAGESIZE);
+	double start;
+	char *addr;
+
+	if (argc > 1)
+		len = strtoul(argv[1], NULL, 0) << 30;
+
+	addr = map(len);
+	touch(addr, len, pagesize);
+	start = now();
+	if (mlock(addr, len)) {
+		perror("mlock");
+		exit(1);
+	}
+	report("mlock present", len, now() - start);
+	start = now();
+	munlock(addr, len);
+	report("munlock", len, now() - start);
+	munmap(addr, len);
+
+	addr = map(len);
+	start = now();
+	if (mlock(addr, len)) {
+		perror("mlock");
+		exit(1);
+	}
+	report("mlock fault", len, now() - start);
+	munmap(addr, len);
+
+	addr = map(len);
+	start = now();
+	if (mlockall(MCL_CURRENT | MCL_ONFAULT)) {
+		perror("mlockall(MCL_ONFAULT)");
+		exit(1);
+	}
+	report("mlockall onfault", len, now() - start);
+	start = now();
+	touch(addr, len, pagesize);
+	report("  then touch", len, now() - start);
+	munlockall();
+	munmap(addr, len);
+	return 0;
+}
@@ -0,0 +1,144 @@
+/*
+ * Copy a buffer out of another process three ways and compare:
+ * process_vm_readv(), pread() on /proc/pid/mem, and a pipe the other
+ * process writes the buffer into.
+ *
+ * Usage: process_vm_bench [megabytes] [rounds]
+ *
+ * /proc/pid/mem needs the reader to be the ptrace parent of a stopped
+ * process, so the child attaches itself with PTRACE_TRACEME and stops.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/syscall.h>
+
+/* this kernel's numbers, whatever the installed headers say */
+#if defined(__x86_64__)
+#define NR_process_vm_readv 310
+#elif defined(__i386__)
+#define NR_process_vm_readv 347
+#else
+#define NR_process_vm_readv __NR_process_vm_readv
+#endif
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void report(const char *how, size_t len, int rounds, double secs)
+{
+	printf("%-18s %8.0f MB/s\n", how,
+	       (double)len * rounds / (1 << 20) / secs);
+}
+
+int main(int argc, char **argv)
+{
+	size_t len = 64UL << 20;
+	int rounds = 20;
+	char *remote, *local;
+	int pipefd[2];
+	char path[64];
+	double start;
+	pid_t pid;
+	int i, fd;
+
+	if (argc > 1)
+		len = strtoul(argv[1], NULL, 0) << 20;
+	if (argc > 2)
+		rounds = atoi(argv[2]);
+
+	/* same address in the child after fork */
+	remote = malloc(len);
+	local = malloc(len);
+	if (!remote || !local || pipe(pipefd)) {
+		perror("setup");
+		exit(1);
+	}
+	memset(remote, 0x5a, len);
+
+	pid = fork();
+	if (pid == 0) {
+		close(pipefd[0]);
+		ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+		raise(SIGSTOP);
+		for (i = 0; i < rounds; i++) {
+			size_t done = 0;
+
+			while (done < len) {
+				ssize_t n = write(pipefd[1], remote + done,
+						  len - done);
+				if (n <= 0)
+					exit(1);
+				done += n;
+			}
+		}
+		exit(0);
+	}
+	close(pipefd[1]);
+	waitpid(pid, NULL, WUNTRACED);
+
+	start = now();
+	for (i = 0; i < rounds; i++) {
+		struct iovec liov = { local, len };
+		struct iovec riov = { remote, len };
+
+		if (syscall(NR_process_vm_readv, pid, &liov, 1, &riov, 1, 0)
+		    != (ssize_t)len) {
+			perror("process_vm_readv");
+			break;
+		}
+	}
+	if (i == rounds)
+		report("process_vm_readv", len, rounds, now() - start);
+
+	snprintf(path, sizeof(path), "/proc/%d/mem", pid);
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		perror(path);
+	else {
+		start = now();
+		for (i = 0; i < rounds; i++)
+			if (pread(fd, local, len, (off_t)(unsigned long)remote)
+			    != (ssize_t)len) {
+				perror("pread");
+				break;
+			}
+		if (i == rounds)
+			report("/proc/pid/mem", len, rounds, now() - start);
+		close(fd);
+	}
+
+	ptrace(PTRACE_DETACH, pid, NULL, NULL);
+	start = now();
+	for (i = 0; i < rounds; i++) {
+		size_t done = 0;
+
+		while (done < len) {
+			ssize_t n = read(pipefd[0], local + done, len - done);
+			if (n <= 0)
+				break;
+			done += n;
+		}
+		if (done < len) {
+			fprintf(stderr, "pipe: short read\n");
+			break;
+		}
+	}
+	if (i == rounds)
+		report("pipe", len, rounds, now() - start);
+
+	waitpid(pid, NULL, 0);
+	return 0;
+}
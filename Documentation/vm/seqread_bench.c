@@ -0,0 +1,124 @@
+/*
+ * Buffered sequential read of a file, through read() or through splice()
+ * into a pipe that is drained to /dev/null.  Reports throughput and the
+ * system CPU time spent per gigabyte, which is where page cache lookups
+ * and readahead show up once the file is cached.
+ *
+ * Usage: seqread_bench file [read|splice] [buffer KB] [passes]
+ *
+ * The first pass reads whatever is not cached yet; drop the caches
+ * beforehand (echo 3 > /proc/sys/vm/drop_caches) to time readahead from
+ * disk as well.
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static double sys_time(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+static long long read_pass(int fd, char *buf, size_t len)
+{
+	long long total = 0;
+	ssize_t n;
+
+	while ((n = pread(fd, buf, len, total)) > 0)
+		total += n;
+	return n < 0 ? -1 : total;
+}
+
+static long long splice_pass(int fd, int pipefd[2], int null, size_t len)
+{
+	long long total = 0;
+	loff_t pos = 0;
+	ssize_t n;
+
+	while ((n = splice(fd, &pos, pipefd[1], NULL, len, 0)) > 0) {
+		total += n;
+		while (n > 0) {
+			ssize_t m = splice(pipefd[0], NULL, null, NULL, n, 0);
+
+			if (m <= 0)
+				return -1;
+			n -= m;
+		}
+	}
+	return n < 0 ? -1 : total;
+}
+
+int main(int argc, char **argv)
+{
+	int use_splice = 0;
+	size_t len = 128 << 10;
+	int passes = 5;
+	int pipefd[2], null = -1;
+	char *buf;
+	int i, fd;
+
+	if (argc < 2) {
+		fprintf(stderr,
+			"usage: %s file [read|splice] [buffer KB] [passes]\n",
+			argv[0]);
+		exit(1);
+	}
+	if (argc > 2)
+		use_splice = !strcmp(argv[2], "splice");
+	if (argc > 3)
+		len = strtoul(argv[3], NULL, 0) << 10;
+	if (argc > 4)
+		passes = atoi(argv[4]);
+
+	fd = open(argv[1], O_RDONLY);
+	buf = malloc(len);
+	if (fd < 0 || !buf) {
+		perror(argv[1]);
+		exit(1);
+	}
+	if (use_splice) {
+		null = open("/dev/null", O_WRONLY);
+		if (null < 0 || pipe(pipefd)) {
+			perror("splice setup");
+			exit(1);
+		}
+	}
+
+	for (i = 0; i < passes; i++) {
+		double start = now(), sys = sys_time(), secs;
+		long long total;
+
+		if (use_splice)
+			total = splice_pass(fd, pipefd, null, len);
+		else
+			total = read_pass(fd, buf, len);
+		if (total < 0) {
+			perror(use_splice ? "splice" : "read");
+			exit(1);
+		}
+		secs = now() - start;
+		sys = sys_time() - sys;
+		printf("pass %d: %s %lld MB in %.3f s, %.0f MB/s, "
+		       "%.3f s system per GB\n",
+		       i, use_splice ? "splice" : "read", total >> 20, secs,
+		       (total >> 20) / secs,
+		       total ? sys * (1 << 30) / total : 0.0);
+	}
+	return 0;
+}
@@ -0,0 +1,103 @@
+/*
+ * Random access throughput of a shared memory mapping, to compare tmpfs
+ * mounted with huge=never and with huge=within_size or huge=always, or
+ * SysV shared memory with the shmem_enabled sysfs knob set either way.
+ *
+ * Usage: shmem_huge_bench <file on tmpfs | shm> [megabytes] [seconds]
+ *
+ * The region is sized, mapped shared and written once to populate it,
+ * then 8-byte words are read and updated at random for the given time.
+ * ShmemPmdMapped in /proc/meminfo shows whether huge pmds were used.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/time.h>
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+	size_t len = 1024UL << 20;
+	double secs = 10, start, elapsed;
+	unsigned long long seed = 1, accesses = 0;
+	unsigned long *words, nr_words, i;
+	int shmid = -1, fd;
+
+	if (argc < 2) {
+		fprintf(stderr,
+			"usage: %s <file on tmpfs | shm> [megabytes] [seconds]\n",
+			argv[0]);
+		exit(1);
+	}
+	if (argc > 2)
+		len = strtoul(argv[2], NULL, 0) << 20;
+	if (argc > 3)
+		secs = atof(argv[3]);
+
+	if (!strcmp(argv[1], "shm")) {
+		shmid = shmget(IPC_PRIVATE, len, IPC_CREAT | 0600);
+		if (shmid < 0) {
+			perror("shmget");
+			exit(1);
+		}
+		words = shmat(shmid, NULL, 0);
+		shmctl(shmid, IPC_RMID, NULL);
+		if (words == (void *)-1) {
+			perror("shmat");
+			exit(1);
+		}
+	} else {
+		fd = open(argv[1], O_RDWR | O_CREAT | O_TRUNC, 0600);
+		if (fd < 0 || ftruncate(fd, len)) {
+			perror(argv[1]);
+			exit(1);
+		}
+		words = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED,
+			     fd, 0);
+		if (words == MAP_FAILED) {
+			perror("mmap");
+			exit(1);
+		}
+		close(fd);
+		unlink(argv[1]);
+	}
+
+	nr_words = len / sizeof(*words);
+	start = now();
+	for (i = 0; i < nr_words; i += 512)
+		words[i] = i;
+	printf("populate: %.3f s\n", now() - start);
+
+	start = now();
+	do {
+		/* a batch between clock reads, plain LCG for the offsets */
+		for (i = 0; i < 1000000; i++) {
+			seed = seed * 6364136223846793005ULL +
+				1442695040888963407ULL;
+			words[(seed >> 16) % nr_words]++;
+		}
+		accesses += i;
+		elapsed = now() - start;
+	} while (elapsed < secs);
+
+	printf("random access: %.1f M/s over %lu MB\n",
+	       accesses / elapsed / 1e6, (unsigned long)(len >> 20));
+
+	if (shmid >= 0)
+		shmdt(words);
+	else
+		munmap(words, len);
+	return 0;
+}
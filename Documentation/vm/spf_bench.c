@@ -0,0 +1,131 @@
+/*
+ * Page fault scalability of a threaded process while another thread keeps
+ * changing its address space, to show what CONFIG_SPECULATIVE_PAGE_FAULT
+ * buys over faults that all queue behind mmap_sem.
+ *
+ * Usage: spf_bench [threads] [seconds] [megabytes per thread]
+ *
+ * Each faulting thread owns a private anonymous region which it touches
+ * page by page and then zaps with MADV_DONTNEED, over and over.  One more
+ * thread mmap()s, mprotect()s and munmap()s a small unrelated region in
+ * a loop, taking mmap_sem for writing each time.  The run is repeated with
+ * 1, 2, 4, ... threads up to the given count, each time once without and
+ * once with the mmap thread.  Compare spf_fault and spf_fault_abort in
+ * /proc/vmstat before and after to see how many faults went speculative.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+static volatile int stop;
+static size_t region_len = 16UL << 20;
+static long pagesize;
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void *fault_thread(void *arg)
+{
+	unsigned long long *faults = arg;
+	char *addr;
+	size_t i;
+
+	addr = mmap(NULL, region_len, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (addr == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+	while (!stop) {
+		for (i = 0; i < region_len; i += pagesize)
+			addr[i] = 1;
+		*faults += region_len / pagesize;
+		madvise(addr, region_len, MADV_DONTNEED);
+	}
+	munmap(addr, region_len);
+	return NULL;
+}
+
+static void *mmap_thread(void *arg)
+{
+	unsigned long long *ops = arg;
+	size_t len = 16 * pagesize;
+	char *addr;
+
+	while (!stop) {
+		addr = mmap(NULL, len, PROT_READ | PROT_WRITE,
+			    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (addr == MAP_FAILED) {
+			perror("mmap");
+			exit(1);
+		}
+		mprotect(addr, len / 2, PROT_READ);
+		munmap(addr, len);
+		(*ops)++;
+	}
+	return NULL;
+}
+
+static void run(int nr_threads, int with_mmap, double secs)
+{
+	pthread_t threads[nr_threads], mapper;
+	unsigned long long faults[nr_threads], total = 0, ops = 0;
+	double start, elapsed;
+	int i;
+
+	stop = 0;
+	for (i = 0; i < nr_threads; i++) {
+		faults[i] = 0;
+		pthread_create(&threads[i], NULL, fault_thread, &faults[i]);
+	}
+	if (with_mmap)
+		pthread_create(&mapper, NULL, mmap_thread, &ops);
+	start = now();
+	usleep(secs * 1e6);
+	stop = 1;
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(threads[i], NULL);
+		total += faults[i];
+	}
+	if (with_mmap)
+		pthread_join(mapper, NULL);
+	elapsed = now() - start;
+
+	printf("%3d threads %-10s %8.2f M faults/s %8.2f M/s per thread",
+	       nr_threads, with_mmap ? "+mmap" : "", total / elapsed / 1e6,
+	       total / elapsed / 1e6 / nr_threads);
+	if (with_mmap)
+		printf(" %8.0f mmap/s", ops / elapsed);
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	int max_threads = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+	double secs = 5;
+	int n;
+
+	pagesize = sysconf(_SC_PAGESIZE);
+	if (argc > 1)
+		max_threads = atoi(argv[1]);
+	if (argc > 2)
+		secs = atof(argv[2]);
+	if (argc > 3)
+		region_len = strtoul(argv[3], NULL, 0) << 20;
+	if (max_threads < 1)
+		max_threads = 1;
+
+	for (n = 1; n <= max_threads; n *= 2) {
+		run(n, 0, secs);
+		run(n, 1, secs);
+	}
+	return 0;
+}
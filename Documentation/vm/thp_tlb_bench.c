@@ -0,0 +1,113 @@
+/*
+ * TLB bound random access to private anonymous memory, once with the
+ * region marked MADV_NOHUGEPAGE and once with MADV_HUGEPAGE, to show what
+ * transparent huge pages buy when the working set is far larger than the
+ * TLB reach of 4K pages.
+ *
+ * Usage: thp_tlb_bench [megabytes] [seconds]
+ *
+ * Set /sys/kernel/mm/transparent_hugepage/enabled to madvise or always.
+ * Each region is aligned to 2MB, populated, and then 8-byte words are
+ * read and updated at random for the given time.  The AnonHugePages
+ * line of /proc/self/smaps is reported for each run.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+#ifndef MADV_HUGEPAGE
+#define MADV_HUGEPAGE	14
+#define MADV_NOHUGEPAGE	15
+#endif
+
+#define HPAGE_SIZE	(2UL << 20)
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static unsigned long anon_huge_kb(void)
+{
+	unsigned long kb, total = 0;
+	char line[256];
+	FILE *f = fopen("/proc/self/smaps", "r");
+
+	if (!f)
+		return 0;
+	while (fgets(line, sizeof(line), f))
+		if (sscanf(line, "AnonHugePages: %lu kB", &kb) == 1)
+			total += kb;
+	fclose(f);
+	return total;
+}
+
+static void run(const char *name, int advice, size_t len, double secs)
+{
+	unsigned long long seed = 1, accesses = 0;
+	unsigned long *words, nr_words, i;
+	double start, elapsed;
+	char *raw, *addr;
+
+	/* over-allocate so that a 2MB aligned range fits */
+	raw = mmap(NULL, len + HPAGE_SIZE, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (raw == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+	addr = (char *)(((unsigned long)raw + HPAGE_SIZE - 1) &
+			~(HPAGE_SIZE - 1));
+	if (madvise(addr, len, advice))
+		perror("madvise");
+
+	words = (unsigned long *)addr;
+	nr_words = len / sizeof(*words);
+	start = now();
+	for (i = 0; i < nr_words; i += 512)
+		words[i] = i;
+	printf("%-8s populate: %.3f s, AnonHugePages %lu kB\n", name,
+	       now() - start, anon_huge_kb());
+
+	start = now();
+	do {
+		/* a batch between clock reads, plain LCG for the offsets */
+		for (i = 0; i < 1000000; i++) {
+			seed = seed * 6364136223846793005ULL +
+				1442695040888963407ULL;
+			words[(seed >> 16) % nr_words]++;
+		}
+		accesses += i;
+		elapsed = now() - start;
+	} while (elapsed < secs);
+
+	printf("%-8s random access: %.1f M/s over %lu MB\n", name,
+	       accesses / elapsed / 1e6, (unsigned long)(len >> 20));
+	munmap(raw, len + HPAGE_SIZE);
+}
+
+int main(int argc, char **argv)
+{
+	size_t len = 1024UL << 20;
+	double secs = 10;
+
+	if (argc > 1)
+		len = strtoul(argv[1], NULL, 0) << 20;
+	if (argc > 2)
+		secs = atof(argv[2]);
+	len &= ~(HPAGE_SIZE - 1);
+	if (!len) {
+		fprintf(stderr, "usage: %s [megabytes] [seconds]\n", argv[0]);
+		exit(1);
+	}
+
+	run("nohuge", MADV_NOHUGEPAGE, len, secs);
+	run("huge", MADV_HUGEPAGE, len, secs);
+	return 0;
+}
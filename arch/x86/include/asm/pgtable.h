@@ -391,6 +391,116 @@ static inline int pmd_bad(pmd_t pmd)
 	return (pmd_flags(pmd) & ~_PAGE_USER) != _KERNPG_TABLE;
 }
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+/*
+ * A transparent huge pmd maps HPAGE_PMD_NR naturally aligned order-0
+ * pages with a single PSE entry.  Such entries only ever live in
+ * anonymous vmas, where a set PSE bit is enough to tell them apart from
+ * a page table pointer, even while the entry is made not-present for a
+ * split.
+ */
+static inline int pmd_trans_huge(pmd_t pmd)
+{
+	return pmd_flags(pmd) & _PAGE_PSE;
+}
+
+static inline int pmd_write(pmd_t pmd)
+{
+	return pmd_flags(pmd) & _PAGE_RW;
+}
+
+static inline int pmd_young(pmd_t pmd)
+{
+	return pmd_flags(pmd) & _PAGE_ACCESSED;
+}
+
+static inline int pmd_dirty(pmd_t pmd)
+{
+	return pmd_flags(pmd) & _PAGE_DIRTY;
+}
+
+static inline pmd_t pmd_set_flags(pmd_t pmd, pmdval_t set)
+{
+	return native_make_pmd(native_pmd_val(pmd) | set);
+}
+
+static inline pmd_t pmd_clear_flags(pmd_t pmd, pmdval_t clear)
+{
+	return native_make_pmd(native_pmd_val(pmd) & ~clear);
+}
+
+static inline pmd_t pmd_mkhuge(pmd_t pmd)
+{
+	return pmd_set_flags(pmd, _PAGE_PSE);
+}
+
+static inline pmd_t pmd_mkwrite(pmd_t pmd)
+{
+	return pmd_set_flags(pmd, _PAGE_RW);
+}
+
+static inline pmd_t pmd_wrprotect(pmd_t pmd)
+{
+	return pmd_clear_flags(pmd, _PAGE_RW);
+}
+
+static inline pmd_t pmd_mkdirty(pmd_t pmd)
+{
+	return pmd_set_flags(pmd, _PAGE_DIRTY);
+}
+
+static inline pmd_t pmd_mkyoung(pmd_t pmd)
+{
+	return pmd_set_flags(pmd, _PAGE_ACCESSED);
+}
+
+static inline pmd_t pmd_mknotpresent(pmd_t pmd)
+{
+	return pmd_clear_flags(pmd, _PAGE_PRESENT | _PAGE_PROTNONE);
+}
+
+/* pmd_page() does not mask the NX bit, huge user pmds may carry it */
+#define pmd_trans_huge_page(pmd)	pfn_to_page(pmd_pfn(pmd))
+
+/*
+ * The pte that maps subpage @index of the huge pmd @pmd with the same
+ * protection, dirty and accessed state.
+ */
+static inline pte_t pmd_subpage_pte(pmd_t pmd, unsigned int index)
+{
+	pteval_t val = native_pmd_val(pmd) & ~_PAGE_PSE;
+
+	return native_make_pte(val + ((pteval_t)index << PAGE_SHIFT));
+}
+
+static inline pmd_t pmdp_get_and_clear(struct mm_struct *mm,
+				       unsigned long addr, pmd_t *pmdp)
+{
+	return native_make_pmd(xchg(&pmdp->pmd, 0));
+}
+
+/*
+ * Make a huge pmd not-present and return its last value, including any
+ * dirty or accessed bit the hardware set up to the exchange.
+ */
+static inline pmd_t pmdp_invalidate(struct mm_struct *mm,
+				    unsigned long addr, pmd_t *pmdp)
+{
+	pmd_t pmd = pmd_mknotpresent(*pmdp);
+
+	return native_make_pmd(xchg(&pmdp->pmd, pmd_val(pmd)));
+}
+
+static inline int pmdp_test_and_clear_young(struct vm_area_struct *vma,
+					    unsigned long addr, pmd_t *pmdp)
+{
+	if (!pmd_young(*pmdp))
+		return 0;
+	return test_and_clear_bit(_PAGE_BIT_ACCESSED,
+				  (unsigned long *)&pmdp->pmd);
+}
+#endif /* CONFIG_TRANSPARENT_HUGEPAGE */
+
 static inline unsigned long pages_to_mb(unsigned long npg)
 {
 	return npg >> (20 - PAGE_SHIFT);
@@ -669,6 +669,18 @@ __SYSCALL(__NR_fanotify_init, sys_fanotify_init)
 __SYSCALL(__NR_fanotify_mark, sys_fanotify_mark)
 #define __NR_prlimit64				302
 __SYSCALL(__NR_prlimit64, sys_prlimit64)
+/* 303 - 309 are reserved for the upstream numbering */
+__SYSCALL(303, sys_ni_syscall)
+__SYSCALL(304, sys_ni_syscall)
+__SYSCALL(305, sys_ni_syscall)
+__SYSCALL(306, sys_ni_syscall)
+__SYSCALL(307, sys_ni_syscall)
+__SYSCALL(308, sys_ni_syscall)
+__SYSCALL(309, sys_ni_syscall)
+#define __NR_process_vm_readv			310
+__SYSCALL(__NR_process_vm_readv, sys_process_vm_readv)
+#define __NR_process_vm_writev			311
+__SYSCALL(__NR_process_vm_writev, sys_process_vm_writev)
 
 #ifndef __NO_STUBS
 #define __ARCH_WANT_OLD_READDIR
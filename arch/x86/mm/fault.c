@@ -940,6 +940,21 @@ static int fault_in_kernel_space(unsigned long address)
 	return address >= TASK_SIZE_MAX;
 }
 
+static inline void
+account_fault(struct pt_regs *regs, unsigned long address,
+	      struct task_struct *tsk, int fault)
+{
+	if (fault & VM_FAULT_MAJOR) {
+		tsk->maj_flt++;
+		perf_sw_event(PERF_COUNT_SW_PAGE_FAULTS_MAJ, 1, 0,
+				     regs, address);
+	} else {
+		tsk->min_flt++;
+		perf_sw_event(PERF_COUNT_SW_PAGE_FAULTS_MIN, 1, 0,
+				     regs, address);
+	}
+}
+
 /*
  * This routine handles page faults.  It determines the address,
  * and the problem, and then passes it off to one of the appropriate
@@ -1042,6 +1057,21 @@ do_page_fault(struct pt_regs *regs, unsigned long error_code)
 		return;
 	}
 
+	/*
+	 * Try to resolve not-present user faults without mmap_sem first.
+	 * Anything the speculative path cannot handle, including every
+	 * error, is retried below the usual way.
+	 */
+	if ((error_code & (PF_USER | PF_PROT)) == PF_USER) {
+		fault = handle_speculative_fault(mm, address,
+				(error_code & PF_WRITE) ? FAULT_FLAG_WRITE : 0);
+		if (!(fault & VM_FAULT_RETRY)) {
+			account_fault(regs, address, tsk, fault);
+			check_v8086_mode(regs, address, tsk);
+			return;
+		}
+	}
+
 	/*
 	 * When running in the kernel we expect faults to occur only to
 	 * addresses in user space.  All other faults represent errors in
@@ -1126,16 +1156,7 @@ good_area:
 		return;
 	}
 
-	if (fault & VM_FAULT_MAJOR) {
-		tsk->maj_flt++;
-		perf_sw_event(PERF_COUNT_SW_PAGE_FAULTS_MAJ, 1, 0,
-				     regs, address);
-	} else {
-		tsk->min_flt++;
-		perf_sw_event(PERF_COUNT_SW_PAGE_FAULTS_MIN, 1, 0,
-				     regs, address);
-	}
-
+	account_fault(regs, address, tsk, fault);
 	check_v8086_mode(regs, address, tsk);
 
 	up_read(&mm->mmap_sem);
@@ -108,7 +108,8 @@ EXPORT_SYMBOL_GPL(leave_mm);
 /*
  * TLB flush IPI:
  *
- * 1) Flush the tlb entries if the cpu uses the mm that's being flushed.
+ * 1) Flush the tlb entries if the cpu uses the mm that's being flushed,
+ *    or whatever mm it uses if no mm was given (batched reclaim flush).
  * 2) Leave the mm if we are in the lazy tlb mode.
  *
  * Interrupts are disabled.
@@ -149,7 +150,8 @@ void smp_invalidate_interrupt(struct pt_regs *regs)
 		 * BUG();
 		 */
 
-	if (f->flush_mm == percpu_read(cpu_tlbstate.active_mm)) {
+	if (!f->flush_mm ||
+	    f->flush_mm == percpu_read(cpu_tlbstate.active_mm)) {
 		if (percpu_read(cpu_tlbstate.state) == TLBSTATE_OK) {
 			if (f->flush_va == TLB_FLUSH_ALL)
 				local_flush_tlb();
@@ -164,6 +166,7 @@ out:
 	cpumask_clear_cpu(cpu, to_cpumask(f->flush_cpumask));
 	smp_mb__after_clear_bit();
 	inc_irq_stat(irq_tlb_count);
+	count_vm_tlb_event(NR_TLB_REMOTE_FLUSH_RECEIVED);
 }
 
 static void flush_tlb_others_ipi(const struct cpumask *cpumask,
@@ -202,9 +205,14 @@ static void flush_tlb_others_ipi(const struct cpumask *cpumask,
 	raw_spin_unlock(&f->tlbstate_lock);
 }
 
+/*
+ * @mm may be NULL, with @va == TLB_FLUSH_ALL, to flush all user
+ * translations whatever mm the target cpus are running.
+ */
 void native_flush_tlb_others(const struct cpumask *cpumask,
 			     struct mm_struct *mm, unsigned long va)
 {
+	count_vm_tlb_event(NR_TLB_REMOTE_FLUSH);
 	if (is_uv_system()) {
 		unsigned int cpu;
 
@@ -235,6 +243,7 @@ void flush_tlb_current_task(void)
 
 	preempt_disable();
 
+	count_vm_tlb_event(NR_TLB_LOCAL_FLUSH_ALL);
 	local_flush_tlb();
 	if (cpumask_any_but(mm_cpumask(mm), smp_processor_id()) < nr_cpu_ids)
 		flush_tlb_others(mm_cpumask(mm), mm, TLB_FLUSH_ALL);
@@ -246,9 +255,10 @@ void flush_tlb_mm(struct mm_struct *mm)
 	preempt_disable();
 
 	if (current->active_mm == mm) {
-		if (current->mm)
+		if (current->mm) {
+			count_vm_tlb_event(NR_TLB_LOCAL_FLUSH_ALL);
 			local_flush_tlb();
-		else
+		} else
 			leave_mm(smp_processor_id());
 	}
 	if (cpumask_any_but(mm_cpumask(mm), smp_processor_id()) < nr_cpu_ids)
@@ -264,9 +274,10 @@ void flush_tlb_page(struct vm_area_struct *vma, unsigned long va)
 	preempt_disable();
 
 	if (current->active_mm == mm) {
-		if (current->mm)
+		if (current->mm) {
+			count_vm_tlb_event(NR_TLB_LOCAL_FLUSH_ONE);
 			__flush_tlb_one(va);
-		else
+		} else
 			leave_mm(smp_processor_id());
 	}
 
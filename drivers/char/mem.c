@@ -26,6 +26,7 @@
 #include <linux/bootmem.h>
 #include <linux/splice.h>
 #include <linux/pfn.h>
+#include <linux/shmem_fs.h>
 
 #include <asm/uaccess.h>
 #include <asm/io.h>
@@ -687,6 +688,23 @@ static int mmap_zero(struct file *file, struct vm_area_struct *vma)
 	return 0;
 }
 
+#if defined(CONFIG_SHMEM) && defined(CONFIG_TRANSPARENT_HUGEPAGE)
+static unsigned long get_unmapped_area_zero(struct file *file,
+				unsigned long addr, unsigned long len,
+				unsigned long pgoff, unsigned long flags)
+{
+	/*
+	 * mmap_zero() replaces the file of a shared mapping with a shmem
+	 * one: align it for huge pmds the way shmem would.
+	 */
+	if (flags & MAP_SHARED)
+		return shmem_get_unmapped_area(NULL, addr, len, pgoff, flags);
+	return current->mm->get_unmapped_area(file, addr, len, pgoff, flags);
+}
+#else
+#define get_unmapped_area_zero	NULL
+#endif
+
 static ssize_t write_full(struct file *file, const char __user *buf,
 			  size_t count, loff_t *ppos)
 {
@@ -798,6 +816,7 @@ static const struct file_operations zero_fops = {
 	.read		= read_zero,
 	.write		= write_zero,
 	.mmap		= mmap_zero,
+	.get_unmapped_area = get_unmapped_area_zero,
 };
 
 /*
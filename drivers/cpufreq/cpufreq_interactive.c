@@ -25,12 +25,23 @@
 #include <linux/timer.h>
 #include <linux/workqueue.h>
 #include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 
 #include <asm/cputime.h>
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/cpufreq_interactive.h>
+
 static void (*pm_idle_old)(void);
 static atomic_t active_count = ATOMIC_INIT(0);
 
+/*
+ * Number of timer windows remembered per CPU for the predictive mode.
+ * Must be a power of two.
+ */
+#define LOAD_HISTORY_LEN 4
+
 struct cpufreq_interactive_cpuinfo {
 	struct timer_list cpu_timer;
 	int timer_idlecancel;
@@ -44,6 +55,12 @@ struct cpufreq_interactive_cpuinfo {
 	struct cpufreq_frequency_table *freq_table;
 	unsigned int target_freq;
 	int governor_enabled;
+	/* Load of the last windows, in percent of policy->max */
+	unsigned int load_history[LOAD_HISTORY_LEN];
+	unsigned int load_history_head;
+	/* Time of the oldest pending speed change request, 0 if none */
+	u64 request_time;
+	unsigned long evaluations;
 };
 
 static DEFINE_PER_CPU(struct cpufreq_interactive_cpuinfo, cpuinfo);
@@ -57,6 +74,14 @@ static spinlock_t up_cpumask_lock;
 static cpumask_t down_cpumask;
 static spinlock_t down_cpumask_lock;
 
+/* Statistics, reset when the governor is first started */
+static spinlock_t stats_lock;
+static u64 stats_start_time;
+static unsigned long total_transitions;
+static unsigned long redundant_requests;
+static u64 total_transition_latency;
+static unsigned int max_transition_latency;
+
 /* Go to max speed when CPU load at or above this value. */
 #define DEFAULT_GO_MAXSPEED_LOAD 85
 static unsigned long go_maxspeed_load;
@@ -67,6 +92,12 @@ static unsigned long go_maxspeed_load;
 #define DEFAULT_MIN_SAMPLE_TIME 80000;
 static unsigned long min_sample_time;
 
+/*
+ * When set, pick the speed from the load predicted out of the recent
+ * load history instead of the greater of short-term and long-term load.
+ */
+static unsigned long predictive;
+
 #define DEBUG 0
 #define BUFSZ 128
 
@@ -167,20 +198,172 @@ struct cpufreq_governor cpufreq_gov_interactive = {
 	.owner = THIS_MODULE,
 };
 
+static void cpufreq_interactive_record_load(
+	struct cpufreq_interactive_cpuinfo *pcpu, unsigned int load)
+{
+	pcpu->load_history[pcpu->load_history_head++ &
+			   (LOAD_HISTORY_LEN - 1)] = load;
+}
+
+/*
+ * Predict the load of the next window: a weighted average of the
+ * remembered windows with the newest one weighing most, extrapolated by
+ * the average trend between the oldest and the newest window.
+ */
+static unsigned int cpufreq_interactive_predict_load(
+	struct cpufreq_interactive_cpuinfo *pcpu)
+{
+	unsigned int n = min_t(unsigned int, pcpu->load_history_head,
+			       LOAD_HISTORY_LEN);
+	unsigned int head = pcpu->load_history_head;
+	unsigned int i, weight, sum = 0, weights = 0;
+	int newest, oldest, predicted;
+
+	if (!n)
+		return 0;
+
+	for (i = 0; i < n; i++) {
+		weight = n - i;
+		sum += weight * pcpu->load_history[(head - 1 - i) &
+						   (LOAD_HISTORY_LEN - 1)];
+		weights += weight;
+	}
+
+	predicted = sum / weights;
+
+	if (n > 1) {
+		newest = pcpu->load_history[(head - 1) & (LOAD_HISTORY_LEN - 1)];
+		oldest = pcpu->load_history[(head - n) & (LOAD_HISTORY_LEN - 1)];
+		predicted += (newest - oldest) / (int) (n - 1);
+	}
+
+	return clamp(predicted, 0, 100);
+}
+
+/*
+ * All CPUs of a policy share its clock, so the policy runs at the
+ * highest speed requested by any of them.
+ */
+static unsigned int cpufreq_interactive_policy_target(
+	struct cpufreq_policy *policy)
+{
+	unsigned int j;
+	unsigned int max_freq = 0;
+
+	for_each_cpu(j, policy->cpus) {
+		struct cpufreq_interactive_cpuinfo *pjcpu =
+			&per_cpu(cpuinfo, j);
+
+		if (pjcpu->governor_enabled && pjcpu->target_freq > max_freq)
+			max_freq = pjcpu->target_freq;
+	}
+
+	return max_freq;
+}
+
+/*
+ * Drop the pending requests of all CPUs of @policy.  If the speed could
+ * not be changed, also forget their targets: the next sample then sees a
+ * change again and queues a new request, so the switch is retried.
+ */
+static void cpufreq_interactive_drop_requests(struct cpufreq_policy *policy,
+					      bool failed)
+{
+	unsigned int j;
+
+	for_each_cpu(j, policy->cpus) {
+		struct cpufreq_interactive_cpuinfo *pjcpu =
+			&per_cpu(cpuinfo, j);
+
+		if (!pjcpu->governor_enabled)
+			continue;
+
+		pjcpu->request_time = 0;
+		if (failed)
+			pjcpu->target_freq = policy->cur;
+	}
+}
+
+/*
+ * Evaluate the policy of @pcpu once for all of its CPUs and switch it to
+ * the policy-wide target speed, unless it already runs at that speed.
+ */
+static void cpufreq_interactive_set_policy_freq(
+	struct cpufreq_interactive_cpuinfo *pcpu)
+{
+	struct cpufreq_policy *policy = pcpu->policy;
+	unsigned int target_freq = cpufreq_interactive_policy_target(policy);
+	u64 request_time = 0;
+	unsigned int latency;
+	unsigned long flags;
+	unsigned int j;
+
+	/*
+	 * Another evaluation got here first.  Redundant requests are
+	 * counted where they are detected, in the timer, so this one is
+	 * only dropped.
+	 */
+	if (!target_freq || target_freq == policy->cur) {
+		cpufreq_interactive_drop_requests(policy, false);
+		dbgpr("policy %d: already at tgt=%d\n", policy->cpu,
+		      target_freq);
+		return;
+	}
+
+	if (__cpufreq_driver_target(policy, target_freq, CPUFREQ_RELATION_H)) {
+		cpufreq_interactive_drop_requests(policy, true);
+		dbgpr("policy %d: set tgt=%d failed\n", policy->cpu,
+		      target_freq);
+		return;
+	}
+
+	for_each_cpu(j, policy->cpus) {
+		struct cpufreq_interactive_cpuinfo *pjcpu =
+			&per_cpu(cpuinfo, j);
+
+		if (!pjcpu->governor_enabled)
+			continue;
+
+		if (pjcpu->request_time &&
+		    (!request_time || pjcpu->request_time < request_time))
+			request_time = pjcpu->request_time;
+		pjcpu->request_time = 0;
+		pjcpu->freq_change_time_in_idle =
+			get_cpu_idle_time_us(j, &pjcpu->freq_change_time);
+	}
+
+	latency = request_time ?
+		(unsigned int) (ktime_to_us(ktime_get()) - request_time) : 0;
+
+	spin_lock_irqsave(&stats_lock, flags);
+	total_transitions++;
+	total_transition_latency += latency;
+	if (latency > max_transition_latency)
+		max_transition_latency = latency;
+	spin_unlock_irqrestore(&stats_lock, flags);
+
+	dbgpr("policy %d: set tgt=%d (actual=%d) lat=%uus\n", policy->cpu,
+	      target_freq, policy->cur, latency);
+}
+
 static void cpufreq_interactive_timer(unsigned long data)
 {
 	unsigned int delta_idle;
 	unsigned int delta_time;
 	int cpu_load;
+	int window_load;
 	int load_since_change;
+	unsigned int relation = CPUFREQ_RELATION_H;
 	u64 time_in_idle;
 	u64 idle_exit_time;
 	struct cpufreq_interactive_cpuinfo *pcpu =
 		&per_cpu(cpuinfo, data);
 	u64 now_idle;
 	unsigned int new_freq;
+	unsigned int policy_freq;
 	unsigned int index;
 	unsigned long flags;
+	int queued;
 
 	smp_rmb();
 
@@ -226,6 +409,8 @@ static void cpufreq_interactive_timer(unsigned long data)
 		goto rearm;
 	}
 
+	pcpu->evaluations++;
+
 	if (delta_idle > delta_time)
 		cpu_load = 0;
 	else
@@ -242,13 +427,28 @@ static void cpufreq_interactive_timer(unsigned long data)
 		load_since_change =
 			100 * (delta_time - delta_idle) / delta_time;
 
-	/*
-	 * Choose greater of short-term load (since last idle timer
-	 * started or timer function re-armed itself) or long-term load
-	 * (since last frequency change).
-	 */
-	if (load_since_change > cpu_load)
+	window_load = cpu_load;
+	cpufreq_interactive_record_load(pcpu,
+		cpu_load * pcpu->policy->cur / pcpu->policy->max);
+
+	if (predictive) {
+		/*
+		 * Unless the CPU is saturated at its current speed, in
+		 * which case its real demand is unknown, go to the lowest
+		 * speed that covers the predicted load.
+		 */
+		if (cpu_load < go_maxspeed_load) {
+			cpu_load = cpufreq_interactive_predict_load(pcpu);
+			relation = CPUFREQ_RELATION_L;
+		}
+	} else if (load_since_change > cpu_load) {
+		/*
+		 * Choose greater of short-term load (since last idle timer
+		 * started or timer function re-armed itself) or long-term
+		 * load (since last frequency change).
+		 */
 		cpu_load = load_since_change;
+	}
 
 	if (cpu_load >= go_maxspeed_load)
 		new_freq = pcpu->policy->max;
@@ -256,13 +456,15 @@ static void cpufreq_interactive_timer(unsigned long data)
 		new_freq = pcpu->policy->max * cpu_load / 100;
 
 	if (cpufreq_frequency_table_target(pcpu->policy, pcpu->freq_table,
-					   new_freq, CPUFREQ_RELATION_H,
+					   new_freq, relation,
 					   &index)) {
 		dbgpr("timer %d: cpufreq_frequency_table_target error\n", (int) data);
 		goto rearm;
 	}
 
 	new_freq = pcpu->freq_table[index].frequency;
+	trace_cpufreq_interactive_target(data, window_load, cpu_load,
+					 pcpu->policy->cur, new_freq);
 
 	if (pcpu->target_freq == new_freq)
 	{
@@ -282,23 +484,50 @@ static void cpufreq_interactive_timer(unsigned long data)
 		}
 	}
 
-	dbgpr("timer %d: load=%d cur=%d tgt=%d queue\n", (int) data, cpu_load, pcpu->target_freq, new_freq);
+	pcpu->target_freq = new_freq;
 
-	if (new_freq < pcpu->target_freq) {
-		pcpu->target_freq = new_freq;
+	/*
+	 * Only kick the up task or down work if the speed of the whole
+	 * policy changes: another CPU sharing the clock may already hold
+	 * it at (or above) this speed.
+	 */
+	policy_freq = cpufreq_interactive_policy_target(pcpu->policy);
+	if (policy_freq == pcpu->policy->cur) {
+		spin_lock_irqsave(&stats_lock, flags);
+		redundant_requests++;
+		spin_unlock_irqrestore(&stats_lock, flags);
+		dbgpr("timer %d: load=%d tgt=%d policy already at %d\n",
+		      (int) data, cpu_load, new_freq, policy_freq);
+		goto rearm_if_notmax;
+	}
+
+	dbgpr("timer %d: load=%d cur=%d tgt=%d queue\n", (int) data, cpu_load, pcpu->policy->cur, policy_freq);
+
+	if (!pcpu->request_time)
+		pcpu->request_time = ktime_to_us(ktime_get());
+
+	/*
+	 * One evaluation covers the whole policy: if another CPU of it is
+	 * already queued, the up task or down work will see this CPU's
+	 * new target too.
+	 */
+	if (policy_freq < pcpu->policy->cur) {
 		spin_lock_irqsave(&down_cpumask_lock, flags);
+		queued = cpumask_intersects(&down_cpumask, pcpu->policy->cpus);
 		cpumask_set_cpu(data, &down_cpumask);
 		spin_unlock_irqrestore(&down_cpumask_lock, flags);
-		queue_work(down_wq, &freq_scale_down_work);
+		if (!queued)
+			queue_work(down_wq, &freq_scale_down_work);
 	} else {
-		pcpu->target_freq = new_freq;
 #if DEBUG
 		up_request_time = ktime_to_us(ktime_get());
 #endif
 		spin_lock_irqsave(&up_cpumask_lock, flags);
+		queued = cpumask_intersects(&up_cpumask, pcpu->policy->cpus);
 		cpumask_set_cpu(data, &up_cpumask);
 		spin_unlock_irqrestore(&up_cpumask_lock, flags);
-		wake_up_process(up_task);
+		if (!queued)
+			wake_up_process(up_task);
 	}
 
 rearm_if_notmax:
@@ -484,13 +713,10 @@ static int cpufreq_interactive_up_task(void *data)
 			if (!pcpu->governor_enabled)
 				continue;
 
-			__cpufreq_driver_target(pcpu->policy,
-						pcpu->target_freq,
-						CPUFREQ_RELATION_H);
-			pcpu->freq_change_time_in_idle =
-				get_cpu_idle_time_us(cpu,
-						     &pcpu->freq_change_time);
-			dbgpr("up %d: set tgt=%d (actual=%d)\n", cpu, pcpu->target_freq, pcpu->policy->cur);
+			/* One evaluation covers all CPUs of the policy */
+			cpumask_andnot(&tmp_mask, &tmp_mask,
+				       pcpu->policy->cpus);
+			cpufreq_interactive_set_policy_freq(pcpu);
 		}
 	}
 
@@ -517,13 +743,8 @@ static void cpufreq_interactive_freq_down(struct work_struct *work)
 		if (!pcpu->governor_enabled)
 			continue;
 
-		__cpufreq_driver_target(pcpu->policy,
-					pcpu->target_freq,
-					CPUFREQ_RELATION_H);
-		pcpu->freq_change_time_in_idle =
-			get_cpu_idle_time_us(cpu,
-					     &pcpu->freq_change_time);
-		dbgpr("down %d: set tgt=%d (actual=%d)\n", cpu, pcpu->target_freq, pcpu->policy->cur);
+		cpumask_andnot(&tmp_mask, &tmp_mask, pcpu->policy->cpus);
+		cpufreq_interactive_set_policy_freq(pcpu);
 	}
 }
 
@@ -557,9 +778,110 @@ static ssize_t store_min_sample_time(struct kobject *kobj,
 static struct global_attr min_sample_time_attr = __ATTR(min_sample_time, 0644,
 		show_min_sample_time, store_min_sample_time);
 
+static ssize_t show_predictive(struct kobject *kobj,
+			       struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", predictive);
+}
+
+static ssize_t store_predictive(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	unsigned long val;
+	int ret;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	predictive = !!val;
+	return count;
+}
+
+static struct global_attr predictive_attr = __ATTR(predictive, 0644,
+		show_predictive, store_predictive);
+
+static unsigned long cpufreq_interactive_total_evaluations(void)
+{
+	unsigned long evaluations = 0;
+	unsigned int i;
+
+	for_each_possible_cpu(i)
+		evaluations += per_cpu(cpuinfo, i).evaluations;
+
+	return evaluations;
+}
+
+static ssize_t show_total_evaluations(struct kobject *kobj,
+				      struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", cpufreq_interactive_total_evaluations());
+}
+
+static struct global_attr total_evaluations_attr = __ATTR(total_evaluations, 0444,
+		show_total_evaluations, NULL);
+
+static ssize_t show_evaluation_rate(struct kobject *kobj,
+				    struct attribute *attr, char *buf)
+{
+	u64 elapsed = ktime_to_us(ktime_get()) - stats_start_time;
+	u64 evaluations = cpufreq_interactive_total_evaluations();
+
+	if (!elapsed)
+		return sprintf(buf, "0\n");
+
+	return sprintf(buf, "%llu\n",
+		       div64_u64(evaluations * USEC_PER_SEC, elapsed));
+}
+
+static struct global_attr evaluation_rate_attr = __ATTR(evaluation_rate, 0444,
+		show_evaluation_rate, NULL);
+
+static ssize_t show_total_transitions(struct kobject *kobj,
+				      struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", total_transitions);
+}
+
+static struct global_attr total_transitions_attr = __ATTR(total_transitions, 0444,
+		show_total_transitions, NULL);
+
+static ssize_t show_redundant_requests(struct kobject *kobj,
+				       struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", redundant_requests);
+}
+
+static struct global_attr redundant_requests_attr = __ATTR(redundant_requests, 0444,
+		show_redundant_requests, NULL);
+
+static ssize_t show_transition_latency(struct kobject *kobj,
+				       struct attribute *attr, char *buf)
+{
+	u64 avg = 0;
+	unsigned int max;
+	unsigned long flags;
+
+	spin_lock_irqsave(&stats_lock, flags);
+	if (total_transitions)
+		avg = div64_u64(total_transition_latency, total_transitions);
+	max = max_transition_latency;
+	spin_unlock_irqrestore(&stats_lock, flags);
+
+	return sprintf(buf, "%llu %u\n", avg, max);
+}
+
+static struct global_attr transition_latency_attr = __ATTR(transition_latency, 0444,
+		show_transition_latency, NULL);
+
 static struct attribute *interactive_attributes[] = {
 	&go_maxspeed_load_attr.attr,
 	&min_sample_time_attr.attr,
+	&predictive_attr.attr,
+	&total_evaluations_attr.attr,
+	&evaluation_rate_attr.attr,
+	&total_transitions_attr.attr,
+	&redundant_requests_attr.attr,
+	&transition_latency_attr.attr,
 	NULL,
 };
 
@@ -572,21 +894,32 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *new_policy,
 		unsigned int event)
 {
 	int rc;
-	struct cpufreq_interactive_cpuinfo *pcpu =
-		&per_cpu(cpuinfo, new_policy->cpu);
+	unsigned int j;
+	unsigned long flags;
+	struct cpufreq_interactive_cpuinfo *pcpu;
 
 	switch (event) {
 	case CPUFREQ_GOV_START:
 		if (!cpu_online(new_policy->cpu))
 			return -EINVAL;
 
-		pcpu->policy = new_policy;
-		pcpu->freq_table = cpufreq_frequency_get_table(new_policy->cpu);
-		pcpu->target_freq = new_policy->cur;
-		pcpu->freq_change_time_in_idle =
-			get_cpu_idle_time_us(new_policy->cpu,
-					     &pcpu->freq_change_time);
-		pcpu->governor_enabled = 1;
+		/*
+		 * The core starts the governor once per policy: set up every
+		 * CPU sharing its clock, so that each one's load counts.
+		 */
+		for_each_cpu(j, new_policy->cpus) {
+			pcpu = &per_cpu(cpuinfo, j);
+			pcpu->policy = new_policy;
+			pcpu->freq_table = cpufreq_frequency_get_table(j);
+			pcpu->target_freq = new_policy->cur;
+			pcpu->load_history_head = 0;
+			pcpu->request_time = 0;
+			pcpu->evaluations = 0;
+			pcpu->freq_change_time_in_idle =
+				get_cpu_idle_time_us(j,
+						     &pcpu->freq_change_time);
+			pcpu->governor_enabled = 1;
+		}
 		smp_wmb();
 		/*
 		 * Do not register the idle hook and create sysfs
@@ -595,6 +928,14 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *new_policy,
 		if (atomic_inc_return(&active_count) > 1)
 			return 0;
 
+		spin_lock_irqsave(&stats_lock, flags);
+		stats_start_time = ktime_to_us(ktime_get());
+		total_transitions = 0;
+		redundant_requests = 0;
+		total_transition_latency = 0;
+		max_transition_latency = 0;
+		spin_unlock_irqrestore(&stats_lock, flags);
+
 		rc = sysfs_create_group(cpufreq_global_kobject,
 				&interactive_attr_group);
 		if (rc)
@@ -605,17 +946,23 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *new_policy,
 		break;
 
 	case CPUFREQ_GOV_STOP:
-		pcpu->governor_enabled = 0;
+		for_each_cpu(j, new_policy->cpus) {
+			pcpu = &per_cpu(cpuinfo, j);
+			pcpu->governor_enabled = 0;
+		}
 		smp_wmb();
-		del_timer_sync(&pcpu->cpu_timer);
+		for_each_cpu(j, new_policy->cpus) {
+			pcpu = &per_cpu(cpuinfo, j);
+			del_timer_sync(&pcpu->cpu_timer);
+			/*
+			 * Reset idle exit time since we may cancel the timer
+			 * before it can run after the last idle exit time,
+			 * to avoid tripping the check in idle exit for a timer
+			 * that is trying to run.
+			 */
+			pcpu->idle_exit_time = 0;
+		}
 		flush_work(&freq_scale_down_work);
-		/*
-		 * Reset idle exit time since we may cancel the timer
-		 * before it can run after the last idle exit time,
-		 * to avoid tripping the check in idle exit for a timer
-		 * that is trying to run.
-		 */
-		pcpu->idle_exit_time = 0;
 
 		if (atomic_dec_return(&active_count) > 0)
 			return 0;
@@ -675,6 +1022,7 @@ static int __init cpufreq_interactive_init(void)
 
 	spin_lock_init(&up_cpumask_lock);
 	spin_lock_init(&down_cpumask_lock);
+	spin_lock_init(&stats_lock);
 
 #if DEBUG
 	spin_lock_init(&dbgpr_lock);
@@ -27,9 +27,14 @@
 #include <asm/uaccess.h>
 #include <asm/cacheflush.h>
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/pmem.h>
+
 #define PMEM_MAX_DEVICES 10
 #define PMEM_MAX_ORDER 128
 #define PMEM_MIN_ALLOC PAGE_SIZE
+/* number of free lists, num_entries is an unsigned long */
+#define PMEM_NUM_ORDERS BITS_PER_LONG
 
 #define PMEM_DEBUG 1
 
@@ -116,6 +121,17 @@ struct pmem_info {
 	/* the bitmap for the region indicating which entries are allocated
 	 * and which are free */
 	struct pmem_bits *bitmap;
+	/* the free blocks of each order, linked through free_nodes: the
+	 * node of an index is on a list iff the index is the first entry
+	 * of a free block */
+	struct list_head free_list[PMEM_NUM_ORDERS];
+	struct list_head *free_nodes;
+	unsigned long free_count[PMEM_NUM_ORDERS];
+	/* allocator statistics, protected by bitmap_sem */
+	unsigned long allocs;
+	unsigned long alloc_failures;
+	unsigned long splits;
+	unsigned long merges;
 	/* indicates the region should not be managed with an allocator */
 	unsigned no_allocator;
 	/* indicates maps of this region should be cached, if a mix of
@@ -166,6 +182,8 @@ static int id_count;
 	PMEM_LEN(id, index))
 #define PMEM_REVOKED(data) (data->flags & PMEM_FLAGS_REVOKED)
 #define PMEM_IS_PAGE_ALIGNED(addr) (!((addr) & (~PAGE_MASK)))
+#define PMEM_IS_FREE_BLOCK(id, index) \
+	(!list_empty(&pmem[id].free_nodes[index]))
 #define PMEM_IS_SUBMAP(data) ((data->flags & PMEM_FLAGS_SUBMAP) && \
 	(!(data->flags & PMEM_FLAGS_UNSUBMAP)))
 
@@ -232,6 +250,22 @@ static int is_master_owner(struct file *file)
 	return ret;
 }
 
+static void pmem_add_free_block(int id, int index)
+{
+	/* caller should hold the write lock on pmem_sem! */
+	int order = PMEM_ORDER(id, index);
+
+	list_add(&pmem[id].free_nodes[index], &pmem[id].free_list[order]);
+	pmem[id].free_count[order]++;
+}
+
+static void pmem_del_free_block(int id, int index)
+{
+	/* caller should hold the write lock on pmem_sem! */
+	list_del_init(&pmem[id].free_nodes[index]);
+	pmem[id].free_count[PMEM_ORDER(id, index)]--;
+}
+
 static int pmem_free(int id, int index)
 {
 	/* caller should hold the write lock on pmem_sem! */
@@ -245,20 +279,23 @@ static int pmem_free(int id, int index)
 	/* clean up the bitmap, merging any buddies */
 	pmem[id].bitmap[curr].allocated = 0;
 	/* find a slots buddy Buddy# = Slot# ^ (1 << order)
-	 * if the buddy is also free merge them
-	 * repeat until the buddy is not free or end of the bitmap is reached
+	 * if the buddy is the start of a free block of the same order merge
+	 * them, repeat until the buddy is not free or lies past the end of
+	 * the bitmap
 	 */
-	do {
+	for (;;) {
 		buddy = PMEM_BUDDY_INDEX(id, curr);
-		if (PMEM_IS_FREE(id, buddy) &&
-				PMEM_ORDER(id, buddy) == PMEM_ORDER(id, curr)) {
-			PMEM_ORDER(id, buddy)++;
-			PMEM_ORDER(id, curr)++;
-			curr = min(buddy, curr);
-		} else {
+		if (buddy >= pmem[id].num_entries ||
+		    !PMEM_IS_FREE_BLOCK(id, buddy) ||
+		    PMEM_ORDER(id, buddy) != PMEM_ORDER(id, curr))
 			break;
-		}
-	} while (curr < pmem[id].num_entries);
+		pmem_del_free_block(id, buddy);
+		PMEM_ORDER(id, buddy)++;
+		PMEM_ORDER(id, curr)++;
+		curr = min(buddy, curr);
+		pmem[id].merges++;
+	}
+	pmem_add_free_block(id, curr);
 
 	return 0;
 }
@@ -376,12 +413,31 @@ static unsigned long pmem_order(unsigned long len)
 	return i;
 }
 
+static int pmem_largest_free_order(int id)
+{
+	int i;
+
+	for (i = PMEM_NUM_ORDERS - 1; i >= 0; i--)
+		if (pmem[id].free_count[i])
+			return i;
+	return -1;
+}
+
+static unsigned long pmem_free_entries(int id)
+{
+	unsigned long entries = 0;
+	int i;
+
+	for (i = 0; i < PMEM_NUM_ORDERS; i++)
+		entries += pmem[id].free_count[i] << i;
+	return entries;
+}
+
 static int pmem_allocate(int id, unsigned long len)
 {
 	/* caller should hold the write lock on pmem_sem! */
 	/* return the corresponding pdata[] entry */
-	int curr = 0;
-	int end = pmem[id].num_entries;
+	int curr;
 	int best_fit = -1;
 	unsigned long order = pmem_order(len);
 
@@ -397,32 +453,29 @@ static int pmem_allocate(int id, unsigned long len)
 		return -1;
 	DLOG("order %lx\n", order);
 
-	/* look through the bitmap:
-	 * 	if you find a free slot of the correct order use it
-	 * 	otherwise, use the best fit (smallest with size > order) slot
+	/* use a free slot of the correct order if there is one, otherwise
+	 * the best fit: a slot of the smallest order > order
 	 */
-	while (curr < end) {
-		if (PMEM_IS_FREE(id, curr)) {
-			if (PMEM_ORDER(id, curr) == (unsigned char)order) {
-				/* set the not free bit and clear others */
-				best_fit = curr;
-				break;
-			}
-			if (PMEM_ORDER(id, curr) > (unsigned char)order &&
-			    (best_fit < 0 ||
-			     PMEM_ORDER(id, curr) < PMEM_ORDER(id, best_fit)))
-				best_fit = curr;
+	for (curr = order; curr < PMEM_NUM_ORDERS; curr++) {
+		if (!list_empty(&pmem[id].free_list[curr])) {
+			best_fit = pmem[id].free_list[curr].next -
+				   pmem[id].free_nodes;
+			break;
 		}
-		curr = PMEM_NEXT_INDEX(id, curr);
 	}
 
 	/* if best_fit < 0, there are no suitable slots,
 	 * return an error
 	 */
 	if (best_fit < 0) {
+		pmem[id].alloc_failures++;
+		trace_pmem_alloc_failure(pmem[id].dev.name, len, order,
+					 pmem_largest_free_order(id),
+					 pmem_free_entries(id));
 		printk("pmem: no space left to allocate!\n");
 		return -1;
 	}
+	pmem_del_free_block(id, best_fit);
 
 	/* now partition the best fit:
 	 * 	split the slot into 2 buddies of order - 1
@@ -433,8 +486,12 @@ static int pmem_allocate(int id, unsigned long len)
 		PMEM_ORDER(id, best_fit) -= 1;
 		buddy = PMEM_BUDDY_INDEX(id, best_fit);
 		PMEM_ORDER(id, buddy) = PMEM_ORDER(id, best_fit);
+		pmem[id].bitmap[buddy].allocated = 0;
+		pmem_add_free_block(id, buddy);
+		pmem[id].splits++;
 	}
 	pmem[id].bitmap[best_fit].allocated = 1;
+	pmem[id].allocs++;
 	return best_fit;
 }
 
@@ -1217,6 +1274,36 @@ static struct file_operations debug_fops = {
 };
 #endif
 
+static ssize_t show_pmem_buddy_stats(struct device *dev,
+				     struct device_attribute *attr, char *buf)
+{
+	struct miscdevice *misc = dev_get_drvdata(dev);
+	int id = misc->minor;
+	int i, n = 0;
+
+	/* the misc minor of a pmem device is its index in pmem[] */
+	if (misc != &pmem[id].dev)
+		return -ENODEV;
+
+	down_read(&pmem[id].bitmap_sem);
+	n += scnprintf(buf + n, PAGE_SIZE - n, "order free_blocks\n");
+	for (i = 0; i < PMEM_NUM_ORDERS; i++)
+		if (pmem[id].free_count[i])
+			n += scnprintf(buf + n, PAGE_SIZE - n, "%5d %lu\n", i,
+				       pmem[id].free_count[i]);
+	n += scnprintf(buf + n, PAGE_SIZE - n,
+		       "free_entries %lu\nallocs %lu\nalloc_failures %lu\n"
+		       "splits %lu\nmerges %lu\n",
+		       pmem_free_entries(id), pmem[id].allocs,
+		       pmem[id].alloc_failures, pmem[id].splits,
+		       pmem[id].merges);
+	up_read(&pmem[id].bitmap_sem);
+
+	return n;
+}
+
+static DEVICE_ATTR(buddy_stats, S_IRUGO, show_pmem_buddy_stats, NULL);
+
 #if 0
 static struct miscdevice pmem_dev = {
 	.name = "pmem",
@@ -1224,12 +1311,47 @@ static struct miscdevice pmem_dev = {
 };
 #endif
 
+/* set up the bitmap and free lists for pmem[id].num_entries entries, carved
+ * into the largest buddy blocks that fit */
+static int pmem_init_allocator(int id)
+{
+	int i, index = 0;
+
+	pmem[id].bitmap = kmalloc(pmem[id].num_entries *
+				  sizeof(struct pmem_bits), GFP_KERNEL);
+	if (!pmem[id].bitmap)
+		return -ENOMEM;
+
+	memset(pmem[id].bitmap, 0, sizeof(struct pmem_bits) *
+					  pmem[id].num_entries);
+
+	pmem[id].free_nodes = kmalloc(pmem[id].num_entries *
+				      sizeof(struct list_head), GFP_KERNEL);
+	if (!pmem[id].free_nodes) {
+		kfree(pmem[id].bitmap);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < pmem[id].num_entries; i++)
+		INIT_LIST_HEAD(&pmem[id].free_nodes[i]);
+	for (i = 0; i < PMEM_NUM_ORDERS; i++)
+		INIT_LIST_HEAD(&pmem[id].free_list[i]);
+
+	for (i = sizeof(pmem[id].num_entries) * 8 - 1; i >= 0; i--) {
+		if ((pmem[id].num_entries) &  1UL<<i) {
+			PMEM_ORDER(id, index) = i;
+			pmem_add_free_block(id, index);
+			index = PMEM_NEXT_INDEX(id, index);
+		}
+	}
+	return 0;
+}
+
 int pmem_setup(struct android_pmem_platform_data *pdata,
 	       long (*ioctl)(struct file *, unsigned int, unsigned long),
 	       int (*release)(struct inode *, struct file *))
 {
 	int err = 0;
-	int i, index = 0;
 	int id = id_count;
 	id_count++;
 
@@ -1255,21 +1377,9 @@ int pmem_setup(struct android_pmem_platform_data *pdata,
 	}
 	pmem[id].num_entries = pmem[id].size / PMEM_MIN_ALLOC;
 
-	pmem[id].bitmap = kmalloc(pmem[id].num_entries *
-				  sizeof(struct pmem_bits), GFP_KERNEL);
-	if (!pmem[id].bitmap)
+	if (pmem_init_allocator(id))
 		goto err_no_mem_for_metadata;
 
-	memset(pmem[id].bitmap, 0, sizeof(struct pmem_bits) *
-					  pmem[id].num_entries);
-
-	for (i = sizeof(pmem[id].num_entries) * 8 - 1; i >= 0; i--) {
-		if ((pmem[id].num_entries) &  1<<i) {
-			PMEM_ORDER(id, index) = i;
-			index = PMEM_NEXT_INDEX(id, index);
-		}
-	}
-
 	if (pmem[id].cached)
 		pmem[id].vbase = ioremap_cached(pmem[id].base,
 						pmem[id].size);
@@ -1288,12 +1398,18 @@ int pmem_setup(struct android_pmem_platform_data *pdata,
 	if (pmem[id].no_allocator)
 		pmem[id].allocated = 0;
 
+	if (!pmem[id].no_allocator &&
+	    device_create_file(pmem[id].dev.this_device, &dev_attr_buddy_stats))
+		printk(KERN_WARNING "%s: unable to create buddy_stats\n",
+		       pdata->name);
+
 #if PMEM_DEBUG
 	debugfs_create_file(pdata->name, S_IFREG | S_IRUGO, NULL, (void *)id,
 			    &debug_fops);
 #endif
 	return 0;
 error_cant_remap:
+	kfree(pmem[id].free_nodes);
 	kfree(pmem[id].bitmap);
 err_no_mem_for_metadata:
 	misc_deregister(&pmem[id].dev);
@@ -1342,3 +1458,105 @@ static void __exit pmem_exit(void)
 module_init(pmem_init);
 module_exit(pmem_exit);
 
+#ifdef CONFIG_ANDROID_PMEM_SELFTEST
+/* the self-test region: 13 entries start out as free blocks of order 3, 2
+ * and 0 at indices 0, 8 and 12 */
+#define PMEM_SELFTEST_ENTRIES 13
+
+static int __init pmem_selftest_check(int id, const char *step,
+				      const unsigned long *expect)
+{
+	int i, ret = 0;
+
+	for (i = 0; i < PMEM_NUM_ORDERS; i++) {
+		if (pmem[id].free_count[i] != (i < 4 ? expect[i] : 0)) {
+			printk(KERN_ERR "pmem selftest: %s: %lu free blocks "
+			       "of order %d\n", step, pmem[id].free_count[i], i);
+			ret = -EINVAL;
+		}
+	}
+	return ret;
+}
+
+static int __init pmem_selftest(void)
+{
+	static const unsigned long initial[4] = { 1, 0, 1, 1 };
+	static const unsigned long split[4] = { 1, 1, 0, 1 };
+	static const unsigned long no_order0[4] = { 0, 0, 1, 1 };
+	static const unsigned long merged[4] = { 0, 0, 1, 0 };
+	void *buf;
+	int a, b, c, d, id = id_count;
+	int ret = 0;
+
+	/* borrow the next unused slot: the allocator works on pmem[id] */
+	if (id >= PMEM_MAX_DEVICES)
+		return 0;
+
+	/* the region is carved from kmalloc'd memory, nothing maps it */
+	buf = kmalloc(PMEM_SELFTEST_ENTRIES * PMEM_MIN_ALLOC, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+	pmem[id].dev.name = "pmem_selftest";
+	pmem[id].base = virt_to_phys(buf);
+	pmem[id].size = PMEM_SELFTEST_ENTRIES * PMEM_MIN_ALLOC;
+	pmem[id].num_entries = PMEM_SELFTEST_ENTRIES;
+	init_rwsem(&pmem[id].bitmap_sem);
+	if (pmem_init_allocator(id)) {
+		kfree(buf);
+		return -ENOMEM;
+	}
+
+	down_write(&pmem[id].bitmap_sem);
+	ret |= pmem_selftest_check(id, "setup", initial);
+
+	/* an exact fit is taken before anything is split */
+	a = pmem_allocate(id, PMEM_MIN_ALLOC);
+	if (a != 12)
+		ret = -EINVAL;
+	ret |= pmem_selftest_check(id, "exact fit", no_order0);
+
+	/* the order 2 block at 8 is split twice, leaving 9 and 10 free */
+	b = pmem_allocate(id, PMEM_MIN_ALLOC);
+	if (b != 8)
+		ret = -EINVAL;
+	ret |= pmem_selftest_check(id, "split", split);
+
+	/* the order 3 block goes whole, then nothing of order 3 is left */
+	c = pmem_allocate(id, 8 * PMEM_MIN_ALLOC);
+	d = pmem_allocate(id, 8 * PMEM_MIN_ALLOC);
+	if (c != 0 || d != -1)
+		ret = -EINVAL;
+
+	/* freeing 8 coalesces it with 9, then with 10, back to order 2 */
+	pmem_free(id, b);
+	ret |= pmem_selftest_check(id, "coalesce", merged);
+
+	/* 12 has no buddy inside the region and must stay order 0 */
+	pmem_free(id, a);
+	pmem_free(id, c);
+	ret |= pmem_selftest_check(id, "free all", initial);
+
+	if (pmem_free_entries(id) != PMEM_SELFTEST_ENTRIES ||
+	    pmem[id].allocs != 3 || pmem[id].alloc_failures != 1 ||
+	    pmem[id].splits != 2 || pmem[id].merges != 2) {
+		printk(KERN_ERR "pmem selftest: free_entries %lu allocs %lu "
+		       "alloc_failures %lu splits %lu merges %lu\n",
+		       pmem_free_entries(id), pmem[id].allocs,
+		       pmem[id].alloc_failures, pmem[id].splits,
+		       pmem[id].merges);
+		ret = -EINVAL;
+	}
+	up_write(&pmem[id].bitmap_sem);
+
+	kfree(pmem[id].free_nodes);
+	kfree(pmem[id].bitmap);
+	kfree(buf);
+	memset(&pmem[id], 0, sizeof(pmem[id]));
+
+	printk(KERN_INFO "pmem selftest: buddy allocator %s\n",
+	       ret ? "FAILED" : "passed");
+	return ret;
+}
+late_initcall(pmem_selftest);
+#endif
+
@@ -21,11 +21,21 @@
 #include <linux/string.h>
 #include <linux/uaccess.h>
 #include <linux/io.h>
+#include <linux/ram_console.h>
 
 #ifdef CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION
 #include <linux/rslib.h>
 #endif
 
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_EVENT_LOG
+#include <linux/interrupt.h>
+#include <linux/sched.h>
+#include <linux/sort.h>
+#include <linux/vmalloc.h>
+#include <trace/events/irq.h>
+#include <trace/events/sched.h>
+#endif
+
 struct ram_console_buffer {
 	uint32_t    sig;
 	uint32_t    start;
@@ -35,6 +45,41 @@ struct ram_console_buffer {
 
 #define RAM_CONSOLE_SIG (0x43474244) /* DBGC */
 
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_EVENT_LOG
+struct ram_console_event {
+	uint64_t    time;
+	uint32_t    type;
+	uint32_t    arg0;
+	uint32_t    arg1;
+	char        comm[12];
+};
+
+/*
+ * One ring per possible CPU at the end of the buffer.  Only the owning
+ * CPU writes its ring, with interrupts off, so no lock is needed; head
+ * is advanced after the event is complete, so an event torn by a reset
+ * is never reported.
+ */
+struct ram_console_event_ring {
+	uint32_t    sig;
+	uint32_t    cpu;
+	uint32_t    nr_events;
+	uint32_t    head;
+	struct ram_console_event events[0];
+};
+
+struct ram_console_old_event {
+	struct ram_console_event event;
+	unsigned int cpu;
+};
+
+#define RAM_CONSOLE_EVENT_SIG (0x54564544) /* DEVT */
+#define RAM_CONSOLE_EVENTS CONFIG_ANDROID_RAM_CONSOLE_EVENT_LOG_ENTRIES
+#define RAM_CONSOLE_EVENT_RING_SIZE \
+	(sizeof(struct ram_console_event_ring) + \
+	 RAM_CONSOLE_EVENTS * sizeof(struct ram_console_event))
+#endif
+
 #ifdef CONFIG_ANDROID_RAM_CONSOLE_EARLY_INIT
 static char __initdata
 	ram_console_old_log_init_buffer[CONFIG_ANDROID_RAM_CONSOLE_EARLY_SIZE];
@@ -55,6 +100,14 @@ static int ram_console_bad_blocks;
 #define ECC_POLY CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION_POLYNOMIAL
 #endif
 
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_EVENT_LOG
+static void *ram_console_event_rings __read_mostly;
+static struct ram_console_old_event *ram_console_old_events;
+static unsigned int ram_console_old_events_count;
+static char *ram_console_old_events_log;
+static size_t ram_console_old_events_log_size;
+#endif
+
 #ifdef CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION
 static void ram_console_encode_rs8(uint8_t *data, size_t len, uint8_t *ecc)
 {
@@ -154,6 +207,273 @@ void ram_console_enable_console(int enabled)
 		ram_console.flags &= ~CON_ENABLED;
 }
 
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_EVENT_LOG
+static inline struct ram_console_event_ring *ram_console_event_ring(int cpu)
+{
+	return ram_console_event_rings + cpu * RAM_CONSOLE_EVENT_RING_SIZE;
+}
+
+static void ram_console_ring_add(struct ram_console_event_ring *ring,
+				 u64 time, unsigned int type, u32 arg0,
+				 u32 arg1, const char *comm)
+{
+	struct ram_console_event *event;
+
+	event = &ring->events[ring->head & (RAM_CONSOLE_EVENTS - 1)];
+	event->time = time;
+	event->type = type;
+	event->arg0 = arg0;
+	event->arg1 = arg1;
+	if (comm)
+		strncpy(event->comm, comm, sizeof(event->comm));
+	else
+		event->comm[0] = '\0';
+	barrier();
+	ring->head++;
+}
+
+void ram_console_log_event(unsigned int type, u32 arg0, u32 arg1,
+			   const char *comm)
+{
+	unsigned long flags;
+
+	if (!ram_console_event_rings)
+		return;
+
+	local_irq_save(flags);
+	ram_console_ring_add(ram_console_event_ring(smp_processor_id()),
+			     sched_clock(), type, arg0, arg1, comm);
+	local_irq_restore(flags);
+}
+EXPORT_SYMBOL(ram_console_log_event);
+
+static void ram_console_probe_sched_switch(void *ignore,
+					   struct task_struct *prev,
+					   struct task_struct *next)
+{
+	ram_console_log_event(RAM_CONSOLE_EVENT_SCHED_SWITCH,
+			      prev->pid, next->pid, next->comm);
+}
+
+static void ram_console_probe_irq_handler_entry(void *ignore, int irq,
+						struct irqaction *action)
+{
+	ram_console_log_event(RAM_CONSOLE_EVENT_IRQ, irq, 0, action->name);
+}
+
+static int ram_console_old_event_cmp(const void *a, const void *b)
+{
+	const struct ram_console_old_event *ea = a, *eb = b;
+
+	if (ea->event.time < eb->event.time)
+		return -1;
+	return ea->event.time > eb->event.time;
+}
+
+static void __init ram_console_save_old_events(unsigned int nr_rings)
+{
+	struct ram_console_event_ring *ring;
+	struct ram_console_old_event *old;
+	unsigned int cpu, count, i, n = 0;
+
+	for (cpu = 0; cpu < nr_rings; cpu++) {
+		ring = ram_console_event_ring(cpu);
+		if (ring->sig == RAM_CONSOLE_EVENT_SIG &&
+		    ring->cpu == cpu && ring->nr_events == RAM_CONSOLE_EVENTS)
+			n += min_t(uint32_t, ring->head, RAM_CONSOLE_EVENTS);
+	}
+	if (!n)
+		return;
+
+	old = vmalloc(n * sizeof(*old));
+	if (!old) {
+		printk(KERN_ERR "ram_console: failed to allocate old events\n");
+		return;
+	}
+
+	n = 0;
+	for (cpu = 0; cpu < nr_rings; cpu++) {
+		ring = ram_console_event_ring(cpu);
+		if (ring->sig != RAM_CONSOLE_EVENT_SIG ||
+		    ring->cpu != cpu || ring->nr_events != RAM_CONSOLE_EVENTS)
+			continue;
+		count = min_t(uint32_t, ring->head, RAM_CONSOLE_EVENTS);
+		for (i = ring->head - count; i != ring->head; i++) {
+			old[n].event = ring->events[i &
+						    (RAM_CONSOLE_EVENTS - 1)];
+			old[n].event.comm[sizeof(old[n].event.comm) - 1] = '\0';
+			old[n].cpu = cpu;
+			n++;
+		}
+	}
+
+	sort(old, n, sizeof(*old), ram_console_old_event_cmp, NULL);
+	ram_console_old_events = old;
+	ram_console_old_events_count = n;
+	printk(KERN_INFO "ram_console: found %u events\n", n);
+}
+
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_EVENT_LOG_SELFTEST
+/* three scratch rings: 0 has wrapped, 1 interleaves with it, 2 is torn */
+#define RAM_CONSOLE_SELFTEST_RINGS 3
+
+static int __init ram_console_events_selftest(void)
+{
+	struct ram_console_event_ring *ring;
+	const struct ram_console_old_event *old;
+	unsigned int cpu, i;
+	void *rings;
+	int ret = 0;
+
+	rings = vmalloc(RAM_CONSOLE_SELFTEST_RINGS *
+			RAM_CONSOLE_EVENT_RING_SIZE);
+	if (!rings)
+		return -ENOMEM;
+	ram_console_event_rings = rings;
+	for (cpu = 0; cpu < RAM_CONSOLE_SELFTEST_RINGS; cpu++) {
+		ring = ram_console_event_ring(cpu);
+		ring->sig = RAM_CONSOLE_EVENT_SIG;
+		ring->cpu = cpu;
+		ring->nr_events = RAM_CONSOLE_EVENTS;
+		ring->head = 0;
+	}
+
+	/* only the last RAM_CONSOLE_EVENTS survive, at even times from 8 */
+	ring = ram_console_event_ring(0);
+	for (i = 0; i < RAM_CONSOLE_EVENTS + 3; i++)
+		ram_console_ring_add(ring, 2 * (i + 1), RAM_CONSOLE_EVENT_USER,
+				     i, 0, "ring0");
+
+	/* odd times 1, 3 and 5 sort before everything left in ring 0 */
+	ring = ram_console_event_ring(1);
+	for (i = 0; i < 3; i++)
+		ram_console_ring_add(ring, 2 * i + 1, RAM_CONSOLE_EVENT_USER,
+				     i, 0, "ring1");
+
+	/* a ring without its signature is not reported */
+	ring = ram_console_event_ring(2);
+	ram_console_ring_add(ring, 0, RAM_CONSOLE_EVENT_USER, 0, 0, "ring2");
+	ring->sig = 0;
+
+	ram_console_save_old_events(RAM_CONSOLE_SELFTEST_RINGS);
+	old = ram_console_old_events;
+	if (!old || ram_console_old_events_count != RAM_CONSOLE_EVENTS + 3) {
+		printk(KERN_ERR "ram_console selftest: %u events, expected "
+		       "%u\n", ram_console_old_events_count,
+		       RAM_CONSOLE_EVENTS + 3);
+		ret = -EINVAL;
+		goto out;
+	}
+	for (i = 0; i < ram_console_old_events_count; i++) {
+		if (old[i].cpu != (i < 3) || old[i].event.arg0 != i ||
+		    old[i].event.time != (i < 3 ? 2 * i + 1 : 2 * (i + 1))) {
+			printk(KERN_ERR "ram_console selftest: event %u is "
+			       "cpu%u time %llu arg0 %u\n", i, old[i].cpu,
+			       (unsigned long long)old[i].event.time,
+			       old[i].event.arg0);
+			ret = -EINVAL;
+			break;
+		}
+	}
+
+out:
+	vfree(ram_console_old_events);
+	ram_console_old_events = NULL;
+	ram_console_old_events_count = 0;
+	ram_console_event_rings = NULL;
+	vfree(rings);
+
+	printk(KERN_INFO "ram_console selftest: event rings %s\n",
+	       ret ? "FAILED" : "passed");
+	return ret;
+}
+#endif
+
+/*
+ * Carve the event rings out of the end of the buffer, saving the events
+ * of the previous boot first.  Returns the size left for the console.
+ */
+static size_t __init ram_console_init_events(void *buffer,
+					     size_t buffer_size)
+{
+	size_t rings_size = nr_cpu_ids * RAM_CONSOLE_EVENT_RING_SIZE;
+	size_t console_size;
+	unsigned int cpu;
+
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_EVENT_LOG_SELFTEST
+	ram_console_events_selftest();
+#endif
+	if (buffer_size < rings_size + sizeof(struct ram_console_buffer)) {
+		printk(KERN_ERR "ram_console: buffer too small for %zu bytes "
+		       "of event rings\n", rings_size);
+		return buffer_size;
+	}
+	console_size = (buffer_size - rings_size) & ~(sizeof(uint64_t) - 1);
+	ram_console_event_rings = buffer + console_size;
+
+	ram_console_save_old_events(nr_cpu_ids);
+
+	for (cpu = 0; cpu < nr_cpu_ids; cpu++) {
+		struct ram_console_event_ring *ring =
+			ram_console_event_ring(cpu);
+		ring->sig = RAM_CONSOLE_EVENT_SIG;
+		ring->cpu = cpu;
+		ring->nr_events = RAM_CONSOLE_EVENTS;
+		ring->head = 0;
+	}
+
+	return console_size;
+}
+
+static void __init ram_console_format_old_events(void)
+{
+	const struct ram_console_old_event *old;
+	size_t size = ram_console_old_events_count * 80;
+	unsigned long rem;
+	u64 ts;
+	char *text;
+	size_t n = 0;
+	unsigned int i;
+
+	text = vmalloc(size);
+	if (!text) {
+		printk(KERN_ERR "ram_console: failed to allocate event log\n");
+		return;
+	}
+
+	for (i = 0; i < ram_console_old_events_count; i++) {
+		old = &ram_console_old_events[i];
+		ts = old->event.time;
+		rem = do_div(ts, 1000000000);
+		n += scnprintf(text + n, size - n, "[%5lu.%06lu] cpu%u ",
+			       (unsigned long) ts, rem / 1000, old->cpu);
+		switch (old->event.type) {
+		case RAM_CONSOLE_EVENT_SCHED_SWITCH:
+			n += scnprintf(text + n, size - n,
+				       "switch %u => %u %s\n",
+				       old->event.arg0, old->event.arg1,
+				       old->event.comm);
+			break;
+		case RAM_CONSOLE_EVENT_IRQ:
+			n += scnprintf(text + n, size - n, "irq %u %s\n",
+				       old->event.arg0, old->event.comm);
+			break;
+		default:
+			n += scnprintf(text + n, size - n,
+				       "event %u %08x %08x %s\n",
+				       old->event.type, old->event.arg0,
+				       old->event.arg1, old->event.comm);
+			break;
+		}
+	}
+
+	vfree(ram_console_old_events);
+	ram_console_old_events = NULL;
+	ram_console_old_events_log = text;
+	ram_console_old_events_log_size = n;
+}
+#endif
+
 static void __init
 ram_console_save_old(struct ram_console_buffer *buffer, char *dest)
 {
@@ -229,6 +549,9 @@ static int __init ram_console_init(struct ram_console_buffer *buffer,
 	uint8_t *par;
 #endif
 	ram_console_buffer = buffer;
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_EVENT_LOG
+	buffer_size = ram_console_init_events(buffer, buffer_size);
+#endif
 	ram_console_buffer_size =
 		buffer_size - sizeof(struct ram_console_buffer);
 
@@ -379,10 +702,59 @@ static const struct file_operations ram_console_file_ops = {
 	.read = ram_console_read_old,
 };
 
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_EVENT_LOG
+static ssize_t ram_console_read_old_events(struct file *file,
+					   char __user *buf,
+					   size_t len, loff_t *offset)
+{
+	return simple_read_from_buffer(buf, len, offset,
+				       ram_console_old_events_log,
+				       ram_console_old_events_log_size);
+}
+
+static const struct file_operations ram_console_events_file_ops = {
+	.owner = THIS_MODULE,
+	.read = ram_console_read_old_events,
+};
+
+static void __init ram_console_late_init_events(void)
+{
+	struct proc_dir_entry *entry;
+
+	if (!ram_console_event_rings)
+		return;
+
+	register_trace_sched_switch(ram_console_probe_sched_switch, NULL);
+	register_trace_irq_handler_entry(ram_console_probe_irq_handler_entry,
+					 NULL);
+
+	if (!ram_console_old_events)
+		return;
+
+	ram_console_format_old_events();
+	if (!ram_console_old_events_log)
+		return;
+
+	entry = create_proc_entry("last_events", S_IFREG | S_IRUGO, NULL);
+	if (!entry) {
+		printk(KERN_ERR "ram_console: failed to create proc entry\n");
+		vfree(ram_console_old_events_log);
+		ram_console_old_events_log = NULL;
+		return;
+	}
+
+	entry->proc_fops = &ram_console_events_file_ops;
+	entry->size = ram_console_old_events_log_size;
+}
+#endif
+
 static int __init ram_console_late_init(void)
 {
 	struct proc_dir_entry *entry;
 
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_EVENT_LOG
+	ram_console_late_init_events();
+#endif
 	if (ram_console_old_log == NULL)
 		return 0;
 #ifdef CONFIG_ANDROID_RAM_CONSOLE_EARLY_INIT
@@ -106,6 +106,15 @@
  *				to work correctly.  You should set it
  *				to true.
  *
+ *	num_buffers	Number of buffers in the I/O pipeline.  Zero
+ *				means FSG_NUM_BUFFERS; other values are
+ *				limited to 2 .. FSG_MAX_NUM_BUFFERS.
+ *	buflen		Size of each of the pipeline buffers.  Zero
+ *				means FSG_BUFLEN; other values are
+ *				rounded down to a multiple of the page
+ *				size and limited to FSG_BUFLEN ..
+ *				FSG_MAX_BUFLEN.
+ *
  * If "removable" is not set for a LUN then a backing file must be
  * specified.  If it is set, then NULL filename means the LUN's medium
  * is not loaded (an empty string as "filename" in the fsg_config
@@ -133,6 +142,9 @@
  *				USB device controller (usually true),
  *				boolean to permit the driver to halt
  *				bulk endpoints.
+ *	num_buffers=N	Default N = FSG_NUM_BUFFERS, number of buffers
+ *				used to pipeline USB and file I/O.
+ *	buflen=N	Default N = 16384, size of each buffer.
  *
  * The module parameters may be prefixed with some string.  You need
  * to consult gadget's documentation or source to verify whether it is
@@ -142,9 +154,11 @@
  *
  *
  * Requirements are modest; only a bulk-in and a bulk-out endpoint are
- * needed.  The memory requirement amounts to two 16K buffers, size
- * configurable by a parameter.  Support is included for both
- * full-speed and high-speed operation.
+ * needed.  The memory requirement amounts to a ring of buffers which
+ * is allocated when the function is set up: by default FSG_NUM_BUFFERS
+ * (two unless changed in Kconfig) buffers of 16K, both number and size
+ * configurable by parameters.  Support is included for both full-speed
+ * and high-speed operation.
  *
  * Note that the driver is slightly non-portable in that it assumes a
  * single memory/DMA buffer will be useable for bulk-in, bulk-out, and
@@ -283,12 +297,14 @@
 #include <linux/kref.h>
 #include <linux/kthread.h>
 #include <linux/limits.h>
+#include <linux/pagemap.h>
 #include <linux/rwsem.h>
 #include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/string.h>
 #include <linux/freezer.h>
 #include <linux/utsname.h>
+#include <linux/writeback.h>
 
 #include <linux/usb/ch9.h>
 #include <linux/usb/gadget.h>
@@ -362,7 +378,9 @@ struct fsg_common {
 
 	struct fsg_buffhd	*next_buffhd_to_fill;
 	struct fsg_buffhd	*next_buffhd_to_drain;
-	struct fsg_buffhd	buffhds[FSG_NUM_BUFFERS];
+	struct fsg_buffhd	*buffhds;
+	unsigned int		fsg_num_buffers;
+	u32			buflen;
 
 	int			cmnd_size;
 	u8			cmnd[MAX_COMMAND_SIZE];
@@ -430,6 +448,9 @@ struct fsg_config {
 
 	char			can_stall;
 
+	unsigned int		num_buffers;	/* 0 means FSG_NUM_BUFFERS */
+	u32			buflen;		/* 0 means FSG_BUFLEN */
+
 #ifdef CONFIG_USB_ANDROID_MASS_STORAGE
 	struct platform_device *pdev;
 #endif
@@ -731,6 +752,31 @@ static int sleep_thread(struct fsg_common *common)
 
 /*-------------------------------------------------------------------------*/
 
+static void fsg_lun_readahead(struct fsg_lun *curlun, loff_t file_offset,
+			      u32 amount)
+{
+	struct file		*filp = curlun->filp;
+	struct address_space	*mapping = filp->f_mapping;
+	pgoff_t			index = file_offset >> PAGE_CACHE_SHIFT;
+	unsigned long		nr_pages;
+	struct page		*page;
+
+	if (file_offset >= curlun->file_length)
+		return;
+	amount = min((loff_t) amount, curlun->file_length - file_offset);
+	nr_pages = ((file_offset & ~PAGE_CACHE_MASK) + amount +
+		    PAGE_CACHE_SIZE - 1) >> PAGE_CACHE_SHIFT;
+
+	/* Already cached; the read path takes care of async readahead */
+	page = find_get_page(mapping, index);
+	if (page) {
+		page_cache_release(page);
+		return;
+	}
+
+	page_cache_sync_readahead(mapping, &filp->f_ra, filp, index, nr_pages);
+}
+
 static int do_read(struct fsg_common *common)
 {
 	struct fsg_lun		*curlun = common->curlun;
@@ -769,6 +815,13 @@ static int do_read(struct fsg_common *common)
 	if (unlikely(amount_left == 0))
 		return -EIO;		/* No default reply */
 
+	/* Transfers longer than a single buffer are read from the
+	 * backing file in buflen sized pieces.  Tell the page cache
+	 * about the whole request up front so that it can be read ahead
+	 * while the first buffers are being sent to the host. */
+	if (amount_left > common->buflen)
+		fsg_lun_readahead(curlun, file_offset, amount_left);
+
 	for (;;) {
 
 		/* Figure out how much we need to read:
@@ -779,7 +832,7 @@ static int do_read(struct fsg_common *common)
 		 *	the next page.
 		 * If this means reading 0 then we were asked to read past
 		 *	the end of file. */
-		amount = min(amount_left, FSG_BUFLEN);
+		amount = min(amount_left, common->buflen);
 		amount = min((loff_t) amount,
 				curlun->file_length - file_offset);
 		partial_page = file_offset & (PAGE_CACHE_SIZE - 1);
@@ -860,6 +913,27 @@ static int do_read(struct fsg_common *common)
 
 /*-------------------------------------------------------------------------*/
 
+/* Sequential writes are collected into runs of at least this size before
+ * writeback of the run is started, so that the backing storage sees a few
+ * large writes instead of one per buffer. */
+#define FSG_WRITEBACK_CHUNK	((loff_t)(1024 * 1024))
+
+static void fsg_lun_writeback(struct fsg_lun *curlun, loff_t start,
+			      loff_t end)
+{
+	/* A write that does not continue the run starts a new one; the
+	 * old run is left to the flusher threads. */
+	if (start != curlun->wb_end)
+		curlun->wb_start = start;
+	curlun->wb_end = end;
+
+	if (curlun->wb_end - curlun->wb_start < FSG_WRITEBACK_CHUNK)
+		return;
+	__filemap_fdatawrite_range(curlun->filp->f_mapping, curlun->wb_start,
+				   curlun->wb_end - 1, WB_SYNC_NONE);
+	curlun->wb_start = curlun->wb_end;
+}
+
 static int do_write(struct fsg_common *common)
 {
 	struct fsg_lun		*curlun = common->curlun;
@@ -868,10 +942,12 @@ static int do_write(struct fsg_common *common)
 	int			get_some_more;
 	u32			amount_left_to_req, amount_left_to_write;
 	loff_t			usb_offset, file_offset, file_offset_tmp;
+	loff_t			start_offset;
 	unsigned int		amount;
 	unsigned int		partial_page;
 	ssize_t			nwritten;
 	int			rc;
+	int			fua = 0;
 
 	if (curlun->ro) {
 		curlun->sense_data = SS_WRITE_PROTECTED;
@@ -891,16 +967,14 @@ static int do_write(struct fsg_common *common)
 		/* We allow DPO (Disable Page Out = don't save data in the
 		 * cache) and FUA (Force Unit Access = write directly to the
 		 * medium).  We don't implement DPO; we implement FUA by
-		 * performing synchronous output. */
+		 * syncing the whole written range once the data is in,
+		 * rather than each buffer with O_SYNC. */
 		if (common->cmnd[1] & ~0x18) {
 			curlun->sense_data = SS_INVALID_FIELD_IN_CDB;
 			return -EINVAL;
 		}
-		if (common->cmnd[1] & 0x08) {	/* FUA */
-			spin_lock(&curlun->filp->f_lock);
-			curlun->filp->f_flags |= O_SYNC;
-			spin_unlock(&curlun->filp->f_lock);
-		}
+		if (common->cmnd[1] & 0x08)	/* FUA */
+			fua = 1;
 	}
 	if (lba >= curlun->num_sectors) {
 		curlun->sense_data = SS_LOGICAL_BLOCK_ADDRESS_OUT_OF_RANGE;
@@ -909,7 +983,7 @@ static int do_write(struct fsg_common *common)
 
 	/* Carry out the file writes */
 	get_some_more = 1;
-	file_offset = usb_offset = ((loff_t) lba) << 9;
+	start_offset = file_offset = usb_offset = ((loff_t) lba) << 9;
 	amount_left_to_req = common->data_size_from_cmnd;
 	amount_left_to_write = common->data_size_from_cmnd;
 
@@ -928,7 +1002,7 @@ static int do_write(struct fsg_common *common)
 			 * If this means getting 0, then we were asked
 			 *	to write past the end of file.
 			 * Finally, round down to a block boundary. */
-			amount = min(amount_left_to_req, FSG_BUFLEN);
+			amount = min(amount_left_to_req, common->buflen);
 			amount = min((loff_t) amount, curlun->file_length -
 					usb_offset);
 			partial_page = usb_offset & (PAGE_CACHE_SIZE - 1);
@@ -1047,6 +1121,17 @@ static int do_write(struct fsg_common *common)
 			return rc;
 	}
 
+	if (file_offset > start_offset) {
+		if (!fua)
+			fsg_lun_writeback(curlun, start_offset, file_offset);
+		else if (vfs_fsync_range(curlun->filp, start_offset,
+					 file_offset - 1, 1)) {
+			curlun->sense_data = SS_WRITE_ERROR;
+			curlun->sense_data_info = start_offset >> 9;
+			curlun->info_valid = 1;
+		}
+	}
+
 	return -EIO;		/* No default reply */
 }
 
@@ -1131,7 +1216,7 @@ static int do_verify(struct fsg_common *common)
 		 * And don't try to read past the end of the file.
 		 * If this means reading 0 then we were asked to read
 		 * past the end of file. */
-		amount = min(amount_left, FSG_BUFLEN);
+		amount = min(amount_left, common->buflen);
 		amount = min((loff_t) amount,
 				curlun->file_length - file_offset);
 		if (amount == 0) {
@@ -1364,7 +1449,7 @@ static int do_mode_sense(struct fsg_common *common, struct fsg_buffhd *bh)
 	} else {			/* SC_MODE_SENSE_10 */
 		buf[3] = (curlun->ro ? 0x80 : 0x00);		/* WP, DPOFUA */
 		buf += 8;
-		limit = 65535;		/* Should really be FSG_BUFLEN */
+		limit = 65535;		/* Should really be common->buflen */
 	}
 
 	/* No block descriptors */
@@ -1590,7 +1675,7 @@ static int pad_with_zeros(struct fsg_dev *fsg)
 				return rc;
 		}
 
-		nsend = min(fsg->common->usb_amount_left, FSG_BUFLEN);
+		nsend = min(fsg->common->usb_amount_left, fsg->common->buflen);
 		memset(bh->buf + nkeep, 0, nsend - nkeep);
 		bh->inreq->length = nsend;
 		bh->inreq->zero = 0;
@@ -1633,7 +1718,7 @@ static int throw_away_data(struct fsg_common *common)
 		bh = common->next_buffhd_to_fill;
 		if (bh->state == BUF_STATE_EMPTY
 		 && common->usb_amount_left > 0) {
-			amount = min(common->usb_amount_left, FSG_BUFLEN);
+			amount = min(common->usb_amount_left, common->buflen);
 
 			/* amount is always divisible by 512, hence by
 			 * the bulk-out maxpacket size */
@@ -2353,7 +2438,7 @@ reset:
 	if (common->fsg) {
 		fsg = common->fsg;
 
-		for (i = 0; i < FSG_NUM_BUFFERS; ++i) {
+		for (i = 0; i < common->fsg_num_buffers; ++i) {
 			struct fsg_buffhd *bh = &common->buffhds[i];
 
 			if (bh->inreq) {
@@ -2405,7 +2490,7 @@ reset:
 	clear_bit(IGNORE_BULK_OUT, &fsg->atomic_bitflags);
 
 	/* Allocate the requests */
-	for (i = 0; i < FSG_NUM_BUFFERS; ++i) {
+	for (i = 0; i < common->fsg_num_buffers; ++i) {
 		struct fsg_buffhd	*bh = &common->buffhds[i];
 
 		rc = alloc_request(common, fsg->bulk_in, &bh->inreq);
@@ -2473,7 +2558,7 @@ static void handle_exception(struct fsg_common *common)
 
 	/* Cancel all the pending transfers */
 	if (likely(common->fsg)) {
-		for (i = 0; i < FSG_NUM_BUFFERS; ++i) {
+		for (i = 0; i < common->fsg_num_buffers; ++i) {
 			bh = &common->buffhds[i];
 			if (bh->inreq_busy)
 				usb_ep_dequeue(common->fsg->bulk_in, bh->inreq);
@@ -2485,7 +2570,7 @@ static void handle_exception(struct fsg_common *common)
 		/* Wait until everything is idle */
 		for (;;) {
 			int num_active = 0;
-			for (i = 0; i < FSG_NUM_BUFFERS; ++i) {
+			for (i = 0; i < common->fsg_num_buffers; ++i) {
 				bh = &common->buffhds[i];
 				num_active += bh->inreq_busy + bh->outreq_busy;
 			}
@@ -2506,7 +2591,7 @@ static void handle_exception(struct fsg_common *common)
 	 * state, and the exception.  Then invoke the handler. */
 	spin_lock_irq(&common->lock);
 
-	for (i = 0; i < FSG_NUM_BUFFERS; ++i) {
+	for (i = 0; i < common->fsg_num_buffers; ++i) {
 		bh = &common->buffhds[i];
 		bh->state = BUF_STATE_EMPTY;
 	}
@@ -2798,14 +2883,26 @@ static struct fsg_common *fsg_common_init(struct fsg_common *common,
 
 
 	/* Data buffers cyclic list */
-	bh = common->buffhds;
-	i = FSG_NUM_BUFFERS;
+	common->fsg_num_buffers = cfg->num_buffers ?: FSG_NUM_BUFFERS;
+	common->fsg_num_buffers = clamp(common->fsg_num_buffers, 2u,
+					(unsigned)FSG_MAX_NUM_BUFFERS);
+	common->buflen = cfg->buflen ?: FSG_BUFLEN;
+	common->buflen = clamp_t(u32, common->buflen & PAGE_CACHE_MASK,
+				 FSG_BUFLEN, FSG_MAX_BUFLEN);
+
+	bh = kcalloc(common->fsg_num_buffers, sizeof *bh, GFP_KERNEL);
+	if (unlikely(!bh)) {
+		rc = -ENOMEM;
+		goto error_release;
+	}
+	common->buffhds = bh;
+	i = common->fsg_num_buffers;
 	goto buffhds_first_it;
 	do {
 		bh->next = bh + 1;
 		++bh;
 buffhds_first_it:
-		bh->buf = kmalloc(FSG_BUFLEN, GFP_KERNEL);
+		bh->buf = kmalloc(common->buflen, GFP_KERNEL);
 		if (unlikely(!bh->buf)) {
 			rc = -ENOMEM;
 			goto error_release;
@@ -2866,6 +2963,8 @@ buffhds_first_it:
 	/* Information */
 	INFO(common, FSG_DRIVER_DESC ", version: " FSG_DRIVER_VERSION "\n");
 	INFO(common, "Number of LUNs=%d\n", common->nluns);
+	INFO(common, "Number of buffers=%u, buffer length=%u\n",
+	     common->fsg_num_buffers, common->buflen);
 
 	pathbuf = kmalloc(PATH_MAX, GFP_KERNEL);
 	for (i = 0, nluns = common->nluns, curlun = common->luns;
@@ -2935,12 +3034,14 @@ static void fsg_common_release(struct kref *ref)
 		kfree(common->luns);
 	}
 
-	{
+	if (likely(common->buffhds)) {
 		struct fsg_buffhd *bh = common->buffhds;
-		unsigned i = FSG_NUM_BUFFERS;
+		unsigned i = common->fsg_num_buffers;
 		do {
 			kfree(bh->buf);
 		} while (++bh, --i);
+
+		kfree(common->buffhds);
 	}
 
 	if (common->free_storage_on_release)
@@ -3092,6 +3193,8 @@ struct fsg_module_parameters {
 	unsigned int	file_count, ro_count, removable_count, cdrom_count;
 	unsigned int	luns;	/* nluns */
 	int		stall;	/* can_stall */
+	unsigned int	num_buffers;
+	unsigned int	buflen;
 };
 
 
@@ -3118,7 +3221,11 @@ struct fsg_module_parameters {
 	_FSG_MODULE_PARAM(prefix, params, luns, uint,			\
 			  "number of LUNs");				\
 	_FSG_MODULE_PARAM(prefix, params, stall, bool,			\
-			  "false to prevent bulk stalls")
+			  "false to prevent bulk stalls");		\
+	_FSG_MODULE_PARAM(prefix, params, num_buffers, uint,		\
+			  "number of pipeline buffers");		\
+	_FSG_MODULE_PARAM(prefix, params, buflen, uint,			\
+			  "size of each pipeline buffer")
 
 
 static void
@@ -3155,6 +3262,8 @@ fsg_config_from_params(struct fsg_config *cfg,
 
 	/* Finalise */
 	cfg->can_stall = params->stall;
+	cfg->num_buffers = params->num_buffers;
+	cfg->buflen = params->buflen;
 }
 
 static inline struct fsg_common *
@@ -290,6 +290,10 @@ struct fsg_lun {
 	u32		sense_data_info;
 	u32		unit_attention_data;
 
+	/* sequential run of writes not yet handed to writeback */
+	loff_t		wb_start;
+	loff_t		wb_end;
+
 	struct device	dev;
 };
 
@@ -306,11 +310,21 @@ static struct fsg_lun *fsg_lun_from_dev(struct device *dev)
 #define DELAYED_STATUS	(EP0_BUFSIZE + 999)	/* An impossibly large value */
 
 /* Number of buffers we will use.  2 is enough for double-buffering */
+#ifdef CONFIG_USB_GADGET_STORAGE_NUM_BUFFERS
+#define FSG_NUM_BUFFERS	CONFIG_USB_GADGET_STORAGE_NUM_BUFFERS
+#else
 #define FSG_NUM_BUFFERS	2
+#endif
+
+/* Upper limit for the number of buffers configurable at run time */
+#define FSG_MAX_NUM_BUFFERS	32
 
 /* Default size of buffer length. */
 #define FSG_BUFLEN	((u32)16384)
 
+/* Upper limit for the buffer length configurable at run time */
+#define FSG_MAX_BUFLEN	((u32)(128 * 1024))
+
 /* Maximal number of LUNs supported in mass storage function */
 #define FSG_MAX_LUNS	8
 
@@ -649,6 +663,7 @@ static int fsg_lun_open(struct fsg_lun *curlun, const char *filename)
 	curlun->filp = filp;
 	curlun->file_length = size;
 	curlun->num_sectors = num_sectors;
+	curlun->wb_start = curlun->wb_end = 0;
 	LDBG(curlun, "open backing file: %s\n", filename);
 	rc = 0;
 
@@ -664,6 +679,7 @@ static void fsg_lun_close(struct fsg_lun *curlun)
 		LDBG(curlun, "close backing file\n");
 		fput(curlun->filp);
 		curlun->filp = NULL;
+		curlun->wb_start = curlun->wb_end = 0;
 	}
 }
 
@@ -27,6 +27,7 @@
 #include <linux/backing-dev.h>
 #include <linux/buffer_head.h>
 #include <linux/tracepoint.h>
+#include <linux/memcontrol.h>
 #include "internal.h"
 
 /*
@@ -39,8 +40,10 @@ struct wb_writeback_work {
 	unsigned int for_kupdate:1;
 	unsigned int range_cyclic:1;
 	unsigned int for_background:1;
+	unsigned short memcg_id;	/* only inodes dirtied by this memcg */
 
 	struct list_head list;		/* pending work list */
+	struct list_head memcg_list;	/* bdi->memcg_work_list, if memcg_id */
 	struct completion *done;	/* set if the caller waits */
 };
 
@@ -156,6 +159,80 @@ void bdi_start_background_writeback(struct backing_dev_info *bdi)
 	__bdi_start_writeback(bdi, LONG_MAX, true, true);
 }
 
+/*
+ * A memcg work stays on bdi->memcg_work_list from the time it is queued
+ * until wb_do_writeback() is done with it, so that it is seen while it
+ * runs as well as while it waits on work_list.
+ */
+static bool __bdi_memcg_work_pending(struct backing_dev_info *bdi,
+				     unsigned short memcg_id)
+{
+	struct wb_writeback_work *work;
+
+	list_for_each_entry(work, &bdi->memcg_work_list, memcg_list)
+		if (work->memcg_id == memcg_id)
+			return true;
+	return false;
+}
+
+static bool bdi_memcg_work_pending(struct backing_dev_info *bdi,
+				   unsigned short memcg_id)
+{
+	bool pending;
+
+	spin_lock_bh(&bdi->wb_lock);
+	pending = __bdi_memcg_work_pending(bdi, memcg_id);
+	spin_unlock_bh(&bdi->wb_lock);
+	return pending;
+}
+
+/**
+ * bdi_start_memcg_writeback - start background writeback for a memcg
+ * @bdi: the backing device to write from
+ * @memcg_id: css id of the memory cgroup over its dirty limits
+ *
+ * Description:
+ *   Like bdi_start_background_writeback(), but only writes the inodes
+ *   last dirtied by the memory cgroup and stops once the cgroup is below
+ *   its own background threshold.  Does nothing if such work is already
+ *   queued or running for the cgroup on this bdi.
+ */
+void bdi_start_memcg_writeback(struct backing_dev_info *bdi,
+			       unsigned short memcg_id)
+{
+	struct wb_writeback_work *work;
+
+	if (bdi_memcg_work_pending(bdi, memcg_id))
+		return;
+
+	work = kzalloc(sizeof(*work), GFP_ATOMIC);
+	if (!work) {
+		if (bdi->wb.task) {
+			trace_writeback_nowork(bdi);
+			wake_up_process(bdi->wb.task);
+		}
+		return;
+	}
+
+	work->sync_mode	= WB_SYNC_NONE;
+	work->nr_pages	= LONG_MAX;
+	work->range_cyclic = 1;
+	work->for_background = 1;
+	work->memcg_id = memcg_id;
+
+	/* recheck: another dirtier of the cgroup may have raced with us */
+	spin_lock_bh(&bdi->wb_lock);
+	if (__bdi_memcg_work_pending(bdi, memcg_id)) {
+		spin_unlock_bh(&bdi->wb_lock);
+		kfree(work);
+		return;
+	}
+	list_add(&work->memcg_list, &bdi->memcg_work_list);
+	spin_unlock_bh(&bdi->wb_lock);
+
+	bdi_queue_work(bdi, work);
+}
+
 /*
  * Redirty an inode: set its when-it-was dirtied timestamp and move it to the
  * furthest end of its superblock's dirty-inode list.
@@ -491,6 +568,12 @@ static int writeback_sb_inodes(struct super_block *sb, struct bdi_writeback *wb,
 			requeue_io(inode);
 			continue;
 		}
+		if (wbc->memcg_id &&
+		    !mem_cgroup_mapping_dirtied_by(inode->i_mapping,
+						   wbc->memcg_id)) {
+			requeue_io(inode);
+			continue;
+		}
 		/*
 		 * Was this inode dirtied after sync_sb_inodes was called?
 		 * This keeps sync from extra jobs and livelock.
@@ -575,10 +658,13 @@ static void __writeback_inodes_sb(struct super_block *sb,
  */
 #define MAX_WRITEBACK_PAGES     1024
 
-static inline bool over_bground_thresh(void)
+static inline bool over_bground_thresh(unsigned short memcg_id)
 {
 	unsigned long background_thresh, dirty_thresh;
 
+	if (memcg_id)
+		return mem_cgroup_over_bground_thresh(memcg_id);
+
 	global_dirty_limits(&background_thresh, &dirty_thresh);
 
 	return (global_page_state(NR_FILE_DIRTY) +
@@ -609,6 +695,7 @@ static long wb_writeback(struct bdi_writeback *wb,
 		.for_kupdate		= work->for_kupdate,
 		.for_background		= work->for_background,
 		.range_cyclic		= work->range_cyclic,
+		.memcg_id		= work->memcg_id,
 	};
 	unsigned long oldest_jif;
 	long wrote = 0;
@@ -634,9 +721,9 @@ static long wb_writeback(struct bdi_writeback *wb,
 
 		/*
 		 * For background writeout, stop when we are below the
-		 * background dirty threshold
+		 * background dirty threshold (of the memcg, if for one)
 		 */
-		if (work->for_background && !over_bground_thresh())
+		if (work->for_background && !over_bground_thresh(work->memcg_id))
 			break;
 
 		wbc.more_io = 0;
@@ -649,6 +736,7 @@ static long wb_writeback(struct bdi_writeback *wb,
 		else
 			writeback_inodes_wb(wb, &wbc);
 		trace_wbc_writeback_written(&wbc, wb->bdi);
+		bdi_update_bandwidth(wb->bdi);
 
 		work->nr_pages -= MAX_WRITEBACK_PAGES - wbc.nr_to_write;
 		wrote += MAX_WRITEBACK_PAGES - wbc.nr_to_write;
@@ -668,6 +756,12 @@ static long wb_writeback(struct bdi_writeback *wb,
 		 */
 		if (wbc.nr_to_write < MAX_WRITEBACK_PAGES)
 			continue;
+		/*
+		 * Nothing of the memcg's could be written: leave its
+		 * dirtiers to queue more work rather than spin here.
+		 */
+		if (work->memcg_id)
+			break;
 		/*
 		 * Nothing written. Wait for some inode to
 		 * become available for writeback. Otherwise
@@ -761,6 +855,12 @@ long wb_do_writeback(struct bdi_writeback *wb, int force_wait)
 
 		wrote += wb_writeback(wb, work);
 
+		if (work->memcg_id) {
+			spin_lock_bh(&bdi->wb_lock);
+			list_del(&work->memcg_list);
+			spin_unlock_bh(&bdi->wb_lock);
+		}
+
 		/*
 		 * Notify the caller of completion if this is a synchronous
 		 * work item, otherwise just free it.
@@ -28,6 +28,7 @@
 #include <linux/security.h>
 #include <linux/writeback.h>		/* for the emergency remount stuff */
 #include <linux/idr.h>
+#include <linux/cleancache.h>
 #include <linux/mutex.h>
 #include <linux/backing-dev.h>
 #include "internal.h"
@@ -108,6 +109,7 @@ static struct super_block *alloc_super(struct file_system_type *type)
 		init_rwsem(&s->s_dquot.dqptr_sem);
 		init_waitqueue_head(&s->s_wait_unfrozen);
 		s->s_maxbytes = MAX_NON_LFS;
+		s->cleancache_poolid = -1;
 		s->s_op = &default_op;
 		s->s_time_gran = 1000000000;
 	}
@@ -175,6 +177,7 @@ void deactivate_locked_super(struct super_block *s)
 {
 	struct file_system_type *fs = s->s_type;
 	if (atomic_dec_and_test(&s->s_active)) {
+		cleancache_invalidate_fs(s);
 		fs->kill_sb(s);
 		put_filesystem(fs);
 		put_super(s);
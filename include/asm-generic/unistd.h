@@ -646,9 +646,20 @@ __SYSCALL(__NR_prlimit64, sys_prlimit64)
 __SYSCALL(__NR_fanotify_init, sys_fanotify_init)
 #define __NR_fanotify_mark 263
 __SYSCALL(__NR_fanotify_mark, sys_fanotify_mark)
+/* 264 - 269 are reserved for the upstream numbering */
+__SYSCALL(264, sys_ni_syscall)
+__SYSCALL(265, sys_ni_syscall)
+__SYSCALL(266, sys_ni_syscall)
+__SYSCALL(267, sys_ni_syscall)
+__SYSCALL(268, sys_ni_syscall)
+__SYSCALL(269, sys_ni_syscall)
+#define __NR_process_vm_readv 270
+__SYSCALL(__NR_process_vm_readv, sys_process_vm_readv)
+#define __NR_process_vm_writev 271
+__SYSCALL(__NR_process_vm_writev, sys_process_vm_writev)
 
 #undef __NR_syscalls
-#define __NR_syscalls 264
+#define __NR_syscalls 272
 
 /*
  * All syscalls below here should go away really,
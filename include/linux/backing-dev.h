@@ -40,11 +40,15 @@ typedef int (congested_fn)(void *, int);
 enum bdi_stat_item {
 	BDI_RECLAIMABLE,
 	BDI_WRITEBACK,
+	BDI_WRITTEN,
 	NR_BDI_STAT_ITEMS
 };
 
 #define BDI_STAT_BATCH (8*(1+ilog2(nr_cpu_ids)))
 
+/* write bandwidth a bdi starts with, in pages per second (100MB/s) */
+#define INIT_BW		(100 << (20 - PAGE_SHIFT))
+
 struct bdi_writeback {
 	struct backing_dev_info *bdi;	/* our parent bdi */
 	unsigned int nr;
@@ -76,13 +80,19 @@ struct backing_dev_info {
 	struct prop_local_percpu completions;
 	int dirty_exceeded;
 
+	unsigned long bw_time_stamp;	/* last time write bw was updated */
+	unsigned long written_stamp;	/* BDI_WRITTEN at bw_time_stamp */
+	unsigned long write_bandwidth;	/* estimated, in pages per second */
+	unsigned long avg_write_bandwidth; /* ... further smoothed */
+
 	unsigned int min_ratio;
 	unsigned int max_ratio, max_prop_frac;
 
 	struct bdi_writeback wb;  /* default writeback info for this bdi */
-	spinlock_t wb_lock;	  /* protects work_list */
+	spinlock_t wb_lock;	  /* protects work_list, memcg_work_list */
 
 	struct list_head work_list;
+	struct list_head memcg_work_list; /* memcg works queued or running */
 
 	struct device *dev;
 
@@ -104,6 +114,8 @@ void bdi_unregister(struct backing_dev_info *bdi);
 int bdi_setup_and_register(struct backing_dev_info *, char *, unsigned int);
 void bdi_start_writeback(struct backing_dev_info *bdi, long nr_pages);
 void bdi_start_background_writeback(struct backing_dev_info *bdi);
+void bdi_start_memcg_writeback(struct backing_dev_info *bdi,
+			       unsigned short memcg_id);
 int bdi_writeback_thread(void *data);
 int bdi_has_dirty_io(struct backing_dev_info *bdi);
 void bdi_arm_supers_timer(void);
@@ -183,6 +195,7 @@ static inline s64 bdi_stat_sum(struct backing_dev_info *bdi,
 }
 
 extern void bdi_writeout_inc(struct backing_dev_info *bdi);
+extern void bdi_update_bandwidth(struct backing_dev_info *bdi);
 
 /*
  * maximal error of a stat counter.
@@ -0,0 +1,129 @@
+#ifndef _LINUX_CLEANCACHE_H
+#define _LINUX_CLEANCACHE_H
+/*
+ * Cleancache: a second chance for clean page cache pages.
+ *
+ * When reclaim drops a clean, uptodate page of a filesystem that opted
+ * in, the page is offered to a backend registered with
+ * cleancache_register_ops().  A later page cache miss asks the backend
+ * before reading from disk.  The backend may drop what it holds at any
+ * time; a get is exclusive, so a page is never in both caches.
+ *
+ * Pages are named by (pool, inode number, page index); each opted-in
+ * superblock gets its own pool.
+ *
+ * See Documentation/vm/cleancache.txt.
+ */
+
+#include <linux/fs.h>
+#include <linux/mm.h>
+
+struct cleancache_ops {
+	/* a filesystem opted in: returns a pool id, or < 0 on failure */
+	int (*init_fs)(size_t pagesize);
+	/* fill @page from (@ino, @index) and drop the copy: 0 if found */
+	int (*get_page)(int pool_id, ino_t ino, pgoff_t index,
+			struct page *page);
+	/* take a copy of @page for (@ino, @index); may silently fail */
+	void (*put_page)(int pool_id, ino_t ino, pgoff_t index,
+			 struct page *page);
+	void (*invalidate_page)(int pool_id, ino_t ino, pgoff_t index);
+	void (*invalidate_inode)(int pool_id, ino_t ino);
+	void (*invalidate_fs)(int pool_id);
+};
+
+#ifdef CONFIG_CLEANCACHE
+
+extern bool cleancache_enabled;
+extern struct cleancache_ops
+	cleancache_register_ops(struct cleancache_ops *ops);
+
+extern void __cleancache_init_fs(struct super_block *sb);
+extern int __cleancache_get_page(struct page *page);
+extern void __cleancache_put_page(struct page *page);
+extern void __cleancache_invalidate_page(struct address_space *mapping,
+					 struct page *page);
+extern void __cleancache_invalidate_inode(struct address_space *mapping);
+extern void __cleancache_invalidate_fs(struct super_block *sb);
+
+#else /* CONFIG_CLEANCACHE */
+
+#define cleancache_enabled (0)
+
+static inline void __cleancache_init_fs(struct super_block *sb)
+{
+}
+
+static inline int __cleancache_get_page(struct page *page)
+{
+	return -1;
+}
+
+static inline void __cleancache_put_page(struct page *page)
+{
+}
+
+static inline void __cleancache_invalidate_page(struct address_space *mapping,
+						struct page *page)
+{
+}
+
+static inline void __cleancache_invalidate_inode(struct address_space *mapping)
+{
+}
+
+static inline void __cleancache_invalidate_fs(struct super_block *sb)
+{
+}
+
+#endif /* CONFIG_CLEANCACHE */
+
+/*
+ * Called by a filesystem from its fill_super to have its clean pages
+ * kept in cleancache.  The filesystem must guarantee that an inode's
+ * contents change only through the page cache (or that it invalidates
+ * the inode itself), and that inode numbers are stable and unique.
+ */
+static inline void cleancache_init_fs(struct super_block *sb)
+{
+	if (cleancache_enabled)
+		__cleancache_init_fs(sb);
+}
+
+/*
+ * Fill a locked, !uptodate page cache page from cleancache.  Returns 0
+ * on success, in which case no read is needed.
+ */
+static inline int cleancache_get_page(struct page *page)
+{
+	if (cleancache_enabled)
+		return __cleancache_get_page(page);
+	return -1;
+}
+
+static inline void cleancache_put_page(struct page *page)
+{
+	if (cleancache_enabled)
+		__cleancache_put_page(page);
+}
+
+static inline void cleancache_invalidate_page(struct address_space *mapping,
+					      struct page *page)
+{
+	if (cleancache_enabled)
+		__cleancache_invalidate_page(mapping, page);
+}
+
+static inline void cleancache_invalidate_inode(struct address_space *mapping)
+{
+	if (cleancache_enabled)
+		__cleancache_invalidate_inode(mapping);
+}
+
+static inline void cleancache_invalidate_fs(struct super_block *sb)
+{
+	if (cleancache_enabled)
+		__cleancache_invalidate_fs(sb);
+}
+
+#endif /* _LINUX_CLEANCACHE_H */
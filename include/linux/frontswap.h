@@ -0,0 +1,149 @@
+#ifndef _LINUX_FRONTSWAP_H
+#define _LINUX_FRONTSWAP_H
+/*
+ * Frontswap: a synchronous hook in front of the swap device.
+ *
+ * A backend registered with frontswap_register_ops() is offered every
+ * page on its way to swap, before any bio is built.  If it accepts the
+ * page, the page is never written to the device and is read back from
+ * the backend on swapin instead.  A per swap type bitmap records which
+ * slots the backend holds.
+ *
+ * See Documentation/vm/frontswap.txt.
+ */
+
+#include <linux/swap.h>
+#include <linux/mm.h>
+#include <linux/bitops.h>
+
+struct frontswap_ops {
+	/* a swap type was enabled: set up to receive its pages */
+	void (*init)(unsigned type);
+	/* take a copy of @page for slot @offset: 0 if taken */
+	int (*store)(unsigned type, pgoff_t offset, struct page *page);
+	/* fill @page from slot @offset: 0 if found */
+	int (*load)(unsigned type, pgoff_t offset, struct page *page);
+	/* slot @offset was freed */
+	void (*invalidate_page)(unsigned type, pgoff_t offset);
+	/* the swap type is going away: drop all its slots */
+	void (*invalidate_area)(unsigned type);
+};
+
+#ifdef CONFIG_FRONTSWAP
+
+extern bool frontswap_enabled;
+extern struct frontswap_ops
+	frontswap_register_ops(struct frontswap_ops *ops);
+extern unsigned long frontswap_curr_pages(void);
+
+extern void __frontswap_init(struct swap_info_struct *sis);
+extern int __frontswap_store(struct page *page);
+extern int __frontswap_load(struct page *page);
+extern void __frontswap_invalidate_page(struct swap_info_struct *sis,
+					pgoff_t offset);
+extern void __frontswap_invalidate_area(struct swap_info_struct *sis);
+
+static inline unsigned long *frontswap_map_get(struct swap_info_struct *p)
+{
+	return p->frontswap_map;
+}
+
+static inline void frontswap_map_set(struct swap_info_struct *p,
+				     unsigned long *map)
+{
+	p->frontswap_map = map;
+}
+
+static inline bool frontswap_test(struct swap_info_struct *sis,
+				  pgoff_t offset)
+{
+	return sis->frontswap_map && test_bit(offset, sis->frontswap_map);
+}
+
+#else /* CONFIG_FRONTSWAP */
+
+#define frontswap_enabled (0)
+
+static inline unsigned long *frontswap_map_get(struct swap_info_struct *p)
+{
+	return NULL;
+}
+
+static inline void frontswap_map_set(struct swap_info_struct *p,
+				     unsigned long *map)
+{
+}
+
+static inline bool frontswap_test(struct swap_info_struct *sis,
+				  pgoff_t offset)
+{
+	return false;
+}
+
+static inline void __frontswap_init(struct swap_info_struct *sis)
+{
+}
+
+static inline int __frontswap_store(struct page *page)
+{
+	return -1;
+}
+
+static inline int __frontswap_load(struct page *page)
+{
+	return -1;
+}
+
+static inline void __frontswap_invalidate_page(struct swap_info_struct *sis,
+					       pgoff_t offset)
+{
+}
+
+static inline void __frontswap_invalidate_area(struct swap_info_struct *sis)
+{
+}
+
+#endif /* CONFIG_FRONTSWAP */
+
+static inline void frontswap_init(struct swap_info_struct *sis)
+{
+	if (frontswap_enabled)
+		__frontswap_init(sis);
+}
+
+/*
+ * Offer a locked swapcache page to the backend before it is written to
+ * the swap device.  Returns 0 if the backend took it.
+ */
+static inline int frontswap_store(struct page *page)
+{
+	if (frontswap_enabled)
+		return __frontswap_store(page);
+	return -1;
+}
+
+/*
+ * Fill a locked swapcache page from the backend.  Returns 0 on success,
+ * in which case no read from the swap device is needed.
+ */
+static inline int frontswap_load(struct page *page)
+{
+	if (frontswap_enabled)
+		return __frontswap_load(page);
+	return -1;
+}
+
+static inline void frontswap_invalidate_page(struct swap_info_struct *sis,
+					     pgoff_t offset)
+{
+	if (frontswap_enabled)
+		__frontswap_invalidate_page(sis, offset);
+}
+
+static inline void frontswap_invalidate_area(struct swap_info_struct *sis)
+{
+	if (frontswap_enabled)
+		__frontswap_invalidate_area(sis);
+}
+
+#endif /* _LINUX_FRONTSWAP_H */
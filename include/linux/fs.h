@@ -150,6 +150,12 @@ struct inodes_stat_t {
 #define WRITE			RW_MASK
 #define READA			RWA_MASK
 
+/*
+ * rw_copy_check_uvector() type for iovecs that describe another address
+ * space: validate lengths only, do not access_ok() the buffers.
+ */
+#define CHECK_IOVEC_ONLY	-1
+
 #define READ_SYNC		(READ | REQ_SYNC | REQ_UNPLUG)
 #define READ_META		(READ | REQ_META)
 #define WRITE_SYNC_PLUG		(WRITE | REQ_SYNC | REQ_NOIDLE)
@@ -636,6 +642,9 @@ struct address_space {
 	spinlock_t		private_lock;	/* for use by the address_space */
 	struct list_head	private_list;	/* ditto */
 	struct address_space	*assoc_mapping;	/* ditto */
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR
+	unsigned short		i_memcg;	/* css id of last dirtier */
+#endif
 } __attribute__((aligned(sizeof(long))));
 	/*
 	 * On most architectures that alignment is already the case; but
@@ -1385,6 +1394,12 @@ struct super_block {
 	 * generic_show_options()
 	 */
 	char *s_options;
+
+	/*
+	 * Cleancache pool holding this filesystem's evicted clean pages,
+	 * or -1 if it did not opt in with cleancache_init_fs().
+	 */
+	int cleancache_poolid;
 };
 
 extern struct timespec current_fs_time(struct super_block *sb);
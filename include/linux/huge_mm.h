@@ -0,0 +1,218 @@
+#ifndef _LINUX_HUGE_MM_H
+#define _LINUX_HUGE_MM_H
+/*
+ * Transparent huge pages for anonymous memory and shmem.
+ *
+ * A huge pmd maps HPAGE_PMD_NR naturally aligned, physically contiguous
+ * order-0 pages.  Each of them keeps its own reference count, mapcount,
+ * rmap and LRU position, so turning the huge pmd back into a pte table
+ * (a "split") only touches page tables.
+ */
+
+#include <linux/mm.h>
+#include <linux/sched.h>
+
+struct mmu_gather;
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+
+#define HPAGE_PMD_SHIFT		PMD_SHIFT
+#define HPAGE_PMD_SIZE		(1UL << HPAGE_PMD_SHIFT)
+#define HPAGE_PMD_MASK		(~(HPAGE_PMD_SIZE - 1))
+#define HPAGE_PMD_ORDER		(HPAGE_PMD_SHIFT - PAGE_SHIFT)
+#define HPAGE_PMD_NR		(1 << HPAGE_PMD_ORDER)
+
+enum transparent_hugepage_mode {
+	TRANSPARENT_HUGEPAGE_NEVER,
+	TRANSPARENT_HUGEPAGE_MADVISE,
+	TRANSPARENT_HUGEPAGE_ALWAYS,
+};
+
+extern int transparent_hugepage_mode;
+
+/* vmas that can never be backed by transparent huge pages */
+#define VM_NO_THP	(VM_SPECIAL | VM_MIXEDMAP | VM_INSERTPAGE | VM_SAO | \
+			 VM_HUGETLB | VM_SHARED | VM_MAYSHARE | \
+			 VM_GROWSDOWN | VM_GROWSUP | VM_NOHUGEPAGE)
+
+/*
+ * Whether page faults in @vma may be served with huge pmds.  Only
+ * private anonymous memory qualifies.
+ */
+static inline int transparent_hugepage_enabled(struct vm_area_struct *vma)
+{
+	if (vma->vm_ops || (vma->vm_flags & VM_NO_THP))
+		return 0;
+	if (transparent_hugepage_mode == TRANSPARENT_HUGEPAGE_ALWAYS)
+		return 1;
+	return transparent_hugepage_mode == TRANSPARENT_HUGEPAGE_MADVISE &&
+		(vma->vm_flags & VM_HUGEPAGE);
+}
+
+extern int do_huge_pmd_anonymous_page(struct mm_struct *mm,
+				      struct vm_area_struct *vma,
+				      unsigned long address, pmd_t *pmd,
+				      unsigned int flags);
+extern int do_huge_pmd_file_page(struct vm_area_struct *vma,
+				 unsigned long address, pmd_t *pmd,
+				 struct address_space *mapping, pgoff_t index);
+extern struct page *follow_trans_huge_pmd(struct vm_area_struct *vma,
+					  unsigned long address, pmd_t *pmd,
+					  unsigned int flags);
+extern int zap_huge_pmd(struct mmu_gather *tlb, struct vm_area_struct *vma,
+			pmd_t *pmd);
+extern int mincore_huge_pmd(struct vm_area_struct *vma, pmd_t *pmd,
+			    unsigned long addr, unsigned long end,
+			    unsigned char *vec);
+extern int page_referenced_huge_pmd(struct page *page,
+				    struct vm_area_struct *vma,
+				    unsigned long address);
+extern void __split_huge_page_pmd(struct mm_struct *mm, pmd_t *pmd);
+extern void __split_huge_page_vma(struct vm_area_struct *vma);
+extern void __vma_adjust_trans_huge(struct vm_area_struct *vma,
+				    unsigned long start, unsigned long end,
+				    long adjust_next);
+extern int hugepage_madvise(struct vm_area_struct *vma,
+			    unsigned long *vm_flags, int advice);
+extern int __khugepaged_enter(struct mm_struct *mm);
+extern void __khugepaged_exit(struct mm_struct *mm);
+
+/*
+ * Turn a huge pmd back into a pte table mapping the same pages.  Must
+ * be called before walking ptes below a pmd that may be huge.
+ */
+static inline void split_huge_page_pmd(struct mm_struct *mm, pmd_t *pmd)
+{
+	if (unlikely(pmd_trans_huge(*pmd)))
+		__split_huge_page_pmd(mm, pmd);
+}
+
+/* Whether @vma may contain huge pmds at all */
+static inline int vma_may_map_huge_pmd(struct vm_area_struct *vma)
+{
+	if (vma->vm_ops)
+		return vma->vm_ops->pmd_fault != NULL;
+	return vma->anon_vma != NULL;
+}
+
+/*
+ * A huge pmd must never straddle a vma boundary: split the ones that
+ * vma_adjust() is about to cut through.
+ */
+static inline void vma_adjust_trans_huge(struct vm_area_struct *vma,
+					 unsigned long start,
+					 unsigned long end,
+					 long adjust_next)
+{
+	if (vma_may_map_huge_pmd(vma))
+		__vma_adjust_trans_huge(vma, start, end, adjust_next);
+}
+
+/* Split every huge pmd in @vma, before it is made nonlinear */
+static inline void split_huge_page_vma(struct vm_area_struct *vma)
+{
+	if (vma_may_map_huge_pmd(vma))
+		__split_huge_page_vma(vma);
+}
+
+static inline int khugepaged_enter(struct vm_area_struct *vma)
+{
+	if (!test_bit(MMF_VM_HUGEPAGE, &vma->vm_mm->flags) &&
+	    transparent_hugepage_enabled(vma))
+		return __khugepaged_enter(vma->vm_mm);
+	return 0;
+}
+
+static inline void khugepaged_exit(struct mm_struct *mm)
+{
+	if (test_bit(MMF_VM_HUGEPAGE, &mm->flags))
+		__khugepaged_exit(mm);
+}
+
+#else /* CONFIG_TRANSPARENT_HUGEPAGE */
+
+#define HPAGE_PMD_SIZE		({ BUG(); 0; })
+#define HPAGE_PMD_MASK		({ BUG(); 0; })
+#define HPAGE_PMD_NR		({ BUG(); 0; })
+
+static inline int transparent_hugepage_enabled(struct vm_area_struct *vma)
+{
+	return 0;
+}
+
+static inline int do_huge_pmd_anonymous_page(struct mm_struct *mm,
+					     struct vm_area_struct *vma,
+					     unsigned long address, pmd_t *pmd,
+					     unsigned int flags)
+{
+	return VM_FAULT_FALLBACK;
+}
+
+static inline int do_huge_pmd_file_page(struct vm_area_struct *vma,
+					unsigned long address, pmd_t *pmd,
+					struct address_space *mapping,
+					pgoff_t index)
+{
+	return VM_FAULT_FALLBACK;
+}
+
+static inline struct page *follow_trans_huge_pmd(struct vm_area_struct *vma,
+						 unsigned long address,
+						 pmd_t *pmd, unsigned int flags)
+{
+	return NULL;
+}
+
+static inline int zap_huge_pmd(struct mmu_gather *tlb,
+			       struct vm_area_struct *vma, pmd_t *pmd)
+{
+	return 0;
+}
+
+static inline int mincore_huge_pmd(struct vm_area_struct *vma, pmd_t *pmd,
+				   unsigned long addr, unsigned long end,
+				   unsigned char *vec)
+{
+	return 0;
+}
+
+static inline int page_referenced_huge_pmd(struct page *page,
+					   struct vm_area_struct *vma,
+					   unsigned long address)
+{
+	return -1;
+}
+
+static inline void split_huge_page_pmd(struct mm_struct *mm, pmd_t *pmd)
+{
+}
+
+static inline void split_huge_page_vma(struct vm_area_struct *vma)
+{
+}
+
+static inline void vma_adjust_trans_huge(struct vm_area_struct *vma,
+					 unsigned long start,
+					 unsigned long end,
+					 long adjust_next)
+{
+}
+
+static inline int hugepage_madvise(struct vm_area_struct *vma,
+				   unsigned long *vm_flags, int advice)
+{
+	return -EINVAL;
+}
+
+static inline int khugepaged_enter(struct vm_area_struct *vma)
+{
+	return 0;
+}
+
+static inline void khugepaged_exit(struct mm_struct *mm)
+{
+}
+
+#endif /* CONFIG_TRANSPARENT_HUGEPAGE */
+
+#endif /* _LINUX_HUGE_MM_H */
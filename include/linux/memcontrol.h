@@ -24,6 +24,23 @@ struct mem_cgroup;
 struct page_cgroup;
 struct page;
 struct mm_struct;
+struct address_space;
+
+/* Stats that can be updated by kernel. */
+enum mem_cgroup_page_stat_item {
+	MEMCG_NR_FILE_MAPPED, /* # of pages charged as file rss */
+	MEMCG_NR_FILE_DIRTY, /* # of dirty pages in page cache */
+	MEMCG_NR_FILE_WRITEBACK, /* # of pages under writeback */
+};
+
+/* The dirty state and limits of a memory cgroup, in pages. */
+struct mem_cgroup_dirty_info {
+	unsigned long dirty_thresh;
+	unsigned long background_thresh;
+	unsigned long nr_file_dirty;
+	unsigned long nr_writeback;
+	unsigned short id;		/* css id, to target writeback */
+};
 
 extern unsigned long mem_cgroup_isolate_pages(unsigned long nr_to_scan,
 					struct list_head *dst,
@@ -121,7 +138,27 @@ static inline bool mem_cgroup_disabled(void)
 	return false;
 }
 
-void mem_cgroup_update_file_mapped(struct page *page, int val);
+void mem_cgroup_update_page_stat(struct page *page,
+				 enum mem_cgroup_page_stat_item idx, int val);
+
+static inline void mem_cgroup_inc_page_stat(struct page *page,
+					    enum mem_cgroup_page_stat_item idx)
+{
+	mem_cgroup_update_page_stat(page, idx, 1);
+}
+
+static inline void mem_cgroup_dec_page_stat(struct page *page,
+					    enum mem_cgroup_page_stat_item idx)
+{
+	mem_cgroup_update_page_stat(page, idx, -1);
+}
+
+bool mem_cgroup_dirty_info(unsigned long sys_available_mem,
+			   struct mem_cgroup_dirty_info *info);
+bool mem_cgroup_over_bground_thresh(unsigned short id);
+bool mem_cgroup_mapping_dirtied_by(struct address_space *mapping,
+				   unsigned short id);
+
 unsigned long mem_cgroup_soft_limit_reclaim(struct zone *zone, int order,
 						gfp_t gfp_mask);
 u64 mem_cgroup_get_limit(struct mem_cgroup *mem);
@@ -293,9 +330,36 @@ mem_cgroup_print_oom_info(struct mem_cgroup *memcg, struct task_struct *p)
 {
 }
 
-static inline void mem_cgroup_update_file_mapped(struct page *page,
-							int val)
+static inline void mem_cgroup_update_page_stat(struct page *page,
+				enum mem_cgroup_page_stat_item idx, int val)
+{
+}
+
+static inline void mem_cgroup_inc_page_stat(struct page *page,
+					    enum mem_cgroup_page_stat_item idx)
+{
+}
+
+static inline void mem_cgroup_dec_page_stat(struct page *page,
+					    enum mem_cgroup_page_stat_item idx)
+{
+}
+
+static inline bool mem_cgroup_dirty_info(unsigned long sys_available_mem,
+					 struct mem_cgroup_dirty_info *info)
 {
+	return false;
+}
+
+static inline bool mem_cgroup_over_bground_thresh(unsigned short id)
+{
+	return false;
+}
+
+static inline bool mem_cgroup_mapping_dirtied_by(struct address_space *mapping,
+						 unsigned short id)
+{
+	return true;
 }
 
 static inline
@@ -101,7 +101,11 @@ extern unsigned int kobjsize(const void *objp);
 #define VM_NORESERVE	0x00200000	/* should the VM suppress accounting */
 #define VM_HUGETLB	0x00400000	/* Huge TLB Page VM */
 #define VM_NONLINEAR	0x00800000	/* Is non-linear (remap_file_pages) */
+#ifndef CONFIG_TRANSPARENT_HUGEPAGE
 #define VM_MAPPED_COPY	0x01000000	/* T if mapped copy of data (nommu mmap) */
+#else
+#define VM_HUGEPAGE	0x01000000	/* MADV_HUGEPAGE marked this vma */
+#endif
 #define VM_INSERTPAGE	0x02000000	/* The vma has had "vm_insert_page()" done on it */
 #define VM_ALWAYSDUMP	0x04000000	/* Always include in core dumps */
 
@@ -110,6 +114,17 @@ extern unsigned int kobjsize(const void *objp);
 #define VM_SAO		0x20000000	/* Strong Access Ordering (powerpc) */
 #define VM_PFN_AT_MMAP	0x40000000	/* PFNMAP vma that is fully mapped at mmap time */
 #define VM_MERGEABLE	0x80000000	/* KSM may merge identical pages */
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+#define VM_NOHUGEPAGE	0x100000000UL	/* MADV_NOHUGEPAGE marked this vma */
+#endif
+#ifdef CONFIG_64BIT
+#define VM_LOCKONFAULT	0x200000000UL	/* VM_LOCKED, but only as pages fault in */
+#else
+#define VM_LOCKONFAULT	0		/* no vm_flags bit left: MCL_ONFAULT fails */
+#endif
+
+/* Clears both ways of mlocking a vma */
+#define VM_LOCKED_CLEAR_MASK	(~(VM_LOCKED | VM_LOCKONFAULT))
 
 /* Bits set in the VMA until the stack is in its final location */
 #define VM_STACK_INCOMPLETE_SETUP	(VM_RAND_READ | VM_SEQ_READ)
@@ -203,6 +218,11 @@ struct vm_operations_struct {
 	 */
 	int (*access)(struct vm_area_struct *vma, unsigned long addr,
 		      void *buf, int len, int write);
+
+	/* map a whole pmd-sized range at once where the pmd is still empty,
+	 * returns VM_FAULT_FALLBACK to have ->fault do it page by page */
+	int (*pmd_fault)(struct vm_area_struct *vma, unsigned long address,
+			 pmd_t *pmd, unsigned int flags);
 #ifdef CONFIG_NUMA
 	/*
 	 * set_policy() op must add a reference to any non-NULL @new mempolicy
@@ -722,6 +742,8 @@ static inline int page_mapped(struct page *page)
 
 #define VM_FAULT_NOPAGE	0x0100	/* ->fault installed the pte, not return page */
 #define VM_FAULT_LOCKED	0x0200	/* ->fault locked the returned page */
+#define VM_FAULT_RETRY	0x0400	/* speculative fault failed, retry under mmap_sem */
+#define VM_FAULT_FALLBACK 0x0800	/* huge page fault failed, fall back to small */
 
 #define VM_FAULT_ERROR	(VM_FAULT_OOM | VM_FAULT_SIGBUS | VM_FAULT_HWPOISON)
 
@@ -843,6 +865,17 @@ static inline int handle_mm_fault(struct mm_struct *mm,
 }
 #endif
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+extern int handle_speculative_fault(struct mm_struct *mm,
+			unsigned long address, unsigned int flags);
+#else
+static inline int handle_speculative_fault(struct mm_struct *mm,
+			unsigned long address, unsigned int flags)
+{
+	return VM_FAULT_RETRY;
+}
+#endif
+
 extern int make_pages_present(unsigned long addr, unsigned long end);
 extern int access_process_vm(struct task_struct *tsk, unsigned long addr, void *buf, int len, int write);
 
@@ -1236,6 +1269,50 @@ static inline void vma_nonlinear_insert(struct vm_area_struct *vma,
 	list_add_tail(&vma->shared.vm_set.list, list);
 }
 
+/*
+ * Changes to a vma that a speculative page fault could observe (its
+ * bounds, flags, protection or policy) are bracketed by these, under
+ * the mmap_sem held for writing.
+ */
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+static inline void vma_write_begin(struct vm_area_struct *vma)
+{
+	write_seqcount_begin(&vma->vm_sequence);
+}
+
+static inline void vma_write_end(struct vm_area_struct *vma)
+{
+	write_seqcount_end(&vma->vm_sequence);
+}
+
+/* Brackets mremap moving ptes between two vmas of @mm. */
+static inline void mm_move_begin(struct mm_struct *mm)
+{
+	write_seqcount_begin(&mm->mm_move_sequence);
+}
+
+static inline void mm_move_end(struct mm_struct *mm)
+{
+	write_seqcount_end(&mm->mm_move_sequence);
+}
+#else
+static inline void vma_write_begin(struct vm_area_struct *vma)
+{
+}
+
+static inline void vma_write_end(struct vm_area_struct *vma)
+{
+}
+
+static inline void mm_move_begin(struct mm_struct *mm)
+{
+}
+
+static inline void mm_move_end(struct mm_struct *mm)
+{
+}
+#endif
+
 /* mmap.c */
 extern int __vm_enough_memory(struct mm_struct *mm, long pages, int cap_sys_admin);
 extern int vma_adjust(struct vm_area_struct *vma, unsigned long start,
@@ -1248,6 +1325,7 @@ extern struct anon_vma *find_mergeable_anon_vma(struct vm_area_struct *);
 extern int split_vma(struct mm_struct *,
 	struct vm_area_struct *, unsigned long addr, int new_below);
 extern int insert_vm_struct(struct mm_struct *, struct vm_area_struct *);
+extern void put_vma(struct vm_area_struct *vma);
 extern void __vma_link_rb(struct mm_struct *, struct vm_area_struct *,
 	struct rb_node **, struct rb_node *);
 extern void unlink_file_vma(struct vm_area_struct *);
@@ -1282,7 +1360,7 @@ extern unsigned long do_mmap_pgoff(struct file *file, unsigned long addr,
 	unsigned long flag, unsigned long pgoff);
 extern unsigned long mmap_region(struct file *file, unsigned long addr,
 	unsigned long len, unsigned long flags,
-	unsigned int vm_flags, unsigned long pgoff);
+	unsigned long vm_flags, unsigned long pgoff);
 
 static inline unsigned long do_mmap(struct file *file, unsigned long addr,
 	unsigned long len, unsigned long prot,
@@ -1351,6 +1429,10 @@ extern int expand_stack_downwards(struct vm_area_struct *vma,
 
 /* Look up the first VMA which satisfies  addr < vm_end,  NULL if none. */
 extern struct vm_area_struct * find_vma(struct mm_struct * mm, unsigned long addr);
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+extern struct vm_area_struct *get_vma(struct mm_struct *mm, unsigned long addr,
+				      unsigned int *seq);
+#endif
 extern struct vm_area_struct * find_vma_prev(struct mm_struct * mm, unsigned long addr,
 					     struct vm_area_struct **pprev);
 
@@ -9,6 +9,8 @@
 #include <linux/prio_tree.h>
 #include <linux/rbtree.h>
 #include <linux/rwsem.h>
+#include <linux/seqlock.h>
+#include <linux/rcupdate.h>
 #include <linux/completion.h>
 #include <linux/cpumask.h>
 #include <linux/page-debug-flags.h>
@@ -183,6 +185,15 @@ struct vm_area_struct {
 #ifdef CONFIG_NUMA
 	struct mempolicy *vm_policy;	/* NUMA policy for the VMA */
 #endif
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	seqcount_t vm_sequence;		/* odd while the vma is being changed */
+	atomic_t vm_ref_count;		/* pins the vma for speculative faults */
+	struct rcu_head vm_rcu;		/* freed after a grace period */
+#endif
+#ifdef CONFIG_SWAP
+	/* last swap fault address, readahead window and hits: see swap_state.c */
+	atomic_long_t swap_readahead_info;
+#endif
 };
 
 struct core_thread {
@@ -239,6 +250,19 @@ struct mm_struct {
 	int map_count;				/* number of VMAs */
 	struct rw_semaphore mmap_sem;
 	spinlock_t page_table_lock;		/* Protects page tables and some counters */
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	seqcount_t mm_rb_sequence;		/* odd while mm_rb is rebalanced */
+	seqcount_t mm_move_sequence;		/* odd while mremap moves ptes */
+#endif
+#ifdef CONFIG_ARCH_WANT_BATCHED_UNMAP_TLB_FLUSH
+	/*
+	 * Set when reclaim cleared ptes of this mm without flushing the
+	 * TLB yet.  Changes to ptes under the page table lock must flush
+	 * first (flush_tlb_batched_pending) so that no stale entry outlives
+	 * an munmap or mprotect.
+	 */
+	bool tlb_flush_batched;
+#endif
 
 	struct list_head mmlist;		/* List of maybe swapped mm's.	These are globally strung
 						 * together off init_mm.mmlist, and are protected
@@ -310,6 +334,13 @@ struct mm_struct {
 #ifdef CONFIG_MMU_NOTIFIER
 	struct mmu_notifier_mm *mmu_notifier_mm;
 #endif
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	/*
+	 * Page tables preallocated for huge pmds, so that splitting one
+	 * never has to allocate.  Protected by page_table_lock.
+	 */
+	pgtable_t pmd_huge_pte;
+#endif
 };
 
 /* Future-safe accessor for struct mm_struct's cpu_vm_mask. */
@@ -41,6 +41,9 @@ enum {
 	PCG_ACCT_LRU, /* page has been accounted for */
 	PCG_FILE_MAPPED, /* page is accounted as "mapped" */
 	PCG_MIGRATION, /* under page migration */
+	PCG_FILE_DIRTY, /* page is accounted as "dirty" */
+	PCG_FILE_WRITEBACK, /* page is accounted as "writeback" */
+	PCG_MOVE_LOCK, /* serializes stat updates against move_account */
 };
 
 #define TESTPCGFLAG(uname, lname)			\
@@ -55,6 +58,10 @@ static inline void SetPageCgroup##uname(struct page_cgroup *pc)\
 static inline void ClearPageCgroup##uname(struct page_cgroup *pc)	\
 	{ clear_bit(PCG_##lname, &pc->flags);  }
 
+#define TESTSETPCGFLAG(uname, lname)			\
+static inline int TestSetPageCgroup##uname(struct page_cgroup *pc)	\
+	{ return test_and_set_bit(PCG_##lname, &pc->flags);  }
+
 #define TESTCLEARPCGFLAG(uname, lname)			\
 static inline int TestClearPageCgroup##uname(struct page_cgroup *pc)	\
 	{ return test_and_clear_bit(PCG_##lname, &pc->flags);  }
@@ -79,6 +86,16 @@ TESTCLEARPCGFLAG(AcctLRU, ACCT_LRU)
 SETPCGFLAG(FileMapped, FILE_MAPPED)
 CLEARPCGFLAG(FileMapped, FILE_MAPPED)
 TESTPCGFLAG(FileMapped, FILE_MAPPED)
+TESTSETPCGFLAG(FileMapped, FILE_MAPPED)
+TESTCLEARPCGFLAG(FileMapped, FILE_MAPPED)
+
+TESTPCGFLAG(FileDirty, FILE_DIRTY)
+TESTSETPCGFLAG(FileDirty, FILE_DIRTY)
+TESTCLEARPCGFLAG(FileDirty, FILE_DIRTY)
+
+TESTPCGFLAG(FileWriteback, FILE_WRITEBACK)
+TESTSETPCGFLAG(FileWriteback, FILE_WRITEBACK)
+TESTCLEARPCGFLAG(FileWriteback, FILE_WRITEBACK)
 
 SETPCGFLAG(Migration, MIGRATION)
 CLEARPCGFLAG(Migration, MIGRATION)
@@ -104,6 +121,25 @@ static inline void unlock_page_cgroup(struct page_cgroup *pc)
 	bit_spin_unlock(PCG_LOCK, &pc->flags);
 }
 
+/*
+ * The dirty and writeback statistics change from interrupt context when
+ * writeback completes, so they are protected by their own irq-safe bit
+ * lock rather than by lock_page_cgroup().  Nests inside lock_page_cgroup().
+ */
+static inline void move_lock_page_cgroup(struct page_cgroup *pc,
+					 unsigned long *flags)
+{
+	local_irq_save(*flags);
+	bit_spin_lock(PCG_MOVE_LOCK, &pc->flags);
+}
+
+static inline void move_unlock_page_cgroup(struct page_cgroup *pc,
+					   unsigned long *flags)
+{
+	bit_spin_unlock(PCG_MOVE_LOCK, &pc->flags);
+	local_irq_restore(*flags);
+}
+
 #else /* CONFIG_CGROUP_MEM_RES_CTLR */
 struct page_cgroup;
 
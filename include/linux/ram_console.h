@@ -0,0 +1,41 @@
+/* include/linux/ram_console.h
+ *
+ * Interface to the Android RAM console and its persistent event log.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef _LINUX_RAM_CONSOLE_H
+#define _LINUX_RAM_CONSOLE_H
+
+#include <linux/types.h>
+
+/* event types recorded in the persistent event log */
+enum ram_console_event_type {
+	RAM_CONSOLE_EVENT_NONE = 0,
+	RAM_CONSOLE_EVENT_SCHED_SWITCH,	/* arg0 prev pid, arg1 next pid */
+	RAM_CONSOLE_EVENT_IRQ,		/* arg0 irq */
+	RAM_CONSOLE_EVENT_USER = 0x100,	/* first type free for drivers */
+};
+
+void ram_console_enable_console(int enabled);
+
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_EVENT_LOG
+void ram_console_log_event(unsigned int type, u32 arg0, u32 arg1,
+			   const char *comm);
+#else
+static inline void ram_console_log_event(unsigned int type, u32 arg0,
+					 u32 arg1, const char *comm)
+{
+}
+#endif
+
+#endif /* _LINUX_RAM_CONSOLE_H */
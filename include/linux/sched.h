@@ -428,6 +428,7 @@ extern int get_dumpable(struct mm_struct *mm);
 #endif
 					/* leave room for more dump flags */
 #define MMF_VM_MERGEABLE	16	/* KSM may merge identical pages */
+#define MMF_VM_HUGEPAGE		17	/* registered with khugepaged */
 
 #define MMF_INIT_MASK		(MMF_DUMPABLE_MASK | MMF_DUMP_FILTER_MASK)
 
@@ -1161,6 +1162,25 @@ struct sched_rt_entity {
 
 struct rcu_node;
 
+/*
+ * Page reclaim clears ptes without flushing their TLB entries right
+ * away, and flushes all the cpus that may hold them at once later.
+ */
+struct tlbflush_unmap_batch {
+	/* cpus that may hold stale entries for the ptes cleared */
+	struct cpumask cpumask;
+
+	/* true if the batch holds ptes whose TLB entries need a flush */
+	bool flush_required;
+
+	/*
+	 * True if some of the ptes were dirty: a cpu may still write to
+	 * their pages through its TLB until the flush, so it has to happen
+	 * before any of them is written back.
+	 */
+	bool writable;
+};
+
 struct task_struct {
 	volatile long state;	/* -1 unrunnable, 0 runnable, >0 stopped */
 	void *stack;
@@ -1221,6 +1241,9 @@ struct task_struct {
 #if defined(SPLIT_RSS_COUNTING)
 	struct task_rss_stat	rss_stat;
 #endif
+#ifdef CONFIG_ARCH_WANT_BATCHED_UNMAP_TLB_FLUSH
+	struct tlbflush_unmap_batch tlb_ubc;
+#endif
 /* task state */
 	int exit_state;
 	int exit_code, exit_signal;
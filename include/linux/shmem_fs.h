@@ -32,8 +32,14 @@ struct shmem_sb_info {
 	gid_t gid;		    /* Mount gid for root directory */
 	mode_t mode;		    /* Mount mode for root directory */
 	struct mempolicy *mpol;     /* default memory policy for mappings */
+	int huge;		    /* SHMEM_HUGE_* for files in this instance */
 };
 
+/* when to back a file with huge pages, see Documentation/filesystems/tmpfs.txt */
+#define SHMEM_HUGE_NEVER	0
+#define SHMEM_HUGE_WITHIN_SIZE	1
+#define SHMEM_HUGE_ALWAYS	2
+
 static inline struct shmem_inode_info *SHMEM_I(struct inode *inode)
 {
 	return container_of(inode, struct shmem_inode_info, vfs_inode);
@@ -42,4 +48,14 @@ static inline struct shmem_inode_info *SHMEM_I(struct inode *inode)
 extern int init_tmpfs(void);
 extern int shmem_fill_super(struct super_block *sb, void *data, int silent);
 
+/* the policy of the internal mount, for SysV shm and shared anon memory */
+extern int shmem_huge;
+extern int shmem_parse_huge(const char *str);
+extern const char *shmem_format_huge(int huge);
+#if defined(CONFIG_SHMEM) && defined(CONFIG_TRANSPARENT_HUGEPAGE)
+extern unsigned long shmem_get_unmapped_area(struct file *file,
+		unsigned long addr, unsigned long len,
+		unsigned long pgoff, unsigned long flags);
+#endif
+
 #endif
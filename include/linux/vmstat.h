@@ -43,13 +43,37 @@ enum vm_event_item { PGPGIN, PGPGOUT, PSWPIN, PSWPOUT,
 		KSWAPD_LOW_WMARK_HIT_QUICKLY, KSWAPD_HIGH_WMARK_HIT_QUICKLY,
 		KSWAPD_SKIP_CONGESTION_WAIT,
 		PAGEOUTRUN, ALLOCSTALL, PGROTATED,
+		WORKINGSET_REFAULT, WORKINGSET_ACTIVATE,
+		PGLAZYFREE, PGLAZYFREED,
 #ifdef CONFIG_COMPACTION
 		COMPACTBLOCKS, COMPACTPAGES, COMPACTPAGEFAILED,
 		COMPACTSTALL, COMPACTFAIL, COMPACTSUCCESS,
+		COMPACTD_WAKE, COMPACTD_FAIL, COMPACTD_SUCCESS,
 #endif
 #ifdef CONFIG_HUGETLB_PAGE
 		HTLB_BUDDY_PGALLOC, HTLB_BUDDY_PGALLOC_FAIL,
 #endif
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+		THP_FAULT_ALLOC, THP_FAULT_FALLBACK,
+		THP_COLLAPSE_ALLOC, THP_COLLAPSE_ALLOC_FAILED,
+		THP_SPLIT,
+		THP_FILE_ALLOC, THP_FILE_MAPPED,
+#endif
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+		SPF_FAULT, SPF_FAULT_ABORT,
+#endif
+#ifdef CONFIG_SWAP
+		SWAP_RA,	/* pages read ahead on swapin */
+		SWAP_RA_HIT,	/* ... and later faulted on */
+#endif
+#ifdef CONFIG_DEBUG_TLBFLUSH
+		NR_TLB_REMOTE_FLUSH,	/* cpu tried to flush others' tlbs */
+		NR_TLB_REMOTE_FLUSH_RECEIVED,/* cpu received ipi for flush */
+		NR_TLB_LOCAL_FLUSH_ALL,
+		NR_TLB_LOCAL_FLUSH_ONE,
+#endif
+		VMAP_LAZY_PURGE,	/* lazy vunmap purges (TLB flushes) */
+		VMAP_LAZY_PURGE_PAGES,	/* ... and the pages they unmapped */
 		UNEVICTABLE_PGCULLED,	/* culled to noreclaim list */
 		UNEVICTABLE_PGSCANNED,	/* scanned for reclaimability */
 		UNEVICTABLE_PGRESCUED,	/* rescued from noreclaim list */
@@ -63,6 +87,14 @@ enum vm_event_item { PGPGIN, PGPGOUT, PSWPIN, PSWPOUT,
 
 extern int sysctl_stat_interval;
 
+#ifdef CONFIG_DEBUG_TLBFLUSH
+#define count_vm_tlb_event(x)	   count_vm_event(x)
+#define count_vm_tlb_events(x, y)  count_vm_events(x, y)
+#else
+#define count_vm_tlb_event(x)	   do {} while (0)
+#define count_vm_tlb_events(x, y)  do { (void)(y); } while (0)
+#endif
+
 #ifdef CONFIG_VM_EVENT_COUNTERS
 /*
  * Light weight per cpu counter implementation.
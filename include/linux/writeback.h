@@ -52,6 +52,8 @@ struct writeback_control {
 	unsigned for_reclaim:1;		/* Invoked from the page allocator */
 	unsigned range_cyclic:1;	/* range_start is cyclic */
 	unsigned more_io:1;		/* more io to be dispatched */
+	unsigned short memcg_id;	/* If !0, only write back inodes
+					   last dirtied by this memcg */
 };
 
 /*
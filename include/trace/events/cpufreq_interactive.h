@@ -0,0 +1,47 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM cpufreq_interactive
+
+#if !defined(_TRACE_CPUFREQ_INTERACTIVE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_CPUFREQ_INTERACTIVE_H
+
+#include <linux/tracepoint.h>
+
+/*
+ * Emitted on every evaluation of the governor timer.  @load is the
+ * short-term load sampled over the last timer window at frequency @cur,
+ * @predicted the load the governor acted upon and @target the frequency
+ * it picked.  This is enough to replay the decisions offline against a
+ * different policy (see tools/perf/scripts/python/interactive-replay.py).
+ */
+TRACE_EVENT(cpufreq_interactive_target,
+
+	TP_PROTO(unsigned int cpu, unsigned int load, unsigned int predicted,
+		 unsigned int cur, unsigned int target),
+
+	TP_ARGS(cpu, load, predicted, cur, target),
+
+	TP_STRUCT__entry(
+		__field(	unsigned int,	cpu		)
+		__field(	unsigned int,	load		)
+		__field(	unsigned int,	predicted	)
+		__field(	unsigned int,	cur		)
+		__field(	unsigned int,	target		)
+	),
+
+	TP_fast_assign(
+		__entry->cpu = cpu;
+		__entry->load = load;
+		__entry->predicted = predicted;
+		__entry->cur = cur;
+		__entry->target = target;
+	),
+
+	TP_printk("cpu=%u load=%u predicted=%u cur=%u target=%u",
+		  __entry->cpu, __entry->load, __entry->predicted,
+		  __entry->cur, __entry->target)
+);
+
+#endif /* _TRACE_CPUFREQ_INTERACTIVE_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
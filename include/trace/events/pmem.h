@@ -0,0 +1,40 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM pmem
+
+#if !defined(_TRACE_PMEM_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_PMEM_H
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(pmem_alloc_failure,
+
+	TP_PROTO(const char *name, unsigned long len, unsigned int order,
+		 int largest_order, unsigned long free_entries),
+
+	TP_ARGS(name, len, order, largest_order, free_entries),
+
+	TP_STRUCT__entry(
+		__string(	name,		name		)
+		__field(	unsigned long,	len		)
+		__field(	unsigned int,	order		)
+		__field(	int,		largest_order	)
+		__field(	unsigned long,	free_entries	)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, name);
+		__entry->len = len;
+		__entry->order = order;
+		__entry->largest_order = largest_order;
+		__entry->free_entries = free_entries;
+	),
+
+	TP_printk("%s: len=%lu order=%u largest_free_order=%d free_entries=%lu",
+		  __get_str(name), __entry->len, __entry->order,
+		  __entry->largest_order, __entry->free_entries)
+);
+
+#endif /* _TRACE_PMEM_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -148,11 +148,95 @@ DEFINE_EVENT(wbc_class, name, \
 DEFINE_WBC_EVENT(wbc_writeback_start);
 DEFINE_WBC_EVENT(wbc_writeback_written);
 DEFINE_WBC_EVENT(wbc_writeback_wait);
-DEFINE_WBC_EVENT(wbc_balance_dirty_start);
-DEFINE_WBC_EVENT(wbc_balance_dirty_written);
-DEFINE_WBC_EVENT(wbc_balance_dirty_wait);
 DEFINE_WBC_EVENT(wbc_writepage);
 
+#define KBps(x)			((x) << (PAGE_SHIFT - 10))
+
+TRACE_EVENT(bdi_write_bandwidth,
+
+	TP_PROTO(struct backing_dev_info *bdi, unsigned long written_bw),
+
+	TP_ARGS(bdi, written_bw),
+
+	TP_STRUCT__entry(
+		__array(char,		bdi, 32)
+		__field(unsigned long,	written_bw)
+		__field(unsigned long,	write_bw)
+		__field(unsigned long,	avg_write_bw)
+	),
+
+	TP_fast_assign(
+		strncpy(__entry->bdi, dev_name(bdi->dev), 32);
+		__entry->written_bw	= KBps(written_bw);
+		__entry->write_bw	= KBps(bdi->write_bandwidth);
+		__entry->avg_write_bw	= KBps(bdi->avg_write_bandwidth);
+	),
+
+	TP_printk("bdi %s: written_bw=%lu write_bw=%lu avg_write_bw=%lu",
+		  __entry->bdi,
+		  __entry->written_bw,	/* KB/s */
+		  __entry->write_bw,	/* KB/s */
+		  __entry->avg_write_bw	/* KB/s */
+	)
+);
+
+TRACE_EVENT(balance_dirty_pages,
+
+	TP_PROTO(struct backing_dev_info *bdi,
+		 unsigned long thresh,
+		 unsigned long bg_thresh,
+		 unsigned long dirty,
+		 unsigned long bdi_thresh,
+		 unsigned long bdi_dirty,
+		 unsigned long task_ratelimit,
+		 unsigned long dirtied,
+		 long pause),
+
+	TP_ARGS(bdi, thresh, bg_thresh, dirty, bdi_thresh, bdi_dirty,
+		task_ratelimit, dirtied, pause),
+
+	TP_STRUCT__entry(
+		__array(char,		bdi, 32)
+		__field(unsigned long,	limit)
+		__field(unsigned long,	bg_limit)
+		__field(unsigned long,	dirty)
+		__field(unsigned long,	bdi_limit)
+		__field(unsigned long,	bdi_dirty)
+		__field(unsigned long,	write_bw)
+		__field(unsigned long,	task_ratelimit)
+		__field(unsigned int,	dirtied)
+		__field(long,		pause)
+	),
+
+	TP_fast_assign(
+		strncpy(__entry->bdi, dev_name(bdi->dev), 32);
+		__entry->limit		= thresh;
+		__entry->bg_limit	= bg_thresh;
+		__entry->dirty		= dirty;
+		__entry->bdi_limit	= bdi_thresh;
+		__entry->bdi_dirty	= bdi_dirty;
+		__entry->write_bw	= KBps(bdi->avg_write_bandwidth);
+		__entry->task_ratelimit	= KBps(task_ratelimit);
+		__entry->dirtied	= dirtied;
+		__entry->pause		= pause * 1000 / HZ;
+	),
+
+	TP_printk("bdi %s: limit=%lu bg_limit=%lu dirty=%lu "
+		  "bdi_limit=%lu bdi_dirty=%lu write_bw=%lu "
+		  "task_ratelimit=%lu dirtied=%u paused=%ld",
+		  __entry->bdi,
+		  __entry->limit,	/* pages */
+		  __entry->bg_limit,
+		  __entry->dirty,
+		  __entry->bdi_limit,
+		  __entry->bdi_dirty,
+		  __entry->write_bw,	/* KB/s */
+		  __entry->task_ratelimit, /* KB/s */
+		  __entry->dirtied,
+		  __entry->pause	/* ms */
+	)
+);
+
 #endif /* _TRACE_WRITEBACK_H */
 
 /* This part must be outside protection */
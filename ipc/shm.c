@@ -287,6 +287,13 @@ static unsigned long shm_get_unmapped_area(struct file *file,
 	unsigned long flags)
 {
 	struct shm_file_data *sfd = shm_file_data(file);
+
+#ifdef CONFIG_MMU
+	/* shmem only places mappings itself when they may get huge pages */
+	if (!sfd->file->f_op->get_unmapped_area)
+		return current->mm->get_unmapped_area(sfd->file, addr, len,
+						       pgoff, flags);
+#endif
 	return sfd->file->f_op->get_unmapped_area(sfd->file, addr, len,
 						pgoff, flags);
 }
@@ -295,9 +302,7 @@ static const struct file_operations shm_file_operations = {
 	.mmap		= shm_mmap,
 	.fsync		= shm_fsync,
 	.release	= shm_release,
-#ifndef CONFIG_MMU
 	.get_unmapped_area	= shm_get_unmapped_area,
-#endif
 };
 
 static const struct file_operations shm_file_operations_huge = {
@@ -0,0 +1,174 @@
+/*
+ * Cleancache: a second chance for clean page cache pages.
+ *
+ * __remove_from_page_cache() puts clean, uptodate pages of opted-in
+ * filesystems to the registered backend; do_mpage_readpage() gets them
+ * back before issuing a read.  Truncation, direct I/O invalidation and
+ * umount tell the backend to drop what it holds.
+ *
+ * See Documentation/vm/cleancache.txt.
+ */
+
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/pagemap.h>
+#include <linux/cleancache.h>
+#include <linux/debugfs.h>
+#include <linux/module.h>
+#include <linux/rcupdate.h>
+
+static struct cleancache_ops cleancache_ops __read_mostly;
+
+/* set once a backend registers: checked inline on every hook */
+bool cleancache_enabled __read_mostly;
+EXPORT_SYMBOL(cleancache_enabled);
+
+#ifdef CONFIG_DEBUG_FS
+static u64 cleancache_succ_gets;
+static u64 cleancache_failed_gets;
+static u64 cleancache_puts;
+static u64 cleancache_invalidates;
+
+static inline void inc_cleancache_succ_gets(void) { cleancache_succ_gets++; }
+static inline void inc_cleancache_failed_gets(void) { cleancache_failed_gets++; }
+static inline void inc_cleancache_puts(void) { cleancache_puts++; }
+static inline void inc_cleancache_invalidates(void) { cleancache_invalidates++; }
+#else
+static inline void inc_cleancache_succ_gets(void) { }
+static inline void inc_cleancache_failed_gets(void) { }
+static inline void inc_cleancache_puts(void) { }
+static inline void inc_cleancache_invalidates(void) { }
+#endif
+
+/*
+ * Register a backend and enable cleancache.  Filesystems mounted before
+ * this call have no pool and are left alone.  Returns the previously
+ * registered ops.
+ */
+struct cleancache_ops cleancache_register_ops(struct cleancache_ops *ops)
+{
+	struct cleancache_ops old = cleancache_ops;
+
+	cleancache_ops = *ops;
+	cleancache_enabled = true;
+	return old;
+}
+EXPORT_SYMBOL(cleancache_register_ops);
+
+/*
+ * Reclaim puts pages of a superblock while it is being unmounted, so the
+ * hooks below look up the pool id and call the backend inside an RCU read
+ * side section.  __cleancache_invalidate_fs() unpublishes the pool id and
+ * waits for them before the backend frees the pool.
+ */
+
+void __cleancache_init_fs(struct super_block *sb)
+{
+	sb->cleancache_poolid = cleancache_ops.init_fs(PAGE_SIZE);
+}
+EXPORT_SYMBOL(__cleancache_init_fs);
+
+int __cleancache_get_page(struct page *page)
+{
+	int ret = -1;
+	int pool_id;
+
+	VM_BUG_ON(!PageLocked(page));
+	rcu_read_lock();
+	pool_id = ACCESS_ONCE(page->mapping->host->i_sb->cleancache_poolid);
+	if (pool_id < 0)
+		goto out;
+
+	ret = cleancache_ops.get_page(pool_id, page->mapping->host->i_ino,
+				      page->index, page);
+	if (ret == 0)
+		inc_cleancache_succ_gets();
+	else
+		inc_cleancache_failed_gets();
+out:
+	rcu_read_unlock();
+	return ret;
+}
+EXPORT_SYMBOL(__cleancache_get_page);
+
+/*
+ * Called under mapping->tree_lock with interrupts disabled, from
+ * __remove_from_page_cache(): the backend must not sleep.
+ */
+void __cleancache_put_page(struct page *page)
+{
+	int pool_id;
+
+	VM_BUG_ON(!PageLocked(page));
+	rcu_read_lock();
+	pool_id = ACCESS_ONCE(page->mapping->host->i_sb->cleancache_poolid);
+	if (pool_id >= 0) {
+		cleancache_ops.put_page(pool_id, page->mapping->host->i_ino,
+					page->index, page);
+		inc_cleancache_puts();
+	}
+	rcu_read_unlock();
+}
+EXPORT_SYMBOL(__cleancache_put_page);
+
+void __cleancache_invalidate_page(struct address_space *mapping,
+				  struct page *page)
+{
+	int pool_id;
+
+	VM_BUG_ON(!PageLocked(page));
+	rcu_read_lock();
+	pool_id = ACCESS_ONCE(mapping->host->i_sb->cleancache_poolid);
+	if (pool_id >= 0) {
+		cleancache_ops.invalidate_page(pool_id, mapping->host->i_ino,
+					       page->index);
+		inc_cleancache_invalidates();
+	}
+	rcu_read_unlock();
+}
+EXPORT_SYMBOL(__cleancache_invalidate_page);
+
+void __cleancache_invalidate_inode(struct address_space *mapping)
+{
+	int pool_id;
+
+	rcu_read_lock();
+	pool_id = ACCESS_ONCE(mapping->host->i_sb->cleancache_poolid);
+	if (pool_id >= 0)
+		cleancache_ops.invalidate_inode(pool_id, mapping->host->i_ino);
+	rcu_read_unlock();
+}
+EXPORT_SYMBOL(__cleancache_invalidate_inode);
+
+/* Called at umount before the filesystem is killed. */
+void __cleancache_invalidate_fs(struct super_block *sb)
+{
+	int pool_id = sb->cleancache_poolid;
+
+	if (pool_id < 0)
+		return;
+
+	sb->cleancache_poolid = -1;
+	/* let puts and gets that still see the old pool id finish */
+	synchronize_rcu();
+	cleancache_ops.invalidate_fs(pool_id);
+}
+EXPORT_SYMBOL(__cleancache_invalidate_fs);
+
+#ifdef CONFIG_DEBUG_FS
+static int __init init_cleancache(void)
+{
+	struct dentry *root = debugfs_create_dir("cleancache", NULL);
+
+	if (root == NULL)
+		return -ENXIO;
+	debugfs_create_u64("succ_gets", S_IRUGO, root, &cleancache_succ_gets);
+	debugfs_create_u64("failed_gets", S_IRUGO, root,
+			   &cleancache_failed_gets);
+	debugfs_create_u64("puts", S_IRUGO, root, &cleancache_puts);
+	debugfs_create_u64("invalidates", S_IRUGO, root,
+			   &cleancache_invalidates);
+	return 0;
+}
+module_init(init_cleancache);
+#endif
@@ -14,6 +14,8 @@
 #include <linux/backing-dev.h>
 #include <linux/sysctl.h>
 #include <linux/sysfs.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
 #include "internal.h"
 
 /*
@@ -583,6 +585,171 @@ int sysctl_extfrag_handler(struct ctl_table *table, int write,
 	return 0;
 }
 
+/*
+ * kcompactd compacts a zone in the background when a high-order
+ * allocation found it below the low watermark for its order, there is
+ * enough free memory to migrate into, and the fragmentation index says
+ * the shortage is due to fragmentation rather than to lack of memory.
+ * Allocations that can't stall in direct compaction, like atomic
+ * allocations for jumbo frames, then find their pages next time.
+ */
+static bool kcompactd_zone_suitable(struct zone *zone, int order)
+{
+	unsigned long watermark = low_wmark_pages(zone);
+
+	if (zone_watermark_ok(zone, order, watermark, 0, 0))
+		return false;
+
+	/* copies of pages are allocated during migration: see above */
+	if (!zone_watermark_ok(zone, 0, watermark + (2UL << order), 0, 0))
+		return false;
+
+	return fragmentation_index(zone, order) > sysctl_extfrag_threshold;
+}
+
+static bool kcompactd_node_suitable(pg_data_t *pgdat, int order,
+				    int classzone_idx)
+{
+	int zoneid;
+
+	for (zoneid = 0; zoneid <= classzone_idx; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+
+		if (populated_zone(zone) && kcompactd_zone_suitable(zone, order))
+			return true;
+	}
+	return false;
+}
+
+static void kcompactd_do_work(pg_data_t *pgdat)
+{
+	int order = pgdat->kcompactd_max_order;
+	int classzone_idx = pgdat->kcompactd_classzone_idx;
+	int zoneid;
+
+	pgdat->kcompactd_max_order = 0;
+	pgdat->kcompactd_classzone_idx = 0;
+	count_vm_event(COMPACTD_WAKE);
+
+	for (zoneid = 0; zoneid <= classzone_idx; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+		struct compact_control cc = {
+			.nr_freepages = 0,
+			.nr_migratepages = 0,
+			.order = order,
+			.migratetype = MIGRATE_MOVABLE,
+			.zone = zone,
+		};
+		int status;
+
+		if (!populated_zone(zone))
+			continue;
+		if (!kcompactd_zone_suitable(zone, order))
+			continue;
+		if (compaction_deferred(zone))
+			continue;
+		if (kthread_should_stop())
+			return;
+
+		INIT_LIST_HEAD(&cc.freepages);
+		INIT_LIST_HEAD(&cc.migratepages);
+		status = compact_zone(zone, &cc);
+
+		if (zone_watermark_ok(zone, order, low_wmark_pages(zone), 0, 0)) {
+			zone->compact_considered = 0;
+			zone->compact_defer_shift = 0;
+			count_vm_event(COMPACTD_SUCCESS);
+		} else if (status == COMPACT_COMPLETE) {
+			/* the whole zone was scanned: back off as direct does */
+			defer_compaction(zone);
+			count_vm_event(COMPACTD_FAIL);
+		}
+	}
+}
+
+static int kcompactd(void *p)
+{
+	pg_data_t *pgdat = (pg_data_t *)p;
+	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
+
+	if (!cpumask_empty(cpumask))
+		set_cpus_allowed_ptr(current, cpumask);
+	set_freezable();
+	set_user_nice(current, 19);
+
+	while (!kthread_should_stop()) {
+		wait_event_freezable(pgdat->kcompactd_wait,
+				     pgdat->kcompactd_max_order ||
+				     kthread_should_stop());
+		if (pgdat->kcompactd_max_order)
+			kcompactd_do_work(pgdat);
+	}
+	return 0;
+}
+
+/*
+ * Called from wakeup_kswapd() when a zone is below the low watermark for
+ * an allocation of @order.
+ */
+void wakeup_kcompactd(pg_data_t *pgdat, int order, int classzone_idx)
+{
+	if (!order)
+		return;
+	if (!waitqueue_active(&pgdat->kcompactd_wait))
+		return;
+	if (!kcompactd_node_suitable(pgdat, order, classzone_idx))
+		return;
+
+	if (pgdat->kcompactd_max_order < order)
+		pgdat->kcompactd_max_order = order;
+	if (pgdat->kcompactd_classzone_idx < classzone_idx)
+		pgdat->kcompactd_classzone_idx = classzone_idx;
+	wake_up_interruptible(&pgdat->kcompactd_wait);
+}
+
+/*
+ * This kcompactd start function will be called by init and node-hot-add.
+ * On node-hot-add, kcompactd will moved to proper cpus if cpus are hot-added.
+ */
+int kcompactd_run(int nid)
+{
+	pg_data_t *pgdat = NODE_DATA(nid);
+
+	if (pgdat->kcompactd)
+		return 0;
+
+	pgdat->kcompactd = kthread_run(kcompactd, pgdat, "kcompactd%d", nid);
+	if (IS_ERR(pgdat->kcompactd)) {
+		printk(KERN_ERR "Failed to start kcompactd on node %d\n", nid);
+		pgdat->kcompactd = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Called by memory hotplug when all memory in a node is offlined.
+ */
+void kcompactd_stop(int nid)
+{
+	struct task_struct *kcompactd = NODE_DATA(nid)->kcompactd;
+
+	if (kcompactd) {
+		kthread_stop(kcompactd);
+		NODE_DATA(nid)->kcompactd = NULL;
+	}
+}
+
+static int __init kcompactd_init(void)
+{
+	int nid;
+
+	for_each_node_state(nid, N_HIGH_MEMORY)
+		kcompactd_run(nid);
+	return 0;
+}
+module_init(kcompactd_init)
+
 #if defined(CONFIG_SYSFS) && defined(CONFIG_NUMA)
 ssize_t sysfs_compact_node(struct sys_device *dev,
 			struct sysdev_attribute *attr,
@@ -34,6 +34,7 @@
 #include <linux/hardirq.h> /* for BUG_ON(!in_atomic()) only */
 #include <linux/memcontrol.h>
 #include <linux/mm_inline.h> /* for page_is_file_cache() */
+#include <linux/cleancache.h>
 #include "internal.h"
 
 /*
@@ -119,6 +120,15 @@ void __remove_from_page_cache(struct page *page)
 {
 	struct address_space *mapping = page->mapping;
 
+	/*
+	 * A clean, uptodate page gets a second chance in cleancache;
+	 * anything else must not leave a stale copy behind there.
+	 */
+	if (PageUptodate(page) && PageMappedToDisk(page))
+		cleancache_put_page(page);
+	else
+		cleancache_invalidate_page(mapping, page);
+
 	radix_tree_delete(&mapping->page_tree, page->index);
 	page->mapping = NULL;
 	mapping->nrpages--;
@@ -136,6 +146,7 @@ void __remove_from_page_cache(struct page *page)
 	 */
 	if (PageDirty(page) && mapping_cap_account_dirty(mapping)) {
 		dec_zone_page_state(page, NR_FILE_DIRTY);
+		mem_cgroup_dec_page_stat(page, MEMCG_NR_FILE_DIRTY);
 		dec_bdi_stat(mapping->backing_dev_info, BDI_RECLAIMABLE);
 	}
 }
@@ -227,6 +238,7 @@ int __filemap_fdatawrite_range(struct address_space *mapping, loff_t start,
 	ret = do_writepages(mapping, &wbc);
 	return ret;
 }
+EXPORT_SYMBOL(__filemap_fdatawrite_range);
 
 static inline int __filemap_fdatawrite(struct address_space *mapping,
 	int sync_mode)
@@ -450,7 +462,10 @@ int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 
 	ret = add_to_page_cache(page, mapping, offset, gfp_mask);
 	if (ret == 0) {
-		if (page_is_file_cache(page))
+		if (page_is_file_cache(page) &&
+		    workingset_refault(mapping, offset))
+			__lru_cache_add(page, LRU_ACTIVE_FILE);
+		else if (page_is_file_cache(page))
 			lru_cache_add_file(page);
 		else
 			lru_cache_add_anon(page);
@@ -759,7 +774,7 @@ unsigned find_get_pages(struct address_space *mapping, pgoff_t start,
 	rcu_read_lock();
 restart:
 	nr_found = radix_tree_gang_lookup_slot(&mapping->page_tree,
-				(void ***)pages, start, nr_pages);
+				(void ***)pages, NULL, start, nr_pages);
 	ret = 0;
 	for (i = 0; i < nr_found; i++) {
 		struct page *page;
@@ -804,45 +819,120 @@ repeat:
 unsigned find_get_pages_contig(struct address_space *mapping, pgoff_t index,
 			       unsigned int nr_pages, struct page **pages)
 {
+	void **slots[PAGEVEC_SIZE];
+	unsigned long indices[PAGEVEC_SIZE];
 	unsigned int i;
-	unsigned int ret;
+	unsigned int ret = 0;
 	unsigned int nr_found;
 
+	/*
+	 * Look up a pagevec's worth of slots at a time, with their indices:
+	 * a gang lookup of all @nr_pages would go on past the first hole
+	 * collecting pages that are of no use here.
+	 */
 	rcu_read_lock();
+	while (ret < nr_pages) {
+		unsigned int batch = min_t(unsigned int, nr_pages - ret,
+					   PAGEVEC_SIZE);
 restart:
-	nr_found = radix_tree_gang_lookup_slot(&mapping->page_tree,
-				(void ***)pages, index, nr_pages);
-	ret = 0;
-	for (i = 0; i < nr_found; i++) {
-		struct page *page;
+		nr_found = radix_tree_gang_lookup_slot(&mapping->page_tree,
+					slots, indices, index, batch);
+		for (i = 0; i < nr_found; i++) {
+			struct page *page;
+
+			if (indices[i] != index)
+				goto out;
 repeat:
-		page = radix_tree_deref_slot((void **)pages[i]);
-		if (unlikely(!page))
-			continue;
-		if (radix_tree_deref_retry(page))
-			goto restart;
+			page = radix_tree_deref_slot(slots[i]);
+			if (unlikely(!page))
+				goto out;
+			if (radix_tree_deref_retry(page))
+				goto restart;
 
-		if (page->mapping == NULL || page->index != index)
-			break;
+			if (!page_cache_get_speculative(page))
+				goto repeat;
 
-		if (!page_cache_get_speculative(page))
-			goto repeat;
+			/* Has the page moved? */
+			if (unlikely(page != *slots[i])) {
+				page_cache_release(page);
+				goto repeat;
+			}
 
-		/* Has the page moved? */
-		if (unlikely(page != *((void **)pages[i]))) {
-			page_cache_release(page);
-			goto repeat;
-		}
+			/* Truncated and reused between lookup and reference? */
+			if (page->mapping == NULL || page->index != index) {
+				page_cache_release(page);
+				goto out;
+			}
 
-		pages[ret] = page;
-		ret++;
-		index++;
+			pages[ret] = page;
+			ret++;
+			index++;
+		}
+		if (nr_found < batch)
+			break;
 	}
+out:
 	rcu_read_unlock();
 	return ret;
 }
 EXPORT_SYMBOL(find_get_pages_contig);
 
+/**
+ * page_cache_next_run - find the next run of cached pages
+ * @mapping:	the address_space to search
+ * @index:	where to start looking
+ * @max_index:	the last index of interest
+ * @run_end:	set to just past the end of the run found
+ *
+ * Returns the index of the first page cached at or after @index, and sets
+ * *@run_end past the last page of the contiguous run starting there, both
+ * clamped to @max_index + 1.  If nothing is cached up to @max_index, both
+ * are @max_index + 1.  One lockless gang lookup of up to PAGEVEC_SIZE
+ * slots answers this, so a caller walking a range need not look up every
+ * index in it; a run longer than that is reported in pieces.
+ *
+ * No page references are taken: like radix_tree_lookup() under RCU, the
+ * answer may be out of date as soon as it is returned.
+ */
+pgoff_t page_cache_next_run(struct address_space *mapping, pgoff_t index,
+			    pgoff_t max_index, pgoff_t *run_end)
+{
+	void **slots[PAGEVEC_SIZE];
+	unsigned long indices[PAGEVEC_SIZE];
+	unsigned int i, nr_found;
+	pgoff_t start, end;
+
+	rcu_read_lock();
+restart:
+	start = end = max_index + 1;
+	nr_found = radix_tree_gang_lookup_slot(&mapping->page_tree,
+				slots, indices, index, PAGEVEC_SIZE);
+	for (i = 0; i < nr_found; i++) {
+		struct page *page;
+
+		if (indices[i] > max_index)
+			break;
+		if (start <= max_index && indices[i] != end)
+			break;
+		page = radix_tree_deref_slot(slots[i]);
+		if (unlikely(!page)) {
+			/* being deleted: a hole, unless the run has not begun */
+			if (start <= max_index)
+				break;
+			continue;
+		}
+		if (radix_tree_deref_retry(page))
+			goto restart;
+		if (start > max_index)
+			start = indices[i];
+		end = indices[i] + 1;
+	}
+	rcu_read_unlock();
+
+	*run_end = end;
+	return start;
+}
+
 /**
  * find_get_pages_tag - find and return pages that match @tag
  * @mapping:	the address_space to search
@@ -974,6 +1064,9 @@ static void do_generic_file_read(struct file *filp, loff_t *ppos,
 	pgoff_t prev_index;
 	unsigned long offset;      /* offset into pagecache page */
 	unsigned int prev_offset;
+	struct page *batch[PAGEVEC_SIZE]; /* pages looked up ahead of index */
+	pgoff_t batch_start = 0;
+	unsigned int batch_nr = 0, batch_next = 0;
 	int error;
 
 	index = *ppos >> PAGE_CACHE_SHIFT;
@@ -990,7 +1083,24 @@ static void do_generic_file_read(struct file *filp, loff_t *ppos,
 
 		cond_resched();
 find_page:
-		page = find_get_page(mapping, index);
+		/*
+		 * A read of several pages takes references on the cached ones
+		 * a pagevec at a time, rather than a radix tree walk for each.
+		 */
+		page = NULL;
+		if (batch_next == batch_nr && last_index - index > 1) {
+			batch_start = index;
+			batch_next = 0;
+			batch_nr = find_get_pages_contig(mapping, index,
+					min_t(pgoff_t, last_index - index,
+					      PAGEVEC_SIZE), batch);
+			if (batch_nr)
+				page = batch[batch_next++];
+		} else if (batch_next < batch_nr &&
+			   batch_start + batch_next == index)
+			page = batch[batch_next++];
+		else
+			page = find_get_page(mapping, index);
 		if (!page) {
 			page_cache_sync_readahead(mapping,
 					ra, filp,
@@ -1172,6 +1282,9 @@ no_cached_page:
 	}
 
 out:
+	while (batch_next < batch_nr)
+		page_cache_release(batch[batch_next++]);
+
 	ra->prev_pos = prev_index;
 	ra->prev_pos <<= PAGE_CACHE_SHIFT;
 	ra->prev_pos |= prev_offset;
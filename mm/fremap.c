@@ -13,6 +13,7 @@
 #include <linux/pagemap.h>
 #include <linux/swapops.h>
 #include <linux/rmap.h>
+#include <linux/huge_mm.h>
 #include <linux/module.h>
 #include <linux/syscalls.h>
 #include <linux/mmu_notifier.h>
@@ -211,9 +212,13 @@ SYSCALL_DEFINE5(remap_file_pages, unsigned long, start, unsigned long, size,
 			}
 			goto out;
 		}
+		/* nonlinear vmas are only ever looked at pte by pte */
+		split_huge_page_vma(vma);
 		spin_lock(&mapping->i_mmap_lock);
 		flush_dcache_mmap_lock(mapping);
+		vma_write_begin(vma);
 		vma->vm_flags |= VM_NONLINEAR;
+		vma_write_end(vma);
 		vma_prio_tree_remove(vma, &mapping->i_mmap);
 		vma_nonlinear_insert(vma, &mapping->i_mmap_nonlinear);
 		flush_dcache_mmap_unlock(mapping);
@@ -224,9 +229,11 @@ SYSCALL_DEFINE5(remap_file_pages, unsigned long, start, unsigned long, size,
 		/*
 		 * drop PG_Mlocked flag for over-mapped range
 		 */
-		unsigned int saved_flags = vma->vm_flags;
+		unsigned long saved_flags = vma->vm_flags;
+		vma_write_begin(vma);
 		munlock_vma_pages_range(vma, start, start + size);
 		vma->vm_flags = saved_flags;
+		vma_write_end(vma);
 	}
 
 	mmu_notifier_invalidate_range_start(mm, start, start + size);
@@ -0,0 +1,195 @@
+/*
+ * Frontswap: a synchronous hook in front of the swap device.
+ *
+ * swap_writepage() offers each page to the registered backend before
+ * building a bio; pages the backend accepts are marked in the swap
+ * type's frontswap_map and later served by swap_readpage() without
+ * touching the device.  Freeing a swap slot or disabling a swap type
+ * tells the backend to drop what it holds.
+ *
+ * See Documentation/vm/frontswap.txt.
+ */
+
+#include <linux/mm.h>
+#include <linux/swap.h>
+#include <linux/swapops.h>
+#include <linux/frontswap.h>
+#include <linux/debugfs.h>
+#include <linux/module.h>
+
+static struct frontswap_ops frontswap_ops __read_mostly;
+
+/* set once a backend registers: checked inline on every swap I/O */
+bool frontswap_enabled __read_mostly;
+EXPORT_SYMBOL(frontswap_enabled);
+
+/* pages held by the backend, summed over the swap types' frontswap_pages */
+static atomic_long_t frontswap_total_pages = ATOMIC_LONG_INIT(0);
+
+#ifdef CONFIG_DEBUG_FS
+static u64 frontswap_loads;
+static u64 frontswap_succ_stores;
+static u64 frontswap_failed_stores;
+static u64 frontswap_invalidates;
+
+static inline void inc_frontswap_loads(void) { frontswap_loads++; }
+static inline void inc_frontswap_succ_stores(void) { frontswap_succ_stores++; }
+static inline void inc_frontswap_failed_stores(void) { frontswap_failed_stores++; }
+static inline void inc_frontswap_invalidates(void) { frontswap_invalidates++; }
+#else
+static inline void inc_frontswap_loads(void) { }
+static inline void inc_frontswap_succ_stores(void) { }
+static inline void inc_frontswap_failed_stores(void) { }
+static inline void inc_frontswap_invalidates(void) { }
+#endif
+
+/*
+ * Register a backend and enable frontswap.  Swap types enabled before
+ * this call have no frontswap_map and are left alone until the next
+ * swapon.  Returns the previously registered ops.
+ */
+struct frontswap_ops frontswap_register_ops(struct frontswap_ops *ops)
+{
+	struct frontswap_ops old = frontswap_ops;
+
+	frontswap_ops = *ops;
+	frontswap_enabled = true;
+	return old;
+}
+EXPORT_SYMBOL(frontswap_register_ops);
+
+/* Called from swapon once the swap type's frontswap_map is set up. */
+void __frontswap_init(struct swap_info_struct *sis)
+{
+	BUG_ON(sis == NULL);
+	if (sis->frontswap_map == NULL)
+		return;
+	atomic_set(&sis->frontswap_pages, 0);
+	frontswap_ops.init(sis->type);
+}
+EXPORT_SYMBOL(__frontswap_init);
+
+/*
+ * Offer a locked swapcache page to the backend.  If a page is stored
+ * again at a slot the backend already holds and the new store fails,
+ * the stale copy must be dropped so the device is read instead.
+ */
+int __frontswap_store(struct page *page)
+{
+	int ret = -1, dup = 0;
+	swp_entry_t entry = { .val = page_private(page), };
+	int type = swp_type(entry);
+	struct swap_info_struct *sis = page_swap_info(page);
+	pgoff_t offset = swp_offset(entry);
+
+	BUG_ON(!PageLocked(page));
+	if (sis->frontswap_map == NULL)
+		return -1;
+	if (frontswap_test(sis, offset))
+		dup = 1;
+	ret = frontswap_ops.store(type, offset, page);
+	if (ret == 0) {
+		set_bit(offset, sis->frontswap_map);
+		inc_frontswap_succ_stores();
+		if (!dup) {
+			atomic_inc(&sis->frontswap_pages);
+			atomic_long_inc(&frontswap_total_pages);
+		}
+	} else {
+		inc_frontswap_failed_stores();
+		if (dup) {
+			clear_bit(offset, sis->frontswap_map);
+			atomic_dec(&sis->frontswap_pages);
+			atomic_long_dec(&frontswap_total_pages);
+			frontswap_ops.invalidate_page(type, offset);
+		}
+	}
+	return ret;
+}
+EXPORT_SYMBOL(__frontswap_store);
+
+/*
+ * Fill a locked swapcache page from the backend if it holds the slot.
+ * The copy is kept: the slot stays valid until swap_free() drops it.
+ */
+int __frontswap_load(struct page *page)
+{
+	int ret = -1;
+	swp_entry_t entry = { .val = page_private(page), };
+	int type = swp_type(entry);
+	struct swap_info_struct *sis = page_swap_info(page);
+	pgoff_t offset = swp_offset(entry);
+
+	BUG_ON(!PageLocked(page));
+	if (frontswap_test(sis, offset))
+		ret = frontswap_ops.load(type, offset, page);
+	if (ret == 0)
+		inc_frontswap_loads();
+	return ret;
+}
+EXPORT_SYMBOL(__frontswap_load);
+
+/* A swap slot was freed: called from swap_entry_free() under swap_lock. */
+void __frontswap_invalidate_page(struct swap_info_struct *sis, pgoff_t offset)
+{
+	BUG_ON(sis == NULL);
+	if (frontswap_test(sis, offset)) {
+		frontswap_ops.invalidate_page(sis->type, offset);
+		clear_bit(offset, sis->frontswap_map);
+		atomic_dec(&sis->frontswap_pages);
+		atomic_long_dec(&frontswap_total_pages);
+		inc_frontswap_invalidates();
+	}
+}
+EXPORT_SYMBOL(__frontswap_invalidate_page);
+
+/*
+ * The swap type is being disabled.  try_to_unuse() has already brought
+ * every page back, so this only releases the backend's bookkeeping.
+ */
+void __frontswap_invalidate_area(struct swap_info_struct *sis)
+{
+	BUG_ON(sis == NULL);
+	if (sis->frontswap_map == NULL)
+		return;
+	frontswap_ops.invalidate_area(sis->type);
+	atomic_long_sub(atomic_read(&sis->frontswap_pages),
+			&frontswap_total_pages);
+	atomic_set(&sis->frontswap_pages, 0);
+	memset(sis->frontswap_map, 0, BITS_TO_LONGS(sis->max) * sizeof(long));
+}
+EXPORT_SYMBOL(__frontswap_invalidate_area);
+
+/* Number of pages currently held by the backend, over all swap types. */
+unsigned long frontswap_curr_pages(void)
+{
+	return atomic_long_read(&frontswap_total_pages);
+}
+EXPORT_SYMBOL(frontswap_curr_pages);
+
+#ifdef CONFIG_DEBUG_FS
+static int curr_pages_get(void *data, u64 *val)
+{
+	*val = frontswap_curr_pages();
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(curr_pages_fops, curr_pages_get, NULL, "%llu\n");
+
+static int __init init_frontswap(void)
+{
+	struct dentry *root = debugfs_create_dir("frontswap", NULL);
+
+	if (root == NULL)
+		return -ENXIO;
+	debugfs_create_u64("loads", S_IRUGO, root, &frontswap_loads);
+	debugfs_create_u64("succ_stores", S_IRUGO, root, &frontswap_succ_stores);
+	debugfs_create_u64("failed_stores", S_IRUGO, root,
+			   &frontswap_failed_stores);
+	debugfs_create_u64("invalidates", S_IRUGO, root,
+			   &frontswap_invalidates);
+	debugfs_create_file("curr_pages", S_IRUGO, root, NULL,
+			    &curr_pages_fops);
+	return 0;
+}
+module_init(init_frontswap);
+#endif
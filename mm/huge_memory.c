@@ -0,0 +1,1403 @@
+/*
+ *  linux/mm/huge_memory.c
+ *
+ *  Transparent huge pages for anonymous memory and shmem.
+ *
+ *  Page faults in suitably aligned private anonymous vmas are served with
+ *  a single pmd mapping HPAGE_PMD_NR physically contiguous pages, and
+ *  khugepaged collapses ranges that were populated with small pages into
+ *  huge pmds in the background.  Shared shmem mappings get huge pmds
+ *  where the file was populated from a huge page, see shmem_pmd_fault().
+ *
+ *  The pages behind a huge pmd are ordinary order-0 pages carved out of
+ *  one high order allocation: each keeps its own reference count,
+ *  mapcount, rmap and LRU position.  Anything that needs to look at
+ *  individual ptes (mprotect, mremap, fork, reclaim, migration, ...)
+ *  simply splits the huge pmd back into a pte table first; the pte table
+ *  is preallocated when the huge pmd is set up, so a split never fails.
+ *
+ *  This work is licensed under the terms of the GNU GPL, version 2.
+ */
+
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/highmem.h>
+#include <linux/hugetlb.h>
+#include <linux/huge_mm.h>
+#include <linux/mmu_notifier.h>
+#include <linux/rmap.h>
+#include <linux/swap.h>
+#include <linux/mman.h>
+#include <linux/pagemap.h>
+#include <linux/memcontrol.h>
+#include <linux/shmem_fs.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
+#include <linux/hash.h>
+#include <linux/slab.h>
+#include <linux/init.h>
+
+#include <asm/tlb.h>
+#include <asm/tlbflush.h>
+#include <asm/pgalloc.h>
+#include "internal.h"
+
+int transparent_hugepage_mode __read_mostly =
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE_ALWAYS
+	TRANSPARENT_HUGEPAGE_ALWAYS;
+#else
+	TRANSPARENT_HUGEPAGE_MADVISE;
+#endif
+
+/* default: scan 8*512 ptes (or vmas) every 10 seconds */
+static unsigned int khugepaged_pages_to_scan __read_mostly = HPAGE_PMD_NR*8;
+static unsigned int khugepaged_scan_sleep_millisecs __read_mostly = 10000;
+/* during fragmentation poll the hugepage allocator once every minute */
+static unsigned int khugepaged_alloc_sleep_millisecs __read_mostly = 60000;
+/*
+ * Empty ptes a range may have and still be collapsed: they are filled
+ * with zeroed pages.  The default collapses any range with one page in
+ * it, like a huge page fault would have done in the first place.
+ */
+static unsigned int khugepaged_max_ptes_none __read_mostly = HPAGE_PMD_NR-1;
+static unsigned long khugepaged_pages_collapsed;
+static unsigned long khugepaged_full_scans;
+
+static struct task_struct *khugepaged_thread __read_mostly;
+static DECLARE_WAIT_QUEUE_HEAD(khugepaged_wait);
+static DEFINE_SPINLOCK(khugepaged_mm_lock);
+
+#define MM_SLOTS_HASH_SHIFT 10
+#define MM_SLOTS_HASH_HEADS (1 << MM_SLOTS_HASH_SHIFT)
+static struct hlist_head mm_slots_hash[MM_SLOTS_HASH_HEADS];
+static struct kmem_cache *mm_slot_cache __read_mostly;
+
+/**
+ * struct mm_slot - khugepaged information per mm that is being scanned
+ * @hash: link to the mm_slots hash list
+ * @mm_node: link into the mm_slots list, rooted in khugepaged_scan.mm_head
+ * @mm: the mm that this information is valid for
+ */
+struct mm_slot {
+	struct hlist_node hash;
+	struct list_head mm_node;
+	struct mm_struct *mm;
+};
+
+/**
+ * struct khugepaged_scan - cursor for scanning
+ * @mm_head: the head of the mm list to scan
+ * @mm_slot: the current mm_slot we are scanning
+ * @address: the next address inside that to be scanned
+ *
+ * There is only the one khugepaged_scan instance of this cursor structure.
+ */
+struct khugepaged_scan {
+	struct list_head mm_head;
+	struct mm_slot *mm_slot;
+	unsigned long address;
+};
+
+static struct khugepaged_scan khugepaged_scan = {
+	.mm_head = LIST_HEAD_INIT(khugepaged_scan.mm_head),
+};
+
+static inline int khugepaged_enabled(void)
+{
+	return transparent_hugepage_mode != TRANSPARENT_HUGEPAGE_NEVER;
+}
+
+static inline int khugepaged_test_exit(struct mm_struct *mm)
+{
+	return atomic_read(&mm->mm_users) == 0;
+}
+
+/*
+ * The pte tables deposited for huge pmds are kept on a per-mm list
+ * threaded through page->lru.  Any of them will do for any split.
+ */
+static void deposit_pmd_huge_pte(struct mm_struct *mm, pgtable_t pgtable)
+{
+	assert_spin_locked(&mm->page_table_lock);
+
+	if (!mm->pmd_huge_pte)
+		INIT_LIST_HEAD(&pgtable->lru);
+	else
+		list_add(&pgtable->lru, &mm->pmd_huge_pte->lru);
+	mm->pmd_huge_pte = pgtable;
+}
+
+static pgtable_t withdraw_pmd_huge_pte(struct mm_struct *mm)
+{
+	pgtable_t pgtable;
+
+	assert_spin_locked(&mm->page_table_lock);
+
+	pgtable = mm->pmd_huge_pte;
+	VM_BUG_ON(!pgtable);
+	if (list_empty(&pgtable->lru))
+		mm->pmd_huge_pte = NULL;
+	else {
+		mm->pmd_huge_pte = list_entry(pgtable->lru.next,
+					      struct page, lru);
+		list_del(&pgtable->lru);
+	}
+	return pgtable;
+}
+
+/* The statistic a huge pmd mapping @page is accounted in */
+static inline enum zone_stat_item huge_pmd_stat_item(struct page *page)
+{
+	return PageAnon(page) ? NR_ANON_TRANSPARENT_HUGEPAGES :
+				NR_SHMEM_PMDMAPPED;
+}
+
+static pmd_t mk_huge_pmd(struct page *page, struct vm_area_struct *vma)
+{
+	pmd_t entry;
+
+	entry = pmd_mkyoung(pmd_mkhuge(pfn_pmd(page_to_pfn(page),
+					       vma->vm_page_prot)));
+	if (likely(vma->vm_flags & VM_WRITE))
+		entry = pmd_mkwrite(pmd_mkdirty(entry));
+	return entry;
+}
+
+/*
+ * Allocate HPAGE_PMD_NR contiguous pages and split them into individual
+ * order-0 pages.  Huge page allocations are opportunistic: don't retry
+ * hard and don't warn, the caller falls back to small pages.
+ */
+static struct page *alloc_hugepage(struct vm_area_struct *vma,
+				   unsigned long haddr)
+{
+	gfp_t gfp = GFP_HIGHUSER_MOVABLE | __GFP_NORETRY | __GFP_NOWARN;
+	struct page *page;
+
+	if (vma)
+		page = alloc_pages_vma(gfp, HPAGE_PMD_ORDER, vma, haddr);
+	else
+		page = alloc_pages(gfp, HPAGE_PMD_ORDER);
+	if (page)
+		split_page(page, HPAGE_PMD_ORDER);
+	return page;
+}
+
+static void free_hugepage(struct page *page)
+{
+	int i;
+
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		__free_page(page + i);
+}
+
+static int mem_cgroup_charge_hugepage(struct page *page, struct mm_struct *mm)
+{
+	int i;
+
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		if (mem_cgroup_newpage_charge(page + i, mm, GFP_KERNEL)) {
+			while (--i >= 0)
+				mem_cgroup_uncharge_page(page + i);
+			return -ENOMEM;
+		}
+	}
+	return 0;
+}
+
+static void mem_cgroup_uncharge_hugepage(struct page *page)
+{
+	int i;
+
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		mem_cgroup_uncharge_page(page + i);
+}
+
+static void clear_hugepage(struct page *page, unsigned long haddr)
+{
+	int i;
+
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		cond_resched();
+		clear_user_highpage(page + i, haddr + i * PAGE_SIZE);
+		__SetPageUptodate(page + i);
+	}
+}
+
+int do_huge_pmd_anonymous_page(struct mm_struct *mm, struct vm_area_struct *vma,
+			       unsigned long address, pmd_t *pmd,
+			       unsigned int flags)
+{
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+	pgtable_t pgtable;
+	struct page *page;
+	int i;
+
+	if (haddr < vma->vm_start || haddr + HPAGE_PMD_SIZE > vma->vm_end)
+		return VM_FAULT_FALLBACK;
+	if (unlikely(anon_vma_prepare(vma)))
+		return VM_FAULT_OOM;
+	if (unlikely(khugepaged_enter(vma)))
+		return VM_FAULT_OOM;
+
+	page = alloc_hugepage(vma, haddr);
+	if (unlikely(!page)) {
+		count_vm_event(THP_FAULT_FALLBACK);
+		return VM_FAULT_FALLBACK;
+	}
+	if (unlikely(mem_cgroup_charge_hugepage(page, mm))) {
+		free_hugepage(page);
+		count_vm_event(THP_FAULT_FALLBACK);
+		return VM_FAULT_FALLBACK;
+	}
+	pgtable = pte_alloc_one(mm, haddr);
+	if (unlikely(!pgtable)) {
+		mem_cgroup_uncharge_hugepage(page);
+		free_hugepage(page);
+		return VM_FAULT_OOM;
+	}
+
+	clear_hugepage(page, haddr);
+
+	spin_lock(&mm->page_table_lock);
+	if (unlikely(!pmd_none(*pmd))) {
+		/* somebody else populated this range meanwhile */
+		spin_unlock(&mm->page_table_lock);
+		pte_free(mm, pgtable);
+		mem_cgroup_uncharge_hugepage(page);
+		free_hugepage(page);
+		return 0;
+	}
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		page_add_new_anon_rmap(page + i, vma, haddr + i * PAGE_SIZE);
+	deposit_pmd_huge_pte(mm, pgtable);
+	mm->nr_ptes++;
+	add_mm_counter(mm, MM_ANONPAGES, HPAGE_PMD_NR);
+	inc_zone_page_state(page, NR_ANON_TRANSPARENT_HUGEPAGES);
+	/* No need to invalidate - it was non-present before */
+	set_pmd(pmd, mk_huge_pmd(page, vma));
+	spin_unlock(&mm->page_table_lock);
+
+	count_vm_event(THP_FAULT_ALLOC);
+	return 0;
+}
+
+/*
+ * Map the HPAGE_PMD_NR page cache pages of @mapping from @index on with
+ * a huge pmd at @address, provided they are all there, uptodate and one
+ * naturally aligned, physically contiguous block.  The caller checked
+ * that the range is inside both the vma and the file, and that the vma
+ * is shared: there is no copy-on-write of huge pmds.  Returns
+ * VM_FAULT_FALLBACK when the range has to be mapped with ptes.
+ *
+ * Every page is kept locked until the pmd is in place, as a pte fault
+ * keeps its page locked through VM_FAULT_LOCKED: truncation, hole
+ * punching and shmem_writepage() all lock the page before taking it out
+ * of the page cache, so after the checks below none of them can have
+ * done so without unmapping the huge pmd afterwards.
+ */
+int do_huge_pmd_file_page(struct vm_area_struct *vma, unsigned long address,
+			  pmd_t *pmd, struct address_space *mapping,
+			  pgoff_t index)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+	struct page *head = NULL, *page;
+	pgtable_t pgtable;
+	int ret = VM_FAULT_FALLBACK;
+	int i;
+
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		page = find_get_page(mapping, index + i);
+		if (!page)
+			goto unlock;
+		if (!i) {
+			head = page;
+			if (page_to_pfn(head) & (HPAGE_PMD_NR - 1)) {
+				page_cache_release(head);
+				goto unlock;
+			}
+		}
+		if (page != head + i || !trylock_page(page)) {
+			page_cache_release(page);
+			goto unlock;
+		}
+		if (page->mapping != mapping || !PageUptodate(page)) {
+			unlock_page(page);
+			page_cache_release(page);
+			goto unlock;
+		}
+	}
+
+	/* with the pages locked, i_size can only have shrunk before this */
+	if (((loff_t)(index + HPAGE_PMD_NR) << PAGE_CACHE_SHIFT) >
+	    i_size_read(mapping->host))
+		goto unlock;
+
+	pgtable = pte_alloc_one(mm, haddr);
+	if (unlikely(!pgtable)) {
+		ret = VM_FAULT_OOM;
+		goto unlock;
+	}
+
+	spin_lock(&mm->page_table_lock);
+	if (unlikely(!pmd_none(*pmd))) {
+		spin_unlock(&mm->page_table_lock);
+		pte_free(mm, pgtable);
+		ret = 0;
+		goto unlock;
+	}
+	/* the page cache references become the mapping's ones */
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		page_add_file_rmap(head + i);
+	deposit_pmd_huge_pte(mm, pgtable);
+	mm->nr_ptes++;
+	add_mm_counter(mm, MM_FILEPAGES, HPAGE_PMD_NR);
+	inc_zone_page_state(head, NR_SHMEM_PMDMAPPED);
+	set_pmd(pmd, mk_huge_pmd(head, vma));
+	spin_unlock(&mm->page_table_lock);
+
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		unlock_page(head + i);
+	count_vm_event(THP_FILE_MAPPED);
+	return 0;
+
+unlock:
+	while (--i >= 0) {
+		unlock_page(head + i);
+		page_cache_release(head + i);
+	}
+	return ret;
+}
+
+/*
+ * follow_page() for a huge pmd.  Returns NULL if the pmd was split
+ * meanwhile, or had to be split because a write was requested through a
+ * read-only huge pmd: the caller then looks at the ptes.
+ */
+struct page *follow_trans_huge_pmd(struct vm_area_struct *vma,
+				   unsigned long address, pmd_t *pmd,
+				   unsigned int flags)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	struct page *page = NULL;
+
+	spin_lock(&mm->page_table_lock);
+	if (unlikely(!pmd_trans_huge(*pmd)))
+		goto out;
+	if ((flags & FOLL_WRITE) && !pmd_write(*pmd)) {
+		spin_unlock(&mm->page_table_lock);
+		__split_huge_page_pmd(mm, pmd);
+		return NULL;
+	}
+
+	page = pmd_trans_huge_page(*pmd) +
+		((address & ~HPAGE_PMD_MASK) >> PAGE_SHIFT);
+	if (flags & FOLL_GET)
+		get_page(page);
+	if (flags & FOLL_TOUCH) {
+		if ((flags & FOLL_WRITE) &&
+		    !pmd_dirty(*pmd) && !PageDirty(page))
+			set_page_dirty(page);
+		mark_page_accessed(page);
+	}
+out:
+	spin_unlock(&mm->page_table_lock);
+	return page;
+}
+
+/*
+ * Unmap a whole huge pmd.  Returns 0 if the pmd was split under us, in
+ * which case the caller has to zap the ptes instead.
+ */
+int zap_huge_pmd(struct mmu_gather *tlb, struct vm_area_struct *vma,
+		 pmd_t *pmd)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	pgtable_t pgtable;
+	struct page *page;
+	pmd_t orig;
+	int i;
+
+	spin_lock(&mm->page_table_lock);
+	if (unlikely(!pmd_trans_huge(*pmd))) {
+		spin_unlock(&mm->page_table_lock);
+		return 0;
+	}
+	orig = pmdp_get_and_clear(mm, 0, pmd);
+	pgtable = withdraw_pmd_huge_pte(mm);
+	mm->nr_ptes--;
+	spin_unlock(&mm->page_table_lock);
+
+	page = pmd_trans_huge_page(orig);
+	dec_zone_page_state(page, huge_pmd_stat_item(page));
+	if (PageAnon(page))
+		add_mm_counter(mm, MM_ANONPAGES, -HPAGE_PMD_NR);
+	else
+		add_mm_counter(mm, MM_FILEPAGES, -HPAGE_PMD_NR);
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		if (!PageAnon(page + i)) {
+			/* as zap_pte_range() does for file ptes */
+			if (pmd_dirty(orig))
+				set_page_dirty(page + i);
+			if (pmd_young(orig) &&
+			    likely(!VM_SequentialReadHint(vma)))
+				mark_page_accessed(page + i);
+		}
+		page_remove_rmap(page + i);
+		VM_BUG_ON(page_mapcount(page + i) < 0);
+		tlb_remove_page(tlb, page + i);
+	}
+	pte_free(mm, pgtable);
+	return 1;
+}
+
+int mincore_huge_pmd(struct vm_area_struct *vma, pmd_t *pmd,
+		     unsigned long addr, unsigned long end,
+		     unsigned char *vec)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	int ret = 0;
+
+	spin_lock(&mm->page_table_lock);
+	if (likely(pmd_trans_huge(*pmd))) {
+		memset(vec, 1, (end - addr) >> PAGE_SHIFT);
+		ret = 1;
+	}
+	spin_unlock(&mm->page_table_lock);
+	return ret;
+}
+
+static pmd_t *huge_pmd_offset(struct mm_struct *mm, unsigned long address)
+{
+	pgd_t *pgd;
+	pud_t *pud;
+
+	pgd = pgd_offset(mm, address);
+	if (!pgd_present(*pgd))
+		return NULL;
+	pud = pud_offset(pgd, address);
+	if (!pud_present(*pud))
+		return NULL;
+	return pmd_offset(pud, address);
+}
+
+/*
+ * page_referenced() for a page that may be mapped by a huge pmd.  Returns
+ * -1 if @page is not mapped by a huge pmd at @address, otherwise whether
+ * the huge mapping has been referenced.  All subpages share the one
+ * accessed bit: it is only cleared when the last subpage is looked at,
+ * so that the whole block ages together.
+ */
+int page_referenced_huge_pmd(struct page *page, struct vm_area_struct *vma,
+			     unsigned long address)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	unsigned long index = (address & ~HPAGE_PMD_MASK) >> PAGE_SHIFT;
+	pmd_t *pmd;
+	int ret = -1;
+
+	pmd = huge_pmd_offset(mm, address);
+	if (!pmd || !pmd_trans_huge(*pmd))
+		return -1;
+
+	spin_lock(&mm->page_table_lock);
+	if (pmd_trans_huge(*pmd) &&
+	    pmd_trans_huge_page(*pmd) + index == page) {
+		if (index == HPAGE_PMD_NR - 1) {
+			ret = pmdp_test_and_clear_young(vma, address, pmd);
+			if (ret)
+				flush_tlb_range(vma, address & HPAGE_PMD_MASK,
+					(address & HPAGE_PMD_MASK) +
+					HPAGE_PMD_SIZE);
+		} else
+			ret = pmd_young(*pmd) != 0;
+		ret |= mmu_notifier_clear_flush_young(mm, address);
+	}
+	spin_unlock(&mm->page_table_lock);
+	return ret;
+}
+
+void __split_huge_page_pmd(struct mm_struct *mm, pmd_t *pmd)
+{
+	pgtable_t pgtable;
+	pmd_t orig, _pmd;
+	pte_t *pte;
+	int i;
+
+	spin_lock(&mm->page_table_lock);
+	if (unlikely(!pmd_trans_huge(*pmd)))
+		goto out;
+
+	/*
+	 * Never let a cpu see the small and the huge translation at the
+	 * same time: make the huge pmd not-present and flush it before
+	 * the pte table goes in.  It stays pmd_trans_huge() meanwhile, so
+	 * faults and walkers keep waiting on page_table_lock for us.  The
+	 * exchange returns the dirty and accessed bits as of the moment no
+	 * cpu could set them any more; the ptes are built from that.
+	 */
+	orig = pmdp_invalidate(mm, 0, pmd);
+	flush_tlb_mm(mm);
+
+	pgtable = withdraw_pmd_huge_pte(mm);
+	pmd_populate(mm, &_pmd, pgtable);
+	pte = pte_offset_map(&_pmd, 0);
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		set_pte(pte + i, pmd_subpage_pte(orig, i));
+	pte_unmap(pte);
+
+	smp_wmb(); /* See comment in __pte_alloc */
+	pmd_populate(mm, pmd, pgtable);
+
+	dec_zone_page_state(pmd_trans_huge_page(orig),
+			    huge_pmd_stat_item(pmd_trans_huge_page(orig)));
+	count_vm_event(THP_SPLIT);
+out:
+	spin_unlock(&mm->page_table_lock);
+}
+
+void __split_huge_page_vma(struct vm_area_struct *vma)
+{
+	unsigned long haddr = ALIGN(vma->vm_start, HPAGE_PMD_SIZE);
+	pmd_t *pmd;
+
+	for (; haddr + HPAGE_PMD_SIZE <= vma->vm_end; haddr += HPAGE_PMD_SIZE) {
+		pmd = huge_pmd_offset(vma->vm_mm, haddr);
+		if (pmd)
+			split_huge_page_pmd(vma->vm_mm, pmd);
+		cond_resched();
+	}
+}
+
+static void split_huge_page_address(struct mm_struct *mm,
+				    unsigned long address)
+{
+	pmd_t *pmd;
+
+	VM_BUG_ON(!(address & ~HPAGE_PMD_MASK));
+
+	pmd = huge_pmd_offset(mm, address);
+	if (pmd)
+		split_huge_page_pmd(mm, pmd);
+}
+
+static void split_huge_page_boundary(struct vm_area_struct *vma,
+				     unsigned long address)
+{
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+
+	if ((address & ~HPAGE_PMD_MASK) &&
+	    haddr >= vma->vm_start && haddr + HPAGE_PMD_SIZE <= vma->vm_end)
+		split_huge_page_address(vma->vm_mm, address);
+}
+
+void __vma_adjust_trans_huge(struct vm_area_struct *vma,
+			     unsigned long start, unsigned long end,
+			     long adjust_next)
+{
+	split_huge_page_boundary(vma, start);
+	split_huge_page_boundary(vma, end);
+
+	/* vma_adjust() is also going to move the start of the next vma */
+	if (adjust_next > 0) {
+		struct vm_area_struct *next = vma->vm_next;
+
+		split_huge_page_boundary(next, next->vm_start +
+					 (adjust_next << PAGE_SHIFT));
+	}
+}
+
+int hugepage_madvise(struct vm_area_struct *vma,
+		     unsigned long *vm_flags, int advice)
+{
+	switch (advice) {
+	case MADV_HUGEPAGE:
+		/* MADV_HUGEPAGE after MADV_NOHUGEPAGE is allowed */
+		if (*vm_flags & (VM_NO_THP & ~VM_NOHUGEPAGE))
+			return -EINVAL;
+		*vm_flags &= ~VM_NOHUGEPAGE;
+		*vm_flags |= VM_HUGEPAGE;
+		/*
+		 * Let khugepaged collapse what the vma already maps.  vm_flags
+		 * is only updated by our caller, check the new value.
+		 */
+		if (!test_bit(MMF_VM_HUGEPAGE, &vma->vm_mm->flags) &&
+		    !vma->vm_ops && khugepaged_enabled() &&
+		    __khugepaged_enter(vma->vm_mm))
+			return -ENOMEM;
+		break;
+	case MADV_NOHUGEPAGE:
+		*vm_flags &= ~VM_HUGEPAGE;
+		*vm_flags |= VM_NOHUGEPAGE;
+		break;
+	}
+	return 0;
+}
+
+/*
+ * khugepaged: collapse ranges mapped by small pages into huge pmds.
+ */
+
+static struct mm_slot *get_mm_slot(struct mm_struct *mm)
+{
+	struct mm_slot *mm_slot;
+	struct hlist_head *bucket;
+	struct hlist_node *node;
+
+	bucket = &mm_slots_hash[hash_ptr(mm, MM_SLOTS_HASH_SHIFT)];
+	hlist_for_each_entry(mm_slot, node, bucket, hash) {
+		if (mm == mm_slot->mm)
+			return mm_slot;
+	}
+	return NULL;
+}
+
+int __khugepaged_enter(struct mm_struct *mm)
+{
+	struct mm_slot *mm_slot;
+	int wakeup;
+
+	mm_slot = kmem_cache_zalloc(mm_slot_cache, GFP_KERNEL);
+	if (!mm_slot)
+		return -ENOMEM;
+
+	spin_lock(&khugepaged_mm_lock);
+	if (test_and_set_bit(MMF_VM_HUGEPAGE, &mm->flags)) {
+		spin_unlock(&khugepaged_mm_lock);
+		kmem_cache_free(mm_slot_cache, mm_slot);
+		return 0;
+	}
+	mm_slot->mm = mm;
+	hlist_add_head(&mm_slot->hash,
+		       &mm_slots_hash[hash_ptr(mm, MM_SLOTS_HASH_SHIFT)]);
+	/* insert just behind the scanning cursor, to let the area settle */
+	wakeup = list_empty(&khugepaged_scan.mm_head);
+	list_add_tail(&mm_slot->mm_node, &khugepaged_scan.mm_head);
+	spin_unlock(&khugepaged_mm_lock);
+
+	/* khugepaged keeps the mm_struct, not the address space, alive */
+	atomic_inc(&mm->mm_count);
+	if (wakeup)
+		wake_up_interruptible(&khugepaged_wait);
+	return 0;
+}
+
+void __khugepaged_exit(struct mm_struct *mm)
+{
+	struct mm_slot *mm_slot;
+	int free = 0;
+
+	spin_lock(&khugepaged_mm_lock);
+	mm_slot = get_mm_slot(mm);
+	if (mm_slot && khugepaged_scan.mm_slot != mm_slot) {
+		hlist_del(&mm_slot->hash);
+		list_del(&mm_slot->mm_node);
+		free = 1;
+	}
+	spin_unlock(&khugepaged_mm_lock);
+
+	if (free) {
+		clear_bit(MMF_VM_HUGEPAGE, &mm->flags);
+		kmem_cache_free(mm_slot_cache, mm_slot);
+		mmdrop(mm);
+	} else if (mm_slot) {
+		/*
+		 * khugepaged is scanning this mm right now: wait for it to
+		 * drop mmap_sem.  It notices mm_users dropped to zero next
+		 * time it takes mmap_sem and leaves the page tables alone,
+		 * releasing the slot itself.
+		 */
+		down_write(&mm->mmap_sem);
+		up_write(&mm->mmap_sem);
+	}
+}
+
+/* Called with khugepaged_mm_lock held, returns the mm to mmdrop() */
+static struct mm_struct *collect_mm_slot(struct mm_slot *mm_slot)
+{
+	struct mm_struct *mm = mm_slot->mm;
+
+	if (!khugepaged_test_exit(mm))
+		return NULL;
+
+	hlist_del(&mm_slot->hash);
+	list_del(&mm_slot->mm_node);
+	clear_bit(MMF_VM_HUGEPAGE, &mm->flags);
+	kmem_cache_free(mm_slot_cache, mm_slot);
+	return mm;
+}
+
+static void release_pte_pages(pte_t *pte, pte_t *_pte)
+{
+	while (--_pte >= pte) {
+		pte_t pteval = *_pte;
+		struct page *page;
+
+		if (pte_none(pteval))
+			continue;
+		page = pte_page(pteval);
+		dec_zone_page_state(page, NR_ISOLATED_ANON);
+		unlock_page(page);
+		putback_lru_page(page);
+	}
+}
+
+/*
+ * Take the pages mapped by @pte off the LRU and lock them, provided all
+ * of them are exclusively owned, writable anonymous pages.
+ */
+static int __collapse_huge_page_isolate(struct vm_area_struct *vma,
+					unsigned long address, pte_t *pte)
+{
+	struct page *page;
+	pte_t *_pte;
+	int none = 0;
+
+	for (_pte = pte; _pte < pte + HPAGE_PMD_NR;
+	     _pte++, address += PAGE_SIZE) {
+		pte_t pteval = *_pte;
+
+		if (pte_none(pteval)) {
+			if (++none <= khugepaged_max_ptes_none)
+				continue;
+			goto out;
+		}
+		if (!pte_present(pteval) || !pte_write(pteval))
+			goto out;
+		page = vm_normal_page(vma, address, pteval);
+		if (unlikely(!page))
+			goto out;
+		VM_BUG_ON(!PageAnon(page));
+
+		/* only the pte may hold a reference: no swapcache, no pins */
+		if (page_count(page) != 1)
+			goto out;
+		if (!trylock_page(page))
+			goto out;
+		if (isolate_lru_page(page)) {
+			unlock_page(page);
+			goto out;
+		}
+		inc_zone_page_state(page, NR_ISOLATED_ANON);
+	}
+	return 1;
+
+out:
+	release_pte_pages(pte, _pte);
+	return 0;
+}
+
+/* Copy the isolated pages into @page and free them, returns the holes */
+static int __collapse_huge_page_copy(pte_t *pte, struct page *page,
+				     struct vm_area_struct *vma,
+				     unsigned long address, spinlock_t *ptl)
+{
+	pte_t *_pte;
+	int none = 0;
+
+	for (_pte = pte; _pte < pte + HPAGE_PMD_NR;
+	     _pte++, page++, address += PAGE_SIZE) {
+		pte_t pteval = *_pte;
+		struct page *src_page;
+
+		if (pte_none(pteval)) {
+			clear_user_highpage(page, address);
+			none++;
+		} else {
+			src_page = pte_page(pteval);
+			copy_user_highpage(page, src_page, address, vma);
+			VM_BUG_ON(page_mapcount(src_page) != 1);
+			VM_BUG_ON(page_count(src_page) != 2);
+
+			spin_lock(ptl);
+			pte_clear(vma->vm_mm, address, _pte);
+			page_remove_rmap(src_page);
+			spin_unlock(ptl);
+
+			dec_zone_page_state(src_page, NR_ISOLATED_ANON);
+			unlock_page(src_page);
+			/* drop the isolation reference and the pte's one */
+			put_page(src_page);
+			put_page(src_page);
+		}
+		__SetPageUptodate(page);
+		cond_resched();
+	}
+	return none;
+}
+
+static int collapse_huge_page(struct mm_struct *mm, unsigned long address)
+{
+	struct vm_area_struct *vma;
+	struct page *new_page;
+	pmd_t *pmd, _pmd;
+	pte_t *pte;
+	pgtable_t pgtable;
+	spinlock_t *ptl;
+	unsigned long hstart, hend;
+	int i, none;
+
+	VM_BUG_ON(address & ~HPAGE_PMD_MASK);
+
+	/* the allocation may take a while, don't hold mmap_sem over it */
+	up_read(&mm->mmap_sem);
+
+	new_page = alloc_hugepage(NULL, address);
+	if (unlikely(!new_page)) {
+		count_vm_event(THP_COLLAPSE_ALLOC_FAILED);
+		return -ENOMEM;
+	}
+	count_vm_event(THP_COLLAPSE_ALLOC);
+	if (unlikely(mem_cgroup_charge_hugepage(new_page, mm))) {
+		free_hugepage(new_page);
+		return 0;
+	}
+
+	down_write(&mm->mmap_sem);
+	if (unlikely(khugepaged_test_exit(mm)))
+		goto out;
+
+	/* everything may have changed while mmap_sem was dropped */
+	vma = find_vma(mm, address);
+	if (!vma)
+		goto out;
+	hstart = (vma->vm_start + ~HPAGE_PMD_MASK) & HPAGE_PMD_MASK;
+	hend = vma->vm_end & HPAGE_PMD_MASK;
+	if (address < hstart || address + HPAGE_PMD_SIZE > hend)
+		goto out;
+	if (!transparent_hugepage_enabled(vma) || !vma->anon_vma)
+		goto out;
+
+	pmd = huge_pmd_offset(mm, address);
+	if (!pmd || !pmd_present(*pmd) || pmd_trans_huge(*pmd))
+		goto out;
+
+	mmu_notifier_invalidate_range_start(mm, address,
+					    address + HPAGE_PMD_SIZE);
+	/*
+	 * With mmap_sem held for writing and the anon_vma locked, neither
+	 * page faults nor rmap walkers can get at the range while its pmd
+	 * is cleared.  Flushing the TLB also waits out gup_fast().
+	 */
+	vma_write_begin(vma);
+	anon_vma_lock(vma->anon_vma);
+	spin_lock(&mm->page_table_lock);
+	_pmd = pmdp_get_and_clear(mm, address, pmd);
+	spin_unlock(&mm->page_table_lock);
+	flush_tlb_range(vma, address, address + HPAGE_PMD_SIZE);
+
+	pte = pte_offset_map(&_pmd, address);
+	ptl = pte_lockptr(mm, &_pmd);
+	spin_lock(ptl);
+	i = __collapse_huge_page_isolate(vma, address, pte);
+	spin_unlock(ptl);
+
+	if (unlikely(!i)) {
+		pte_unmap(pte);
+		spin_lock(&mm->page_table_lock);
+		BUG_ON(!pmd_none(*pmd));
+		set_pmd(pmd, _pmd);
+		spin_unlock(&mm->page_table_lock);
+		anon_vma_unlock(vma->anon_vma);
+		vma_write_end(vma);
+		mmu_notifier_invalidate_range_end(mm, address,
+						  address + HPAGE_PMD_SIZE);
+		goto out;
+	}
+
+	/* isolated and locked, rmap walkers can no longer find the pages */
+	anon_vma_unlock(vma->anon_vma);
+
+	none = __collapse_huge_page_copy(pte, new_page, vma, address, ptl);
+	pte_unmap(pte);
+	pgtable = pmd_pgtable(_pmd);
+
+	spin_lock(&mm->page_table_lock);
+	BUG_ON(!pmd_none(*pmd));
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		page_add_new_anon_rmap(new_page + i, vma,
+				       address + i * PAGE_SIZE);
+	/* the pte table stays accounted in nr_ptes while deposited */
+	deposit_pmd_huge_pte(mm, pgtable);
+	add_mm_counter(mm, MM_ANONPAGES, none);
+	inc_zone_page_state(new_page, NR_ANON_TRANSPARENT_HUGEPAGES);
+	set_pmd(pmd, mk_huge_pmd(new_page, vma));
+	spin_unlock(&mm->page_table_lock);
+	vma_write_end(vma);
+	mmu_notifier_invalidate_range_end(mm, address,
+					  address + HPAGE_PMD_SIZE);
+
+	khugepaged_pages_collapsed++;
+	up_write(&mm->mmap_sem);
+	return 0;
+
+out:
+	up_write(&mm->mmap_sem);
+	mem_cgroup_uncharge_hugepage(new_page);
+	free_hugepage(new_page);
+	return 0;
+}
+
+/*
+ * Look whether the range at @address is worth collapsing.  Returns 0 with
+ * mmap_sem still held for reading, otherwise mmap_sem has been released
+ * and a collapse attempted; -ENOMEM if no huge page could be allocated.
+ */
+static int khugepaged_scan_pmd(struct mm_struct *mm,
+			       struct vm_area_struct *vma,
+			       unsigned long address)
+{
+	unsigned long _address;
+	int none = 0, referenced = 0;
+	struct page *page;
+	pte_t *pte, *_pte;
+	spinlock_t *ptl;
+	pmd_t *pmd;
+	int ret = 0;
+
+	VM_BUG_ON(address & ~HPAGE_PMD_MASK);
+
+	pmd = huge_pmd_offset(mm, address);
+	if (!pmd || !pmd_present(*pmd) || pmd_trans_huge(*pmd))
+		return 0;
+
+	pte = pte_offset_map_lock(mm, pmd, address, &ptl);
+	for (_address = address, _pte = pte; _pte < pte + HPAGE_PMD_NR;
+	     _pte++, _address += PAGE_SIZE) {
+		pte_t pteval = *_pte;
+
+		if (pte_none(pteval)) {
+			if (++none <= khugepaged_max_ptes_none)
+				continue;
+			goto out_unmap;
+		}
+		if (!pte_present(pteval) || !pte_write(pteval))
+			goto out_unmap;
+		page = vm_normal_page(vma, _address, pteval);
+		if (unlikely(!page) || !PageLRU(page) || PageLocked(page))
+			goto out_unmap;
+		VM_BUG_ON(!PageAnon(page));
+		if (page_count(page) != 1)
+			goto out_unmap;
+		if (pte_young(pteval) || PageReferenced(page))
+			referenced = 1;
+	}
+	ret = referenced;
+out_unmap:
+	pte_unmap_unlock(pte, ptl);
+	if (ret)
+		/* collapse_huge_page() releases mmap_sem */
+		return collapse_huge_page(mm, address) ? : 1;
+	return 0;
+}
+
+static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
+					    int *alloc_failed)
+{
+	struct mm_slot *mm_slot;
+	struct mm_struct *mm, *drop = NULL;
+	struct vm_area_struct *vma;
+	unsigned int progress = 0;
+
+	spin_lock(&khugepaged_mm_lock);
+	if (khugepaged_scan.mm_slot)
+		mm_slot = khugepaged_scan.mm_slot;
+	else if (list_empty(&khugepaged_scan.mm_head)) {
+		/* the last mm exited since khugepaged_has_work() */
+		spin_unlock(&khugepaged_mm_lock);
+		return pages;
+	} else {
+		mm_slot = list_entry(khugepaged_scan.mm_head.next,
+				     struct mm_slot, mm_node);
+		khugepaged_scan.address = 0;
+		khugepaged_scan.mm_slot = mm_slot;
+	}
+	spin_unlock(&khugepaged_mm_lock);
+
+	mm = mm_slot->mm;
+	down_read(&mm->mmap_sem);
+	if (unlikely(khugepaged_test_exit(mm)))
+		vma = NULL;
+	else
+		vma = find_vma(mm, khugepaged_scan.address);
+
+	progress++;
+	for (; vma; vma = vma->vm_next) {
+		unsigned long hstart, hend;
+
+		cond_resched();
+		if (unlikely(khugepaged_test_exit(mm))) {
+			progress++;
+			break;
+		}
+
+		hstart = (vma->vm_start + ~HPAGE_PMD_MASK) & HPAGE_PMD_MASK;
+		hend = vma->vm_end & HPAGE_PMD_MASK;
+		if (!transparent_hugepage_enabled(vma) || !vma->anon_vma ||
+		    hstart >= hend || khugepaged_scan.address > hend) {
+			progress++;
+			continue;
+		}
+		if (khugepaged_scan.address < hstart)
+			khugepaged_scan.address = hstart;
+
+		while (khugepaged_scan.address < hend) {
+			int ret;
+
+			cond_resched();
+			if (unlikely(khugepaged_test_exit(mm)))
+				goto breakouterloop;
+
+			ret = khugepaged_scan_pmd(mm, vma,
+						  khugepaged_scan.address);
+			khugepaged_scan.address += HPAGE_PMD_SIZE;
+			progress += HPAGE_PMD_NR;
+			if (ret) {
+				/* mmap_sem was released */
+				if (ret < 0)
+					*alloc_failed = 1;
+				goto breakouterloop_mmap_sem;
+			}
+			if (progress >= pages)
+				goto breakouterloop;
+		}
+	}
+breakouterloop:
+	up_read(&mm->mmap_sem); /* exit_mmap will destroy ptes after this */
+breakouterloop_mmap_sem:
+
+	spin_lock(&khugepaged_mm_lock);
+	VM_BUG_ON(khugepaged_scan.mm_slot != mm_slot);
+	/*
+	 * Release the current mm_slot if this mm is about to die, or
+	 * if we scanned all vmas of this mm.
+	 */
+	if (khugepaged_test_exit(mm) || !vma) {
+		if (mm_slot->mm_node.next != &khugepaged_scan.mm_head) {
+			khugepaged_scan.mm_slot = list_entry(
+				mm_slot->mm_node.next,
+				struct mm_slot, mm_node);
+			khugepaged_scan.address = 0;
+		} else {
+			khugepaged_scan.mm_slot = NULL;
+			khugepaged_full_scans++;
+		}
+		drop = collect_mm_slot(mm_slot);
+	}
+	spin_unlock(&khugepaged_mm_lock);
+
+	if (drop)
+		mmdrop(drop);
+	return progress;
+}
+
+static int khugepaged_has_work(void)
+{
+	return !list_empty(&khugepaged_scan.mm_head) && khugepaged_enabled();
+}
+
+static int khugepaged_wait_event(void)
+{
+	return khugepaged_has_work() || kthread_should_stop();
+}
+
+/* Returns whether a huge page allocation failed */
+static int khugepaged_do_scan(void)
+{
+	unsigned int progress = 0, pass_through_head = 0;
+	unsigned int pages = khugepaged_pages_to_scan;
+	int alloc_failed = 0;
+
+	while (progress < pages && !alloc_failed) {
+		cond_resched();
+
+		if (unlikely(kthread_should_stop() || freezing(current)))
+			break;
+
+		if (!khugepaged_scan.mm_slot)
+			pass_through_head++;
+		if (!khugepaged_has_work() || pass_through_head >= 2)
+			break;
+		progress += khugepaged_scan_mm_slot(pages - progress,
+						    &alloc_failed);
+	}
+	return alloc_failed;
+}
+
+static int khugepaged(void *none)
+{
+	set_freezable();
+	set_user_nice(current, 19);
+
+	while (!kthread_should_stop()) {
+		unsigned int msecs;
+
+		if (!khugepaged_has_work()) {
+			wait_event_freezable(khugepaged_wait,
+					     khugepaged_wait_event());
+			continue;
+		}
+
+		if (khugepaged_do_scan())
+			msecs = khugepaged_alloc_sleep_millisecs;
+		else
+			msecs = khugepaged_scan_sleep_millisecs;
+		if (msecs)
+			wait_event_freezable_timeout(khugepaged_wait,
+						     kthread_should_stop(),
+						     msecs_to_jiffies(msecs));
+	}
+	return 0;
+}
+
+#ifdef CONFIG_SYSFS
+
+#define THP_ATTR_RO(_name) \
+	static struct kobj_attribute _name##_attr = __ATTR_RO(_name)
+#define THP_ATTR(_name) \
+	static struct kobj_attribute _name##_attr = \
+		__ATTR(_name, 0644, _name##_show, _name##_store)
+
+static const char * const transparent_hugepage_modes[] = {
+	[TRANSPARENT_HUGEPAGE_NEVER]	= "never",
+	[TRANSPARENT_HUGEPAGE_MADVISE]	= "madvise",
+	[TRANSPARENT_HUGEPAGE_ALWAYS]	= "always",
+};
+
+static ssize_t enabled_show(struct kobject *kobj,
+			    struct kobj_attribute *attr, char *buf)
+{
+	ssize_t len = 0;
+	int i;
+
+	for (i = TRANSPARENT_HUGEPAGE_ALWAYS;
+	     i >= TRANSPARENT_HUGEPAGE_NEVER; i--)
+		len += sprintf(buf + len,
+			       i == transparent_hugepage_mode ? "[%s]%s" : "%s%s",
+			       transparent_hugepage_modes[i],
+			       i == TRANSPARENT_HUGEPAGE_NEVER ? "\n" : " ");
+	return len;
+}
+
+static ssize_t enabled_store(struct kobject *kobj,
+			     struct kobj_attribute *attr,
+			     const char *buf, size_t count)
+{
+	int i;
+
+	for (i = TRANSPARENT_HUGEPAGE_NEVER;
+	     i <= TRANSPARENT_HUGEPAGE_ALWAYS; i++) {
+		if (sysfs_streq(buf, transparent_hugepage_modes[i])) {
+			transparent_hugepage_mode = i;
+			wake_up_interruptible(&khugepaged_wait);
+			return count;
+		}
+	}
+	return -EINVAL;
+}
+THP_ATTR(enabled);
+
+#ifdef CONFIG_SHMEM
+/* huge page policy of the internal mount: SysV shm, shared anon memory */
+static ssize_t shmem_enabled_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	ssize_t len = 0;
+	int i;
+
+	for (i = SHMEM_HUGE_ALWAYS; i >= SHMEM_HUGE_NEVER; i--)
+		len += sprintf(buf + len, i == shmem_huge ? "[%s]%s" : "%s%s",
+			       shmem_format_huge(i),
+			       i == SHMEM_HUGE_NEVER ? "\n" : " ");
+	return len;
+}
+
+static ssize_t shmem_enabled_store(struct kobject *kobj,
+				   struct kobj_attribute *attr,
+				   const char *buf, size_t count)
+{
+	int huge = shmem_parse_huge(buf);
+
+	if (huge < 0)
+		return huge;
+	shmem_huge = huge;
+	return count;
+}
+THP_ATTR(shmem_enabled);
+#endif
+
+static struct attribute *hugepage_attrs[] = {
+	&enabled_attr.attr,
+#ifdef CONFIG_SHMEM
+	&shmem_enabled_attr.attr,
+#endif
+	NULL,
+};
+
+static struct attribute_group hugepage_attr_group = {
+	.attrs = hugepage_attrs,
+};
+
+static ssize_t show_uint(char *buf, unsigned int val)
+{
+	return sprintf(buf, "%u\n", val);
+}
+
+static ssize_t store_uint(const char *buf, size_t count, unsigned int *val,
+			  unsigned long min, unsigned long max)
+{
+	unsigned long v;
+	int err;
+
+	err = strict_strtoul(buf, 10, &v);
+	if (err || v < min || v > max)
+		return -EINVAL;
+
+	*val = v;
+	wake_up_interruptible(&khugepaged_wait);
+	return count;
+}
+
+static ssize_t pages_to_scan_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return show_uint(buf, khugepaged_pages_to_scan);
+}
+
+static ssize_t pages_to_scan_store(struct kobject *kobj,
+				   struct kobj_attribute *attr,
+				   const char *buf, size_t count)
+{
+	return store_uint(buf, count, &khugepaged_pages_to_scan, 1, UINT_MAX);
+}
+THP_ATTR(pages_to_scan);
+
+static ssize_t scan_sleep_millisecs_show(struct kobject *kobj,
+					 struct kobj_attribute *attr,
+					 char *buf)
+{
+	return show_uint(buf, khugepaged_scan_sleep_millisecs);
+}
+
+static ssize_t scan_sleep_millisecs_store(struct kobject *kobj,
+					  struct kobj_attribute *attr,
+					  const char *buf, size_t count)
+{
+	return store_uint(buf, count, &khugepaged_scan_sleep_millisecs,
+			  0, UINT_MAX);
+}
+THP_ATTR(scan_sleep_millisecs);
+
+static ssize_t alloc_sleep_millisecs_show(struct kobject *kobj,
+					  struct kobj_attribute *attr,
+					  char *buf)
+{
+	return show_uint(buf, khugepaged_alloc_sleep_millisecs);
+}
+
+static ssize_t alloc_sleep_millisecs_store(struct kobject *kobj,
+					   struct kobj_attribute *attr,
+					   const char *buf, size_t count)
+{
+	return store_uint(buf, count, &khugepaged_alloc_sleep_millisecs,
+			  0, UINT_MAX);
+}
+THP_ATTR(alloc_sleep_millisecs);
+
+static ssize_t max_ptes_none_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return show_uint(buf, khugepaged_max_ptes_none);
+}
+
+static ssize_t max_ptes_none_store(struct kobject *kobj,
+				   struct kobj_attribute *attr,
+				   const char *buf, size_t count)
+{
+	return store_uint(buf, count, &khugepaged_max_ptes_none,
+			  0, HPAGE_PMD_NR - 1);
+}
+THP_ATTR(max_ptes_none);
+
+static ssize_t pages_collapsed_show(struct kobject *kobj,
+				    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", khugepaged_pages_collapsed);
+}
+THP_ATTR_RO(pages_collapsed);
+
+static ssize_t full_scans_show(struct kobject *kobj,
+			       struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", khugepaged_full_scans);
+}
+THP_ATTR_RO(full_scans);
+
+static struct attribute *khugepaged_attrs[] = {
+	&pages_to_scan_attr.attr,
+	&scan_sleep_millisecs_attr.attr,
+	&alloc_sleep_millisecs_attr.attr,
+	&max_ptes_none_attr.attr,
+	&pages_collapsed_attr.attr,
+	&full_scans_attr.attr,
+	NULL,
+};
+
+static struct attribute_group khugepaged_attr_group = {
+	.attrs = khugepaged_attrs,
+	.name = "khugepaged",
+};
+
+static int __init hugepage_init_sysfs(void)
+{
+	struct kobject *hugepage_kobj;
+	int err;
+
+	hugepage_kobj = kobject_create_and_add("transparent_hugepage",
+					       mm_kobj);
+	if (!hugepage_kobj)
+		return -ENOMEM;
+
+	err = sysfs_create_group(hugepage_kobj, &hugepage_attr_group);
+	if (!err)
+		err = sysfs_create_group(hugepage_kobj,
+					 &khugepaged_attr_group);
+	if (err)
+		kobject_put(hugepage_kobj);
+	return err;
+}
+#else
+static inline int hugepage_init_sysfs(void)
+{
+	return 0;
+}
+#endif /* CONFIG_SYSFS */
+
+static int __init hugepage_init(void)
+{
+	int err;
+
+	mm_slot_cache = KMEM_CACHE(mm_slot, 0);
+	if (!mm_slot_cache)
+		return -ENOMEM;
+
+	err = hugepage_init_sysfs();
+	if (err) {
+		printk(KERN_ERR "hugepage: register sysfs failed\n");
+		goto out_free;
+	}
+
+	khugepaged_thread = kthread_run(khugepaged, NULL, "khugepaged");
+	if (IS_ERR(khugepaged_thread)) {
+		printk(KERN_ERR "hugepage: creating kthread failed\n");
+		err = PTR_ERR(khugepaged_thread);
+		goto out_free;
+	}
+	return 0;
+
+out_free:
+	kmem_cache_destroy(mm_slot_cache);
+	return err;
+}
+module_init(hugepage_init)
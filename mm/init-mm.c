@@ -20,6 +20,10 @@ struct mm_struct init_mm = {
 	.mm_count	= ATOMIC_INIT(1),
 	.mmap_sem	= __RWSEM_INITIALIZER(init_mm.mmap_sem),
 	.page_table_lock =  __SPIN_LOCK_UNLOCKED(init_mm.page_table_lock),
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	.mm_rb_sequence	= SEQCNT_ZERO,
+	.mm_move_sequence = SEQCNT_ZERO,
+#endif
 	.mmlist		= LIST_HEAD_INIT(init_mm.mmlist),
 	.cpu_vm_mask	= CPU_MASK_ALL,
 	INIT_MM_CONTEXT(init_mm)
@@ -113,11 +113,13 @@ struct ksm_scan {
  * @node: rb node of this ksm page in the stable tree
  * @hlist: hlist head of rmap_items using this ksm page
  * @kpfn: page frame number of this ksm page
+ * @checksum: checksum of the ksm page, its first key in the stable tree
  */
 struct stable_node {
 	struct rb_node node;
 	struct hlist_head hlist;
 	unsigned long kpfn;
+	u32 checksum;
 };
 
 /**
@@ -126,7 +128,8 @@ struct stable_node {
  * @anon_vma: pointer to anon_vma for this mm,address, when in stable tree
  * @mm: the memory structure this rmap_item is pointing into
  * @address: the virtual address this rmap_item tracks (+ flags in low bits)
- * @oldchecksum: previous checksum of the page at that virtual address
+ * @oldchecksum: previous checksum of the page at that virtual address,
+ *	its first key in the unstable tree
  * @node: rb node of this rmap_item in the unstable tree
  * @head: pointer to stable_node heading this list in the stable tree
  * @hlist: link into hlist of rmap_items hanging off that stable_node
@@ -181,9 +184,18 @@ static unsigned long ksm_pages_unshared;
 /* The number of rmap_items in use: to calculate pages_volatile */
 static unsigned long ksm_rmap_items;
 
+/* The number of pages freed by merging, ever */
+static unsigned long ksm_pages_merged;
+
+/* CPU time ksmd spent scanning, in nanoseconds */
+static u64 ksm_scan_cpu_ns;
+
 /* Number of pages ksmd should scan in one batch */
 static unsigned int ksm_thread_pages_to_scan = 100;
 
+/* Batches may grow up to this while they merge pages: 0 disables */
+static unsigned int ksm_thread_max_pages_to_scan;
+
 /* Milliseconds ksmd should sleep between batches */
 static unsigned int ksm_thread_sleep_millisecs = 20;
 
@@ -667,6 +679,13 @@ error:
 }
 #endif /* CONFIG_SYSFS */
 
+static inline int cmp_checksum(u32 checksum, u32 tree_checksum)
+{
+	if (checksum < tree_checksum)
+		return -1;
+	return checksum > tree_checksum;
+}
+
 static u32 calc_checksum(struct page *page)
 {
 	u32 checksum;
@@ -946,7 +965,7 @@ static struct page *try_to_merge_two_pages(struct rmap_item *rmap_item,
  * This function returns the stable tree node of identical content if found,
  * NULL otherwise.
  */
-static struct page *stable_tree_search(struct page *page)
+static struct page *stable_tree_search(struct page *page, u32 checksum)
 {
 	struct rb_node *node = root_stable_tree.rb_node;
 	struct stable_node *stable_node;
@@ -963,6 +982,16 @@ static struct page *stable_tree_search(struct page *page)
 
 		cond_resched();
 		stable_node = rb_entry(node, struct stable_node, node);
+		/*
+		 * Pages with different checksums cannot be identical:
+		 * only look at the contents of ksm pages with ours.
+		 */
+		ret = cmp_checksum(checksum, stable_node->checksum);
+		if (ret) {
+			node = ret < 0 ? node->rb_left : node->rb_right;
+			continue;
+		}
+
 		tree_page = get_ksm_page(stable_node);
 		if (!tree_page)
 			return NULL;
@@ -994,6 +1023,10 @@ static struct stable_node *stable_tree_insert(struct page *kpage)
 	struct rb_node **new = &root_stable_tree.rb_node;
 	struct rb_node *parent = NULL;
 	struct stable_node *stable_node;
+	u32 checksum;
+
+	/* kpage is write-protected now: this checksum stays valid */
+	checksum = calc_checksum(kpage);
 
 	while (*new) {
 		struct page *tree_page;
@@ -1001,12 +1034,15 @@ static struct stable_node *stable_tree_insert(struct page *kpage)
 
 		cond_resched();
 		stable_node = rb_entry(*new, struct stable_node, node);
-		tree_page = get_ksm_page(stable_node);
-		if (!tree_page)
-			return NULL;
+		ret = cmp_checksum(checksum, stable_node->checksum);
+		if (!ret) {
+			tree_page = get_ksm_page(stable_node);
+			if (!tree_page)
+				return NULL;
 
-		ret = memcmp_pages(kpage, tree_page);
-		put_page(tree_page);
+			ret = memcmp_pages(kpage, tree_page);
+			put_page(tree_page);
+		}
 
 		parent = *new;
 		if (ret < 0)
@@ -1033,6 +1069,7 @@ static struct stable_node *stable_tree_insert(struct page *kpage)
 	INIT_HLIST_HEAD(&stable_node->hlist);
 
 	stable_node->kpfn = page_to_pfn(kpage);
+	stable_node->checksum = checksum;
 	set_page_stable_node(kpage, stable_node);
 
 	return stable_node;
@@ -1051,6 +1088,10 @@ static struct stable_node *stable_tree_insert(struct page *kpage)
  *
  * This function does both searching and inserting, because they share
  * the same walking algorithm in an rbtree.
+ *
+ * The tree is ordered by checksum first, so the walk only looks up and
+ * compares the pages that have the same checksum as ours: most steps
+ * cost neither a page table walk under mmap_sem nor a memcmp.
  */
 static
 struct rmap_item *unstable_tree_search_insert(struct rmap_item *rmap_item,
@@ -1068,6 +1109,14 @@ struct rmap_item *unstable_tree_search_insert(struct rmap_item *rmap_item,
 
 		cond_resched();
 		tree_rmap_item = rb_entry(*new, struct rmap_item, node);
+		ret = cmp_checksum(rmap_item->oldchecksum,
+				   tree_rmap_item->oldchecksum);
+		if (ret) {
+			parent = *new;
+			new = ret < 0 ? &parent->rb_left : &parent->rb_right;
+			continue;
+		}
+
 		tree_page = get_mergeable_page(tree_rmap_item);
 		if (IS_ERR_OR_NULL(tree_page))
 			return NULL;
@@ -1142,8 +1191,10 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 
 	remove_rmap_item_from_tree(rmap_item);
 
+	checksum = calc_checksum(page);
+
 	/* We first start with searching the page inside the stable tree */
-	kpage = stable_tree_search(page);
+	kpage = stable_tree_search(page, checksum);
 	if (kpage) {
 		err = try_to_merge_with_ksm_page(rmap_item, page, kpage);
 		if (!err) {
@@ -1154,6 +1205,7 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 			lock_page(kpage);
 			stable_tree_append(rmap_item, page_stable_node(kpage));
 			unlock_page(kpage);
+			ksm_pages_merged++;
 		}
 		put_page(kpage);
 		return;
@@ -1165,7 +1217,6 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 	 * don't want to insert it in the unstable tree, and we don't want
 	 * to waste our time searching for something identical to it there.
 	 */
-	checksum = calc_checksum(page);
 	if (rmap_item->oldchecksum != checksum) {
 		rmap_item->oldchecksum = checksum;
 		return;
@@ -1190,6 +1241,7 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 			if (stable_node) {
 				stable_tree_append(tree_rmap_item, stable_node);
 				stable_tree_append(rmap_item, stable_node);
+				ksm_pages_merged++;
 			}
 			unlock_page(kpage);
 
@@ -1368,14 +1420,41 @@ static int ksmd_should_run(void)
 	return (ksm_run & KSM_RUN_MERGE) && !list_empty(&ksm_mm_head.mm_list);
 }
 
+/*
+ * With max_pages_to_scan set, a batch that merged something doubles the
+ * next one, up to that limit; a batch that merged nothing halves it, down
+ * to pages_to_scan.  ksmd then scans fast only while it pays off.
+ */
+static unsigned int ksm_next_batch(unsigned int batch, unsigned long merged)
+{
+	unsigned int min = ksm_thread_pages_to_scan;
+	unsigned int max = ksm_thread_max_pages_to_scan;
+
+	if (max <= min)
+		return min;
+	if (merged)
+		batch = batch > max / 2 ? max : batch * 2;
+	else
+		batch /= 2;
+	return clamp(batch, min, max);
+}
+
 static int ksm_scan_thread(void *nothing)
 {
+	unsigned int batch = ksm_thread_pages_to_scan;
+
 	set_user_nice(current, 5);
 
 	while (!kthread_should_stop()) {
 		mutex_lock(&ksm_thread_mutex);
-		if (ksmd_should_run())
-			ksm_do_scan(ksm_thread_pages_to_scan);
+		if (ksmd_should_run()) {
+			unsigned long merged = ksm_pages_merged;
+			u64 runtime = task_sched_runtime(current);
+
+			ksm_do_scan(batch);
+			ksm_scan_cpu_ns += task_sched_runtime(current) - runtime;
+			batch = ksm_next_batch(batch, ksm_pages_merged - merged);
+		}
 		mutex_unlock(&ksm_thread_mutex);
 
 		if (ksmd_should_run()) {
@@ -1804,6 +1883,29 @@ static ssize_t pages_to_scan_store(struct kobject *kobj,
 }
 KSM_ATTR(pages_to_scan);
 
+static ssize_t max_pages_to_scan_show(struct kobject *kobj,
+				      struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_thread_max_pages_to_scan);
+}
+
+static ssize_t max_pages_to_scan_store(struct kobject *kobj,
+				       struct kobj_attribute *attr,
+				       const char *buf, size_t count)
+{
+	int err;
+	unsigned long nr_pages;
+
+	err = strict_strtoul(buf, 10, &nr_pages);
+	if (err || nr_pages > UINT_MAX)
+		return -EINVAL;
+
+	ksm_thread_max_pages_to_scan = nr_pages;
+
+	return count;
+}
+KSM_ATTR(max_pages_to_scan);
+
 static ssize_t run_show(struct kobject *kobj, struct kobj_attribute *attr,
 			char *buf)
 {
@@ -1896,15 +1998,49 @@ static ssize_t full_scans_show(struct kobject *kobj,
 }
 KSM_ATTR_RO(full_scans);
 
+static ssize_t pages_merged_show(struct kobject *kobj,
+				 struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_merged);
+}
+KSM_ATTR_RO(pages_merged);
+
+static ssize_t scan_cpu_msecs_show(struct kobject *kobj,
+				   struct kobj_attribute *attr, char *buf)
+{
+	u64 msecs = ksm_scan_cpu_ns;
+
+	do_div(msecs, NSEC_PER_MSEC);
+	return sprintf(buf, "%llu\n", (unsigned long long)msecs);
+}
+KSM_ATTR_RO(scan_cpu_msecs);
+
+static ssize_t cpu_usecs_per_merge_show(struct kobject *kobj,
+					struct kobj_attribute *attr, char *buf)
+{
+	u64 usecs = ksm_scan_cpu_ns;
+	unsigned long merged = ksm_pages_merged;
+
+	do_div(usecs, NSEC_PER_USEC);
+	if (merged)
+		do_div(usecs, merged);
+	return sprintf(buf, "%llu\n", (unsigned long long)usecs);
+}
+KSM_ATTR_RO(cpu_usecs_per_merge);
+
 static struct attribute *ksm_attrs[] = {
 	&sleep_millisecs_attr.attr,
 	&pages_to_scan_attr.attr,
+	&max_pages_to_scan_attr.attr,
 	&run_attr.attr,
 	&pages_shared_attr.attr,
 	&pages_sharing_attr.attr,
 	&pages_unshared_attr.attr,
 	&pages_volatile_attr.attr,
 	&full_scans_attr.attr,
+	&pages_merged_attr.attr,
+	&scan_cpu_msecs_attr.attr,
+	&cpu_usecs_per_merge_attr.attr,
 	NULL,
 };
 
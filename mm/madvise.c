@@ -11,8 +11,16 @@
 #include <linux/mempolicy.h>
 #include <linux/page-isolation.h>
 #include <linux/hugetlb.h>
+#include <linux/huge_mm.h>
 #include <linux/sched.h>
 #include <linux/ksm.h>
+#include <linux/swap.h>
+#include <linux/swapops.h>
+#include <linux/mmu_notifier.h>
+
+#include <asm/tlbflush.h>
+
+#include "internal.h"
 
 /*
  * Any behaviour which results in changes to the vma->vm_flags needs to
@@ -25,6 +33,7 @@ static int madvise_need_mmap_write(int behavior)
 	case MADV_REMOVE:
 	case MADV_WILLNEED:
 	case MADV_DONTNEED:
+	case MADV_FREE:
 		return 0;
 	default:
 		/* be safe, default to 1. list exceptions explicitly */
@@ -71,6 +80,12 @@ static long madvise_behavior(struct vm_area_struct * vma,
 		if (error)
 			goto out;
 		break;
+	case MADV_HUGEPAGE:
+	case MADV_NOHUGEPAGE:
+		error = hugepage_madvise(vma, &new_flags, behavior);
+		if (error)
+			goto out;
+		break;
 	}
 
 	if (new_flags == vma->vm_flags) {
@@ -104,7 +119,9 @@ success:
 	/*
 	 * vm_flags is protected by the mmap_sem held in write mode.
 	 */
+	vma_write_begin(vma);
 	vma->vm_flags = new_flags;
+	vma_write_end(vma);
 
 out:
 	if (error == -ENOMEM)
@@ -177,6 +194,118 @@ static long madvise_dontneed(struct vm_area_struct * vma,
 	return 0;
 }
 
+static int madvise_free_pte_range(pmd_t *pmd, unsigned long addr,
+				  unsigned long end, struct mm_walk *walk)
+{
+	struct vm_area_struct *vma = walk->private;
+	struct mm_struct *mm = vma->vm_mm;
+	pte_t *pte, ptent;
+	spinlock_t *ptl;
+	struct page *page;
+	int nr_swap = 0;
+
+	split_huge_page_pmd(mm, pmd);
+	if (pmd_none_or_trans_huge_or_clear_bad(pmd))
+		return 0;
+
+	pte = pte_offset_map_lock(mm, pmd, addr, &ptl);
+	flush_tlb_batched_pending(mm);
+	for (; addr != end; pte++, addr += PAGE_SIZE) {
+		ptent = *pte;
+		if (pte_none(ptent))
+			continue;
+
+		if (!pte_present(ptent)) {
+			swp_entry_t entry;
+
+			if (pte_file(ptent))
+				continue;
+			entry = pte_to_swp_entry(ptent);
+			if (non_swap_entry(entry))
+				continue;
+			/* nothing worth keeping: drop the swapped copy now */
+			free_swap_and_cache(entry);
+			pte_clear_not_present_full(mm, addr, pte, 0);
+			nr_swap++;
+			continue;
+		}
+
+		page = vm_normal_page(vma, addr, ptent);
+		if (!page || !PageAnon(page) || PageKsm(page) ||
+		    PageCompound(page))
+			continue;
+		/* a page shared with a fork child still holds its data */
+		if (page_mapcount(page) != 1)
+			continue;
+
+		if (PageSwapCache(page) || PageDirty(page)) {
+			if (!trylock_page(page))
+				continue;
+			if (PageSwapCache(page) && !try_to_free_swap(page)) {
+				unlock_page(page);
+				continue;
+			}
+			ClearPageDirty(page);
+			unlock_page(page);
+		}
+
+		/*
+		 * A clean, old pte on a clean page is what reclaim takes as
+		 * permission to discard.  A write before then dirties the
+		 * pte again and the page is swapped as usual.
+		 */
+		if (pte_young(ptent) || pte_dirty(ptent)) {
+			ptent = ptep_get_and_clear_full(mm, addr, pte, 0);
+			ptent = pte_mkold(pte_mkclean(ptent));
+			set_pte_at(mm, addr, pte, ptent);
+		}
+		ClearPageReferenced(page);
+		deactivate_page(page);
+		count_vm_event(PGLAZYFREE);
+	}
+	if (nr_swap)
+		add_mm_counter(mm, MM_SWAPENTS, -nr_swap);
+	pte_unmap_unlock(pte - 1, ptl);
+	cond_resched();
+	return 0;
+}
+
+/*
+ * Application no longer needs the contents of these anonymous pages,
+ * but may well reuse the memory soon.  Rather than zapping the range
+ * like MADV_DONTNEED, which costs a fault and a zeroed page on every
+ * reuse, the pages are marked clean and moved to the tail of the
+ * inactive list.  Under memory pressure reclaim discards them without
+ * swapping; if the application writes to a page first, the pte is
+ * dirty again and the page keeps its new contents.  Until either
+ * happens a read returns the old data.
+ */
+static long madvise_free(struct vm_area_struct *vma,
+			 struct vm_area_struct **prev,
+			 unsigned long start, unsigned long end)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	struct mm_walk free_walk = {
+		.pmd_entry = madvise_free_pte_range,
+		.mm = mm,
+		.private = vma,
+	};
+
+	*prev = vma;
+	if (vma->vm_flags & (VM_LOCKED|VM_HUGETLB|VM_PFNMAP))
+		return -EINVAL;
+	/* only anonymous memory: file pages have to be written back */
+	if (vma->vm_file || (vma->vm_flags & VM_SHARED))
+		return -EINVAL;
+
+	lru_add_drain();
+	mmu_notifier_invalidate_range_start(mm, start, end);
+	walk_page_range(start, end, &free_walk);
+	flush_tlb_range(vma, start, end);
+	mmu_notifier_invalidate_range_end(mm, start, end);
+	return 0;
+}
+
 /*
  * Application wants to free up the pages and associated backing store.
  * This is effectively punching a hole into the middle of a file.
@@ -260,6 +389,15 @@ madvise_vma(struct vm_area_struct *vma, struct vm_area_struct **prev,
 		return madvise_remove(vma, prev, start, end);
 	case MADV_WILLNEED:
 		return madvise_willneed(vma, prev, start, end);
+	case MADV_FREE:
+		/*
+		 * Reclaim discards lazily freed pages on its way to swapping
+		 * them out: without swap they would never be reclaimed, so
+		 * free them right away.
+		 */
+		if (nr_swap_pages > 0)
+			return madvise_free(vma, prev, start, end);
+		/* fall through */
 	case MADV_DONTNEED:
 		return madvise_dontneed(vma, prev, start, end);
 	default:
@@ -279,9 +417,14 @@ madvise_behavior_valid(int behavior)
 	case MADV_REMOVE:
 	case MADV_WILLNEED:
 	case MADV_DONTNEED:
+	case MADV_FREE:
 #ifdef CONFIG_KSM
 	case MADV_MERGEABLE:
 	case MADV_UNMERGEABLE:
+#endif
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	case MADV_HUGEPAGE:
+	case MADV_NOHUGEPAGE:
 #endif
 		return 1;
 
@@ -312,6 +455,10 @@ madvise_behavior_valid(int behavior)
  *		some pages ahead.
  *  MADV_DONTNEED - the application is finished with the given range,
  *		so the kernel can free resources associated with it.
+ *  MADV_FREE - the application is finished with the contents of the given
+ *		anonymous range: the kernel may discard the pages under
+ *		memory pressure instead of swapping them, unless they are
+ *		written to again first.
  *  MADV_REMOVE - the application wants to free up the given range of
  *		pages and associated backing store.
  *  MADV_DONTFORK - omit this area from child's address space when forking:
@@ -26,6 +26,7 @@
 #include <linux/cgroup.h>
 #include <linux/mm.h>
 #include <linux/hugetlb.h>
+#include <linux/huge_mm.h>
 #include <linux/pagemap.h>
 #include <linux/smp.h>
 #include <linux/page-flags.h>
@@ -48,6 +49,7 @@
 #include <linux/page_cgroup.h>
 #include <linux/cpu.h>
 #include <linux/oom.h>
+#include <linux/writeback.h>
 #include "internal.h"
 
 #include <asm/uaccess.h>
@@ -86,9 +88,21 @@ enum mem_cgroup_stat_index {
 	MEM_CGROUP_STAT_CACHE, 	   /* # of pages charged as cache */
 	MEM_CGROUP_STAT_RSS,	   /* # of pages charged as anon rss */
 	MEM_CGROUP_STAT_FILE_MAPPED,  /* # of pages charged as file rss */
+	MEM_CGROUP_STAT_FILE_DIRTY,	/* # of dirty pages in page cache */
+	MEM_CGROUP_STAT_WRITEBACK,	/* # of pages under writeback */
 	MEM_CGROUP_STAT_PGPGIN_COUNT,	/* # of pages paged in */
 	MEM_CGROUP_STAT_PGPGOUT_COUNT,	/* # of pages paged out */
 	MEM_CGROUP_STAT_SWAPOUT, /* # of pages, swapped out */
+	/* limit reclaim by the charging task; keep the same order below */
+	MEM_CGROUP_STAT_DIRECT_RECLAIM,	/* # of reclaims */
+	MEM_CGROUP_STAT_DIRECT_RECLAIM_US, /* usecs spent reclaiming */
+	MEM_CGROUP_STAT_PGSCAN_DIRECT,	/* # of pages scanned */
+	MEM_CGROUP_STAT_PGSTEAL_DIRECT,	/* # of pages reclaimed */
+	/* reclaim by the background worker, at the high watermark */
+	MEM_CGROUP_STAT_BG_RECLAIM,
+	MEM_CGROUP_STAT_BG_RECLAIM_US,
+	MEM_CGROUP_STAT_PGSCAN_BG,
+	MEM_CGROUP_STAT_PGSTEAL_BG,
 	MEM_CGROUP_EVENTS,	/* incremented at every  pagein/pageout */
 
 	MEM_CGROUP_STAT_NSTATS,
@@ -182,6 +196,17 @@ struct mem_cgroup_eventfd_list {
 static void mem_cgroup_threshold(struct mem_cgroup *mem);
 static void mem_cgroup_oom_notify(struct mem_cgroup *mem);
 
+/*
+ * Dirty page limits of a memory cgroup, as vm.dirty_* for the system.
+ * Only one of each ratio/bytes pair is in effect: the other is zero.
+ */
+struct vm_dirty_param {
+	int dirty_ratio;
+	int dirty_background_ratio;
+	unsigned long dirty_bytes;
+	unsigned long dirty_background_bytes;
+};
+
 /*
  * The memory controller data structure. The memory controller controls both
  * page cache and RSS per cgroup. We would eventually like to provide
@@ -227,6 +252,17 @@ struct mem_cgroup {
 	atomic_t	refcnt;
 
 	unsigned int	swappiness;
+	/* dirty page limits, protected by reclaim_param_lock */
+	struct vm_dirty_param dirty_param;
+
+	/*
+	 * Background reclaim starts when usage comes within
+	 * high_wmark_distance of the limit and goes on until it is
+	 * low_wmark_distance below it.  In pages, 0 is off.
+	 */
+	unsigned long	high_wmark_distance;
+	unsigned long	low_wmark_distance;
+	struct work_struct bgreclaim_work;
 	/* OOM-Killer disable */
 	int		oom_kill_disable;
 
@@ -1052,6 +1088,23 @@ static unsigned int get_swappiness(struct mem_cgroup *memcg)
 	return swappiness;
 }
 
+static void get_dirty_param(struct mem_cgroup *memcg,
+			    struct vm_dirty_param *param)
+{
+	/* root ? */
+	if (memcg->css.cgroup->parent == NULL) {
+		param->dirty_ratio = vm_dirty_ratio;
+		param->dirty_bytes = vm_dirty_bytes;
+		param->dirty_background_ratio = dirty_background_ratio;
+		param->dirty_background_bytes = dirty_background_bytes;
+		return;
+	}
+
+	spin_lock(&memcg->reclaim_param_lock);
+	*param = memcg->dirty_param;
+	spin_unlock(&memcg->reclaim_param_lock);
+}
+
 /* A routine for testing mem is not under move_account */
 
 static bool mem_cgroup_under_move(struct mem_cgroup *mem)
@@ -1250,11 +1303,13 @@ mem_cgroup_select_victim(struct mem_cgroup *root_mem)
 static int mem_cgroup_hierarchical_reclaim(struct mem_cgroup *root_mem,
 						struct zone *zone,
 						gfp_t gfp_mask,
-						unsigned long reclaim_options)
+						unsigned long reclaim_options,
+						unsigned long *total_scanned)
 {
 	struct mem_cgroup *victim;
 	int ret, total = 0;
 	int loop = 0;
+	unsigned long scanned;
 	bool noswap = reclaim_options & MEM_CGROUP_RECLAIM_NOSWAP;
 	bool shrink = reclaim_options & MEM_CGROUP_RECLAIM_SHRINK;
 	bool check_soft = reclaim_options & MEM_CGROUP_RECLAIM_SOFT;
@@ -1263,6 +1318,8 @@ static int mem_cgroup_hierarchical_reclaim(struct mem_cgroup *root_mem,
 	/* If memsw_is_minimum==1, swap-out is of-no-use. */
 	if (root_mem->memsw_is_minimum)
 		noswap = true;
+	if (total_scanned)
+		*total_scanned = 0;
 
 	while (1) {
 		victim = mem_cgroup_select_victim(root_mem);
@@ -1302,9 +1359,13 @@ static int mem_cgroup_hierarchical_reclaim(struct mem_cgroup *root_mem,
 		if (check_soft)
 			ret = mem_cgroup_shrink_node_zone(victim, gfp_mask,
 				noswap, get_swappiness(victim), zone);
-		else
+		else {
 			ret = try_to_free_mem_cgroup_pages(victim, gfp_mask,
-						noswap, get_swappiness(victim));
+						noswap, get_swappiness(victim),
+						&scanned);
+			if (total_scanned)
+				*total_scanned += scanned;
+		}
 		css_put(&victim->css);
 		/*
 		 * At shrinking usage, we can't check we should stop here or
@@ -1318,11 +1379,102 @@ static int mem_cgroup_hierarchical_reclaim(struct mem_cgroup *root_mem,
 			if (res_counter_check_under_soft_limit(&root_mem->res))
 				return total;
 		} else if (mem_cgroup_check_under_limit(root_mem))
-			return 1 + total;
+			return total;
 	}
 	return total;
 }
 
+static void mem_cgroup_reclaim_statistics(struct mem_cgroup *mem,
+					  bool background, ktime_t start,
+					  unsigned long scanned,
+					  unsigned long reclaimed)
+{
+	int idx = background ? MEM_CGROUP_STAT_BG_RECLAIM :
+			       MEM_CGROUP_STAT_DIRECT_RECLAIM;
+
+	this_cpu_inc(mem->stat->count[idx]);
+	this_cpu_add(mem->stat->count[idx + 1],
+		     ktime_us_delta(ktime_get(), start));
+	this_cpu_add(mem->stat->count[idx + 2], scanned);
+	this_cpu_add(mem->stat->count[idx + 3], reclaimed);
+}
+
+/*
+ * Is the usage of @mem within @distance pages of its limit?
+ */
+static bool mem_cgroup_near_limit(struct mem_cgroup *mem,
+				  unsigned long distance)
+{
+	unsigned long long limit, usage;
+
+	if (!distance)
+		return false;
+	limit = res_counter_read_u64(&mem->res, RES_LIMIT);
+	if (limit == RESOURCE_MAX)
+		return false;
+	usage = res_counter_read_u64(&mem->res, RES_USAGE);
+	return usage + ((unsigned long long)distance << PAGE_SHIFT) > limit;
+}
+
+static bool mem_cgroup_above_low_wmark(struct mem_cgroup *mem)
+{
+	return mem_cgroup_near_limit(mem, max(mem->low_wmark_distance,
+					      mem->high_wmark_distance));
+}
+
+/*
+ * The background reclaimer: like kswapd for a zone, it brings the usage
+ * of a cgroup past its high watermark back down to the low watermark, so
+ * that its tasks need not reclaim when they charge.  It reclaims from the
+ * cgroup's hierarchy one child at a time and gives up when nothing can
+ * be reclaimed any more.
+ */
+static void mem_cgroup_bgreclaim(struct work_struct *work)
+{
+	struct mem_cgroup *mem = container_of(work, struct mem_cgroup,
+					      bgreclaim_work);
+	unsigned long scanned, total_scanned = 0, total = 0;
+	int loop = 0;
+	ktime_t start;
+
+	if (css_is_removed(&mem->css))
+		goto out;
+
+	start = ktime_get();
+	while (mem_cgroup_above_low_wmark(mem)) {
+		int ret;
+
+		ret = mem_cgroup_hierarchical_reclaim(mem, NULL, GFP_KERNEL,
+						MEM_CGROUP_RECLAIM_SHRINK,
+						&scanned);
+		total_scanned += scanned;
+		total += ret;
+		if (!ret && ++loop > MEM_CGROUP_RECLAIM_RETRIES)
+			break;
+		cond_resched();
+	}
+	mem_cgroup_reclaim_statistics(mem, true, start, total_scanned, total);
+out:
+	mem_cgroup_put(mem);
+}
+
+/*
+ * Called after each charge to the res_counter: start background reclaim
+ * of @mem, or of any ancestor it is charged to, above its high watermark.
+ */
+static void mem_cgroup_check_wmarks(struct mem_cgroup *mem)
+{
+	for (; mem; mem = parent_mem_cgroup(mem)) {
+		if (!mem_cgroup_near_limit(mem, mem->high_wmark_distance))
+			continue;
+		if (work_pending(&mem->bgreclaim_work))
+			continue;
+		mem_cgroup_get(mem);
+		if (!queue_work(system_unbound_wq, &mem->bgreclaim_work))
+			mem_cgroup_put(mem);
+	}
+}
+
 static int mem_cgroup_oom_lock_cb(struct mem_cgroup *mem, void *data)
 {
 	int *val = (int *)data;
@@ -1461,36 +1613,69 @@ bool mem_cgroup_handle_oom(struct mem_cgroup *mem, gfp_t mask)
 }
 
 /*
- * Currently used to update mapped file statistics, but the routine can be
- * generalized to update other statistics as well.
+ * Update the mapped, dirty or writeback statistics of the cgroup a page
+ * is charged to.  The page_cgroup flag of each statistic records whether
+ * the page has been counted, so that move_account() can carry the counts
+ * over and an update racing with the charge or uncharge of the page is
+ * simply dropped instead of leaving the counter unbalanced.
+ *
+ * Called from interrupt context when writeback completes.
  */
-void mem_cgroup_update_file_mapped(struct page *page, int val)
+void mem_cgroup_update_page_stat(struct page *page,
+				 enum mem_cgroup_page_stat_item idx, int val)
 {
 	struct mem_cgroup *mem;
 	struct page_cgroup *pc;
+	unsigned long flags;
+	int stat, changed;
 
+	if (mem_cgroup_disabled())
+		return;
 	pc = lookup_page_cgroup(page);
 	if (unlikely(!pc))
 		return;
 
-	lock_page_cgroup(pc);
+	move_lock_page_cgroup(pc, &flags);
 	mem = pc->mem_cgroup;
 	if (!mem || !PageCgroupUsed(pc))
 		goto done;
 
-	/*
-	 * Preemption is already disabled. We can use __this_cpu_xxx
-	 */
-	if (val > 0) {
-		__this_cpu_inc(mem->stat->count[MEM_CGROUP_STAT_FILE_MAPPED]);
-		SetPageCgroupFileMapped(pc);
-	} else {
-		__this_cpu_dec(mem->stat->count[MEM_CGROUP_STAT_FILE_MAPPED]);
-		ClearPageCgroupFileMapped(pc);
+	switch (idx) {
+	case MEMCG_NR_FILE_MAPPED:
+		stat = MEM_CGROUP_STAT_FILE_MAPPED;
+		if (val > 0)
+			changed = !TestSetPageCgroupFileMapped(pc);
+		else
+			changed = TestClearPageCgroupFileMapped(pc);
+		break;
+	case MEMCG_NR_FILE_DIRTY:
+		stat = MEM_CGROUP_STAT_FILE_DIRTY;
+		if (val > 0) {
+			changed = !TestSetPageCgroupFileDirty(pc);
+			/* remember the dirtier for targeted writeback */
+			if (changed && page->mapping)
+				page->mapping->i_memcg = css_id(&mem->css);
+		} else
+			changed = TestClearPageCgroupFileDirty(pc);
+		break;
+	case MEMCG_NR_FILE_WRITEBACK:
+		stat = MEM_CGROUP_STAT_WRITEBACK;
+		if (val > 0)
+			changed = !TestSetPageCgroupFileWriteback(pc);
+		else
+			changed = TestClearPageCgroupFileWriteback(pc);
+		break;
+	default:
+		BUG();
 	}
 
+	/*
+	 * Interrupts are disabled. We can use __this_cpu_xxx
+	 */
+	if (changed)
+		__this_cpu_add(mem->stat->count[stat], val > 0 ? 1 : -1);
 done:
-	unlock_page_cgroup(pc);
+	move_unlock_page_cgroup(pc, &flags);
 }
 
 /*
@@ -1636,6 +1821,8 @@ static int __mem_cgroup_do_charge(struct mem_cgroup *mem, gfp_t gfp_mask,
 	struct mem_cgroup *mem_over_limit;
 	struct res_counter *fail_res;
 	unsigned long flags = 0;
+	unsigned long scanned;
+	ktime_t start;
 	int ret;
 
 	ret = res_counter_charge(&mem->res, csize, &fail_res);
@@ -1658,8 +1845,11 @@ static int __mem_cgroup_do_charge(struct mem_cgroup *mem, gfp_t gfp_mask,
 	if (!(gfp_mask & __GFP_WAIT))
 		return CHARGE_WOULDBLOCK;
 
+	start = ktime_get();
 	ret = mem_cgroup_hierarchical_reclaim(mem_over_limit, NULL,
-					gfp_mask, flags);
+					gfp_mask, flags, &scanned);
+	mem_cgroup_reclaim_statistics(mem_over_limit, false, start,
+				      scanned, ret);
 	/*
 	 * try_to_free_mem_cgroup_pages() might not give us a full
 	 * picture of reclaim. Some pages are reclaimed and might be
@@ -1807,6 +1997,7 @@ again:
 		}
 	} while (ret != CHARGE_OK);
 
+	mem_cgroup_check_wmarks(mem);
 	if (csize > PAGE_SIZE)
 		refill_stock(mem, csize - PAGE_SIZE);
 	css_put(&mem->css);
@@ -1959,29 +2150,45 @@ static void __mem_cgroup_commit_charge(struct mem_cgroup *mem,
  * @uncharge is false, so a caller should do "uncharge".
  */
 
+static void __mem_cgroup_move_stat(struct mem_cgroup *from,
+	struct mem_cgroup *to, int idx)
+{
+	__this_cpu_dec(from->stat->count[idx]);
+	__this_cpu_inc(to->stat->count[idx]);
+}
+
 static void __mem_cgroup_move_account(struct page_cgroup *pc,
 	struct mem_cgroup *from, struct mem_cgroup *to, bool uncharge)
 {
+	unsigned long flags;
+
 	VM_BUG_ON(from == to);
 	VM_BUG_ON(PageLRU(pc->page));
 	VM_BUG_ON(!PageCgroupLocked(pc));
 	VM_BUG_ON(!PageCgroupUsed(pc));
 	VM_BUG_ON(pc->mem_cgroup != from);
 
-	if (PageCgroupFileMapped(pc)) {
-		/* Update mapped_file data for mem_cgroup */
-		preempt_disable();
-		__this_cpu_dec(from->stat->count[MEM_CGROUP_STAT_FILE_MAPPED]);
-		__this_cpu_inc(to->stat->count[MEM_CGROUP_STAT_FILE_MAPPED]);
-		preempt_enable();
-	}
+	/*
+	 * Carry the page's file statistics over to @to, and switch
+	 * pc->mem_cgroup, without mem_cgroup_update_page_stat() seeing
+	 * one cgroup's counters with the other's pointer.
+	 */
+	move_lock_page_cgroup(pc, &flags);
+	if (PageCgroupFileMapped(pc))
+		__mem_cgroup_move_stat(from, to, MEM_CGROUP_STAT_FILE_MAPPED);
+	if (PageCgroupFileDirty(pc))
+		__mem_cgroup_move_stat(from, to, MEM_CGROUP_STAT_FILE_DIRTY);
+	if (PageCgroupFileWriteback(pc))
+		__mem_cgroup_move_stat(from, to, MEM_CGROUP_STAT_WRITEBACK);
+	/* caller should have done css_get */
+	pc->mem_cgroup = to;
+	move_unlock_page_cgroup(pc, &flags);
+
 	mem_cgroup_charge_statistics(from, pc, false);
 	if (uncharge)
 		/* This is not "cancel", but cancel_charge does all we need. */
 		mem_cgroup_cancel_charge(from);
 
-	/* caller should have done css_get */
-	pc->mem_cgroup = to;
 	mem_cgroup_charge_statistics(to, pc, true);
 	/*
 	 * We charges against "to" which may not have any tasks. Then, "to"
@@ -2324,6 +2531,7 @@ __mem_cgroup_uncharge_common(struct page *page, enum charge_type ctype)
 {
 	struct page_cgroup *pc;
 	struct mem_cgroup *mem = NULL;
+	unsigned long flags;
 
 	if (mem_cgroup_disabled())
 		return NULL;
@@ -2365,7 +2573,17 @@ __mem_cgroup_uncharge_common(struct page *page, enum charge_type ctype)
 
 	mem_cgroup_charge_statistics(mem, pc, false);
 
+	/*
+	 * A page is normally cleaned before it leaves the page cache, but
+	 * don't let a leftover dirty or writeback mark outlive the charge.
+	 */
+	move_lock_page_cgroup(pc, &flags);
+	if (TestClearPageCgroupFileDirty(pc))
+		__this_cpu_dec(mem->stat->count[MEM_CGROUP_STAT_FILE_DIRTY]);
+	if (TestClearPageCgroupFileWriteback(pc))
+		__this_cpu_dec(mem->stat->count[MEM_CGROUP_STAT_WRITEBACK]);
 	ClearPageCgroupUsed(pc);
+	move_unlock_page_cgroup(pc, &flags);
 	/*
 	 * pc->mem_cgroup is not cleared here. It will be accessed when it's
 	 * freed from LRU. This is safe because uncharged page is expected not
@@ -2791,7 +3009,7 @@ static int mem_cgroup_resize_limit(struct mem_cgroup *memcg,
 			break;
 
 		mem_cgroup_hierarchical_reclaim(memcg, NULL, GFP_KERNEL,
-						MEM_CGROUP_RECLAIM_SHRINK);
+						MEM_CGROUP_RECLAIM_SHRINK, NULL);
 		curusage = res_counter_read_u64(&memcg->res, RES_USAGE);
 		/* Usage is reduced ? */
   		if (curusage >= oldusage)
@@ -2851,7 +3069,7 @@ static int mem_cgroup_resize_memsw_limit(struct mem_cgroup *memcg,
 
 		mem_cgroup_hierarchical_reclaim(memcg, NULL, GFP_KERNEL,
 						MEM_CGROUP_RECLAIM_NOSWAP |
-						MEM_CGROUP_RECLAIM_SHRINK);
+						MEM_CGROUP_RECLAIM_SHRINK, NULL);
 		curusage = res_counter_read_u64(&memcg->memsw, RES_USAGE);
 		/* Usage is reduced ? */
 		if (curusage >= oldusage)
@@ -2893,7 +3111,7 @@ unsigned long mem_cgroup_soft_limit_reclaim(struct zone *zone, int order,
 
 		reclaimed = mem_cgroup_hierarchical_reclaim(mz->mem, zone,
 						gfp_mask,
-						MEM_CGROUP_RECLAIM_SOFT);
+						MEM_CGROUP_RECLAIM_SOFT, NULL);
 		nr_reclaimed += reclaimed;
 		spin_lock(&mctz->lock);
 
@@ -3080,7 +3298,8 @@ try_to_free:
 			goto out;
 		}
 		progress = try_to_free_mem_cgroup_pages(mem, GFP_KERNEL,
-						false, get_swappiness(mem));
+						false, get_swappiness(mem),
+						NULL);
 		if (!progress) {
 			nr_retries--;
 			/* maybe some writeback is necessary */
@@ -3356,9 +3575,19 @@ enum {
 	MCS_CACHE,
 	MCS_RSS,
 	MCS_FILE_MAPPED,
+	MCS_FILE_DIRTY,
+	MCS_WRITEBACK,
 	MCS_PGPGIN,
 	MCS_PGPGOUT,
 	MCS_SWAP,
+	MCS_DIRECT_RECLAIM,
+	MCS_DIRECT_RECLAIM_US,
+	MCS_PGSCAN_DIRECT,
+	MCS_PGSTEAL_DIRECT,
+	MCS_BG_RECLAIM,
+	MCS_BG_RECLAIM_US,
+	MCS_PGSCAN_BG,
+	MCS_PGSTEAL_BG,
 	MCS_INACTIVE_ANON,
 	MCS_ACTIVE_ANON,
 	MCS_INACTIVE_FILE,
@@ -3378,9 +3607,19 @@ struct {
 	{"cache", "total_cache"},
 	{"rss", "total_rss"},
 	{"mapped_file", "total_mapped_file"},
+	{"dirty", "total_dirty"},
+	{"writeback", "total_writeback"},
 	{"pgpgin", "total_pgpgin"},
 	{"pgpgout", "total_pgpgout"},
 	{"swap", "total_swap"},
+	{"direct_reclaim", "total_direct_reclaim"},
+	{"direct_reclaim_us", "total_direct_reclaim_us"},
+	{"pgscan_direct", "total_pgscan_direct"},
+	{"pgsteal_direct", "total_pgsteal_direct"},
+	{"background_reclaim", "total_background_reclaim"},
+	{"background_reclaim_us", "total_background_reclaim_us"},
+	{"pgscan_background", "total_pgscan_background"},
+	{"pgsteal_background", "total_pgsteal_background"},
 	{"inactive_anon", "total_inactive_anon"},
 	{"active_anon", "total_active_anon"},
 	{"inactive_file", "total_inactive_file"},
@@ -3393,6 +3632,7 @@ static int mem_cgroup_get_local_stat(struct mem_cgroup *mem, void *data)
 {
 	struct mcs_total_stat *s = data;
 	s64 val;
+	int i;
 
 	/* per cpu stat */
 	val = mem_cgroup_read_stat(mem, MEM_CGROUP_STAT_CACHE);
@@ -3401,6 +3641,10 @@ static int mem_cgroup_get_local_stat(struct mem_cgroup *mem, void *data)
 	s->stat[MCS_RSS] += val * PAGE_SIZE;
 	val = mem_cgroup_read_stat(mem, MEM_CGROUP_STAT_FILE_MAPPED);
 	s->stat[MCS_FILE_MAPPED] += val * PAGE_SIZE;
+	val = mem_cgroup_read_stat(mem, MEM_CGROUP_STAT_FILE_DIRTY);
+	s->stat[MCS_FILE_DIRTY] += val * PAGE_SIZE;
+	val = mem_cgroup_read_stat(mem, MEM_CGROUP_STAT_WRITEBACK);
+	s->stat[MCS_WRITEBACK] += val * PAGE_SIZE;
 	val = mem_cgroup_read_stat(mem, MEM_CGROUP_STAT_PGPGIN_COUNT);
 	s->stat[MCS_PGPGIN] += val;
 	val = mem_cgroup_read_stat(mem, MEM_CGROUP_STAT_PGPGOUT_COUNT);
@@ -3409,6 +3653,9 @@ static int mem_cgroup_get_local_stat(struct mem_cgroup *mem, void *data)
 		val = mem_cgroup_read_stat(mem, MEM_CGROUP_STAT_SWAPOUT);
 		s->stat[MCS_SWAP] += val * PAGE_SIZE;
 	}
+	for (i = 0; i <= MCS_PGSTEAL_BG - MCS_DIRECT_RECLAIM; i++)
+		s->stat[MCS_DIRECT_RECLAIM + i] += mem_cgroup_read_stat(mem,
+					MEM_CGROUP_STAT_DIRECT_RECLAIM + i);
 
 	/* per zone stat */
 	val = mem_cgroup_get_local_zonestat(mem, LRU_INACTIVE_ANON);
@@ -3534,6 +3781,269 @@ static int mem_cgroup_swappiness_write(struct cgroup *cgrp, struct cftype *cft,
 	return 0;
 }
 
+enum {
+	MEM_CGROUP_DIRTY_RATIO,
+	MEM_CGROUP_DIRTY_BYTES,
+	MEM_CGROUP_DIRTY_BACKGROUND_RATIO,
+	MEM_CGROUP_DIRTY_BACKGROUND_BYTES,
+};
+
+static u64 mem_cgroup_dirty_read(struct cgroup *cgrp, struct cftype *cft)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_cont(cgrp);
+	struct vm_dirty_param param;
+
+	get_dirty_param(memcg, &param);
+	switch (cft->private) {
+	case MEM_CGROUP_DIRTY_RATIO:
+		return param.dirty_ratio;
+	case MEM_CGROUP_DIRTY_BYTES:
+		return param.dirty_bytes;
+	case MEM_CGROUP_DIRTY_BACKGROUND_RATIO:
+		return param.dirty_background_ratio;
+	case MEM_CGROUP_DIRTY_BACKGROUND_BYTES:
+		return param.dirty_background_bytes;
+	default:
+		BUG();
+	}
+}
+
+/*
+ * As with the vm.dirty_* sysctls, setting a ratio clears the matching
+ * byte limit and the other way round.  The root cgroup uses the sysctls.
+ */
+static int mem_cgroup_dirty_write(struct cgroup *cgrp, struct cftype *cft,
+				  u64 val)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_cont(cgrp);
+	struct vm_dirty_param *param = &memcg->dirty_param;
+
+	if (cgrp->parent == NULL)
+		return -EINVAL;
+	if ((cft->private == MEM_CGROUP_DIRTY_RATIO ||
+	     cft->private == MEM_CGROUP_DIRTY_BACKGROUND_RATIO) && val > 100)
+		return -EINVAL;
+	if (val > ULONG_MAX)
+		return -EINVAL;
+
+	spin_lock(&memcg->reclaim_param_lock);
+	switch (cft->private) {
+	case MEM_CGROUP_DIRTY_RATIO:
+		param->dirty_ratio = val;
+		param->dirty_bytes = 0;
+		break;
+	case MEM_CGROUP_DIRTY_BYTES:
+		param->dirty_bytes = val;
+		param->dirty_ratio = 0;
+		break;
+	case MEM_CGROUP_DIRTY_BACKGROUND_RATIO:
+		param->dirty_background_ratio = val;
+		param->dirty_background_bytes = 0;
+		break;
+	case MEM_CGROUP_DIRTY_BACKGROUND_BYTES:
+		param->dirty_background_bytes = val;
+		param->dirty_background_ratio = 0;
+		break;
+	default:
+		BUG();
+	}
+	spin_unlock(&memcg->reclaim_param_lock);
+
+	return 0;
+}
+
+enum {
+	MEM_CGROUP_HIGH_WMARK,
+	MEM_CGROUP_LOW_WMARK,
+};
+
+static u64 mem_cgroup_wmark_read(struct cgroup *cgrp, struct cftype *cft)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_cont(cgrp);
+	unsigned long distance;
+
+	if (cft->private == MEM_CGROUP_HIGH_WMARK)
+		distance = memcg->high_wmark_distance;
+	else
+		distance = memcg->low_wmark_distance;
+	return (u64)distance << PAGE_SHIFT;
+}
+
+static int mem_cgroup_wmark_write(struct cgroup *cgrp, struct cftype *cft,
+				  const char *buffer)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_cont(cgrp);
+	unsigned long long val;
+	int ret;
+
+	/* the root cgroup has no limit to keep below */
+	if (cgrp->parent == NULL)
+		return -EINVAL;
+	ret = res_counter_memparse_write_strategy(buffer, &val);
+	if (ret)
+		return ret;
+	if (val == RESOURCE_MAX || (val >> PAGE_SHIFT) > ULONG_MAX)
+		return -EINVAL;
+
+	if (cft->private == MEM_CGROUP_HIGH_WMARK)
+		memcg->high_wmark_distance = val >> PAGE_SHIFT;
+	else
+		memcg->low_wmark_distance = val >> PAGE_SHIFT;
+	return 0;
+}
+
+static int mem_cgroup_wmarks_show(struct cgroup *cgrp, struct cftype *cft,
+				  struct cgroup_map_cb *cb)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_cont(cgrp);
+	unsigned long long limit, high, low;
+
+	limit = res_counter_read_u64(&memcg->res, RES_LIMIT);
+	high = (unsigned long long)memcg->high_wmark_distance << PAGE_SHIFT;
+	low = (unsigned long long)max(memcg->low_wmark_distance,
+				      memcg->high_wmark_distance) << PAGE_SHIFT;
+
+	cb->fill(cb, "high_wmark", limit > high ? limit - high : 0);
+	cb->fill(cb, "low_wmark", limit > low ? limit - low : 0);
+	return 0;
+}
+
+struct mem_cgroup_dirty_stat {
+	unsigned long nr_file_dirty;
+	unsigned long nr_writeback;
+	unsigned long nr_file_lru;
+};
+
+static int mem_cgroup_get_dirty_stat(struct mem_cgroup *mem, void *data)
+{
+	struct mem_cgroup_dirty_stat *stat = data;
+	s64 val;
+
+	val = mem_cgroup_read_stat(mem, MEM_CGROUP_STAT_FILE_DIRTY);
+	stat->nr_file_dirty += max_t(s64, val, 0);
+	val = mem_cgroup_read_stat(mem, MEM_CGROUP_STAT_WRITEBACK);
+	stat->nr_writeback += max_t(s64, val, 0);
+	stat->nr_file_lru += mem_cgroup_get_local_zonestat(mem, LRU_INACTIVE_FILE);
+	stat->nr_file_lru += mem_cgroup_get_local_zonestat(mem, LRU_ACTIVE_FILE);
+	return 0;
+}
+
+/*
+ * Pages @mem may still charge before it or one of its ancestors in the
+ * hierarchy hits its limit.
+ */
+static unsigned long mem_cgroup_margin(struct mem_cgroup *mem)
+{
+	unsigned long long margin = ULLONG_MAX;
+
+	do {
+		unsigned long long limit, usage;
+
+		limit = res_counter_read_u64(&mem->res, RES_LIMIT);
+		usage = res_counter_read_u64(&mem->res, RES_USAGE);
+		margin = min(margin, limit > usage ? limit - usage : 0);
+	} while ((mem = parent_mem_cgroup(mem)));
+
+	return min_t(unsigned long long, margin >> PAGE_SHIFT, ULONG_MAX);
+}
+
+/*
+ * The memory a cgroup's dirty ratios apply to is what it could fill with
+ * page cache: the file pages it holds plus the room left below its limit,
+ * but never more than the system's dirtyable memory.
+ */
+static void __mem_cgroup_dirty_info(struct mem_cgroup *mem,
+				    unsigned long sys_available_mem,
+				    struct mem_cgroup_dirty_info *info)
+{
+	struct mem_cgroup_dirty_stat stat = { 0, };
+	struct vm_dirty_param param;
+	unsigned long available_mem;
+
+	mem_cgroup_walk_tree(mem, &stat, mem_cgroup_get_dirty_stat);
+	available_mem = stat.nr_file_lru + mem_cgroup_margin(mem);
+	available_mem = min(available_mem, sys_available_mem);
+
+	get_dirty_param(mem, &param);
+	if (param.dirty_bytes)
+		info->dirty_thresh = DIV_ROUND_UP(param.dirty_bytes, PAGE_SIZE);
+	else
+		info->dirty_thresh = param.dirty_ratio * available_mem / 100;
+	if (param.dirty_background_bytes)
+		info->background_thresh =
+			DIV_ROUND_UP(param.dirty_background_bytes, PAGE_SIZE);
+	else
+		info->background_thresh =
+			param.dirty_background_ratio * available_mem / 100;
+	if (info->background_thresh >= info->dirty_thresh)
+		info->background_thresh = info->dirty_thresh / 2;
+
+	info->nr_file_dirty = stat.nr_file_dirty;
+	info->nr_writeback = stat.nr_writeback;
+	info->id = css_id(&mem->css);
+}
+
+/**
+ * mem_cgroup_dirty_info - dirty state of the current task's cgroup
+ * @sys_available_mem: the system's dirtyable memory, in pages
+ * @info: filled in with the cgroup's dirty pages and thresholds
+ *
+ * Returns false, leaving @info alone, when the task is in the root cgroup
+ * and only the global dirty limits apply.
+ */
+bool mem_cgroup_dirty_info(unsigned long sys_available_mem,
+			   struct mem_cgroup_dirty_info *info)
+{
+	struct mem_cgroup *mem;
+
+	if (mem_cgroup_disabled())
+		return false;
+
+	rcu_read_lock();
+	mem = mem_cgroup_from_task(current);
+	if (mem && (mem_cgroup_is_root(mem) || !css_tryget(&mem->css)))
+		mem = NULL;
+	rcu_read_unlock();
+	if (!mem)
+		return false;
+
+	__mem_cgroup_dirty_info(mem, sys_available_mem, info);
+	css_put(&mem->css);
+	return true;
+}
+
+/*
+ * Has the cgroup with css id @id more dirty pages than its background
+ * threshold?  Used by the flusher to know when to stop writing its inodes.
+ */
+bool mem_cgroup_over_bground_thresh(unsigned short id)
+{
+	struct mem_cgroup_dirty_info info;
+	struct mem_cgroup *mem;
+
+	rcu_read_lock();
+	mem = mem_cgroup_lookup(id);
+	if (mem && !css_tryget(&mem->css))
+		mem = NULL;
+	rcu_read_unlock();
+	if (!mem)
+		return false;
+
+	__mem_cgroup_dirty_info(mem, determine_dirtyable_memory(), &info);
+	css_put(&mem->css);
+	return info.nr_file_dirty > info.background_thresh;
+}
+
+/*
+ * Was @mapping last dirtied by the cgroup with css id @id?  Writeback on
+ * behalf of one cgroup skips the inodes of others.
+ */
+bool mem_cgroup_mapping_dirtied_by(struct address_space *mapping,
+				   unsigned short id)
+{
+	return mapping->i_memcg == id;
+}
+
 static void __mem_cgroup_threshold(struct mem_cgroup *memcg, bool swap)
 {
 	struct mem_cgroup_threshold_ary *t;
@@ -3912,6 +4422,46 @@ static struct cftype mem_cgroup_files[] = {
 		.read_u64 = mem_cgroup_swappiness_read,
 		.write_u64 = mem_cgroup_swappiness_write,
 	},
+	{
+		.name = "high_wmark_distance",
+		.read_u64 = mem_cgroup_wmark_read,
+		.write_string = mem_cgroup_wmark_write,
+		.private = MEM_CGROUP_HIGH_WMARK,
+	},
+	{
+		.name = "low_wmark_distance",
+		.read_u64 = mem_cgroup_wmark_read,
+		.write_string = mem_cgroup_wmark_write,
+		.private = MEM_CGROUP_LOW_WMARK,
+	},
+	{
+		.name = "reclaim_wmarks",
+		.read_map = mem_cgroup_wmarks_show,
+	},
+	{
+		.name = "dirty_ratio",
+		.read_u64 = mem_cgroup_dirty_read,
+		.write_u64 = mem_cgroup_dirty_write,
+		.private = MEM_CGROUP_DIRTY_RATIO,
+	},
+	{
+		.name = "dirty_bytes",
+		.read_u64 = mem_cgroup_dirty_read,
+		.write_u64 = mem_cgroup_dirty_write,
+		.private = MEM_CGROUP_DIRTY_BYTES,
+	},
+	{
+		.name = "dirty_background_ratio",
+		.read_u64 = mem_cgroup_dirty_read,
+		.write_u64 = mem_cgroup_dirty_write,
+		.private = MEM_CGROUP_DIRTY_BACKGROUND_RATIO,
+	},
+	{
+		.name = "dirty_background_bytes",
+		.read_u64 = mem_cgroup_dirty_read,
+		.write_u64 = mem_cgroup_dirty_write,
+		.private = MEM_CGROUP_DIRTY_BACKGROUND_BYTES,
+	},
 	{
 		.name = "move_charge_at_immigrate",
 		.read_u64 = mem_cgroup_move_charge_read,
@@ -4182,9 +4732,12 @@ mem_cgroup_create(struct cgroup_subsys *ss, struct cgroup *cont)
 	mem->last_scanned_child = 0;
 	spin_lock_init(&mem->reclaim_param_lock);
 	INIT_LIST_HEAD(&mem->oom_notify);
+	INIT_WORK(&mem->bgreclaim_work, mem_cgroup_bgreclaim);
 
-	if (parent)
+	if (parent) {
 		mem->swappiness = get_swappiness(parent);
+		get_dirty_param(parent, &mem->dirty_param);
+	}
 	atomic_set(&mem->refcnt, 1);
 	mem->move_charge_at_immigrate = 0;
 	mutex_init(&mem->thresholds_lock);
@@ -4430,6 +4983,10 @@ static int mem_cgroup_count_precharge_pte_range(pmd_t *pmd,
 	pte_t *pte;
 	spinlock_t *ptl;
 
+	split_huge_page_pmd(walk->mm, pmd);
+	if (pmd_none_or_trans_huge_or_clear_bad(pmd))
+		return 0;
+
 	pte = pte_offset_map_lock(vma->vm_mm, pmd, addr, &ptl);
 	for (; addr != end; pte++, addr += PAGE_SIZE)
 		if (is_target_pte_for_mc(vma, addr, *pte, NULL))
@@ -4593,7 +5150,10 @@ static int mem_cgroup_move_charge_pte_range(pmd_t *pmd,
 	pte_t *pte;
 	spinlock_t *ptl;
 
+	split_huge_page_pmd(walk->mm, pmd);
 retry:
+	if (pmd_none_or_trans_huge_or_clear_bad(pmd))
+		return 0;
 	pte = pte_offset_map_lock(vma->vm_mm, pmd, addr, &ptl);
 	for (; addr != end; addr += PAGE_SIZE) {
 		pte_t ptent = *(pte++);
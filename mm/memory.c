@@ -46,6 +46,7 @@
 #include <linux/highmem.h>
 #include <linux/pagemap.h>
 #include <linux/ksm.h>
+#include <linux/huge_mm.h>
 #include <linux/rmap.h>
 #include <linux/module.h>
 #include <linux/delayacct.h>
@@ -795,6 +796,8 @@ static inline int copy_pmd_range(struct mm_struct *dst_mm, struct mm_struct *src
 	src_pmd = pmd_offset(src_pud, addr);
 	do {
 		next = pmd_addr_end(addr, end);
+		/* huge pmds are not shared copy-on-write, give the child ptes */
+		split_huge_page_pmd(src_mm, src_pmd);
 		if (pmd_none_or_clear_bad(src_pmd))
 			continue;
 		if (copy_pte_range(dst_mm, src_mm, dst_pmd, src_pmd,
@@ -901,6 +904,7 @@ static unsigned long zap_pte_range(struct mmu_gather *tlb,
 	init_rss_vec(rss);
 
 	pte = pte_offset_map_lock(mm, pmd, addr, &ptl);
+	flush_tlb_batched_pending(mm);
 	arch_enter_lazy_mmu_mode();
 	do {
 		pte_t ptent = *pte;
@@ -997,7 +1001,16 @@ static inline unsigned long zap_pmd_range(struct mmu_gather *tlb,
 	pmd = pmd_offset(pud, addr);
 	do {
 		next = pmd_addr_end(addr, end);
-		if (pmd_none_or_clear_bad(pmd)) {
+		if (pmd_trans_huge(*pmd)) {
+			if (next - addr != HPAGE_PMD_SIZE)
+				split_huge_page_pmd(vma->vm_mm, pmd);
+			else if (zap_huge_pmd(tlb, vma, pmd)) {
+				(*zap_work) -= HPAGE_PMD_SIZE;
+				continue;
+			}
+			/* fall through */
+		}
+		if (pmd_none_or_trans_huge_or_clear_bad(pmd)) {
 			(*zap_work)--;
 			continue;
 		}
@@ -1273,7 +1286,14 @@ struct page *follow_page(struct vm_area_struct *vma, unsigned long address,
 	pmd = pmd_offset(pud, address);
 	if (pmd_none(*pmd))
 		goto no_page_table;
-	if (pmd_huge(*pmd)) {
+	if (pmd_trans_huge(*pmd) && !is_vm_hugetlb_page(vma)) {
+		page = follow_trans_huge_pmd(vma, address, pmd, flags);
+		if (page)
+			goto out;
+		/* split meanwhile: look at the ptes */
+		if (pmd_none_or_trans_huge_or_clear_bad(pmd))
+			goto no_page_table;
+	} else if (pmd_huge(*pmd)) {
 		BUG_ON(flags & FOLL_GET);
 		page = follow_huge_pmd(mm, address, pmd, flags & FOLL_WRITE);
 		goto out;
@@ -2646,11 +2666,15 @@ static int do_swap_page(struct mm_struct *mm, struct vm_area_struct *vma,
 		goto out;
 	}
 	delayacct_set_flag(DELAYACCT_PF_SWAPIN);
-	page = lookup_swap_cache(entry);
+	page = lookup_swap_cache(entry, vma, address);
 	if (!page) {
 		grab_swap_token(mm); /* Contend for token _before_ read-in */
-		page = swapin_readahead(entry,
-					GFP_HIGHUSER_MOVABLE, vma, address);
+		if (swap_use_vma_readahead())
+			page = swapin_vma_readahead(entry, GFP_HIGHUSER_MOVABLE,
+						    vma, address, pmd);
+		else
+			page = swapin_readahead(entry, GFP_HIGHUSER_MOVABLE,
+						vma, address);
 		if (!page) {
 			/*
 			 * Back out if somebody else faulted in this pte
@@ -2856,6 +2880,9 @@ static int do_anonymous_page(struct mm_struct *mm, struct vm_area_struct *vma,
 	/* Allocate our own private page. */
 	if (unlikely(anon_vma_prepare(vma)))
 		goto oom;
+	/* let khugepaged collapse what the huge page fault couldn't get */
+	if (unlikely(khugepaged_enter(vma)))
+		goto oom;
 	page = alloc_zeroed_user_highpage_movable(vma, address);
 	if (!page)
 		goto oom;
@@ -3220,13 +3247,328 @@ int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	pmd = pmd_alloc(mm, pud, address);
 	if (!pmd)
 		return VM_FAULT_OOM;
-	pte = pte_alloc_map(mm, pmd, address);
-	if (!pte)
+	if (pmd_none(*pmd) && transparent_hugepage_enabled(vma)) {
+		int ret = do_huge_pmd_anonymous_page(mm, vma, address,
+						     pmd, flags);
+		if (!(ret & VM_FAULT_FALLBACK))
+			return ret;
+	} else if (pmd_none(*pmd) && vma->vm_ops && vma->vm_ops->pmd_fault) {
+		int ret = vma->vm_ops->pmd_fault(vma, address, pmd, flags);
+		if (!(ret & VM_FAULT_FALLBACK))
+			return ret;
+	}
+
+	if (unlikely(pmd_none(*pmd)) && __pte_alloc(mm, pmd, address))
 		return VM_FAULT_OOM;
+	/*
+	 * A huge pmd is always mapped writable where the vma allows it, so
+	 * there is nothing to do here: this is a spurious fault, or the pmd
+	 * is being split and the access will be retried.
+	 */
+	if (unlikely(pmd_trans_huge(*pmd)))
+		return 0;
+	pte = pte_offset_map(pmd, address);
 
 	return handle_pte_fault(mm, vma, address, pte, pmd, flags);
 }
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * Speculative page faults resolve the common faults without mmap_sem:
+ * the vma is looked up locklessly in mm_rb and pinned, and everything
+ * read from it is only trusted once its sequence count has been seen
+ * unchanged with the pte lock held.  Every vma modification bumps that
+ * count under mmap_sem, and unlinking leaves it odd for good.
+ *
+ * Only ptes that are still none under an existing pte table are handled:
+ * anonymous faults and read faults on filemap_fault() mappings.  Anything
+ * else returns VM_FAULT_RETRY for the caller to take mmap_sem and go
+ * through handle_mm_fault().
+ *
+ * Page tables are walked with interrupts disabled.  Freeing a page table
+ * is preceded by a TLB shootdown that cannot complete meanwhile, so the
+ * tables we look at stay around until the pte lock is ours.
+ */
+struct spf_fault {
+	struct mm_struct *mm;
+	struct vm_area_struct *vma;
+	unsigned long address;
+	unsigned int flags;
+	unsigned int seq;		/* vma->vm_sequence snapshot */
+	unsigned int move_seq;		/* mm->mm_move_sequence snapshot */
+	pmd_t *pmd;
+	pmd_t pmdval;			/* *pmd as seen by the walk */
+};
+
+static inline int spf_valid(struct spf_fault *spf)
+{
+	return !read_seqcount_retry(&spf->vma->vm_sequence, spf->seq) &&
+	       !read_seqcount_retry(&spf->mm->mm_move_sequence, spf->move_seq);
+}
+
+/*
+ * Find the pte table covering the fault and return 1 if the pte there
+ * is still none, with the pte in *orig_pte.
+ */
+static int spf_walk(struct spf_fault *spf, pte_t *orig_pte)
+{
+	pgd_t *pgd;
+	pud_t *pud;
+	pte_t *pte;
+	int ret = 0;
+
+	local_irq_disable();
+	if (!spf_valid(spf))
+		goto out;
+
+	pgd = pgd_offset(spf->mm, spf->address);
+	if (pgd_none(*pgd) || unlikely(pgd_bad(*pgd)))
+		goto out;
+	pud = pud_offset(pgd, spf->address);
+	if (pud_none(*pud) || unlikely(pud_bad(*pud)))
+		goto out;
+	spf->pmd = pmd_offset(pud, spf->address);
+	spf->pmdval = *spf->pmd;
+	barrier();
+	/* no pte table yet, or a huge pmd: leave it to the locked path */
+	if (pmd_none(spf->pmdval) || pmd_trans_huge(spf->pmdval) ||
+	    unlikely(pmd_bad(spf->pmdval)))
+		goto out;
+
+	pte = pte_offset_map(&spf->pmdval, spf->address);
+	*orig_pte = *pte;
+	pte_unmap(pte);
+	ret = pte_none(*orig_pte);
+out:
+	local_irq_enable();
+	return ret;
+}
+
+/*
+ * Map and lock the pte table found by spf_walk(), provided neither the
+ * vma nor the pmd changed since.  Returns NULL if the fault must be
+ * retried under mmap_sem.
+ */
+static pte_t *spf_pte_map_lock(struct spf_fault *spf, spinlock_t **ptlp)
+{
+	spinlock_t *ptl;
+	pte_t *pte;
+
+	local_irq_disable();
+	if (!spf_valid(spf))
+		goto out;
+	if (pmd_val(*spf->pmd) != pmd_val(spf->pmdval))
+		goto out;
+
+	/*
+	 * Spinning here could deadlock against a cpu holding the lock
+	 * while it waits for us to answer a TLB shootdown.
+	 */
+	ptl = pte_lockptr(spf->mm, &spf->pmdval);
+	pte = pte_offset_map(&spf->pmdval, spf->address);
+	if (!spin_trylock(ptl)) {
+		pte_unmap(pte);
+		goto out;
+	}
+	if (!spf_valid(spf)) {
+		pte_unmap_unlock(pte, ptl);
+		goto out;
+	}
+	local_irq_enable();
+	*ptlp = ptl;
+	return pte;
+out:
+	local_irq_enable();
+	return NULL;
+}
+
+static int spf_anonymous_page(struct spf_fault *spf)
+{
+	struct vm_area_struct *vma = spf->vma;
+	struct page *page = NULL;
+	spinlock_t *ptl;
+	pte_t *pte;
+	pte_t entry;
+
+	/* Use the zero-page for reads */
+	if (!(spf->flags & FAULT_FLAG_WRITE)) {
+		entry = pte_mkspecial(pfn_pte(my_zero_pfn(spf->address),
+						vma->vm_page_prot));
+		goto map;
+	}
+
+	/*
+	 * anon_vma_prepare() needs mmap_sem, and the vma's mempolicy may
+	 * be freed under us: leave both cases to the locked path.
+	 */
+	if (!vma->anon_vma || vma_policy(vma))
+		return VM_FAULT_RETRY;
+	page = alloc_page(GFP_HIGHUSER_MOVABLE);
+	if (!page)
+		return VM_FAULT_RETRY;
+	clear_user_highpage(page, spf->address);
+	__SetPageUptodate(page);
+
+	if (mem_cgroup_newpage_charge(page, spf->mm, GFP_KERNEL)) {
+		page_cache_release(page);
+		return VM_FAULT_RETRY;
+	}
+
+	entry = mk_pte(page, vma->vm_page_prot);
+	if (vma->vm_flags & VM_WRITE)
+		entry = pte_mkwrite(pte_mkdirty(entry));
+map:
+	pte = spf_pte_map_lock(spf, &ptl);
+	if (!pte)
+		goto release;
+	if (!pte_none(*pte)) {
+		/* somebody else resolved the fault */
+		pte_unmap_unlock(pte, ptl);
+		if (page) {
+			mem_cgroup_uncharge_page(page);
+			page_cache_release(page);
+		}
+		return 0;
+	}
+
+	if (page) {
+		inc_mm_counter_fast(spf->mm, MM_ANONPAGES);
+		page_add_new_anon_rmap(page, vma, spf->address);
+	}
+	set_pte_at(spf->mm, spf->address, pte, entry);
+
+	/* No need to invalidate - it was non-present before */
+	update_mmu_cache(vma, spf->address, pte);
+	pte_unmap_unlock(pte, ptl);
+	return 0;
+
+release:
+	if (page) {
+		mem_cgroup_uncharge_page(page);
+		page_cache_release(page);
+	}
+	return VM_FAULT_RETRY;
+}
+
+static int spf_file_read_page(struct spf_fault *spf, pte_t orig_pte)
+{
+	struct vm_area_struct *vma = spf->vma;
+	struct vm_fault vmf;
+	struct page *page;
+	spinlock_t *ptl;
+	pte_t *pte;
+	int ret;
+
+	vmf.virtual_address = (void __user *)(spf->address & PAGE_MASK);
+	vmf.pgoff = ((spf->address - vma->vm_start) >> PAGE_SHIFT) +
+		    vma->vm_pgoff;
+	vmf.flags = spf->flags;
+	vmf.page = NULL;
+
+	ret = filemap_fault(vma, &vmf);
+	if (unlikely(ret & (VM_FAULT_ERROR | VM_FAULT_NOPAGE)))
+		return VM_FAULT_RETRY;
+
+	page = vmf.page;
+	if (unlikely(!(ret & VM_FAULT_LOCKED)))
+		lock_page(page);
+	if (unlikely(PageHWPoison(page))) {
+		ret = VM_FAULT_RETRY;
+		goto out;
+	}
+
+	pte = spf_pte_map_lock(spf, &ptl);
+	if (!pte) {
+		ret = VM_FAULT_RETRY;
+		goto out;
+	}
+	ret &= VM_FAULT_MAJOR;
+	if (unlikely(!pte_same(*pte, orig_pte))) {
+		pte_unmap_unlock(pte, ptl);
+		goto out;
+	}
+
+	flush_icache_page(vma, page);
+	inc_mm_counter_fast(spf->mm, MM_FILEPAGES);
+	page_add_file_rmap(page);
+	set_pte_at(spf->mm, spf->address, pte, mk_pte(page, vma->vm_page_prot));
+
+	/* no need to invalidate: a not-present page won't be cached */
+	update_mmu_cache(vma, spf->address, pte);
+	pte_unmap_unlock(pte, ptl);
+	unlock_page(page);
+	return ret;
+
+out:
+	unlock_page(page);
+	page_cache_release(page);
+	return ret;
+}
+
+/*
+ * Try to handle a fault at @address of @mm without mmap_sem.  Returns
+ * VM_FAULT_RETRY if the caller has to fall back to handle_mm_fault().
+ */
+int handle_speculative_fault(struct mm_struct *mm, unsigned long address,
+			     unsigned int flags)
+{
+	struct spf_fault spf = {
+		.mm		= mm,
+		.address	= address,
+		.flags		= flags,
+	};
+	struct vm_area_struct *vma;
+	pte_t orig_pte;
+	int ret = VM_FAULT_RETRY;
+
+	spf.move_seq = mm->mm_move_sequence.sequence;
+	smp_rmb();
+	if (spf.move_seq & 1)
+		goto out;
+
+	vma = get_vma(mm, address, &spf.seq);
+	if (!vma)
+		goto out;
+	spf.vma = vma;
+	if ((spf.seq & 1) || address < vma->vm_start)
+		goto out_put;
+
+	/* stack expansion, nonlinear and special mappings need mmap_sem */
+	if (vma->vm_flags & (VM_HUGETLB | VM_GROWSDOWN | VM_GROWSUP |
+			     VM_NONLINEAR | VM_LOCKED | VM_PFNMAP |
+			     VM_MIXEDMAP | VM_IO))
+		goto out_put;
+	/* so do access errors, to report them */
+	if (flags & FAULT_FLAG_WRITE) {
+		if (!(vma->vm_flags & VM_WRITE))
+			goto out_put;
+	} else if (!(vma->vm_flags & (VM_READ | VM_EXEC | VM_WRITE)))
+		goto out_put;
+
+	if (!spf_walk(&spf, &orig_pte))
+		goto out_put;
+
+	__set_current_state(TASK_RUNNING);
+	check_sync_rss_stat(current);
+
+	if (!vma->vm_ops)
+		ret = spf_anonymous_page(&spf);
+	else if (vma->vm_ops->fault == filemap_fault &&
+		 !(flags & FAULT_FLAG_WRITE))
+		ret = spf_file_read_page(&spf, orig_pte);
+out_put:
+	put_vma(vma);
+out:
+	if (ret & VM_FAULT_RETRY) {
+		count_vm_event(SPF_FAULT_ABORT);
+	} else {
+		count_vm_event(PGFAULT);
+		count_vm_event(SPF_FAULT);
+	}
+	return ret;
+}
+#endif /* CONFIG_SPECULATIVE_PAGE_FAULT */
+
 #ifndef __PAGETABLE_PUD_FOLDED
 /*
  * Allocate page upper directory.
@@ -17,6 +17,7 @@
 #include <linux/module.h>
 #include <linux/rmap.h>
 #include <linux/mmzone.h>
+#include <linux/mm_inline.h>
 #include <linux/hugetlb.h>
 
 #include "internal.h"
@@ -142,13 +143,136 @@ static inline int stack_guard_page(struct vm_area_struct *vma, unsigned long add
 		!vma_stack_continue(vma->vm_prev, addr);
 }
 
+/*
+ * Move pages just marked PageMlocked to the unevictable list, taking each
+ * zone's lru_lock once for the batch instead of twice per page as
+ * isolate_lru_page() and putback_lru_page() would.
+ *
+ * The pages need not be locked.  munlock_vma_page() and clear_page_mlock()
+ * clear PageMlocked before they isolate the page under the same lru_lock:
+ * if the flag is already clear here the page is left where it is, and
+ * otherwise they take it back off the unevictable list after us.  A page
+ * not on the LRU right now is put back by whoever isolated it, and
+ * putback_lru_page() sees PageMlocked.
+ */
+static void __mlock_lru_batch(struct page **pages, int nr)
+{
+	struct zone *zone = NULL;
+	int culled = 0;
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		struct page *page = pages[i];
+		struct zone *pagezone = page_zone(page);
+
+		if (pagezone != zone) {
+			if (zone)
+				spin_unlock_irq(&zone->lru_lock);
+			zone = pagezone;
+			spin_lock_irq(&zone->lru_lock);
+		}
+
+		if (!PageLRU(page) || PageUnevictable(page) ||
+		    !PageMlocked(page))
+			continue;
+
+		del_page_from_lru_list(zone, page, page_lru(page));
+		ClearPageActive(page);
+		SetPageUnevictable(page);
+		add_page_to_lru_list(zone, page, LRU_UNEVICTABLE);
+		culled++;
+	}
+	if (zone)
+		spin_unlock_irq(&zone->lru_lock);
+
+	if (culled)
+		count_vm_events(UNEVICTABLE_PGCULLED, culled);
+}
+
+/*
+ * Mlock a batch of pages pinned by the caller, and drop the pins.
+ * Like mlock_vma_page(), but with the LRU moves done by __mlock_lru_batch().
+ */
+static void __mlock_page_batch(struct page **pages, int nr)
+{
+	int nr_lru = 0;
+	int i;
+
+	lru_add_drain();	/* push cached pages to LRU */
+
+	for (i = 0; i < nr; i++) {
+		struct page *page = pages[i];
+
+		if (page->mapping) {
+			/*
+			 * That preliminary check is mainly to avoid
+			 * the pointless overhead of lock_page on the
+			 * ZERO_PAGE: which might bounce very badly if
+			 * there is contention.  However, we're still
+			 * dirtying its cacheline with get/put_page:
+			 * we'll add another __get_user_pages flag to
+			 * avoid it if that case turns out to matter.
+			 */
+			lock_page(page);
+			/*
+			 * Because we lock page here and migration is
+			 * blocked by the elevated reference, we need
+			 * only check for file-cache page truncation.
+			 */
+			if (page->mapping && !TestSetPageMlocked(page)) {
+				inc_zone_page_state(page, NR_MLOCK);
+				count_vm_event(UNEVICTABLE_PGMLOCKED);
+				unlock_page(page);
+				/* keep the pin until it is on the list */
+				pages[nr_lru++] = page;
+				continue;
+			}
+			unlock_page(page);
+		}
+		put_page(page);	/* ref from get_user_pages() */
+	}
+
+	__mlock_lru_batch(pages, nr_lru);
+	for (i = 0; i < nr_lru; i++)
+		put_page(pages[i]);
+}
+
+/*
+ * For a VM_LOCKONFAULT vma: mlock only the pages already present.  The
+ * rest are made unevictable as they are faulted in, like any page in a
+ * VM_LOCKED vma that __mlock_vma_pages_range() did not get to.
+ */
+static void __mlock_vma_present_pages(struct vm_area_struct *vma,
+				      unsigned long addr, unsigned long end)
+{
+	struct page *pages[16];
+
+	while (addr < end) {
+		int nr = 0;
+
+		cond_resched();
+
+		while (nr < ARRAY_SIZE(pages) && addr < end) {
+			/* FOLL_DUMP: no ZERO_PAGE, see munlock_vma_pages_range() */
+			struct page *page = follow_page(vma, addr,
+							FOLL_GET | FOLL_DUMP);
+
+			if (page && !IS_ERR(page))
+				pages[nr++] = page;
+			addr += PAGE_SIZE;
+		}
+		__mlock_page_batch(pages, nr);
+	}
+}
+
 /**
  * __mlock_vma_pages_range() -  mlock a range of pages in the vma.
  * @vma:   target vma
  * @start: start address
  * @end:   end address
  *
- * This takes care of making the pages present too.
+ * This takes care of making the pages present too, unless the vma is
+ * VM_LOCKONFAULT.
  *
  * return 0 on success, negative error code on error.
  *
@@ -180,9 +304,12 @@ static long __mlock_vma_pages_range(struct vm_area_struct *vma,
 		nr_pages--;
 	}
 
-	while (nr_pages > 0) {
-		int i;
+	if (vma->vm_flags & VM_LOCKONFAULT) {
+		__mlock_vma_present_pages(vma, addr, end);
+		return 0;
+	}
 
+	while (nr_pages > 0) {
 		cond_resched();
 
 		/*
@@ -203,33 +330,7 @@ static long __mlock_vma_pages_range(struct vm_area_struct *vma,
 		if (ret < 0)
 			break;
 
-		lru_add_drain();	/* push cached pages to LRU */
-
-		for (i = 0; i < ret; i++) {
-			struct page *page = pages[i];
-
-			if (page->mapping) {
-				/*
-				 * That preliminary check is mainly to avoid
-				 * the pointless overhead of lock_page on the
-				 * ZERO_PAGE: which might bounce very badly if
-				 * there is contention.  However, we're still
-				 * dirtying its cacheline with get/put_page:
-				 * we'll add another __get_user_pages flag to
-				 * avoid it if that case turns out to matter.
-				 */
-				lock_page(page);
-				/*
-				 * Because we lock page here and migration is
-				 * blocked by the elevated reference, we need
-				 * only check for file-cache page truncation.
-				 */
-				if (page->mapping)
-					mlock_vma_page(page);
-				unlock_page(page);
-			}
-			put_page(page);	/* ref from get_user_pages() */
-		}
+		__mlock_page_batch(pages, ret);
 
 		addr += ret * PAGE_SIZE;
 		nr_pages -= ret;
@@ -294,10 +395,11 @@ long mlock_vma_pages_range(struct vm_area_struct *vma,
 	 * locked limit.  huge pages are already counted against
 	 * locked vm limit.
 	 */
-	make_pages_present(start, end);
+	if (!(vma->vm_flags & VM_LOCKONFAULT))
+		make_pages_present(start, end);
 
 no_mlock:
-	vma->vm_flags &= ~VM_LOCKED;	/* and don't come back! */
+	vma->vm_flags &= VM_LOCKED_CLEAR_MASK;	/* and don't come back! */
 	return nr_pages;		/* error or pages NOT mlocked */
 }
 
@@ -325,7 +427,7 @@ void munlock_vma_pages_range(struct vm_area_struct *vma,
 	unsigned long addr;
 
 	lru_add_drain();
-	vma->vm_flags &= ~VM_LOCKED;
+	vma->vm_flags &= VM_LOCKED_CLEAR_MASK;
 
 	for (addr = start; addr < end; addr += PAGE_SIZE) {
 		struct page *page;
@@ -364,13 +466,14 @@ void munlock_vma_pages_range(struct vm_area_struct *vma,
  * For vmas that pass the filters, merge/split as appropriate.
  */
 static int mlock_fixup(struct vm_area_struct *vma, struct vm_area_struct **prev,
-	unsigned long start, unsigned long end, unsigned int newflags)
+	unsigned long start, unsigned long end, unsigned long newflags)
 {
 	struct mm_struct *mm = vma->vm_mm;
+	unsigned long oldflags = vma->vm_flags;
 	pgoff_t pgoff;
 	int nr_pages;
 	int ret = 0;
-	int lock = newflags & VM_LOCKED;
+	int lock = !!(newflags & VM_LOCKED);
 
 	if (newflags == vma->vm_flags ||
 			(vma->vm_flags & (VM_IO | VM_PFNMAP)))
@@ -379,7 +482,7 @@ static int mlock_fixup(struct vm_area_struct *vma, struct vm_area_struct **prev,
 	if ((vma->vm_flags & (VM_DONTEXPAND | VM_RESERVED)) ||
 			is_vm_hugetlb_page(vma) ||
 			vma == get_gate_vma(current)) {
-		if (lock)
+		if (lock && !(newflags & VM_LOCKONFAULT))
 			make_pages_present(start, end);
 		goto out;	/* don't set VM_LOCKED,  don't count */
 	}
@@ -411,6 +514,8 @@ success:
 	nr_pages = (end - start) >> PAGE_SHIFT;
 	if (!lock)
 		nr_pages = -nr_pages;
+	else if (oldflags & VM_LOCKED)
+		nr_pages = 0;	/* only switching to or from VM_LOCKONFAULT */
 	mm->locked_vm += nr_pages;
 
 	/*
@@ -420,12 +525,16 @@ success:
 	 */
 
 	if (lock) {
+		vma_write_begin(vma);
 		vma->vm_flags = newflags;
+		vma_write_end(vma);
 		ret = __mlock_vma_pages_range(vma, start, end);
 		if (ret < 0)
 			ret = __mlock_posix_error_return(ret);
 	} else {
+		vma_write_begin(vma);
 		munlock_vma_pages_range(vma, start, end);
+		vma_write_end(vma);
 	}
 
 out:
@@ -453,13 +562,14 @@ static int do_mlock(unsigned long start, size_t len, int on)
 		prev = vma;
 
 	for (nstart = start ; ; ) {
-		unsigned int newflags;
+		unsigned long newflags;
 
 		/* Here we know that  vma->vm_start <= nstart < vma->vm_end. */
 
-		newflags = vma->vm_flags | VM_LOCKED;
-		if (!on)
-			newflags &= ~VM_LOCKED;
+		/* mlock() populates even a vma that mlockall() left on-fault */
+		newflags = vma->vm_flags & VM_LOCKED_CLEAR_MASK;
+		if (on)
+			newflags |= VM_LOCKED;
 
 		tmp = vma->vm_end;
 		if (tmp > end)
@@ -525,20 +635,23 @@ SYSCALL_DEFINE2(munlock, unsigned long, start, size_t, len)
 static int do_mlockall(int flags)
 {
 	struct vm_area_struct * vma, * prev = NULL;
-	unsigned int def_flags = 0;
+	unsigned long def_flags = 0;
+	unsigned long to_add = 0;
 
+	if (flags & MCL_ONFAULT)
+		to_add = VM_LOCKONFAULT;
 	if (flags & MCL_FUTURE)
-		def_flags = VM_LOCKED;
+		def_flags = VM_LOCKED | to_add;
 	current->mm->def_flags = def_flags;
-	if (flags == MCL_FUTURE)
+	if ((flags & ~MCL_ONFAULT) == MCL_FUTURE)
 		goto out;
 
 	for (vma = current->mm->mmap; vma ; vma = prev->vm_next) {
-		unsigned int newflags;
+		unsigned long newflags;
 
-		newflags = vma->vm_flags | VM_LOCKED;
-		if (!(flags & MCL_CURRENT))
-			newflags &= ~VM_LOCKED;
+		newflags = vma->vm_flags & VM_LOCKED_CLEAR_MASK;
+		if (flags & MCL_CURRENT)
+			newflags |= VM_LOCKED | to_add;
 
 		/* Ignore errors */
 		mlock_fixup(vma, &prev, vma->vm_start, vma->vm_end, newflags);
@@ -552,7 +665,11 @@ SYSCALL_DEFINE1(mlockall, int, flags)
 	unsigned long lock_limit;
 	int ret = -EINVAL;
 
-	if (!flags || (flags & ~(MCL_CURRENT | MCL_FUTURE)))
+	if (!flags || (flags & ~(MCL_CURRENT | MCL_FUTURE | MCL_ONFAULT)) ||
+	    flags == MCL_ONFAULT)
+		goto out;
+	/* no vm_flags bit for it on 32-bit */
+	if ((flags & MCL_ONFAULT) && !VM_LOCKONFAULT)
 		goto out;
 
 	ret = -EPERM;
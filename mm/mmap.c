@@ -21,6 +21,7 @@
 #include <linux/personality.h>
 #include <linux/security.h>
 #include <linux/hugetlb.h>
+#include <linux/huge_mm.h>
 #include <linux/profile.h>
 #include <linux/module.h>
 #include <linux/mount.h>
@@ -28,6 +29,7 @@
 #include <linux/rmap.h>
 #include <linux/mmu_notifier.h>
 #include <linux/perf_event.h>
+#include <linux/shmem_fs.h>
 
 #include <asm/uaccess.h>
 #include <asm/cacheflush.h>
@@ -222,6 +224,58 @@ void unlink_file_vma(struct vm_area_struct *vma)
 	}
 }
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * mm_rb is also walked by speculative page faults, which take neither
+ * mmap_sem nor any lock: they retry or give up if the tree was changed
+ * under them.  Writers are serialized by mmap_sem.
+ */
+static inline void mm_rb_write_lock(struct mm_struct *mm)
+{
+	write_seqcount_begin(&mm->mm_rb_sequence);
+}
+
+static inline void mm_rb_write_unlock(struct mm_struct *mm)
+{
+	write_seqcount_end(&mm->mm_rb_sequence);
+}
+
+static void vma_free_rcu(struct rcu_head *head)
+{
+	kmem_cache_free(vm_area_cachep,
+			container_of(head, struct vm_area_struct, vm_rcu));
+}
+#else
+static inline void mm_rb_write_lock(struct mm_struct *mm)
+{
+}
+
+static inline void mm_rb_write_unlock(struct mm_struct *mm)
+{
+}
+#endif
+
+/*
+ * Drop a reference to a vma that has been unlinked from its mm.  A
+ * speculative page fault may still hold one, in which case it is the
+ * fault that releases the file and frees the structure.  Lookups walk
+ * mm_rb under RCU, so the structure itself is freed after a grace period.
+ */
+void put_vma(struct vm_area_struct *vma)
+{
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	if (!atomic_dec_and_test(&vma->vm_ref_count))
+		return;
+#endif
+	if (vma->vm_file)
+		fput(vma->vm_file);
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	call_rcu(&vma->vm_rcu, vma_free_rcu);
+#else
+	kmem_cache_free(vm_area_cachep, vma);
+#endif
+}
+
 /*
  * Close a vm structure and free it, returning the next.
  */
@@ -232,13 +286,10 @@ static struct vm_area_struct *remove_vma(struct vm_area_struct *vma)
 	might_sleep();
 	if (vma->vm_ops && vma->vm_ops->close)
 		vma->vm_ops->close(vma);
-	if (vma->vm_file) {
-		fput(vma->vm_file);
-		if (vma->vm_flags & VM_EXECUTABLE)
-			removed_exe_file_vma(vma->vm_mm);
-	}
+	if (vma->vm_file && (vma->vm_flags & VM_EXECUTABLE))
+		removed_exe_file_vma(vma->vm_mm);
 	mpol_put(vma_policy(vma));
-	kmem_cache_free(vm_area_cachep, vma);
+	put_vma(vma);
 	return next;
 }
 
@@ -410,8 +461,14 @@ __vma_link_list(struct mm_struct *mm, struct vm_area_struct *vma,
 void __vma_link_rb(struct mm_struct *mm, struct vm_area_struct *vma,
 		struct rb_node **rb_link, struct rb_node *rb_parent)
 {
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	atomic_set(&vma->vm_ref_count, 1);
+	seqcount_init(&vma->vm_sequence);
+#endif
+	mm_rb_write_lock(mm);
 	rb_link_node(&vma->vm_rb, rb_parent, rb_link);
 	rb_insert_color(&vma->vm_rb, &mm->mm_rb);
+	mm_rb_write_unlock(mm);
 }
 
 static void __vma_link_file(struct vm_area_struct *vma)
@@ -494,7 +551,9 @@ __vma_unlink(struct mm_struct *mm, struct vm_area_struct *vma,
 	prev->vm_next = next;
 	if (next)
 		next->vm_prev = prev;
+	mm_rb_write_lock(mm);
 	rb_erase(&vma->vm_rb, &mm->mm_rb);
+	mm_rb_write_unlock(mm);
 	if (mm->mmap_cache == vma)
 		mm->mmap_cache = prev;
 }
@@ -519,6 +578,7 @@ int vma_adjust(struct vm_area_struct *vma, unsigned long start,
 	long adjust_next = 0;
 	int remove_next = 0;
 
+	vma_write_begin(vma);
 	if (next && !insert) {
 		struct vm_area_struct *exporter = NULL;
 
@@ -556,11 +616,16 @@ again:			remove_next = 1 + (end > next->vm_end);
 		 * shrinking vma had, to cover any anon pages imported.
 		 */
 		if (exporter && exporter->anon_vma && !importer->anon_vma) {
-			if (anon_vma_clone(importer, exporter))
+			if (anon_vma_clone(importer, exporter)) {
+				vma_write_end(vma);
 				return -ENOMEM;
+			}
 			importer->anon_vma = exporter->anon_vma;
 		}
 	}
+	/* a removed next is left odd: it is never valid again */
+	if (remove_next || adjust_next)
+		vma_write_begin(next);
 
 	if (file) {
 		mapping = file->f_mapping;
@@ -587,6 +652,8 @@ again:			remove_next = 1 + (end > next->vm_end);
 		}
 	}
 
+	vma_adjust_trans_huge(vma, start, end, adjust_next);
+
 	/*
 	 * When changing only vma->vm_end, we don't really need anon_vma
 	 * lock. This is a fairly rare case by itself, but the anon_vma
@@ -643,16 +710,13 @@ again:			remove_next = 1 + (end > next->vm_end);
 		spin_unlock(&mapping->i_mmap_lock);
 
 	if (remove_next) {
-		if (file) {
-			fput(file);
-			if (next->vm_flags & VM_EXECUTABLE)
-				removed_exe_file_vma(mm);
-		}
+		if (file && (next->vm_flags & VM_EXECUTABLE))
+			removed_exe_file_vma(mm);
 		if (next->anon_vma)
 			anon_vma_merge(vma, next);
 		mm->map_count--;
 		mpol_put(vma_policy(next));
-		kmem_cache_free(vm_area_cachep, next);
+		put_vma(next);
 		/*
 		 * In mprotect's case 6 (see comments on vma_merge),
 		 * we must remove another next too. It would clutter
@@ -663,6 +727,9 @@ again:			remove_next = 1 + (end > next->vm_end);
 			goto again;
 		}
 	}
+	if (adjust_next)
+		vma_write_end(next);
+	vma_write_end(vma);
 
 	validate_mm(mm);
 
@@ -968,7 +1035,7 @@ unsigned long do_mmap_pgoff(struct file *file, unsigned long addr,
 {
 	struct mm_struct * mm = current->mm;
 	struct inode *inode;
-	unsigned int vm_flags;
+	unsigned long vm_flags;
 	int error;
 	unsigned long reqprot = prot;
 
@@ -1172,7 +1239,7 @@ SYSCALL_DEFINE1(old_mmap, struct mmap_arg_struct __user *, arg)
  */
 int vma_wants_writenotify(struct vm_area_struct *vma)
 {
-	unsigned int vm_flags = vma->vm_flags;
+	unsigned long vm_flags = vma->vm_flags;
 
 	/* If it was private or non-writable, the write bit is already clear */
 	if ((vm_flags & (VM_WRITE|VM_SHARED)) != ((VM_WRITE|VM_SHARED)))
@@ -1200,7 +1267,7 @@ int vma_wants_writenotify(struct vm_area_struct *vma)
  * We account for memory if it's a private writeable mapping,
  * not hugepages and VM_NORESERVE wasn't set.
  */
-static inline int accountable_mapping(struct file *file, unsigned int vm_flags)
+static inline int accountable_mapping(struct file *file, unsigned long vm_flags)
 {
 	/*
 	 * hugetlb has its own accounting separate from the core VM
@@ -1214,7 +1281,7 @@ static inline int accountable_mapping(struct file *file, unsigned int vm_flags)
 
 unsigned long mmap_region(struct file *file, unsigned long addr,
 			  unsigned long len, unsigned long flags,
-			  unsigned int vm_flags, unsigned long pgoff)
+			  unsigned long vm_flags, unsigned long pgoff)
 {
 	struct mm_struct *mm = current->mm;
 	struct vm_area_struct *vma, *prev;
@@ -1573,6 +1640,13 @@ get_unmapped_area(struct file *file, unsigned long addr, unsigned long len,
 	get_area = current->mm->get_unmapped_area;
 	if (file && file->f_op && file->f_op->get_unmapped_area)
 		get_area = file->f_op->get_unmapped_area;
+#if defined(CONFIG_SHMEM) && defined(CONFIG_TRANSPARENT_HUGEPAGE)
+	else if (!file && (flags & MAP_SHARED)) {
+		/* backed by shmem_zero_setup(): place it as shmem would */
+		pgoff = 0;
+		get_area = shmem_get_unmapped_area;
+	}
+#endif
 	addr = get_area(file, addr, len, pgoff, flags);
 	if (IS_ERR_VALUE(addr))
 		return addr;
@@ -1625,6 +1699,59 @@ struct vm_area_struct *find_vma(struct mm_struct *mm, unsigned long addr)
 
 EXPORT_SYMBOL(find_vma);
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * Look up the first VMA which satisfies addr < vm_end without holding
+ * mmap_sem, for the speculative page fault path.  The vma comes back
+ * pinned (drop it with put_vma()), together with a snapshot of its
+ * sequence count in *seq that the caller must validate before trusting
+ * anything it read from the vma.
+ *
+ * No lock is taken, so concurrent faults do not bounce a cache line:
+ * the tree is walked under RCU and the walk is discarded if
+ * mm_rb_sequence moved.  A walk racing with a rotation may wander, so
+ * it is bounded by the deepest a red-black tree can be.  NULL means
+ * "not found or raced"; either way the caller takes mmap_sem.
+ */
+struct vm_area_struct *get_vma(struct mm_struct *mm, unsigned long addr,
+			       unsigned int *seq)
+{
+	struct vm_area_struct *vma = NULL;
+	struct rb_node *rb_node;
+	unsigned int rb_seq;
+	int depth = 2 * BITS_PER_LONG;
+
+	rcu_read_lock();
+	rb_seq = read_seqcount_begin(&mm->mm_rb_sequence);
+	rb_node = ACCESS_ONCE(mm->mm_rb.rb_node);
+	while (rb_node && --depth) {
+		struct vm_area_struct *vma_tmp;
+
+		vma_tmp = rb_entry(rb_node, struct vm_area_struct, vm_rb);
+		if (vma_tmp->vm_end > addr) {
+			vma = vma_tmp;
+			if (vma_tmp->vm_start <= addr)
+				break;
+			rb_node = ACCESS_ONCE(rb_node->rb_left);
+		} else
+			rb_node = ACCESS_ONCE(rb_node->rb_right);
+	}
+	if (!depth || (vma && !atomic_inc_not_zero(&vma->vm_ref_count)))
+		vma = NULL;
+	if (vma) {
+		*seq = vma->vm_sequence.sequence;
+		smp_rmb();
+	}
+	if (read_seqcount_retry(&mm->mm_rb_sequence, rb_seq) && vma) {
+		rcu_read_unlock();
+		put_vma(vma);
+		return NULL;
+	}
+	rcu_read_unlock();
+	return vma;
+}
+#endif
+
 /* Same as find_vma, but also return a pointer to the previous VMA in *pprev. */
 struct vm_area_struct *
 find_vma_prev(struct mm_struct *mm, unsigned long addr,
@@ -1923,12 +2050,16 @@ detach_vmas_to_be_unmapped(struct mm_struct *mm, struct vm_area_struct *vma,
 
 	insertion_point = (prev ? &prev->vm_next : &mm->mmap);
 	vma->vm_prev = NULL;
+	mm_rb_write_lock(mm);
 	do {
+		/* never ended: speculative faults must not trust it again */
+		vma_write_begin(vma);
 		rb_erase(&vma->vm_rb, &mm->mm_rb);
 		mm->map_count--;
 		tail_vma = vma;
 		vma = vma->vm_next;
 	} while (vma && vma->vm_start < end);
+	mm_rb_write_unlock(mm);
 	*insertion_point = vma;
 	if (vma)
 		vma->vm_prev = prev;
@@ -34,6 +34,7 @@
 #include <linux/syscalls.h>
 #include <linux/buffer_head.h>
 #include <linux/pagevec.h>
+#include <linux/memcontrol.h>
 #include <trace/events/writeback.h>
 
 /*
@@ -43,18 +44,21 @@
 static long ratelimit_pages = 32;
 
 /*
- * When balance_dirty_pages decides that the caller needs to perform some
- * non-background writeback, this is how many pages it will attempt to write.
- * It should be somewhat larger than dirtied pages to ensure that reasonably
- * large amounts of I/O are submitted.
+ * Longest a dirtier sleeps in one go in balance_dirty_pages(), and how
+ * often a bdi's write bandwidth estimate is updated.
  */
-static inline long sync_writeback_pages(unsigned long dirtied)
-{
-	if (dirtied < ratelimit_pages)
-		dirtied = ratelimit_pages;
+#define MAX_PAUSE		max(HZ/5, 1)
+#define BANDWIDTH_INTERVAL	max(HZ/5, 1)
 
-	return dirtied + dirtied / 2;
-}
+/*
+ * The write bandwidth estimate follows the observed rate with a time
+ * constant of about 3 seconds.  Longer gaps between updates mean the
+ * bdi went idle, and are not taken as a drop in bandwidth.
+ */
+#define BANDWIDTH_PERIOD	roundup_pow_of_two(3 * HZ)
+
+/* fixed point unit of dirty_pos_ratio() */
+#define RATIO_SHIFT		10
 
 /* The following parameters are exported via /proc/sys/vm */
 
@@ -219,6 +223,7 @@ int dirty_bytes_handler(struct ctl_table *table, int write,
  */
 static inline void __bdi_writeout_inc(struct backing_dev_info *bdi)
 {
+	__inc_bdi_stat(bdi, BDI_WRITTEN);
 	__prop_inc_percpu_max(&vm_completions, &bdi->completions,
 			      bdi->max_prop_frac);
 }
@@ -471,49 +476,149 @@ unsigned long bdi_dirty_limit(struct backing_dev_info *bdi, unsigned long dirty)
 	return bdi_dirty;
 }
 
+/*
+ * Update the write bandwidth estimate of @bdi from the pages that
+ * completed writeback since the last update.  Called by dirtiers and by
+ * the flusher, so it runs about every BANDWIDTH_INTERVAL while the bdi
+ * is busy.
+ */
+void bdi_update_bandwidth(struct backing_dev_info *bdi)
+{
+	static DEFINE_SPINLOCK(bandwidth_lock);
+	unsigned long now = jiffies;
+	unsigned long elapsed = now - bdi->bw_time_stamp;
+	unsigned long period = BANDWIDTH_PERIOD;
+	unsigned long written, bw;
+	u64 tmp;
+
+	if (elapsed < BANDWIDTH_INTERVAL)
+		return;
+
+	spin_lock(&bandwidth_lock);
+	elapsed = now - bdi->bw_time_stamp;
+	if (elapsed < BANDWIDTH_INTERVAL)
+		goto unlock;
+
+	written = bdi_stat_sum(bdi, BDI_WRITTEN);
+	if (elapsed > period)
+		goto snapshot;
+
+	tmp = (u64)(written - bdi->written_stamp) * HZ;
+	do_div(tmp, elapsed);
+	bw = tmp;
+
+	tmp = (u64)bdi->write_bandwidth * (period - elapsed) + (u64)bw * elapsed;
+	bdi->write_bandwidth = tmp >> ilog2(period);
+
+	/* smooth out the ups and downs of the I/O completions */
+	if (bdi->avg_write_bandwidth > bdi->write_bandwidth)
+		bdi->avg_write_bandwidth -=
+			(bdi->avg_write_bandwidth - bdi->write_bandwidth) >> 3;
+	else
+		bdi->avg_write_bandwidth +=
+			(bdi->write_bandwidth - bdi->avg_write_bandwidth) >> 3;
+
+	trace_bdi_write_bandwidth(bdi, bw);
+snapshot:
+	bdi->written_stamp = written;
+	bdi->bw_time_stamp = now;
+unlock:
+	spin_unlock(&bandwidth_lock);
+}
+
+/*
+ * How fast a task may dirty pages, in 1 << RATIO_SHIFT units of the bdi's
+ * write bandwidth: twice the bandwidth at the freerun point, halfway
+ * between the background and dirty thresholds, falling linearly to
+ * nothing at the dirty threshold.  A bdi over its share of the dirty
+ * pages is slowed down further in proportion.
+ */
+static unsigned long dirty_pos_ratio(unsigned long dirty,
+				     unsigned long freerun,
+				     unsigned long thresh,
+				     unsigned long bdi_dirty,
+				     unsigned long bdi_thresh)
+{
+	u64 ratio;
+
+	if (dirty >= thresh)
+		return 0;
+
+	ratio = (u64)(thresh - dirty) << (RATIO_SHIFT + 1);
+	do_div(ratio, thresh - freerun);
+
+	if (bdi_dirty > bdi_thresh) {
+		ratio *= bdi_thresh;
+		do_div(ratio, bdi_dirty);
+	}
+	return ratio;
+}
+
 /*
  * balance_dirty_pages() must be called by processes which are generating dirty
- * data.  It looks at the number of dirty pages in the machine and will force
- * the caller to perform writeback if the system is over `vm_dirty_ratio'.
- * If we're over `background_thresh' then the writeback threads are woken to
- * perform some writeout.
+ * data.  It looks at the number of dirty pages in the machine and, once
+ * past the freerun point, makes the caller sleep long enough for the
+ * @pages_dirtied pages it just dirtied to be matched by the bdi's write
+ * bandwidth.  The closer the dirty pages get to `vm_dirty_ratio', the
+ * longer the pause; at the limit, the caller waits until writeback brings
+ * it down again.  The writeback threads do all the writeout: dirtiers
+ * never write pages themselves, so their I/O does not compete for the
+ * disk head.
+ *
+ * A task in a memory cgroup is held to the cgroup's dirty limits as well,
+ * and paced by whichever of the two is closer to being exceeded.
  */
 static void balance_dirty_pages(struct address_space *mapping,
-				unsigned long write_chunk)
+				unsigned long pages_dirtied)
 {
 	long nr_reclaimable, bdi_nr_reclaimable;
 	long nr_writeback, bdi_nr_writeback;
+	unsigned long nr_dirty, bdi_dirty;
 	unsigned long background_thresh;
 	unsigned long dirty_thresh;
 	unsigned long bdi_thresh;
-	unsigned long pages_written = 0;
-	unsigned long pause = 1;
+	unsigned long freerun;
+	unsigned long task_ratelimit;
+	unsigned long pos_ratio;
+	struct mem_cgroup_dirty_info memcg_info;
+	unsigned long memcg_dirty = 0, memcg_freerun = 0;
+	bool memcg = false;
+	long pause;
 	bool dirty_exceeded = false;
 	struct backing_dev_info *bdi = mapping->backing_dev_info;
 
 	for (;;) {
-		struct writeback_control wbc = {
-			.sync_mode	= WB_SYNC_NONE,
-			.older_than_this = NULL,
-			.nr_to_write	= write_chunk,
-			.range_cyclic	= 1,
-		};
-
 		nr_reclaimable = global_page_state(NR_FILE_DIRTY) +
 					global_page_state(NR_UNSTABLE_NFS);
 		nr_writeback = global_page_state(NR_WRITEBACK);
+		nr_dirty = nr_reclaimable + nr_writeback;
 
 		global_dirty_limits(&background_thresh, &dirty_thresh);
 
+		memcg = mem_cgroup_dirty_info(determine_dirtyable_memory(),
+					      &memcg_info);
+		if (memcg) {
+			memcg_dirty = memcg_info.nr_file_dirty +
+				      memcg_info.nr_writeback;
+			memcg_freerun = (memcg_info.background_thresh +
+					 memcg_info.dirty_thresh) / 2;
+		}
+
 		/*
 		 * Throttle it only when the background writeback cannot
 		 * catch-up. This avoids (excessively) small writeouts
 		 * when the bdi limits are ramping up.
 		 */
-		if (nr_reclaimable + nr_writeback <
-				(background_thresh + dirty_thresh) / 2)
+		freerun = (background_thresh + dirty_thresh) / 2;
+		if (nr_dirty <= freerun &&
+		    (!memcg || memcg_dirty <= memcg_freerun))
 			break;
 
+		if (nr_dirty > freerun && !writeback_in_progress(bdi))
+			bdi_start_background_writeback(bdi);
+		if (memcg && memcg_dirty > memcg_freerun)
+			bdi_start_memcg_writeback(bdi, memcg_info.id);
+
 		bdi_thresh = bdi_dirty_limit(bdi, dirty_thresh);
 		bdi_thresh = task_dirty_limit(current, bdi_thresh);
 
@@ -534,6 +639,7 @@ static void balance_dirty_pages(struct address_space *mapping,
 			bdi_nr_reclaimable = bdi_stat(bdi, BDI_RECLAIMABLE);
 			bdi_nr_writeback = bdi_stat(bdi, BDI_WRITEBACK);
 		}
+		bdi_dirty = bdi_nr_reclaimable + bdi_nr_writeback;
 
 		/*
 		 * The bdi thresh is somehow "soft" limit derived from the
@@ -541,49 +647,56 @@ static void balance_dirty_pages(struct address_space *mapping,
 		 * bdi or process from holding back light ones; The latter is
 		 * the last resort safeguard.
 		 */
-		dirty_exceeded =
-			(bdi_nr_reclaimable + bdi_nr_writeback >= bdi_thresh)
-			|| (nr_reclaimable + nr_writeback >= dirty_thresh);
+		dirty_exceeded = (bdi_dirty >= bdi_thresh) ||
+				 (nr_dirty >= dirty_thresh) ||
+				 (memcg && memcg_dirty >= memcg_info.dirty_thresh);
 
-		if (!dirty_exceeded)
-			break;
-
-		if (!bdi->dirty_exceeded)
+		if (dirty_exceeded && !bdi->dirty_exceeded)
 			bdi->dirty_exceeded = 1;
 
-		/* Note: nr_reclaimable denotes nr_dirty + nr_unstable.
-		 * Unstable writes are a feature of certain networked
-		 * filesystems (i.e. NFS) in which data may have been
-		 * written to the server's write cache, but has not yet
-		 * been flushed to permanent storage.
-		 * Only move pages to writeback if this bdi is over its
-		 * threshold otherwise wait until the disk writes catch
-		 * up.
-		 */
-		trace_wbc_balance_dirty_start(&wbc, bdi);
-		if (bdi_nr_reclaimable > bdi_thresh) {
-			writeback_inodes_wb(&bdi->wb, &wbc);
-			pages_written += write_chunk - wbc.nr_to_write;
-			trace_wbc_balance_dirty_written(&wbc, bdi);
-			if (pages_written >= write_chunk)
-				break;		/* We've done our duty */
+		bdi_update_bandwidth(bdi);
+
+		pos_ratio = dirty_pos_ratio(nr_dirty, freerun, dirty_thresh,
+					    bdi_dirty, bdi_thresh);
+		if (memcg && memcg_dirty > memcg_freerun)
+			pos_ratio = min(pos_ratio,
+					dirty_pos_ratio(memcg_dirty,
+							memcg_freerun,
+							memcg_info.dirty_thresh,
+							0, 0));
+		task_ratelimit = ((u64)bdi->avg_write_bandwidth * pos_ratio) >>
+				 RATIO_SHIFT;
+		if (task_ratelimit) {
+			pause = HZ * pages_dirtied / task_ratelimit;
+			if (pause > MAX_PAUSE)
+				pause = MAX_PAUSE;
+		} else
+			pause = MAX_PAUSE;
+
+		trace_balance_dirty_pages(bdi, dirty_thresh, background_thresh,
+					  nr_dirty, bdi_thresh, bdi_dirty,
+					  task_ratelimit, pages_dirtied, pause);
+
+		if (pause) {
+			__set_current_state(TASK_KILLABLE);
+			io_schedule_timeout(pause);
 		}
-		trace_wbc_balance_dirty_wait(&wbc, bdi);
-		__set_current_state(TASK_INTERRUPTIBLE);
-		io_schedule_timeout(pause);
 
 		/*
-		 * Increase the delay for each loop, up to our previous
-		 * default of taking a 100ms nap.
+		 * Paid for the pages dirtied; but at the limit, look again
+		 * until writeback has brought the dirty pages below it.
 		 */
-		pause <<= 1;
-		if (pause > HZ / 10)
-			pause = HZ / 10;
+		if (task_ratelimit || fatal_signal_pending(current))
+			break;
 	}
 
 	if (!dirty_exceeded && bdi->dirty_exceeded)
 		bdi->dirty_exceeded = 0;
 
+	if (!laptop_mode && memcg &&
+	    memcg_info.nr_file_dirty > memcg_info.background_thresh)
+		bdi_start_memcg_writeback(bdi, memcg_info.id);
+
 	if (writeback_in_progress(bdi))
 		return;
 
@@ -591,12 +704,12 @@ static void balance_dirty_pages(struct address_space *mapping,
 	 * In laptop mode, we wait until hitting the higher threshold before
 	 * starting background writeout, and then write out all the way down
 	 * to the lower threshold.  So slow writers cause minimal disk activity.
+	 * Past the freerun point writeback was started above.
 	 *
 	 * In normal mode, we start background writeout at the lower
 	 * background_thresh, to keep the amount of dirty memory low.
 	 */
-	if ((laptop_mode && pages_written) ||
-	    (!laptop_mode && (nr_reclaimable > background_thresh)))
+	if (!laptop_mode && (nr_reclaimable > background_thresh))
 		bdi_start_background_writeback(bdi);
 }
 
@@ -644,7 +757,7 @@ void balance_dirty_pages_ratelimited_nr(struct address_space *mapping,
 	p =  &__get_cpu_var(bdp_ratelimits);
 	*p += nr_pages_dirtied;
 	if (unlikely(*p >= ratelimit)) {
-		ratelimit = sync_writeback_pages(*p);
+		ratelimit = *p;
 		*p = 0;
 		preempt_enable();
 		balance_dirty_pages(mapping, ratelimit);
@@ -1121,6 +1234,7 @@ void account_page_dirtied(struct page *page, struct address_space *mapping)
 {
 	if (mapping_cap_account_dirty(mapping)) {
 		__inc_zone_page_state(page, NR_FILE_DIRTY);
+		mem_cgroup_inc_page_stat(page, MEMCG_NR_FILE_DIRTY);
 		__inc_bdi_stat(mapping->backing_dev_info, BDI_RECLAIMABLE);
 		task_dirty_inc(current);
 		task_io_account_write(PAGE_CACHE_SIZE);
@@ -1297,6 +1411,7 @@ int clear_page_dirty_for_io(struct page *page)
 		 */
 		if (TestClearPageDirty(page)) {
 			dec_zone_page_state(page, NR_FILE_DIRTY);
+			mem_cgroup_dec_page_stat(page, MEMCG_NR_FILE_DIRTY);
 			dec_bdi_stat(mapping->backing_dev_info,
 					BDI_RECLAIMABLE);
 			return 1;
@@ -1331,8 +1446,10 @@ int test_clear_page_writeback(struct page *page)
 	} else {
 		ret = TestClearPageWriteback(page);
 	}
-	if (ret)
+	if (ret) {
 		dec_zone_page_state(page, NR_WRITEBACK);
+		mem_cgroup_dec_page_stat(page, MEMCG_NR_FILE_WRITEBACK);
+	}
 	return ret;
 }
 
@@ -1365,8 +1482,10 @@ int test_set_page_writeback(struct page *page)
 	} else {
 		ret = TestSetPageWriteback(page);
 	}
-	if (!ret)
+	if (!ret) {
 		inc_zone_page_state(page, NR_WRITEBACK);
+		mem_cgroup_inc_page_stat(page, MEMCG_NR_FILE_WRITEBACK);
+	}
 	return ret;
 
 }
@@ -595,13 +595,14 @@ static void free_pcppages_bulk(struct zone *zone, int count,
 	int migratetype = 0;
 	int batch_free = 0;
 	int to_free = count;
+	struct page *page, *next;
+	LIST_HEAD(head);
 
-	spin_lock(&zone->lock);
-	zone->all_unreclaimable = 0;
-	zone->pages_scanned = 0;
-
+	/*
+	 * Pick the pages off the pcp lists before taking zone->lock, so
+	 * that the lock is held for the buddy merging only.
+	 */
 	while (to_free) {
-		struct page *page;
 		struct list_head *list;
 
 		/*
@@ -620,13 +621,20 @@ static void free_pcppages_bulk(struct zone *zone, int count,
 
 		do {
 			page = list_entry(list->prev, struct page, lru);
-			/* must delete as __free_one_page list manipulates */
-			list_del(&page->lru);
-			/* MIGRATE_MOVABLE list may include MIGRATE_RESERVEs */
-			__free_one_page(page, zone, 0, page_private(page));
+			list_move(&page->lru, &head);
 			trace_mm_page_pcpu_drain(page, 0, page_private(page));
 		} while (--to_free && --batch_free && !list_empty(list));
 	}
+
+	spin_lock(&zone->lock);
+	zone->all_unreclaimable = 0;
+	zone->pages_scanned = 0;
+
+	/* __free_one_page() reuses page->lru: head is garbage after this */
+	list_for_each_entry_safe(page, next, &head, lru) {
+		/* MIGRATE_MOVABLE list may include MIGRATE_RESERVEs */
+		__free_one_page(page, zone, 0, page_private(page));
+	}
 	__mod_zone_page_state(zone, NR_FREE_PAGES, count);
 	spin_unlock(&zone->lock);
 }
@@ -1075,6 +1083,76 @@ void drain_zone_pages(struct zone *zone, struct per_cpu_pages *pcp)
 }
 #endif
 
+/*
+ * pcp->high adapts to the allocation rate: every refill of an empty pcp
+ * list raises it by a batch, up to pcp->high_max, so that a CPU that
+ * allocates fast keeps more pages around and goes to zone->lock less
+ * often.  Called every sysctl_stat_interval from the vmstat updater,
+ * this lets it decay back to pcp->high_min on a CPU that has gone quiet,
+ * returning the surplus to the buddy allocator.
+ *
+ * Must be called with the thread pinned to the pcp's processor, or for
+ * a processor that is not online.
+ */
+void decay_pcp_high(struct zone *zone, struct per_cpu_pages *pcp)
+{
+	unsigned long flags;
+	int to_drain;
+
+	if (pcp->high <= pcp->high_min)
+		return;
+
+	local_irq_save(flags);
+	pcp->high = max(pcp->high - (pcp->high >> 3), pcp->high_min);
+	to_drain = pcp->count - pcp->high;
+	if (to_drain > 0) {
+		free_pcppages_bulk(zone, to_drain, pcp);
+		pcp->count -= to_drain;
+	}
+	local_irq_restore(flags);
+}
+
+/*
+ * How many pages to drain from a pcp list that reached pcp->high.  A
+ * run of frees with no refill in between doubles the amount each time,
+ * up to what brings the list back to a single batch, so that a CPU
+ * freeing a lot takes zone->lock once per big batch rather than once
+ * per pcp->batch pages.
+ */
+static int nr_pcp_free(struct per_cpu_pages *pcp)
+{
+	int batch = pcp->batch;
+	int nr = batch << pcp->free_factor;
+
+	nr = max(nr, pcp->count - pcp->high + batch);
+	nr = min(nr, pcp->count);
+	if ((batch << pcp->free_factor) < pcp->high)
+		pcp->free_factor++;
+	/* frees outpace allocations: refill in smaller chunks */
+	pcp->alloc_factor >>= 1;
+	return nr;
+}
+
+/*
+ * How many pages to refill an empty pcp list with.  Consecutive
+ * refills double the amount, up to half of pcp->high, and raise
+ * pcp->high itself by a batch (see decay_pcp_high()).
+ */
+static int nr_pcp_alloc(struct per_cpu_pages *pcp)
+{
+	int batch = pcp->batch;
+	int nr = batch << pcp->alloc_factor;
+
+	if (pcp->high < pcp->high_max)
+		pcp->high = min(pcp->high + batch, pcp->high_max);
+	if ((batch << (pcp->alloc_factor + 1)) <= (pcp->high >> 1))
+		pcp->alloc_factor++;
+	/* allocations are catching up: drain in smaller chunks */
+	pcp->free_factor >>= 1;
+
+	return max(min(nr, pcp->high - pcp->count), batch);
+}
+
 /*
  * Drain pages of the indicated processor.
  *
@@ -1197,8 +1275,10 @@ void free_hot_cold_page(struct page *page, int cold)
 		list_add(&page->lru, &pcp->lists[migratetype]);
 	pcp->count++;
 	if (pcp->count >= pcp->high) {
-		free_pcppages_bulk(zone, pcp->batch, pcp);
-		pcp->count -= pcp->batch;
+		int to_free = nr_pcp_free(pcp);
+
+		free_pcppages_bulk(zone, to_free, pcp);
+		pcp->count -= to_free;
 	}
 
 out:
@@ -1302,7 +1382,7 @@ again:
 		list = &pcp->lists[migratetype];
 		if (list_empty(list)) {
 			pcp->count += rmqueue_bulk(zone, 0,
-					pcp->batch, list,
+					nr_pcp_alloc(pcp), list,
 					migratetype, cold);
 			if (unlikely(list_empty(list)))
 				goto failed;
@@ -3384,11 +3464,28 @@ static void setup_pageset(struct per_cpu_pageset *p, unsigned long batch)
 	pcp = &p->pcp;
 	pcp->count = 0;
 	pcp->high = 6 * batch;
+	pcp->high_min = pcp->high;
+	pcp->high_max = pcp->high;
 	pcp->batch = max(1UL, 1 * batch);
 	for (migratetype = 0; migratetype < MIGRATE_PCPTYPES; migratetype++)
 		INIT_LIST_HEAD(&pcp->lists[migratetype]);
 }
 
+/*
+ * Let a busy CPU cache up to four times its usual pcp->high, as long as
+ * all CPUs together cannot hide more than an eighth of the zone.
+ */
+static void setup_pageset_high_max(struct per_cpu_pageset *p,
+				   struct zone *zone)
+{
+	struct per_cpu_pages *pcp = &p->pcp;
+	unsigned long high_max;
+
+	high_max = zone->present_pages / (8 * num_possible_cpus());
+	high_max = min(high_max, 4UL * pcp->high_min);
+	pcp->high_max = max_t(unsigned long, high_max, pcp->high_min);
+}
+
 /*
  * setup_pagelist_highmark() sets the high water mark for hot per_cpu_pagelist
  * to the value high for the pageset p.
@@ -3401,6 +3498,9 @@ static void setup_pagelist_highmark(struct per_cpu_pageset *p,
 
 	pcp = &p->pcp;
 	pcp->high = high;
+	/* an explicit high mark is not adapted to the allocation rate */
+	pcp->high_min = high;
+	pcp->high_max = high;
 	pcp->batch = max(1UL, high/4);
 	if ((high/4) > (PAGE_SHIFT * 8))
 		pcp->batch = PAGE_SHIFT * 8;
@@ -3416,6 +3516,7 @@ static __meminit void setup_zone_pageset(struct zone *zone)
 		struct per_cpu_pageset *pcp = per_cpu_ptr(zone->pageset, cpu);
 
 		setup_pageset(pcp, zone_batchsize(zone));
+		setup_pageset_high_max(pcp, zone);
 
 		if (percpu_pagelist_fraction)
 			setup_pagelist_highmark(pcp,
@@ -3495,6 +3596,7 @@ static int __zone_pcp_update(void *data)
 		local_irq_save(flags);
 		free_pcppages_bulk(zone, pcp->count, pcp);
 		setup_pageset(pset, batch);
+		setup_pageset_high_max(pset, zone);
 		local_irq_restore(flags);
 	}
 	return 0;
@@ -4079,6 +4181,9 @@ static void __paginginit free_area_init_core(struct pglist_data *pgdat,
 	pgdat->nr_zones = 0;
 	init_waitqueue_head(&pgdat->kswapd_wait);
 	pgdat->kswapd_max_order = 0;
+#ifdef CONFIG_COMPACTION
+	init_waitqueue_head(&pgdat->kcompactd_wait);
+#endif
 	pgdat_page_cgroup_init(pgdat);
 	
 	for (j = 0; j < MAX_NR_ZONES; j++) {
@@ -4132,6 +4237,7 @@ static void __paginginit free_area_init_core(struct pglist_data *pgdat,
 		spin_lock_init(&zone->lru_lock);
 		zone_seqlock_init(zone);
 		zone->zone_pgdat = pgdat;
+		atomic_long_set(&zone->inactive_age, 0);
 
 		zone_pcp_init(zone);
 		for_each_lru(l) {
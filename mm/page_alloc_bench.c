@@ -0,0 +1,131 @@
+/*
+ * mm/page_alloc_bench.c
+ *
+ * Page allocator microbenchmark.  On load, a thread bound to every
+ * online CPU allocates order-0 pages in bursts of 'burst' pages and
+ * frees them again, all CPUs at once, for 'duration_ms' milliseconds.
+ * Allocations per second are then reported per CPU and in total.
+ *
+ * Bursts larger than pcp->high make every CPU go to zone->lock, which
+ * is what the per-cpu page lists are meant to avoid; compare the
+ * results for a few burst sizes.  The module stays loaded: unload it
+ * before running it again.
+ */
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/gfp.h>
+#include <linux/mm.h>
+#include <linux/cpu.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/jiffies.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+
+static int burst = 64;
+module_param(burst, int, 0444);
+MODULE_PARM_DESC(burst, "pages allocated before freeing them (default 64)");
+
+static unsigned int duration_ms = 1000;
+module_param(duration_ms, uint, 0444);
+MODULE_PARM_DESC(duration_ms, "run time in milliseconds (default 1000)");
+
+struct bench_result {
+	unsigned long allocs;
+	unsigned long failed;
+	unsigned long elapsed;		/* jiffies */
+	struct completion done;
+};
+
+static DEFINE_PER_CPU(struct bench_result, bench_results);
+static DECLARE_COMPLETION(bench_start);
+
+static int bench_thread(void *arg)
+{
+	struct bench_result *res = arg;
+	struct page **pages;
+	unsigned long start, end;
+	int i, n;
+
+	pages = kmalloc(burst * sizeof(*pages), GFP_KERNEL);
+	if (!pages)
+		goto out;
+
+	wait_for_completion(&bench_start);
+	start = jiffies;
+	end = start + msecs_to_jiffies(duration_ms);
+	while (time_before(jiffies, end)) {
+		for (n = 0; n < burst; n++) {
+			pages[n] = alloc_page(GFP_KERNEL);
+			if (!pages[n]) {
+				res->failed++;
+				break;
+			}
+		}
+		for (i = 0; i < n; i++)
+			__free_page(pages[i]);
+		res->allocs += n;
+		cond_resched();
+	}
+	res->elapsed = jiffies - start;
+	kfree(pages);
+out:
+	complete(&res->done);
+	return 0;
+}
+
+static int __init page_alloc_bench_init(void)
+{
+	unsigned long total = 0;
+	int cpu;
+
+	if (burst < 1 || !duration_ms)
+		return -EINVAL;
+
+	get_online_cpus();
+	for_each_online_cpu(cpu) {
+		struct bench_result *res = &per_cpu(bench_results, cpu);
+		struct task_struct *p;
+
+		memset(res, 0, sizeof(*res));
+		init_completion(&res->done);
+		p = kthread_create(bench_thread, res, "page_alloc_bench/%d",
+				   cpu);
+		if (IS_ERR(p)) {
+			complete(&res->done);
+			continue;
+		}
+		kthread_bind(p, cpu);
+		wake_up_process(p);
+	}
+
+	complete_all(&bench_start);
+
+	for_each_online_cpu(cpu) {
+		struct bench_result *res = &per_cpu(bench_results, cpu);
+		unsigned long rate = 0;
+
+		wait_for_completion(&res->done);
+		if (res->elapsed)
+			rate = res->allocs * HZ / res->elapsed;
+		total += rate;
+		printk(KERN_INFO "page_alloc_bench: cpu %d: %lu allocs/sec"
+		       " (%lu failed)\n", cpu, rate, res->failed);
+	}
+	put_online_cpus();
+
+	printk(KERN_INFO "page_alloc_bench: burst %d: %lu allocs/sec total\n",
+	       burst, total);
+	return 0;
+}
+module_init(page_alloc_bench_init);
+
+static void __exit page_alloc_bench_exit(void)
+{
+}
+module_exit(page_alloc_bench_exit);
+
+MODULE_LICENSE("GPL");
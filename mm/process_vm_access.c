@@ -0,0 +1,345 @@
+/*
+ * linux/mm/process_vm_access.c
+ *
+ * process_vm_readv() and process_vm_writev(): copy between the calling
+ * process and another one, iovec to iovec, without going through the
+ * kernel page by page as ptrace(PTRACE_PEEKDATA) and /proc/pid/mem do.
+ * The remote pages are pinned with get_user_pages() a batch at a time
+ * and copied straight to or from the local buffers.
+ *
+ * The caller needs the same permission as for ptrace attach.
+ */
+
+#include <linux/mm.h>
+#include <linux/uio.h>
+#include <linux/sched.h>
+#include <linux/highmem.h>
+#include <linux/ptrace.h>
+#include <linux/slab.h>
+#include <linux/syscalls.h>
+
+#ifdef CONFIG_COMPAT
+#include <linux/compat.h>
+#endif
+
+/* remote pages pinned at once with the array on the stack */
+#define PVM_MAX_PP_ARRAY_COUNT 16
+
+/* and with an array in one kmalloc'd page */
+#define PVM_MAX_KMALLOC_PAGES (PAGE_SIZE / sizeof(struct page *))
+
+/* where in the local iovec array the copy has got to */
+struct pvm_local {
+	const struct iovec *iov;
+	unsigned long nr_segs;
+	unsigned long seg;
+	size_t offset;
+};
+
+/*
+ * Copy @len bytes between @kaddr and the local iovecs, advancing @local.
+ * Returns the number of bytes copied, short if a local buffer faulted or
+ * the local iovecs ran out.
+ */
+static size_t pvm_copy_local(struct pvm_local *local, char *kaddr,
+			     size_t len, int vm_write)
+{
+	size_t copied = 0;
+
+	while (copied < len && local->seg < local->nr_segs) {
+		const struct iovec *iov = &local->iov[local->seg];
+		char __user *ubuf = iov->iov_base + local->offset;
+		size_t n = min(len - copied, iov->iov_len - local->offset);
+		size_t left;
+
+		if (vm_write)
+			left = copy_from_user(kaddr + copied, ubuf, n);
+		else
+			left = copy_to_user(ubuf, kaddr + copied, n);
+		copied += n - left;
+		local->offset += n - left;
+		if (left)
+			break;
+		if (local->offset == iov->iov_len) {
+			local->seg++;
+			local->offset = 0;
+		}
+	}
+	return copied;
+}
+
+/*
+ * Copy between one remote range and the local iovecs.  Returns the
+ * number of bytes copied, or -EFAULT if nothing could be.
+ */
+static ssize_t process_vm_rw_single_vec(unsigned long addr, unsigned long len,
+					struct pvm_local *local,
+					struct page **process_pages,
+					unsigned long max_pages,
+					struct task_struct *task,
+					struct mm_struct *mm, int vm_write)
+{
+	ssize_t copied = 0;
+
+	while (len && local->seg < local->nr_segs) {
+		unsigned long offset = addr & ~PAGE_MASK;
+		unsigned long nr_pages;
+		int pinned, i;
+
+		nr_pages = min(max_pages,
+			       (offset + len + PAGE_SIZE - 1) >> PAGE_SHIFT);
+
+		down_read(&mm->mmap_sem);
+		pinned = get_user_pages(task, mm, addr & PAGE_MASK, nr_pages,
+					vm_write, 0, process_pages, NULL);
+		up_read(&mm->mmap_sem);
+		if (pinned <= 0)
+			break;
+
+		for (i = 0; i < pinned; i++) {
+			struct page *page = process_pages[i];
+			size_t n = min_t(unsigned long, PAGE_SIZE - offset, len);
+			size_t done = 0;
+
+			if (n && local->seg < local->nr_segs) {
+				char *kaddr = kmap(page);
+
+				done = pvm_copy_local(local, kaddr + offset, n,
+						      vm_write);
+				kunmap(page);
+				if (vm_write && done)
+					set_page_dirty_lock(page);
+			}
+			put_page(page);
+
+			copied += done;
+			addr += done;
+			len -= done;
+			offset = 0;
+			/* a local fault or the end of the local iovecs */
+			if (done < n)
+				len = 0;
+		}
+	}
+	return copied ? copied : -EFAULT;
+}
+
+static ssize_t process_vm_rw_core(pid_t pid, const struct iovec *lvec,
+				  unsigned long liovcnt,
+				  const struct iovec *rvec,
+				  unsigned long riovcnt,
+				  unsigned long flags, int vm_write)
+{
+	struct page *pp_stack[PVM_MAX_PP_ARRAY_COUNT];
+	struct page **process_pages = pp_stack;
+	unsigned long max_pages = PVM_MAX_PP_ARRAY_COUNT;
+	unsigned long nr_pages = 0;
+	struct pvm_local local = {
+		.iov = lvec,
+		.nr_segs = liovcnt,
+	};
+	struct task_struct *task;
+	struct mm_struct *mm;
+	ssize_t copied = 0;
+	ssize_t rc = 0;
+	unsigned long i;
+
+	/* the most remote pages any one batch can need */
+	for (i = 0; i < riovcnt; i++) {
+		unsigned long start = (unsigned long)rvec[i].iov_base;
+		unsigned long len = rvec[i].iov_len;
+
+		if (len)
+			nr_pages = max(nr_pages, ((start + len - 1) >> PAGE_SHIFT)
+				       - (start >> PAGE_SHIFT) + 1);
+	}
+	if (!nr_pages)
+		return 0;
+
+	if (nr_pages > PVM_MAX_PP_ARRAY_COUNT) {
+		process_pages = kmalloc(PAGE_SIZE, GFP_KERNEL);
+		if (!process_pages)
+			return -ENOMEM;
+		max_pages = PVM_MAX_KMALLOC_PAGES;
+	}
+
+	rcu_read_lock();
+	task = find_task_by_vpid(pid);
+	if (task)
+		get_task_struct(task);
+	rcu_read_unlock();
+	if (!task) {
+		rc = -ESRCH;
+		goto free_proc_pages;
+	}
+
+	/* as in mm_for_maps(): no exec may change the rules meanwhile */
+	rc = mutex_lock_killable(&task->cred_guard_mutex);
+	if (rc)
+		goto put_task_struct;
+	mm = get_task_mm(task);
+	if (mm && mm != current->mm &&
+	    !ptrace_may_access(task, PTRACE_MODE_ATTACH)) {
+		mmput(mm);
+		mm = NULL;
+		rc = -EPERM;
+	} else if (!mm)
+		rc = -EINVAL;		/* a kernel thread, or exiting */
+	mutex_unlock(&task->cred_guard_mutex);
+	if (!mm)
+		goto put_task_struct;
+
+	for (i = 0; i < riovcnt && local.seg < liovcnt; i++) {
+		if (!rvec[i].iov_len)
+			continue;
+		rc = process_vm_rw_single_vec(
+			(unsigned long)rvec[i].iov_base, rvec[i].iov_len,
+			&local, process_pages, max_pages, task, mm, vm_write);
+		if (rc < 0)
+			break;
+		copied += rc;
+		/* stop at the first remote hole or local fault */
+		if (rc < rvec[i].iov_len)
+			break;
+	}
+
+	/* like readv(): a partial copy is reported as such */
+	if (copied)
+		rc = copied;
+	mmput(mm);
+
+put_task_struct:
+	put_task_struct(task);
+
+free_proc_pages:
+	if (process_pages != pp_stack)
+		kfree(process_pages);
+	return rc;
+}
+
+static ssize_t process_vm_rw(pid_t pid,
+			     const struct iovec __user *lvec,
+			     unsigned long liovcnt,
+			     const struct iovec __user *rvec,
+			     unsigned long riovcnt,
+			     unsigned long flags, int vm_write)
+{
+	struct iovec iovstack_l[UIO_FASTIOV];
+	struct iovec iovstack_r[UIO_FASTIOV];
+	struct iovec *iov_l = iovstack_l;
+	struct iovec *iov_r = iovstack_r;
+	ssize_t rc;
+
+	if (flags != 0)
+		return -EINVAL;
+
+	/* check the local iovecs for the direction they are accessed in */
+	rc = rw_copy_check_uvector(vm_write ? WRITE : READ, lvec, liovcnt,
+				   UIO_FASTIOV, iovstack_l, &iov_l);
+	if (rc <= 0)
+		goto free_iovecs;
+
+	/* the remote iovecs point into the other mm: check lengths only */
+	rc = rw_copy_check_uvector(CHECK_IOVEC_ONLY, rvec, riovcnt,
+				   UIO_FASTIOV, iovstack_r, &iov_r);
+	if (rc <= 0)
+		goto free_iovecs;
+
+	rc = process_vm_rw_core(pid, iov_l, liovcnt, iov_r, riovcnt, flags,
+				vm_write);
+
+free_iovecs:
+	if (iov_r != iovstack_r)
+		kfree(iov_r);
+	if (iov_l != iovstack_l)
+		kfree(iov_l);
+	return rc;
+}
+
+SYSCALL_DEFINE6(process_vm_readv, pid_t, pid, const struct iovec __user *, lvec,
+		unsigned long, liovcnt, const struct iovec __user *, rvec,
+		unsigned long, riovcnt,	unsigned long, flags)
+{
+	return process_vm_rw(pid, lvec, liovcnt, rvec, riovcnt, flags, 0);
+}
+
+SYSCALL_DEFINE6(process_vm_writev, pid_t, pid,
+		const struct iovec __user *, lvec,
+		unsigned long, liovcnt, const struct iovec __user *, rvec,
+		unsigned long, riovcnt,	unsigned long, flags)
+{
+	return process_vm_rw(pid, lvec, liovcnt, rvec, riovcnt, flags, 1);
+}
+
+#ifdef CONFIG_COMPAT
+
+static ssize_t
+compat_process_vm_rw(compat_pid_t pid,
+		     const struct compat_iovec __user *lvec,
+		     unsigned long liovcnt,
+		     const struct compat_iovec __user *rvec,
+		     unsigned long riovcnt,
+		     unsigned long flags, int vm_write)
+{
+	struct iovec iovstack_l[UIO_FASTIOV];
+	struct iovec iovstack_r[UIO_FASTIOV];
+	struct iovec *iov_l = iovstack_l;
+	struct iovec *iov_r = iovstack_r;
+	ssize_t rc = -EFAULT;
+
+	if (flags != 0)
+		return -EINVAL;
+
+	if (!access_ok(VERIFY_READ, lvec, liovcnt * sizeof(*lvec)))
+		goto out;
+	rc = compat_rw_copy_check_uvector(vm_write ? WRITE : READ, lvec,
+					  liovcnt, UIO_FASTIOV, iovstack_l,
+					  &iov_l);
+	if (rc <= 0)
+		goto free_iovecs;
+
+	rc = -EFAULT;
+	if (!access_ok(VERIFY_READ, rvec, riovcnt * sizeof(*rvec)))
+		goto free_iovecs;
+	rc = compat_rw_copy_check_uvector(CHECK_IOVEC_ONLY, rvec, riovcnt,
+					  UIO_FASTIOV, iovstack_r, &iov_r);
+	if (rc <= 0)
+		goto free_iovecs;
+
+	rc = process_vm_rw_core(pid, iov_l, liovcnt, iov_r, riovcnt, flags,
+				vm_write);
+
+free_iovecs:
+	if (iov_r != iovstack_r)
+		kfree(iov_r);
+	if (iov_l != iovstack_l)
+		kfree(iov_l);
+out:
+	return rc;
+}
+
+asmlinkage ssize_t
+compat_sys_process_vm_readv(compat_pid_t pid,
+			    const struct compat_iovec __user *lvec,
+			    unsigned long liovcnt,
+			    const struct compat_iovec __user *rvec,
+			    unsigned long riovcnt,
+			    unsigned long flags)
+{
+	return compat_process_vm_rw(pid, lvec, liovcnt, rvec,
+				    riovcnt, flags, 0);
+}
+
+asmlinkage ssize_t
+compat_sys_process_vm_writev(compat_pid_t pid,
+			     const struct compat_iovec __user *lvec,
+			     unsigned long liovcnt,
+			     const struct compat_iovec __user *rvec,
+			     unsigned long riovcnt,
+			     unsigned long flags)
+{
+	return compat_process_vm_rw(pid, lvec, liovcnt, rvec,
+				    riovcnt, flags, 1);
+}
+
+#endif
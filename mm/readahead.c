@@ -149,6 +149,9 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 	struct inode *inode = mapping->host;
 	struct page *page;
 	unsigned long end_index;	/* The last page we want to read */
+	pgoff_t last_index;
+	pgoff_t run_start = offset;	/* Next run of cached pages */
+	pgoff_t run_end = offset;
 	LIST_HEAD(page_pool);
 	int page_idx;
 	int ret = 0;
@@ -158,9 +161,12 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 		goto out;
 
 	end_index = ((isize - 1) >> PAGE_CACHE_SHIFT);
+	last_index = min_t(pgoff_t, end_index, offset + nr_to_read - 1);
 
 	/*
-	 * Preallocate as many pages as we will need.
+	 * Preallocate as many pages as we will need.  Which pages are already
+	 * cached is found a run at a time rather than page by page: on a cold
+	 * file one lookup covers the whole window.
 	 */
 	for (page_idx = 0; page_idx < nr_to_read; page_idx++) {
 		pgoff_t page_offset = offset + page_idx;
@@ -168,10 +174,10 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 		if (page_offset > end_index)
 			break;
 
-		rcu_read_lock();
-		page = radix_tree_lookup(&mapping->page_tree, page_offset);
-		rcu_read_unlock();
-		if (page)
+		if (page_offset >= run_end)
+			run_start = page_cache_next_run(mapping, page_offset,
+							last_index, &run_end);
+		if (page_offset >= run_start)
 			continue;
 
 		page = page_cache_alloc_cold(mapping);
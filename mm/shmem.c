@@ -60,6 +60,7 @@ static struct vfsmount *shm_mnt;
 #include <linux/highmem.h>
 #include <linux/seq_file.h>
 #include <linux/magic.h>
+#include <linux/huge_mm.h>
 
 #include <asm/uaccess.h>
 #include <asm/div64.h>
@@ -241,6 +242,29 @@ static void shmem_free_blocks(struct inode *inode, long pages)
 	}
 }
 
+/*
+ * Account one more data page to the inode, against both the size limit
+ * of the instance and the VM_NORESERVE commit charge; undone with
+ * shmem_unacct_blocks() and shmem_free_blocks().
+ */
+static int shmem_reserve_block(struct inode *inode)
+{
+	struct shmem_inode_info *info = SHMEM_I(inode);
+	struct shmem_sb_info *sbinfo = SHMEM_SB(inode->i_sb);
+
+	if (sbinfo->max_blocks) {
+		if ((percpu_counter_compare(&sbinfo->used_blocks, sbinfo->max_blocks) > 0) ||
+		    shmem_acct_block(info->flags))
+			return -ENOSPC;
+		percpu_counter_inc(&sbinfo->used_blocks);
+		spin_lock(&inode->i_lock);
+		inode->i_blocks += BLOCKS_PER_PAGE;
+		spin_unlock(&inode->i_lock);
+	} else if (shmem_acct_block(info->flags))
+		return -ENOSPC;
+	return 0;
+}
+
 static int shmem_reserve_inode(struct super_block *sb)
 {
 	struct shmem_sb_info *sbinfo = SHMEM_SB(sb);
@@ -1208,6 +1232,188 @@ static inline struct mempolicy *shmem_get_sbmpol(struct shmem_sb_info *sbinfo)
 }
 #endif
 
+/* huge page policy of the internal mount, tunable through sysfs */
+int shmem_huge __read_mostly;
+
+static const char * const shmem_huge_names[] = {
+	[SHMEM_HUGE_NEVER]		= "never",
+	[SHMEM_HUGE_WITHIN_SIZE]	= "within_size",
+	[SHMEM_HUGE_ALWAYS]		= "always",
+};
+
+int shmem_parse_huge(const char *str)
+{
+	int huge;
+
+	for (huge = SHMEM_HUGE_NEVER; huge <= SHMEM_HUGE_ALWAYS; huge++)
+		if (sysfs_streq(str, shmem_huge_names[huge]))
+			break;
+	if (huge > SHMEM_HUGE_ALWAYS)
+		return -EINVAL;
+#ifndef CONFIG_TRANSPARENT_HUGEPAGE
+	if (huge != SHMEM_HUGE_NEVER)
+		return -EINVAL;
+#endif
+	return huge;
+}
+
+const char *shmem_format_huge(int huge)
+{
+	return shmem_huge_names[huge];
+}
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+static int shmem_huge_mode(struct inode *inode)
+{
+	if (inode->i_sb == shm_mnt->mnt_sb)
+		return shmem_huge;
+	return SHMEM_SB(inode->i_sb)->huge;
+}
+
+/*
+ * Whether the naturally aligned extent of HPAGE_PMD_NR pages around
+ * @index should come from one huge page: with huge=always wherever the
+ * file may grow to, with huge=within_size only below i_size.
+ */
+static bool shmem_huge_extent(struct inode *inode, unsigned long index)
+{
+	unsigned long hindex = index & ~(HPAGE_PMD_NR - 1);
+
+	switch (shmem_huge_mode(inode)) {
+	case SHMEM_HUGE_ALWAYS:
+		return hindex + HPAGE_PMD_NR <= SHMEM_MAX_INDEX;
+	case SHMEM_HUGE_WITHIN_SIZE:
+		return ((loff_t)(hindex + HPAGE_PMD_NR) << PAGE_CACHE_SHIFT) <=
+			i_size_read(inode);
+	}
+	return false;
+}
+
+static struct page *shmem_alloc_hugepage(gfp_t gfp,
+			struct shmem_inode_info *info, unsigned long hindex)
+{
+	struct page *page;
+#ifdef CONFIG_NUMA
+	struct vm_area_struct pvma;
+
+	/* a pseudo vma for the policy, as in shmem_alloc_page() */
+	pvma.vm_start = 0;
+	pvma.vm_pgoff = hindex;
+	pvma.vm_ops = NULL;
+	pvma.vm_policy = mpol_shared_policy_lookup(&info->policy, hindex);
+	page = alloc_pages_vma(gfp | __GFP_NORETRY | __GFP_NOWARN,
+			       HPAGE_PMD_ORDER, &pvma, 0);
+#else
+	page = alloc_pages(gfp | __GFP_NORETRY | __GFP_NOWARN,
+			   HPAGE_PMD_ORDER);
+#endif
+	if (page)
+		split_page(page, HPAGE_PMD_ORDER);
+	return page;
+}
+
+/*
+ * Populate the empty extent of HPAGE_PMD_NR pages around @index from one
+ * huge page, so that shmem_pmd_fault() can map it with a single pmd.
+ * The huge page is split into order-0 pages which go into the page
+ * cache one by one, like any other shmem page: should the extent only
+ * partly fill up, because of a racing fault, a swap entry, i_size or
+ * the size limit, the pages added stay as small pages and the rest is
+ * freed.  Returns the number of pages added.
+ */
+static int shmem_alloc_huge_extent(struct inode *inode, unsigned long index,
+				   enum sgp_type sgp, gfp_t gfp)
+{
+	struct address_space *mapping = inode->i_mapping;
+	struct shmem_inode_info *info = SHMEM_I(inode);
+	unsigned long hindex = index & ~(HPAGE_PMD_NR - 1);
+	struct page *page, *found;
+	swp_entry_t *entry;
+	int uncharged = 0;
+	int i, nr;
+
+	if (find_get_pages(mapping, hindex, 1, &found)) {
+		nr = found->index < hindex + HPAGE_PMD_NR;
+		page_cache_release(found);
+		if (nr)
+			return 0;
+	}
+
+	page = shmem_alloc_hugepage(gfp, info, hindex);
+	if (!page)
+		return 0;
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		cond_resched();
+		clear_highpage(page + i);
+		flush_dcache_page(page + i);
+		SetPageUptodate(page + i);
+		SetPageSwapBacked(page + i);
+	}
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		if (mem_cgroup_cache_charge(page + i, current->mm,
+					    GFP_KERNEL)) {
+			while (--i >= 0)
+				mem_cgroup_uncharge_cache_page(page + i);
+			nr = 0;
+			goto free;
+		}
+	}
+
+	spin_lock(&info->lock);
+	shmem_recalc_inode(inode);
+	for (nr = 0; nr < HPAGE_PMD_NR; nr++) {
+		entry = shmem_swp_alloc(info, hindex + nr, sgp);
+		if (IS_ERR(entry))
+			break;
+		if (entry->val) {
+			shmem_swp_unmap(entry);
+			break;
+		}
+		shmem_swp_unmap(entry);
+		if (shmem_reserve_block(inode))
+			break;
+		if (add_to_page_cache_lru(page + nr, mapping, hindex + nr,
+					  GFP_NOWAIT)) {
+			/* which uncharged the page */
+			uncharged = 1;
+			break;
+		}
+		info->alloced++;
+	}
+	if (nr)
+		info->flags |= SHMEM_PAGEIN;
+	spin_unlock(&info->lock);
+	if (uncharged) {
+		shmem_unacct_blocks(info->flags, 1);
+		shmem_free_blocks(inode, 1);
+	}
+
+	for (i = 0; i < nr; i++) {
+		unlock_page(page + i);
+		page_cache_release(page + i);
+	}
+	for (i = nr + uncharged; i < HPAGE_PMD_NR; i++)
+		mem_cgroup_uncharge_cache_page(page + i);
+	if (nr == HPAGE_PMD_NR)
+		count_vm_event(THP_FILE_ALLOC);
+free:
+	for (i = nr; i < HPAGE_PMD_NR; i++)
+		page_cache_release(page + i);
+	return nr;
+}
+#else
+static inline bool shmem_huge_extent(struct inode *inode, unsigned long index)
+{
+	return false;
+}
+
+static inline int shmem_alloc_huge_extent(struct inode *inode,
+			unsigned long index, enum sgp_type sgp, gfp_t gfp)
+{
+	return 0;
+}
+#endif /* CONFIG_TRANSPARENT_HUGEPAGE */
+
 /*
  * shmem_getpage - either get the page from swap or allocate a new one
  *
@@ -1220,12 +1426,12 @@ static int shmem_getpage(struct inode *inode, unsigned long idx,
 {
 	struct address_space *mapping = inode->i_mapping;
 	struct shmem_inode_info *info = SHMEM_I(inode);
-	struct shmem_sb_info *sbinfo;
 	struct page *filepage = *pagep;
 	struct page *swappage;
 	struct page *prealloc_page = NULL;
 	swp_entry_t *entry;
 	swp_entry_t swap;
+	bool tried_huge = false;
 	gfp_t gfp;
 	int error;
 
@@ -1258,6 +1464,13 @@ repeat:
 		if (error)
 			goto failed;
 		radix_tree_preload_end();
+		if (sgp != SGP_READ && !tried_huge &&
+		    shmem_huge_extent(inode, idx)) {
+			/* then look again, the page may be there now */
+			tried_huge = true;
+			if (shmem_alloc_huge_extent(inode, idx, sgp, gfp))
+				goto repeat;
+		}
 		if (sgp != SGP_READ && !prealloc_page) {
 			/* We don't care if this fails */
 			prealloc_page = shmem_alloc_page(gfp, info, idx);
@@ -1284,7 +1497,7 @@ repeat:
 
 	if (swap.val) {
 		/* Look it up and read it in.. */
-		swappage = lookup_swap_cache(swap);
+		swappage = lookup_swap_cache(swap, NULL, 0);
 		if (!swappage) {
 			shmem_swp_unmap(entry);
 			/* here we actually do the io */
@@ -1397,19 +1610,7 @@ repeat:
 		spin_unlock(&info->lock);
 	} else {
 		shmem_swp_unmap(entry);
-		sbinfo = SHMEM_SB(inode->i_sb);
-		if (sbinfo->max_blocks) {
-			if ((percpu_counter_compare(&sbinfo->used_blocks, sbinfo->max_blocks) > 0) ||
-			    shmem_acct_block(info->flags)) {
-				spin_unlock(&info->lock);
-				error = -ENOSPC;
-				goto failed;
-			}
-			percpu_counter_inc(&sbinfo->used_blocks);
-			spin_lock(&inode->i_lock);
-			inode->i_blocks += BLOCKS_PER_PAGE;
-			spin_unlock(&inode->i_lock);
-		} else if (shmem_acct_block(info->flags)) {
+		if (shmem_reserve_block(inode)) {
 			spin_unlock(&info->lock);
 			error = -ENOSPC;
 			goto failed;
@@ -1522,6 +1723,96 @@ static int shmem_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
 	return ret | VM_FAULT_LOCKED;
 }
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+/*
+ * Map a whole extent with one huge pmd when it was populated from a huge
+ * page, which shmem_getpage() tries first where the mount asks for it.
+ * Private mappings are left to shmem_fault(): they need ptes for
+ * copy-on-write.
+ */
+static int shmem_pmd_fault(struct vm_area_struct *vma, unsigned long address,
+			   pmd_t *pmd, unsigned int flags)
+{
+	struct inode *inode = vma->vm_file->f_path.dentry->d_inode;
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+	struct page *page = NULL;
+	unsigned long hindex;
+	int error, ret;
+
+	if (!(vma->vm_flags & VM_SHARED) || (vma->vm_flags & VM_NONLINEAR))
+		return VM_FAULT_FALLBACK;
+	if (haddr < vma->vm_start || haddr + HPAGE_PMD_SIZE > vma->vm_end)
+		return VM_FAULT_FALLBACK;
+	hindex = linear_page_index(vma, haddr);
+	if (hindex & (HPAGE_PMD_NR - 1))
+		return VM_FAULT_FALLBACK;
+	if (shmem_huge_mode(inode) == SHMEM_HUGE_NEVER)
+		return VM_FAULT_FALLBACK;
+	/* beyond i_size the small faults have to raise SIGBUS */
+	if (((loff_t)(hindex + HPAGE_PMD_NR) << PAGE_CACHE_SHIFT) >
+	    i_size_read(inode))
+		return VM_FAULT_FALLBACK;
+
+	error = shmem_getpage(inode, linear_page_index(vma, address), &page,
+			      SGP_CACHE, &ret);
+	if (error)
+		return VM_FAULT_FALLBACK;
+	unlock_page(page);
+	page_cache_release(page);
+
+	return ret | do_huge_pmd_file_page(vma, address, pmd,
+					   inode->i_mapping, hindex);
+}
+
+/*
+ * Place mappings of files that get huge pages so that file offset and
+ * virtual address agree modulo HPAGE_PMD_SIZE, or no extent could ever
+ * be mapped with a huge pmd.  Also used with no @file for shared
+ * anonymous mappings and MAP_SHARED of /dev/zero: shmem_zero_setup()
+ * only creates their file on the internal mount once the address is
+ * chosen, so those follow shmem_enabled.
+ */
+unsigned long shmem_get_unmapped_area(struct file *file,
+		unsigned long uaddr, unsigned long len,
+		unsigned long pgoff, unsigned long flags)
+{
+	unsigned long (*get_area)(struct file *, unsigned long,
+				  unsigned long, unsigned long, unsigned long);
+	unsigned long addr, offset, inflated_len;
+	unsigned long inflated_addr, inflated_offset;
+
+	get_area = current->mm->get_unmapped_area;
+	addr = get_area(file, uaddr, len, pgoff, flags);
+	if (IS_ERR_VALUE(addr) || (addr & ~PAGE_MASK) || (flags & MAP_FIXED))
+		return addr;
+	if (len < HPAGE_PMD_SIZE || (uaddr && addr == uaddr))
+		return addr;
+	if ((file ? shmem_huge_mode(file->f_path.dentry->d_inode) :
+		    shmem_huge) == SHMEM_HUGE_NEVER)
+		return addr;
+
+	offset = (pgoff << PAGE_SHIFT) & ~HPAGE_PMD_MASK;
+	if ((addr & ~HPAGE_PMD_MASK) == offset)
+		return addr;
+
+	/* ask for a range one huge page larger and align inside it */
+	inflated_len = len + HPAGE_PMD_SIZE - PAGE_SIZE;
+	if (inflated_len > TASK_SIZE || inflated_len < len)
+		return addr;
+	inflated_addr = get_area(NULL, 0, inflated_len, 0, flags);
+	if (IS_ERR_VALUE(inflated_addr) || (inflated_addr & ~PAGE_MASK))
+		return addr;
+
+	inflated_offset = inflated_addr & ~HPAGE_PMD_MASK;
+	inflated_addr += offset - inflated_offset;
+	if (inflated_offset > offset)
+		inflated_addr += HPAGE_PMD_SIZE;
+	if (inflated_addr > TASK_SIZE - len)
+		return addr;
+	return inflated_addr;
+}
+#endif /* CONFIG_TRANSPARENT_HUGEPAGE */
+
 #ifdef CONFIG_NUMA
 static int shmem_set_policy(struct vm_area_struct *vma, struct mempolicy *new)
 {
@@ -2249,6 +2540,12 @@ static int shmem_parse_options(char *options, struct shmem_sb_info *sbinfo,
 		} else if (!strcmp(this_char,"mpol")) {
 			if (mpol_parse_str(value, &sbinfo->mpol, 1))
 				goto bad_val;
+		} else if (!strcmp(this_char,"huge")) {
+			int huge = shmem_parse_huge(value);
+
+			if (huge < 0)
+				goto bad_val;
+			sbinfo->huge = huge;
 		} else {
 			printk(KERN_ERR "tmpfs: Bad mount option %s\n",
 			       this_char);
@@ -2295,6 +2592,7 @@ static int shmem_remount_fs(struct super_block *sb, int *flags, char *data)
 	sbinfo->max_blocks  = config.max_blocks;
 	sbinfo->max_inodes  = config.max_inodes;
 	sbinfo->free_inodes = config.max_inodes - inodes;
+	sbinfo->huge        = config.huge;
 
 	mpol_put(sbinfo->mpol);
 	sbinfo->mpol        = config.mpol;	/* transfers initial ref */
@@ -2318,6 +2616,8 @@ static int shmem_show_options(struct seq_file *seq, struct vfsmount *vfs)
 		seq_printf(seq, ",uid=%u", sbinfo->uid);
 	if (sbinfo->gid != 0)
 		seq_printf(seq, ",gid=%u", sbinfo->gid);
+	if (sbinfo->huge)
+		seq_printf(seq, ",huge=%s", shmem_format_huge(sbinfo->huge));
 	shmem_show_mpol(seq, sbinfo->mpol);
 	return 0;
 }
@@ -2457,6 +2757,9 @@ static const struct address_space_operations shmem_aops = {
 
 static const struct file_operations shmem_file_operations = {
 	.mmap		= shmem_mmap,
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	.get_unmapped_area = shmem_get_unmapped_area,
+#endif
 #ifdef CONFIG_TMPFS
 	.llseek		= generic_file_llseek,
 	.read		= do_sync_read,
@@ -2530,6 +2833,9 @@ static const struct super_operations shmem_ops = {
 
 static const struct vm_operations_struct shmem_vm_ops = {
 	.fault		= shmem_fault,
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	.pmd_fault	= shmem_pmd_fault,
+#endif
 #ifdef CONFIG_NUMA
 	.set_policy     = shmem_set_policy,
 	.get_policy     = shmem_get_policy,
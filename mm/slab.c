@@ -3652,6 +3652,59 @@ void *kmem_cache_alloc(struct kmem_cache *cachep, gfp_t flags)
 }
 EXPORT_SYMBOL(kmem_cache_alloc);
 
+/**
+ * kmem_cache_alloc_bulk - Allocate several objects
+ * @cachep: The cache to allocate from.
+ * @flags: See kmalloc().
+ * @size: Number of objects to allocate.
+ * @p: Array receiving the objects.
+ *
+ * Like @size calls to kmem_cache_alloc(), with interrupts disabled once
+ * for the whole batch.  Returns @size, or 0 if not all objects could be
+ * allocated, in which case none are.
+ */
+int kmem_cache_alloc_bulk(struct kmem_cache *cachep, gfp_t flags, size_t size,
+			  void **p)
+{
+	unsigned long save_flags;
+	size_t i, n;
+
+	flags &= gfp_allowed_mask;
+
+	lockdep_trace_alloc(flags);
+
+	if (slab_should_failslab(cachep, flags))
+		return 0;
+
+	cache_alloc_debugcheck_before(cachep, flags);
+	local_irq_save(save_flags);
+	for (i = 0; i < size; i++) {
+		p[i] = __do_cache_alloc(cachep, flags);
+		if (unlikely(!p[i]))
+			break;
+	}
+	local_irq_restore(save_flags);
+
+	for (n = 0; n < i; n++) {
+		p[n] = cache_alloc_debugcheck_after(cachep, flags, p[n],
+						    __builtin_return_address(0));
+		kmemleak_alloc_recursive(p[n], obj_size(cachep), 1,
+					 cachep->flags, flags);
+		kmemcheck_slab_alloc(cachep, flags, p[n], obj_size(cachep));
+		if (unlikely(flags & __GFP_ZERO))
+			memset(p[n], 0, obj_size(cachep));
+		trace_kmem_cache_alloc(_RET_IP_, p[n], obj_size(cachep),
+				       cachep->buffer_size, flags);
+	}
+
+	if (unlikely(i < size)) {
+		kmem_cache_free_bulk(cachep, i, p);
+		return 0;
+	}
+	return size;
+}
+EXPORT_SYMBOL(kmem_cache_alloc_bulk);
+
 #ifdef CONFIG_TRACING
 void *kmem_cache_alloc_notrace(struct kmem_cache *cachep, gfp_t flags)
 {
@@ -3828,6 +3881,32 @@ void kmem_cache_free(struct kmem_cache *cachep, void *objp)
 }
 EXPORT_SYMBOL(kmem_cache_free);
 
+/**
+ * kmem_cache_free_bulk - Deallocate several objects
+ * @cachep: The cache the allocations were from.
+ * @size: Number of objects to free.
+ * @p: The previously allocated objects.
+ *
+ * Like @size calls to kmem_cache_free(), with interrupts disabled once
+ * for the whole batch.
+ */
+void kmem_cache_free_bulk(struct kmem_cache *cachep, size_t size, void **p)
+{
+	unsigned long flags;
+	size_t i;
+
+	local_irq_save(flags);
+	for (i = 0; i < size; i++) {
+		debug_check_no_locks_freed(p[i], obj_size(cachep));
+		if (!(cachep->flags & SLAB_DEBUG_OBJECTS))
+			debug_check_no_obj_freed(p[i], obj_size(cachep));
+		__cache_free(cachep, p[i]);
+		trace_kmem_cache_free(_RET_IP_, p[i]);
+	}
+	local_irq_restore(flags);
+}
+EXPORT_SYMBOL(kmem_cache_free_bulk);
+
 /**
  * kfree - free previously allocated memory
  * @objp: pointer returned by kmalloc.
@@ -1735,6 +1735,65 @@ void *kmem_cache_alloc(struct kmem_cache *s, gfp_t gfpflags)
 }
 EXPORT_SYMBOL(kmem_cache_alloc);
 
+/*
+ * Allocate @size objects into @p with interrupts disabled once for the
+ * whole batch: the per cpu freelist is drained first, and refilled from
+ * __slab_alloc() whenever it runs dry.  Returns @size, or 0 if the batch
+ * could not be completed, in which case nothing is left allocated.
+ */
+int kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t gfpflags, size_t size,
+			  void **p)
+{
+	struct kmem_cache_cpu *c;
+	unsigned long flags;
+	size_t i, n;
+
+	gfpflags &= gfp_allowed_mask;
+
+	lockdep_trace_alloc(gfpflags);
+	might_sleep_if(gfpflags & __GFP_WAIT);
+
+	if (should_failslab(s->objsize, gfpflags, s->flags))
+		return 0;
+
+	local_irq_save(flags);
+	c = __this_cpu_ptr(s->cpu_slab);
+	for (i = 0; i < size; i++) {
+		void *object = c->freelist;
+
+		if (unlikely(!object)) {
+			/* may enable interrupts: we can come back elsewhere */
+			object = __slab_alloc(s, gfpflags, NUMA_NO_NODE,
+					      _RET_IP_, c);
+			if (unlikely(!object))
+				break;
+			c = __this_cpu_ptr(s->cpu_slab);
+		} else {
+			c->freelist = get_freepointer(s, object);
+			stat(s, ALLOC_FASTPATH);
+		}
+		p[i] = object;
+	}
+	local_irq_restore(flags);
+
+	for (n = 0; n < i; n++) {
+		if (unlikely(gfpflags & __GFP_ZERO))
+			memset(p[n], 0, s->objsize);
+		kmemcheck_slab_alloc(s, gfpflags, p[n], s->objsize);
+		kmemleak_alloc_recursive(p[n], s->objsize, 1, s->flags,
+					 gfpflags);
+		trace_kmem_cache_alloc(_RET_IP_, p[n], s->objsize, s->size,
+				       gfpflags);
+	}
+
+	if (unlikely(i < size)) {
+		kmem_cache_free_bulk(s, i, p);
+		return 0;
+	}
+	return size;
+}
+EXPORT_SYMBOL(kmem_cache_alloc_bulk);
+
 #ifdef CONFIG_TRACING
 void *kmem_cache_alloc_notrace(struct kmem_cache *s, gfp_t gfpflags)
 {
@@ -1773,12 +1832,16 @@ EXPORT_SYMBOL(kmem_cache_alloc_node_notrace);
  * So we still attempt to reduce cache line usage. Just take the slab
  * lock and free the item. If there is no additional partial page
  * handling required then we can return immediately.
+ *
+ * @head to @tail is a list of @cnt objects of the same slab, already
+ * linked through their free pointers; bulk freeing passes more than one
+ * object at a time, everyone else a single object (@head == @tail).
  */
 static void __slab_free(struct kmem_cache *s, struct page *page,
-			void *x, unsigned long addr)
+			void *head, void *tail, int cnt, unsigned long addr)
 {
 	void *prior;
-	void **object = (void *)x;
+	void **object = (void *)head;
 
 	stat(s, FREE_SLOWPATH);
 	slab_lock(page);
@@ -1788,9 +1851,9 @@ static void __slab_free(struct kmem_cache *s, struct page *page,
 
 checks_ok:
 	prior = page->freelist;
-	set_freepointer(s, object, prior);
+	set_freepointer(s, tail, prior);
 	page->freelist = object;
-	page->inuse--;
+	page->inuse -= cnt;
 
 	if (unlikely(PageSlubFrozen(page))) {
 		stat(s, FREE_FROZEN);
@@ -1827,7 +1890,8 @@ slab_empty:
 	return;
 
 debug:
-	if (!free_debug_processing(s, page, x, addr))
+	VM_BUG_ON(cnt != 1);
+	if (!free_debug_processing(s, page, head, addr))
 		goto out_unlock;
 	goto checks_ok;
 }
@@ -1862,7 +1926,7 @@ static __always_inline void slab_free(struct kmem_cache *s,
 		c->freelist = object;
 		stat(s, FREE_FASTPATH);
 	} else
-		__slab_free(s, page, x, addr);
+		__slab_free(s, page, x, x, 1, addr);
 
 	local_irq_restore(flags);
 }
@@ -1879,6 +1943,62 @@ void kmem_cache_free(struct kmem_cache *s, void *x)
 }
 EXPORT_SYMBOL(kmem_cache_free);
 
+/*
+ * Free @size objects with interrupts disabled once for the whole batch.
+ * Objects of the cpu slab go straight to the per cpu freelist; runs of
+ * objects from another slab are chained together and handed to
+ * __slab_free() under a single slab_lock().
+ */
+void kmem_cache_free_bulk(struct kmem_cache *s, size_t size, void **p)
+{
+	struct kmem_cache_cpu *c;
+	unsigned long flags;
+	size_t i = 0;
+
+	local_irq_save(flags);
+	c = __this_cpu_ptr(s->cpu_slab);
+	while (i < size) {
+		void **object = p[i];
+		struct page *page = virt_to_head_page(object);
+		void *tail = object;
+		int cnt = 1;
+
+		kmemleak_free_recursive(object, s->flags);
+		kmemcheck_slab_free(s, object, s->objsize);
+		debug_check_no_locks_freed(object, s->objsize);
+		if (!(s->flags & SLAB_DEBUG_OBJECTS))
+			debug_check_no_obj_freed(object, s->objsize);
+		trace_kmem_cache_free(_RET_IP_, object);
+		i++;
+
+		if (likely(page == c->page && c->node >= 0)) {
+			set_freepointer(s, object, c->freelist);
+			c->freelist = object;
+			stat(s, FREE_FASTPATH);
+			continue;
+		}
+
+		/* debug checks in __slab_free() work one object at a time */
+		while (!kmem_cache_debug(s) && i < size &&
+		       virt_to_head_page(p[i]) == page) {
+			void **next = p[i++];
+
+			kmemleak_free_recursive(next, s->flags);
+			kmemcheck_slab_free(s, next, s->objsize);
+			debug_check_no_locks_freed(next, s->objsize);
+			if (!(s->flags & SLAB_DEBUG_OBJECTS))
+				debug_check_no_obj_freed(next, s->objsize);
+			trace_kmem_cache_free(_RET_IP_, next);
+			set_freepointer(s, next, object);
+			object = next;
+			cnt++;
+		}
+		__slab_free(s, page, object, tail, cnt, _RET_IP_);
+	}
+	local_irq_restore(flags);
+}
+EXPORT_SYMBOL(kmem_cache_free_bulk);
+
 /* Figure out on which slab page the object resides */
 static struct page *get_object_page(const void *x)
 {
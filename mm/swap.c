@@ -39,6 +39,7 @@ int page_cluster;
 
 static DEFINE_PER_CPU(struct pagevec[NR_LRU_LISTS], lru_add_pvecs);
 static DEFINE_PER_CPU(struct pagevec, lru_rotate_pvecs);
+static DEFINE_PER_CPU(struct pagevec, lru_deactivate_pvecs);
 
 /*
  * This path almost never happens for VM activity - pages are normally
@@ -195,6 +196,68 @@ void activate_page(struct page *page)
 	spin_unlock_irq(&zone->lru_lock);
 }
 
+/*
+ * Move the anon pages to the tail of the inactive anon list, where
+ * reclaim finds them first.
+ */
+static void pagevec_deactivate(struct pagevec *pvec)
+{
+	int i;
+	int pgdeactivate = 0;
+	struct zone *zone = NULL;
+
+	for (i = 0; i < pagevec_count(pvec); i++) {
+		struct page *page = pvec->pages[i];
+		struct zone *pagezone = page_zone(page);
+
+		if (pagezone != zone) {
+			if (zone)
+				spin_unlock_irq(&zone->lru_lock);
+			zone = pagezone;
+			spin_lock_irq(&zone->lru_lock);
+		}
+		if (PageLRU(page) && !PageUnevictable(page) &&
+		    !page_is_file_cache(page)) {
+			int active = PageActive(page);
+
+			del_page_from_lru_list(zone, page, page_lru(page));
+			ClearPageActive(page);
+			ClearPageReferenced(page);
+			add_page_to_lru_list(zone, page, LRU_INACTIVE_ANON);
+			list_move_tail(&page->lru,
+				       &zone->lru[LRU_INACTIVE_ANON].list);
+			if (active) {
+				pgdeactivate++;
+				update_page_reclaim_stat(zone, page, 0, 0);
+			}
+		}
+	}
+	if (zone)
+		spin_unlock_irq(&zone->lru_lock);
+	__count_vm_events(PGDEACTIVATE, pgdeactivate);
+	release_pages(pvec->pages, pvec->nr, pvec->cold);
+	pagevec_reinit(pvec);
+}
+
+/**
+ * deactivate_page - queue an anon page for early reclaim
+ * @page: the page whose contents the owner no longer needs
+ *
+ * Used by MADV_FREE: the page goes to the tail of the inactive anon
+ * list, so reclaim gets to it before pages that still hold data.
+ */
+void deactivate_page(struct page *page)
+{
+	if (PageLRU(page) && !PageUnevictable(page)) {
+		struct pagevec *pvec = &get_cpu_var(lru_deactivate_pvecs);
+
+		page_cache_get(page);
+		if (!pagevec_add(pvec, page))
+			pagevec_deactivate(pvec);
+		put_cpu_var(lru_deactivate_pvecs);
+	}
+}
+
 /*
  * Mark a page as having seen activity.
  *
@@ -208,6 +271,8 @@ void mark_page_accessed(struct page *page)
 			PageReferenced(page) && PageLRU(page)) {
 		activate_page(page);
 		ClearPageReferenced(page);
+		if (page_is_file_cache(page))
+			workingset_activation(page);
 	} else if (!PageReferenced(page)) {
 		SetPageReferenced(page);
 	}
@@ -292,6 +357,10 @@ static void drain_cpu_pagevecs(int cpu)
 		pagevec_move_tail(pvec);
 		local_irq_restore(flags);
 	}
+
+	pvec = &per_cpu(lru_deactivate_pvecs, cpu);
+	if (pagevec_count(pvec))
+		pagevec_deactivate(pvec);
 }
 
 void lru_add_drain(void)
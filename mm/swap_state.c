@@ -19,6 +19,7 @@
 #include <linux/pagevec.h>
 #include <linux/migrate.h>
 #include <linux/page_cgroup.h>
+#include <linux/vmstat.h>
 
 #include <asm/pgtable.h>
 
@@ -251,20 +252,68 @@ void free_pages_and_swap_cache(struct page **pages, int nr)
 	}
 }
 
+/* Read ahead by virtual address: /sys/kernel/mm/swap/vma_ra_enabled */
+bool swap_vma_readahead __read_mostly = true;
+
+/* swap devices on rotating disks, where scattered reads cost seeks */
+atomic_t nr_rotate_swap = ATOMIC_INIT(0);
+
+/*
+ * vma->swap_readahead_info packs the page aligned address of the last
+ * swap fault in the vma, the readahead window used for it, and how many
+ * pages read ahead since then were actually faulted on.
+ */
+#define SWAP_RA_WIN_SHIFT	(PAGE_SHIFT / 2)
+#define SWAP_RA_HITS_MASK	((1UL << SWAP_RA_WIN_SHIFT) - 1)
+#define SWAP_RA_HITS_MAX	SWAP_RA_HITS_MASK
+#define SWAP_RA_WIN_MASK	(~PAGE_MASK & ~SWAP_RA_HITS_MASK)
+
+#define SWAP_RA_HITS(v)		((v) & SWAP_RA_HITS_MASK)
+#define SWAP_RA_WIN(v)		(((v) & SWAP_RA_WIN_MASK) >> SWAP_RA_WIN_SHIFT)
+#define SWAP_RA_ADDR(v)		((v) & PAGE_MASK)
+
+#define SWAP_RA_VAL(addr, win, hits)				\
+	(((addr) & PAGE_MASK) |					\
+	 (((win) << SWAP_RA_WIN_SHIFT) & SWAP_RA_WIN_MASK) |	\
+	 ((hits) & SWAP_RA_HITS_MASK))
+
+/* a vma that never swapped in starts out as if it had a few hits */
+#define GET_SWAP_RA_VAL(vma)					\
+	(atomic_long_read(&(vma)->swap_readahead_info) ? : 4)
+
 /*
  * Lookup a swap entry in the swap cache. A found page will be returned
  * unlocked and with its refcount incremented - we rely on the kernel
  * lock getting page table operations atomic even if we drop the page
  * lock before returning.
+ *
+ * A page brought in by readahead counts as a readahead hit the first
+ * time it is looked up, for @vma's window if there is one.
  */
-struct page * lookup_swap_cache(swp_entry_t entry)
+struct page *lookup_swap_cache(swp_entry_t entry, struct vm_area_struct *vma,
+			       unsigned long addr)
 {
 	struct page *page;
+	unsigned long ra_val;
+	unsigned int win, hits;
 
 	page = find_get_page(&swapper_space, entry.val);
 
-	if (page)
+	if (page) {
 		INC_CACHE_INFO(find_success);
+		if (TestClearPageReadahead(page)) {
+			count_vm_event(SWAP_RA_HIT);
+			if (vma) {
+				ra_val = GET_SWAP_RA_VAL(vma);
+				win = SWAP_RA_WIN(ra_val);
+				hits = SWAP_RA_HITS(ra_val);
+				if (hits < SWAP_RA_HITS_MAX)
+					hits++;
+				atomic_long_set(&vma->swap_readahead_info,
+						SWAP_RA_VAL(addr, win, hits));
+			}
+		}
+	}
 
 	INC_CACHE_INFO(find_total);
 	return page;
@@ -275,13 +324,17 @@ struct page * lookup_swap_cache(swp_entry_t entry)
  * and reading the disk if it is not already cached.
  * A failure return means that either the page allocation failed or that
  * the swap entry is no longer in use.
+ *
+ * *new_page_allocated tells whether a read was started for the page.
  */
-struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
-			struct vm_area_struct *vma, unsigned long addr)
+struct page *__read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr,
+			bool *new_page_allocated)
 {
 	struct page *found_page, *new_page = NULL;
 	int err;
 
+	*new_page_allocated = false;
 	do {
 		/*
 		 * First check the swap cache.  Since this is normally
@@ -332,6 +385,7 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 			 */
 			lru_cache_add_anon(new_page);
 			swap_readpage(new_page);
+			*new_page_allocated = true;
 			return new_page;
 		}
 		radix_tree_preload_end();
@@ -349,6 +403,39 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 	return found_page;
 }
 
+struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr)
+{
+	bool page_allocated;
+
+	return __read_swap_cache_async(entry, gfp_mask, vma, addr,
+				       &page_allocated);
+}
+
+/*
+ * Start an asynchronous read of @entry for readahead.  Pages actually
+ * read are marked PG_readahead so that lookup_swap_cache() can tell
+ * whether readahead was worth it.  Returns false if the read could not
+ * be started.
+ */
+static bool swap_readahead_one(swp_entry_t entry, gfp_t gfp_mask,
+			       struct vm_area_struct *vma, unsigned long addr)
+{
+	struct page *page;
+	bool page_allocated;
+
+	page = __read_swap_cache_async(entry, gfp_mask, vma, addr,
+				       &page_allocated);
+	if (!page)
+		return false;
+	if (page_allocated) {
+		SetPageReadahead(page);
+		count_vm_event(SWAP_RA);
+	}
+	page_cache_release(page);
+	return true;
+}
+
 /**
  * swapin_readahead - swap in pages in hope we need them soon
  * @entry: swap entry of this memory
@@ -372,7 +459,6 @@ struct page *swapin_readahead(swp_entry_t entry, gfp_t gfp_mask,
 			struct vm_area_struct *vma, unsigned long addr)
 {
 	int nr_pages;
-	struct page *page;
 	unsigned long offset;
 	unsigned long end_offset;
 
@@ -386,12 +472,187 @@ struct page *swapin_readahead(swp_entry_t entry, gfp_t gfp_mask,
 	nr_pages = valid_swaphandles(entry, &offset);
 	for (end_offset = offset + nr_pages; offset < end_offset; offset++) {
 		/* Ok, do the async read-ahead now */
-		page = read_swap_cache_async(swp_entry(swp_type(entry), offset),
-						gfp_mask, vma, addr);
-		if (!page)
+		if (offset == swp_offset(entry))
+			continue;
+		if (!swap_readahead_one(swp_entry(swp_type(entry), offset),
+					gfp_mask, vma, addr))
 			break;
-		page_cache_release(page);
 	}
 	lru_add_drain();	/* Push any new pages onto the LRU now */
 	return read_swap_cache_async(entry, gfp_mask, vma, addr);
 }
+
+/*
+ * Number of pages to read around a swap fault at page @pfn.  Every hit
+ * since the previous fault at @prev_pfn grows the window; with no hits
+ * readahead is only kept up for faults adjacent to the previous one.
+ * The window shrinks by at most half per fault.
+ */
+static unsigned int swap_ra_window(unsigned long prev_pfn, unsigned long pfn,
+				   unsigned int hits, unsigned int max_win,
+				   unsigned int prev_win)
+{
+	unsigned int win, roundup;
+
+	win = hits + 2;
+	if (win == 2) {
+		if (pfn != prev_pfn + 1 && pfn != prev_pfn - 1)
+			win = 1;
+	} else {
+		roundup = 4;
+		while (roundup < win)
+			roundup <<= 1;
+		win = roundup;
+	}
+	if (win > max_win)
+		win = max_win;
+	if (win < prev_win / 2)
+		win = prev_win / 2;
+	return win;
+}
+
+#ifdef CONFIG_64BIT
+#define SWAP_RA_ORDER_CEILING	5
+#else
+#define SWAP_RA_ORDER_CEILING	3
+#endif
+#define SWAP_RA_PTE_MAX		(1 << SWAP_RA_ORDER_CEILING)
+
+/**
+ * swapin_vma_readahead - swap in pages in hope we need them soon
+ * @fentry: swap entry of the faulting pte
+ * @gfp_mask: memory allocation flags
+ * @vma: user vma the faulting address belongs to
+ * @faddr: faulting address
+ * @pmd: pmd mapping the pte table of @faddr
+ *
+ * Returns the struct page for @fentry, after queueing swapin.
+ *
+ * Unlike swapin_readahead(), read the swap entries of the ptes around
+ * @faddr: pages neighbouring in the address space are much more likely
+ * to be needed next than pages neighbouring in a fragmented swap area.
+ * The window, up to 1 << page_cluster pages and never crossing the vma
+ * or the pte table, follows the direction of consecutive faults and
+ * adapts to how many pages read ahead for this vma were used.
+ *
+ * Caller must hold down_read on the vma->vm_mm.
+ */
+struct page *swapin_vma_readahead(swp_entry_t fentry, gfp_t gfp_mask,
+				  struct vm_area_struct *vma,
+				  unsigned long faddr, pmd_t *pmd)
+{
+	pte_t ptes[SWAP_RA_PTE_MAX], *pte;
+	unsigned long ra_val, prev_pfn, fpfn, lpfn, rpfn, start, end, pfn;
+	unsigned int max_win, win, left, i;
+	swp_entry_t entry;
+
+	max_win = 1 << min_t(unsigned int, ACCESS_ONCE(page_cluster),
+			     SWAP_RA_ORDER_CEILING);
+	if (max_win == 1)
+		goto skip;
+
+	faddr &= PAGE_MASK;
+	fpfn = PFN_DOWN(faddr);
+	ra_val = GET_SWAP_RA_VAL(vma);
+	prev_pfn = PFN_DOWN(SWAP_RA_ADDR(ra_val));
+	win = swap_ra_window(prev_pfn, fpfn, SWAP_RA_HITS(ra_val), max_win,
+			     SWAP_RA_WIN(ra_val));
+	atomic_long_set(&vma->swap_readahead_info,
+			SWAP_RA_VAL(faddr, win, 0));
+	if (win == 1)
+		goto skip;
+
+	/* read ahead when moving forward, behind when moving backward */
+	if (fpfn == prev_pfn + 1) {
+		lpfn = fpfn;
+		rpfn = fpfn + win;
+	} else if (prev_pfn == fpfn + 1) {
+		lpfn = fpfn + 1 - win;
+		rpfn = fpfn + 1;
+	} else {
+		left = (win - 1) / 2;
+		lpfn = fpfn - left;
+		rpfn = fpfn + win - left;
+	}
+	if (lpfn > fpfn)	/* wrapped below address 0 */
+		lpfn = 0;
+	start = max(lpfn, PFN_DOWN(max(vma->vm_start, faddr & PMD_MASK)));
+	end = min(rpfn, PFN_DOWN(min(vma->vm_end,
+				     (faddr & PMD_MASK) + PMD_SIZE)));
+
+	/*
+	 * Snapshot the ptes without the pte lock: an entry that changes
+	 * under us is caught by swapcache_prepare(), and a stale one only
+	 * costs a useless read.
+	 */
+	pte = pte_offset_map(pmd, start << PAGE_SHIFT);
+	for (i = 0; i < end - start; i++)
+		ptes[i] = pte[i];
+	pte_unmap(pte);
+
+	for (i = 0, pfn = start; pfn < end; i++, pfn++) {
+		if (pfn == fpfn)
+			continue;
+		if (pte_none(ptes[i]) || pte_present(ptes[i]) ||
+		    pte_file(ptes[i]))
+			continue;
+		entry = pte_to_swp_entry(ptes[i]);
+		if (unlikely(non_swap_entry(entry)))
+			continue;
+		if (!swap_readahead_one(entry, gfp_mask, vma,
+					pfn << PAGE_SHIFT))
+			break;
+	}
+	lru_add_drain();	/* Push any new pages onto the LRU now */
+skip:
+	return read_swap_cache_async(fentry, gfp_mask, vma, faddr);
+}
+
+#ifdef CONFIG_SYSFS
+static ssize_t vma_ra_enabled_show(struct kobject *kobj,
+				   struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%s\n", swap_vma_readahead ? "true" : "false");
+}
+
+static ssize_t vma_ra_enabled_store(struct kobject *kobj,
+				    struct kobj_attribute *attr,
+				    const char *buf, size_t count)
+{
+	if (!strncmp(buf, "true", 4) || !strncmp(buf, "1", 1))
+		swap_vma_readahead = true;
+	else if (!strncmp(buf, "false", 5) || !strncmp(buf, "0", 1))
+		swap_vma_readahead = false;
+	else
+		return -EINVAL;
+	return count;
+}
+static struct kobj_attribute vma_ra_enabled_attr =
+	__ATTR(vma_ra_enabled, 0644, vma_ra_enabled_show,
+	       vma_ra_enabled_store);
+
+static struct attribute *swap_attrs[] = {
+	&vma_ra_enabled_attr.attr,
+	NULL,
+};
+
+static struct attribute_group swap_attr_group = {
+	.attrs = swap_attrs,
+};
+
+static int __init swap_init_sysfs(void)
+{
+	struct kobject *swap_kobj;
+	int err;
+
+	swap_kobj = kobject_create_and_add("swap", mm_kobj);
+	if (!swap_kobj)
+		return -ENOMEM;
+
+	err = sysfs_create_group(swap_kobj, &swap_attr_group);
+	if (err)
+		kobject_put(swap_kobj);
+	return err;
+}
+module_init(swap_init_sysfs);
+#endif /* CONFIG_SYSFS */
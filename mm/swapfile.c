@@ -7,6 +7,7 @@
 
 #include <linux/mm.h>
 #include <linux/hugetlb.h>
+#include <linux/huge_mm.h>
 #include <linux/mman.h>
 #include <linux/slab.h>
 #include <linux/kernel_stat.h>
@@ -35,6 +36,7 @@
 #include <asm/tlbflush.h>
 #include <linux/swapops.h>
 #include <linux/page_cgroup.h>
+#include <linux/frontswap.h>
 
 static bool swap_count_continued(struct swap_info_struct *, pgoff_t,
 				 unsigned char);
@@ -584,6 +586,7 @@ static unsigned char swap_entry_free(struct swap_info_struct *p,
 			swap_list.next = p->type;
 		nr_swap_pages++;
 		p->inuse_pages--;
+		frontswap_invalidate_page(p, offset);
 		if ((p->flags & SWP_BLKDEV) &&
 				disk->fops->swap_slot_free_notify)
 			disk->fops->swap_slot_free_notify(p->bdev, offset);
@@ -624,6 +627,18 @@ void swapcache_free(swp_entry_t entry, struct page *page)
 	}
 }
 
+/*
+ * The swap device backing a swapcache page.  The page lock pins its
+ * swap entry, so the device cannot go away underneath the caller.
+ */
+struct swap_info_struct *page_swap_info(struct page *page)
+{
+	swp_entry_t entry = { .val = page_private(page) };
+
+	BUG_ON(!PageSwapCache(page));
+	return swap_info[swp_type(entry)];
+}
+
 /*
  * How many references to page are currently swapped out?
  * This does not give an exact answer when swap count is continued,
@@ -959,7 +974,7 @@ static inline int unuse_pmd_range(struct vm_area_struct *vma, pud_t *pud,
 	pmd = pmd_offset(pud, addr);
 	do {
 		next = pmd_addr_end(addr, end);
-		if (pmd_none_or_clear_bad(pmd))
+		if (pmd_none_or_trans_huge_or_clear_bad(pmd))
 			continue;
 		ret = unuse_pte_range(vma, pmd, addr, next, entry, page);
 		if (ret)
@@ -1547,6 +1562,7 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 {
 	struct swap_info_struct *p = NULL;
 	unsigned char *swap_map;
+	unsigned long *frontswap_map;
 	struct file *swap_file, *victim;
 	struct address_space *mapping;
 	struct inode *inode;
@@ -1640,6 +1656,8 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 	down_write(&swap_unplug_sem);
 	up_write(&swap_unplug_sem);
 
+	frontswap_invalidate_area(p);
+
 	destroy_swap_extents(p);
 	if (p->flags & SWP_CONTINUED)
 		free_swap_count_continuations(p);
@@ -1661,10 +1679,15 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 	p->max = 0;
 	swap_map = p->swap_map;
 	p->swap_map = NULL;
+	frontswap_map = frontswap_map_get(p);
+	frontswap_map_set(p, NULL);
+	if (!(p->flags & SWP_SOLIDSTATE))
+		atomic_dec(&nr_rotate_swap);
 	p->flags = 0;
 	spin_unlock(&swap_lock);
 	mutex_unlock(&swapon_mutex);
 	vfree(swap_map);
+	vfree(frontswap_map);
 	/* Destroy swap account informatin */
 	swap_cgroup_swapoff(type);
 
@@ -1820,6 +1843,7 @@ SYSCALL_DEFINE2(swapon, const char __user *, specialfile, int, swap_flags)
 	unsigned long maxpages;
 	unsigned long swapfilepages;
 	unsigned char *swap_map = NULL;
+	unsigned long *frontswap_map = NULL;
 	struct page *page = NULL;
 	struct inode *inode = NULL;
 	int did_down = 0;
@@ -2042,6 +2066,18 @@ SYSCALL_DEFINE2(swapon, const char __user *, specialfile, int, swap_flags)
 		goto bad_swap;
 	}
 
+	if (frontswap_enabled) {
+		/* without a map, frontswap leaves this swap type alone */
+		size_t size = BITS_TO_LONGS(maxpages) * sizeof(long);
+
+		frontswap_map = vmalloc(size);
+		if (frontswap_map) {
+			memset(frontswap_map, 0, size);
+			frontswap_map_set(p, frontswap_map);
+			frontswap_init(p);
+		}
+	}
+
 	if (p->bdev) {
 		if (blk_queue_nonrot(bdev_get_queue(p->bdev))) {
 			p->flags |= SWP_SOLIDSTATE;
@@ -2050,6 +2086,8 @@ SYSCALL_DEFINE2(swapon, const char __user *, specialfile, int, swap_flags)
 		if (discard_swap(p) == 0 && (swap_flags & SWAP_FLAG_DISCARD))
 			p->flags |= SWP_DISCARDABLE;
 	}
+	if (!(p->flags & SWP_SOLIDSTATE))
+		atomic_inc(&nr_rotate_swap);
 
 	mutex_lock(&swapon_mutex);
 	spin_lock(&swap_lock);
@@ -2096,9 +2134,11 @@ bad_swap:
 bad_swap_2:
 	spin_lock(&swap_lock);
 	p->swap_file = NULL;
+	frontswap_map_set(p, NULL);
 	p->flags = 0;
 	spin_unlock(&swap_lock);
 	vfree(swap_map);
+	vfree(frontswap_map);
 	if (swap_file)
 		filp_close(swap_file, NULL);
 out:
@@ -258,6 +258,7 @@ struct vmap_area {
 	struct rb_node rb_node;		/* address sorted rbtree */
 	struct list_head list;		/* address sorted list */
 	struct list_head purge_list;	/* "lazy purge" list */
+	unsigned long subtree_max_hole;	/* largest va_hole() below rb_node */
 	void *private;
 	struct rcu_head rcu_head;
 };
@@ -267,6 +268,54 @@ static struct rb_root vmap_area_root = RB_ROOT;
 static LIST_HEAD(vmap_area_list);
 static unsigned long vmap_area_pcpu_hole;
 
+/*
+ * Free space is not tracked separately: the hole belonging to an area is
+ * the gap between the end of the previous area and its start.  Every
+ * node of the rbtree caches the largest hole in its subtree, so that
+ * alloc_vmap_area() can skip whole subtrees without a big enough hole
+ * instead of walking the areas one by one.
+ */
+static unsigned long va_prev_end(struct vmap_area *va)
+{
+	if (va->list.prev == &vmap_area_list)
+		return 0;
+	return list_entry(va->list.prev, struct vmap_area, list)->va_end;
+}
+
+static inline unsigned long va_hole(struct vmap_area *va)
+{
+	return va->va_start - va_prev_end(va);
+}
+
+static inline unsigned long subtree_max_hole(struct rb_node *n)
+{
+	if (!n)
+		return 0;
+	return rb_entry(n, struct vmap_area, rb_node)->subtree_max_hole;
+}
+
+static void vmap_area_augment_cb(struct rb_node *n, void *unused)
+{
+	struct vmap_area *va = rb_entry(n, struct vmap_area, rb_node);
+	unsigned long max = va_hole(va);
+
+	max = max(max, subtree_max_hole(n->rb_left));
+	max = max(max, subtree_max_hole(n->rb_right));
+	va->subtree_max_hole = max;
+}
+
+/* The area after @entry had its hole changed: update it up to the root. */
+static void vmap_area_augment_next(struct list_head *entry)
+{
+	struct rb_node *n;
+
+	if (entry->next == &vmap_area_list)
+		return;
+	n = &list_entry(entry->next, struct vmap_area, list)->rb_node;
+	for (; n; n = rb_parent(n))
+		vmap_area_augment_cb(n, NULL);
+}
+
 static struct vmap_area *__find_vmap_area(unsigned long addr)
 {
 	struct rb_node *n = vmap_area_root.rb_node;
@@ -316,6 +365,112 @@ static void __insert_vmap_area(struct vmap_area *va)
 		list_add_rcu(&va->list, &prev->list);
 	} else
 		list_add_rcu(&va->list, &vmap_area_list);
+
+	rb_augment_insert(&va->rb_node, vmap_area_augment_cb, NULL);
+	vmap_area_augment_next(&va->list);
+}
+
+/* Leftmost area of subtree @n with a hole of at least @size. */
+static struct vmap_area *vmap_first_hole(struct rb_node *n,
+					 unsigned long size)
+{
+	for (;;) {
+		struct vmap_area *va = rb_entry(n, struct vmap_area, rb_node);
+
+		if (subtree_max_hole(n->rb_left) >= size)
+			n = n->rb_left;
+		else if (va_hole(va) >= size)
+			return va;
+		else
+			n = n->rb_right;
+	}
+}
+
+/* Next area after @va, in address order, with a hole of at least @size. */
+static struct vmap_area *vmap_next_hole(struct vmap_area *va,
+					unsigned long size)
+{
+	struct rb_node *n = &va->rb_node;
+	struct rb_node *parent;
+
+	if (subtree_max_hole(n->rb_right) >= size)
+		return vmap_first_hole(n->rb_right, size);
+
+	while ((parent = rb_parent(n))) {
+		if (n == parent->rb_left) {
+			va = rb_entry(parent, struct vmap_area, rb_node);
+			if (va_hole(va) >= size)
+				return va;
+			if (subtree_max_hole(parent->rb_right) >= size)
+				return vmap_first_hole(parent->rb_right, size);
+		}
+		n = parent;
+	}
+	return NULL;
+}
+
+/*
+ * Where an allocation would go in the hole after an area ending at
+ * @prev_end: right at @base if the area is below it, otherwise aligned
+ * after a guard page.  Returns @vend if it would not fit below @vend.
+ */
+static unsigned long vmap_hole_addr(unsigned long prev_end,
+				    unsigned long base, unsigned long size,
+				    unsigned long align, unsigned long vend)
+{
+	unsigned long addr = base;
+
+	if (prev_end >= base)
+		addr = ALIGN(prev_end + PAGE_SIZE, align);
+	if (addr < prev_end || addr + size - 1 < addr || addr + size > vend)
+		return vend;
+	return addr;
+}
+
+/*
+ * Lowest suitably aligned address in [vstart, vend) with room for @size
+ * bytes, or @vend if there is none.  Called with vmap_area_lock held.
+ */
+static unsigned long vmap_find_hole(unsigned long size, unsigned long align,
+				    unsigned long vstart, unsigned long vend)
+{
+	unsigned long base = ALIGN(vstart, align);
+	struct rb_node *n = vmap_area_root.rb_node;
+	struct vmap_area *va = NULL;
+	unsigned long addr;
+
+	if (base + size - 1 < base)
+		return vend;
+
+	/* first area that could have room above base before it */
+	while (n) {
+		struct vmap_area *tmp = rb_entry(n, struct vmap_area, rb_node);
+
+		if (tmp->va_start >= base + size) {
+			va = tmp;
+			n = n->rb_left;
+		} else
+			n = n->rb_right;
+	}
+	if (va && va_hole(va) < size)
+		va = vmap_next_hole(va, size);
+
+	/*
+	 * The holes may still be too small once the guard page and the
+	 * alignment are accounted for; candidate addresses only grow, so
+	 * stop as soon as one is past vend.
+	 */
+	for (; va; va = vmap_next_hole(va, size)) {
+		addr = vmap_hole_addr(va_prev_end(va), base, size, align, vend);
+		if (addr == vend || addr + size <= va->va_start)
+			return addr;
+	}
+
+	/* above the last area */
+	if (list_empty(&vmap_area_list))
+		return vmap_hole_addr(0, base, size, align, vend);
+	va = list_entry(vmap_area_list.prev, struct vmap_area, list);
+	return vmap_hole_addr(va->va_end, base, size, align, vend);
 }
 
 static void purge_vmap_area_lazy(void);
@@ -330,7 +485,6 @@ static struct vmap_area *alloc_vmap_area(unsigned long size,
 				int node, gfp_t gfp_mask)
 {
 	struct vmap_area *va;
-	struct rb_node *n;
 	unsigned long addr;
 	int purged = 0;
 
@@ -343,56 +497,9 @@ static struct vmap_area *alloc_vmap_area(unsigned long size,
 		return ERR_PTR(-ENOMEM);
 
 retry:
-	addr = ALIGN(vstart, align);
-
 	spin_lock(&vmap_area_lock);
-	if (addr + size - 1 < addr)
-		goto overflow;
-
-	/* XXX: could have a last_hole cache */
-	n = vmap_area_root.rb_node;
-	if (n) {
-		struct vmap_area *first = NULL;
-
-		do {
-			struct vmap_area *tmp;
-			tmp = rb_entry(n, struct vmap_area, rb_node);
-			if (tmp->va_end >= addr) {
-				if (!first && tmp->va_start < addr + size)
-					first = tmp;
-				n = n->rb_left;
-			} else {
-				first = tmp;
-				n = n->rb_right;
-			}
-		} while (n);
-
-		if (!first)
-			goto found;
-
-		if (first->va_end < addr) {
-			n = rb_next(&first->rb_node);
-			if (n)
-				first = rb_entry(n, struct vmap_area, rb_node);
-			else
-				goto found;
-		}
-
-		while (addr + size > first->va_start && addr + size <= vend) {
-			addr = ALIGN(first->va_end + PAGE_SIZE, align);
-			if (addr + size - 1 < addr)
-				goto overflow;
-
-			n = rb_next(&first->rb_node);
-			if (n)
-				first = rb_entry(n, struct vmap_area, rb_node);
-			else
-				goto found;
-		}
-	}
-found:
-	if (addr + size > vend) {
-overflow:
+	addr = vmap_find_hole(size, align, vstart, vend);
+	if (addr == vend) {
 		spin_unlock(&vmap_area_lock);
 		if (!purged) {
 			purge_vmap_area_lazy();
@@ -427,10 +534,16 @@ static void rcu_free_va(struct rcu_head *head)
 
 static void __free_vmap_area(struct vmap_area *va)
 {
+	struct list_head *prev = va->list.prev;
+	struct rb_node *deepest;
+
 	BUG_ON(RB_EMPTY_NODE(&va->rb_node));
+	deepest = rb_augment_erase_begin(&va->rb_node);
 	rb_erase(&va->rb_node, &vmap_area_root);
 	RB_CLEAR_NODE(&va->rb_node);
 	list_del_rcu(&va->list);
+	rb_augment_erase_end(deepest, vmap_area_augment_cb, NULL);
+	vmap_area_augment_next(prev);
 
 	/*
 	 * Track the highest possible candidate for pcpu area
@@ -513,6 +626,13 @@ static unsigned long lazy_max_pages(void)
 
 static atomic_t vmap_lazy_nr = ATOMIC_INIT(0);
 
+/*
+ * Lazily freed areas waiting for the next purge, linked through
+ * ->purge_list, so that purging does not have to walk every area.
+ */
+static DEFINE_SPINLOCK(vmap_lazy_lock);
+static LIST_HEAD(vmap_lazy_list);
+
 /* for per-CPU blocks */
 static void purge_fragmented_blocks_allcpus(void);
 
@@ -558,24 +678,26 @@ static void __purge_vmap_area_lazy(unsigned long *start, unsigned long *end,
 	if (sync)
 		purge_fragmented_blocks_allcpus();
 
-	rcu_read_lock();
-	list_for_each_entry_rcu(va, &vmap_area_list, list) {
-		if (va->flags & VM_LAZY_FREE) {
-			if (va->va_start < *start)
-				*start = va->va_start;
-			if (va->va_end > *end)
-				*end = va->va_end;
-			nr += (va->va_end - va->va_start) >> PAGE_SHIFT;
-			unmap_vmap_area(va);
-			list_add_tail(&va->purge_list, &valist);
-			va->flags |= VM_LAZY_FREEING;
-			va->flags &= ~VM_LAZY_FREE;
-		}
+	spin_lock(&vmap_lazy_lock);
+	list_splice_init(&vmap_lazy_list, &valist);
+	spin_unlock(&vmap_lazy_lock);
+
+	list_for_each_entry(va, &valist, purge_list) {
+		if (va->va_start < *start)
+			*start = va->va_start;
+		if (va->va_end > *end)
+			*end = va->va_end;
+		nr += (va->va_end - va->va_start) >> PAGE_SHIFT;
+		unmap_vmap_area(va);
+		va->flags |= VM_LAZY_FREEING;
+		va->flags &= ~VM_LAZY_FREE;
 	}
-	rcu_read_unlock();
 
-	if (nr)
+	if (nr) {
 		atomic_sub(nr, &vmap_lazy_nr);
+		count_vm_event(VMAP_LAZY_PURGE);
+		count_vm_events(VMAP_LAZY_PURGE_PAGES, nr);
+	}
 
 	if (nr || force_flush)
 		flush_tlb_kernel_range(*start, *end);
@@ -616,7 +738,10 @@ static void purge_vmap_area_lazy(void)
  */
 static void free_unmap_vmap_area_noflush(struct vmap_area *va)
 {
+	spin_lock(&vmap_lazy_lock);
 	va->flags |= VM_LAZY_FREE;
+	list_add_tail(&va->purge_list, &vmap_lazy_list);
+	spin_unlock(&vmap_lazy_lock);
 	atomic_add((va->va_end - va->va_start) >> PAGE_SHIFT, &vmap_lazy_nr);
 	if (unlikely(atomic_read(&vmap_lazy_nr) > lazy_max_pages()))
 		try_purge_vmap_area_lazy();
@@ -40,6 +40,8 @@
 #include <linux/memcontrol.h>
 #include <linux/delayacct.h>
 #include <linux/sysctl.h>
+#include <linux/compaction.h>
+#include <linux/ksm.h>
 
 #include <asm/tlbflush.h>
 #include <asm/div64.h>
@@ -55,6 +57,9 @@ struct scan_control {
 	/* Incremented by the number of inactive pages that were scanned */
 	unsigned long nr_scanned;
 
+	/* Pages scanned by do_try_to_free_pages() at all priorities */
+	unsigned long total_scanned;
+
 	/* Number of pages freed so far during a call to shrink_zones() */
 	unsigned long nr_reclaimed;
 
@@ -459,6 +464,7 @@ static int __remove_mapping(struct address_space *mapping, struct page *page)
 		spin_unlock_irq(&mapping->tree_lock);
 		swapcache_free(swap, page);
 	} else {
+		workingset_eviction(mapping, page);
 		__remove_from_page_cache(page);
 		spin_unlock_irq(&mapping->tree_lock);
 		mem_cgroup_uncharge_cache_page(page);
@@ -659,6 +665,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 		struct address_space *mapping;
 		struct page *page;
 		int may_enter_fs;
+		int lazyfree = 0;
 
 		cond_resched();
 
@@ -718,8 +725,16 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 		if (PageAnon(page) && !PageSwapCache(page)) {
 			if (!(sc->gfp_mask & __GFP_IO))
 				goto keep_locked;
+			/*
+			 * Anon pages carry their dirty state in the ptes
+			 * until they first go to swap; only MADV_FREE leaves
+			 * both the page and its ptes clean.
+			 */
+			lazyfree = !PageDirty(page) && !PageKsm(page);
 			if (!add_to_swap(page))
 				goto activate_locked;
+			if (lazyfree)
+				ClearPageDirty(page);
 			may_enter_fs = 1;
 		}
 
@@ -730,7 +745,22 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 		 * processes. Try to unmap it here.
 		 */
 		if (page_mapped(page) && mapping) {
-			switch (try_to_unmap(page, TTU_UNMAP)) {
+			enum ttu_flags ttu = TTU_UNMAP | TTU_BATCH_FLUSH;
+			int ret;
+
+			if (lazyfree)
+				ttu |= TTU_LAZYFREE;
+			ret = try_to_unmap(page, ttu);
+			/*
+			 * Mappings left behind, or a dirty pte, mean the page
+			 * holds data again: write it out like any other swap
+			 * cache page from now on.
+			 */
+			if (lazyfree && (ret != SWAP_SUCCESS || PageDirty(page))) {
+				SetPageDirty(page);
+				lazyfree = 0;
+			}
+			switch (ret) {
 			case SWAP_FAIL:
 				goto activate_locked;
 			case SWAP_AGAIN:
@@ -750,7 +780,12 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			if (!sc->may_writepage)
 				goto keep_locked;
 
-			/* Page is dirty, try to write it out here */
+			/*
+			 * Page is dirty. Flush the TLB if a writable entry
+			 * potentially exists to avoid CPU writes after IO
+			 * starts and then write it out here.
+			 */
+			try_to_unmap_flush_dirty();
 			switch (pageout(page, mapping, sync_writeback)) {
 			case PAGE_KEEP:
 				goto keep_locked;
@@ -826,6 +861,8 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 		 * waiting on the page lock, because there are no references.
 		 */
 		__clear_page_locked(page);
+		if (lazyfree)
+			count_vm_event(PGLAZYFREED);
 free_it:
 		nr_reclaimed++;
 
@@ -857,6 +894,8 @@ keep:
 		VM_BUG_ON(PageLRU(page) || PageUnevictable(page));
 	}
 
+	/* no stale TLB entry may point at the pages once they are freed */
+	try_to_unmap_flush();
 	free_page_list(&free_pages);
 
 	list_splice(&ret_pages, page_list);
@@ -1942,6 +1981,7 @@ static unsigned long do_try_to_free_pages(struct zonelist *zonelist,
 	}
 
 out:
+	sc->total_scanned = total_scanned;
 	/*
 	 * Now that we've scanned all the zones at this priority level, note
 	 * that level within the zone so that the next thread which performs
@@ -2032,7 +2072,8 @@ unsigned long mem_cgroup_shrink_node_zone(struct mem_cgroup *mem,
 unsigned long try_to_free_mem_cgroup_pages(struct mem_cgroup *mem_cont,
 					   gfp_t gfp_mask,
 					   bool noswap,
-					   unsigned int swappiness)
+					   unsigned int swappiness,
+					   unsigned long *nr_scanned)
 {
 	struct zonelist *zonelist;
 	unsigned long nr_reclaimed;
@@ -2056,6 +2097,8 @@ unsigned long try_to_free_mem_cgroup_pages(struct mem_cgroup *mem_cont,
 					    sc.gfp_mask);
 
 	nr_reclaimed = do_try_to_free_pages(zonelist, &sc);
+	if (nr_scanned)
+		*nr_scanned = sc.total_scanned;
 
 	trace_mm_vmscan_memcg_reclaim_end(nr_reclaimed);
 
@@ -2422,6 +2465,7 @@ void wakeup_kswapd(struct zone *zone, int order)
 		return;
 	if (pgdat->kswapd_max_order < order)
 		pgdat->kswapd_max_order = order;
+	wakeup_kcompactd(pgdat, order, zone_idx(zone));
 	trace_mm_vmscan_wakeup_kswapd(pgdat->node_id, zone_idx(zone), order);
 	if (!cpuset_zone_allowed_hardwall(zone, GFP_KERNEL))
 		return;
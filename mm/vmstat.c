@@ -336,6 +336,7 @@ void refresh_cpu_vm_stats(int cpu)
 #endif
 			}
 		cond_resched();
+		decay_pcp_high(zone, &p->pcp);
 #ifdef CONFIG_NUMA
 		/*
 		 * Deal with draining the remote pageset of this
@@ -745,6 +746,8 @@ static const char * const vmstat_text[] = {
 	"nr_isolated_anon",
 	"nr_isolated_file",
 	"nr_shmem",
+	"nr_anon_transparent_hugepages",
+	"nr_shmem_pmdmapped",
 #ifdef CONFIG_NUMA
 	"numa_hit",
 	"numa_miss",
@@ -788,6 +791,10 @@ static const char * const vmstat_text[] = {
 	"allocstall",
 
 	"pgrotated",
+	"workingset_refault",
+	"workingset_activate",
+	"pglazyfree",
+	"pglazyfreed",
 
 #ifdef CONFIG_COMPACTION
 	"compact_blocks_moved",
@@ -796,12 +803,40 @@ static const char * const vmstat_text[] = {
 	"compact_stall",
 	"compact_fail",
 	"compact_success",
+	"compact_daemon_wake",
+	"compact_daemon_fail",
+	"compact_daemon_success",
 #endif
 
 #ifdef CONFIG_HUGETLB_PAGE
 	"htlb_buddy_alloc_success",
 	"htlb_buddy_alloc_fail",
 #endif
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	"thp_fault_alloc",
+	"thp_fault_fallback",
+	"thp_collapse_alloc",
+	"thp_collapse_alloc_failed",
+	"thp_split",
+	"thp_file_alloc",
+	"thp_file_mapped",
+#endif
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	"spf_fault",
+	"spf_fault_abort",
+#endif
+#ifdef CONFIG_SWAP
+	"swap_ra",
+	"swap_ra_hit",
+#endif
+#ifdef CONFIG_DEBUG_TLBFLUSH
+	"nr_tlb_remote_flush",
+	"nr_tlb_remote_flush_received",
+	"nr_tlb_local_flush_all",
+	"nr_tlb_local_flush_one",
+#endif
+	"vmap_lazy_purge",
+	"vmap_lazy_purge_pages",
 	"unevictable_pgs_culled",
 	"unevictable_pgs_scanned",
 	"unevictable_pgs_rescued",
@@ -854,11 +889,15 @@ static void zoneinfo_show_print(struct seq_file *m, pg_data_t *pgdat,
 			   "\n    cpu: %i"
 			   "\n              count: %i"
 			   "\n              high:  %i"
-			   "\n              batch: %i",
+			   "\n              batch: %i"
+			   "\n              high_min: %i"
+			   "\n              high_max: %i",
 			   i,
 			   pageset->pcp.count,
 			   pageset->pcp.high,
-			   pageset->pcp.batch);
+			   pageset->pcp.batch,
+			   pageset->pcp.high_min,
+			   pageset->pcp.high_max);
 #ifdef CONFIG_SMP
 		seq_printf(m, "\n  vm stats threshold: %d",
 				pageset->stat_threshold);
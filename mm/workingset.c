@@ -0,0 +1,177 @@
+/*
+ * mm/workingset.c
+ *
+ * Workingset detection: tell a thrashing working set from a stream.
+ *
+ * A page cache page that is read once goes on the inactive file list
+ * and is reclaimed from there, without ever disturbing the active list.
+ * That protects the working set from streaming I/O, but a working set
+ * larger than the inactive list is never noticed either: its pages are
+ * evicted before their second access can activate them, and they keep
+ * being read back in while colder active pages stay resident.
+ *
+ * Each zone counts evictions and activations of file pages in
+ * zone->inactive_age, the number of slots the inactive list has
+ * "advanced" by.  When a page is reclaimed, the counter is remembered in
+ * a shadow entry for its (mapping, index).  When the page is faulted
+ * back in, the difference between the counter now and in its shadow
+ * entry, the refault distance, is how many more inactive slots the page
+ * would have needed to still be resident.  The inactive list can only
+ * grow at the expense of the active list, so if the refault distance is
+ * at most the size of the active file list, the page could have stayed
+ * in memory: it is activated right away, to compete with the active
+ * pages instead of being streamed out again.
+ *
+ * The page cache radix tree has no room for shadow entries, so they are
+ * kept in a separate table hashed by (mapping, index), one word per
+ * slot.  It is lossy: colliding evictions overwrite each other, and
+ * stale entries of truncated files are only ever replaced.  The worst a
+ * stale entry can do is activate one page that did not need it.
+ *
+ * Refaults and activations are counted in /proc/vmstat as
+ * workingset_refault and workingset_activate.
+ */
+
+#include <linux/mm.h>
+#include <linux/swap.h>
+#include <linux/mm_inline.h>
+#include <linux/pagemap.h>
+#include <linux/vmalloc.h>
+#include <linux/hash.h>
+#include <linux/init.h>
+
+/*
+ * Shadow entry layout, from the least significant bit: a valid bit, the
+ * zone and node of the evicted page, hash bits not covered by the slot
+ * number, and the zone's inactive_age at eviction time.
+ */
+#define SHADOW_TAG_BITS		8
+#define SHADOW_TAG_MASK		((1UL << SHADOW_TAG_BITS) - 1)
+#define EVICTION_SHIFT		(1 + ZONES_SHIFT + NODES_SHIFT + SHADOW_TAG_BITS)
+#define EVICTION_MASK		(~0UL >> EVICTION_SHIFT)
+
+static unsigned long *shadow_table __read_mostly;
+static unsigned int shadow_bits __read_mostly;
+
+static unsigned long shadow_hash(struct address_space *mapping, pgoff_t index)
+{
+	return hash_long((unsigned long)mapping ^ hash_long(index, BITS_PER_LONG),
+			 BITS_PER_LONG);
+}
+
+static inline unsigned long *shadow_slot(unsigned long hash)
+{
+	return &shadow_table[hash >> (BITS_PER_LONG - shadow_bits)];
+}
+
+static unsigned long pack_shadow(unsigned long eviction, struct zone *zone,
+				 unsigned long hash)
+{
+	eviction = (eviction << SHADOW_TAG_BITS) | (hash & SHADOW_TAG_MASK);
+	eviction = (eviction << NODES_SHIFT) | zone_to_nid(zone);
+	eviction = (eviction << ZONES_SHIFT) | zone_idx(zone);
+	return (eviction << 1) | 1;
+}
+
+static void unpack_shadow(unsigned long entry, struct zone **zone,
+			  unsigned long *tag, unsigned long *eviction)
+{
+	int zid, nid;
+
+	entry >>= 1;
+	zid = entry & ((1UL << ZONES_SHIFT) - 1);
+	entry >>= ZONES_SHIFT;
+	nid = entry & ((1UL << NODES_SHIFT) - 1);
+	entry >>= NODES_SHIFT;
+	*tag = entry & SHADOW_TAG_MASK;
+	entry >>= SHADOW_TAG_BITS;
+
+	*zone = NODE_DATA(nid)->node_zones + zid;
+	*eviction = entry;
+}
+
+/**
+ * workingset_eviction - note the eviction of a page cache page
+ * @mapping: address space the page was removed from
+ * @page: the page being evicted
+ *
+ * Called by reclaim with the page locked and still in the page cache.
+ */
+void workingset_eviction(struct address_space *mapping, struct page *page)
+{
+	struct zone *zone = page_zone(page);
+	unsigned long hash, eviction;
+
+	if (!shadow_table || !page_is_file_cache(page))
+		return;
+
+	hash = shadow_hash(mapping, page->index);
+	eviction = atomic_long_inc_return(&zone->inactive_age);
+	*shadow_slot(hash) = pack_shadow(eviction, zone, hash);
+}
+
+/**
+ * workingset_refault - evaluate the refault of a previously evicted page
+ * @mapping: address space the page is being added to
+ * @index: offset of the page in @mapping
+ *
+ * Consumes the shadow entry of the page, if there is one, and returns
+ * true if the page should go straight to the active list.
+ */
+bool workingset_refault(struct address_space *mapping, pgoff_t index)
+{
+	unsigned long hash, entry, tag, eviction, refault_distance;
+	unsigned long *slot;
+	struct zone *zone;
+
+	if (!shadow_table)
+		return false;
+
+	hash = shadow_hash(mapping, index);
+	slot = shadow_slot(hash);
+	entry = ACCESS_ONCE(*slot);
+	if (!entry)
+		return false;
+
+	unpack_shadow(entry, &zone, &tag, &eviction);
+	if (tag != (hash & SHADOW_TAG_MASK))
+		return false;
+	*slot = 0;
+
+	count_vm_event(WORKINGSET_REFAULT);
+	refault_distance = (atomic_long_read(&zone->inactive_age) - eviction) &
+			   EVICTION_MASK;
+	if (refault_distance > zone_page_state(zone, NR_ACTIVE_FILE))
+		return false;
+
+	count_vm_event(WORKINGSET_ACTIVATE);
+	atomic_long_inc(&zone->inactive_age);
+	return true;
+}
+
+/**
+ * workingset_activation - note a page activation
+ * @page: page that is being activated
+ */
+void workingset_activation(struct page *page)
+{
+	atomic_long_inc(&page_zone(page)->inactive_age);
+}
+
+static int __init workingset_init(void)
+{
+	unsigned long nr = max(totalram_pages / 2, 1024UL);
+
+	/* one word for every other page of memory */
+	shadow_bits = ilog2(nr);
+	shadow_table = __vmalloc(sizeof(unsigned long) << shadow_bits,
+				 GFP_KERNEL | __GFP_ZERO, PAGE_KERNEL);
+	if (!shadow_table) {
+		printk(KERN_WARNING "workingset: cannot allocate %lu shadow "
+		       "entries, refault detection disabled\n", 1UL << shadow_bits);
+		return -ENOMEM;
+	}
+	printk(KERN_INFO "workingset: %lu shadow entries\n", 1UL << shadow_bits);
+	return 0;
+}
+module_init(workingset_init);
@@ -0,0 +1,472 @@
+/*
+ * zcache: an LZO compressed second-chance cache for clean file pages.
+ *
+ * A cleancache backend: clean page cache pages dropped by reclaim are
+ * compressed with lib/lzo and kept in memory, so a later page cache miss
+ * decompresses them instead of reading from disk or flash.  Pages that
+ * do not compress well are rejected; when the pool grows beyond
+ * max_pool_percent of RAM the least recently put pages are dropped.
+ *
+ * Compressed pages are kmalloc'd and indexed by (inode, index) in one
+ * rbtree per pool, i.e. per mounted filesystem, and sit on a single LRU
+ * list.  Puts come from __remove_from_page_cache() under the irq-safe
+ * mapping->tree_lock, so zcache_lock is always taken with interrupts
+ * disabled and allocations never sleep.
+ *
+ * See Documentation/vm/cleancache.txt.
+ */
+
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/highmem.h>
+#include <linux/rbtree.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/percpu.h>
+#include <linux/cleancache.h>
+#include <linux/lzo.h>
+#include <linux/hrtimer.h>
+#include <linux/debugfs.h>
+#include <linux/module.h>
+
+/* Enable zcache at boot: zcache.enabled=1 */
+static int zcache_enabled;
+module_param_named(enabled, zcache_enabled, bool, 0444);
+
+/* Upper bound on the compressed pool, as a percentage of total RAM */
+static unsigned int zcache_max_pool_percent = 10;
+module_param_named(max_pool_percent, zcache_max_pool_percent, uint, 0644);
+
+/* Pages that do not shrink below this are not worth keeping */
+#define ZCACHE_MAX_COMPRESSED	(PAGE_SIZE * 7 / 8)
+
+#define ZCACHE_GFP	(GFP_NOWAIT | __GFP_NORETRY | __GFP_NOWARN | \
+			 __GFP_NOMEMALLOC)
+
+#define ZCACHE_MAX_POOLS	32
+
+struct zcache_entry {
+	struct rb_node rbnode;
+	struct list_head lru;
+	int pool_id;
+	ino_t ino;
+	pgoff_t index;
+	unsigned int length;
+	unsigned char data[];
+};
+
+struct zcache_pool {
+	struct rb_root rbroot;
+};
+
+/* protects the pools, their trees, the LRU and the pool size */
+static DEFINE_SPINLOCK(zcache_lock);
+static struct zcache_pool *zcache_pools[ZCACHE_MAX_POOLS];
+static LIST_HEAD(zcache_lru);
+static unsigned long zcache_stored_pages;
+static unsigned long zcache_pool_bytes;
+
+/* LZO scratch memory and output buffer, used with preemption disabled */
+static DEFINE_PER_CPU(void *, zcache_wrkmem);
+static DEFINE_PER_CPU(unsigned char *, zcache_dstmem);
+
+/* statistics, updated without locking */
+static u64 zcache_puts;
+static u64 zcache_gets;
+static u64 zcache_get_misses;
+static u64 zcache_reject_compress_poor;
+static u64 zcache_reject_alloc_fail;
+static u64 zcache_evictions;
+static u64 zcache_put_ns;
+static u64 zcache_get_ns;
+
+/*********************************
+* rbtree helpers
+**********************************/
+static inline int zcache_key_cmp(ino_t ino, pgoff_t index,
+				 struct zcache_entry *entry)
+{
+	if (ino != entry->ino)
+		return ino < entry->ino ? -1 : 1;
+	if (index != entry->index)
+		return index < entry->index ? -1 : 1;
+	return 0;
+}
+
+static struct zcache_entry *zcache_rb_search(struct rb_root *root,
+					     ino_t ino, pgoff_t index)
+{
+	struct rb_node *node = root->rb_node;
+	struct zcache_entry *entry;
+	int cmp;
+
+	while (node) {
+		entry = rb_entry(node, struct zcache_entry, rbnode);
+		cmp = zcache_key_cmp(ino, index, entry);
+		if (cmp < 0)
+			node = node->rb_left;
+		else if (cmp > 0)
+			node = node->rb_right;
+		else
+			return entry;
+	}
+	return NULL;
+}
+
+/* The first entry of @ino, in index order, or NULL. */
+static struct zcache_entry *zcache_rb_first_of(struct rb_root *root,
+					       ino_t ino)
+{
+	struct rb_node *node = root->rb_node;
+	struct zcache_entry *entry, *first = NULL;
+
+	while (node) {
+		entry = rb_entry(node, struct zcache_entry, rbnode);
+		if (zcache_key_cmp(ino, 0, entry) <= 0) {
+			if (entry->ino == ino)
+				first = entry;
+			node = node->rb_left;
+		} else
+			node = node->rb_right;
+	}
+	return first;
+}
+
+/*
+ * Insert @entry, returning any entry already stored at its key.  The
+ * old entry is replaced in the tree and left for the caller to drop.
+ */
+static struct zcache_entry *zcache_rb_insert(struct rb_root *root,
+					     struct zcache_entry *entry)
+{
+	struct rb_node **link = &root->rb_node, *parent = NULL;
+	struct zcache_entry *this;
+	int cmp;
+
+	while (*link) {
+		parent = *link;
+		this = rb_entry(parent, struct zcache_entry, rbnode);
+		cmp = zcache_key_cmp(entry->ino, entry->index, this);
+		if (cmp < 0)
+			link = &parent->rb_left;
+		else if (cmp > 0)
+			link = &parent->rb_right;
+		else {
+			rb_replace_node(&this->rbnode, &entry->rbnode, root);
+			return this;
+		}
+	}
+	rb_link_node(&entry->rbnode, parent, link);
+	rb_insert_color(&entry->rbnode, root);
+	return NULL;
+}
+
+/* Unlink an entry that is already out of its tree.  zcache_lock held. */
+static void zcache_drop_entry(struct zcache_entry *entry)
+{
+	list_del(&entry->lru);
+	zcache_stored_pages--;
+	zcache_pool_bytes -= entry->length;
+	kfree(entry);
+}
+
+static void zcache_erase_entry(struct zcache_entry *entry)
+{
+	rb_erase(&entry->rbnode, &zcache_pools[entry->pool_id]->rbroot);
+	zcache_drop_entry(entry);
+}
+
+/* Drop least recently put pages until the pool fits.  zcache_lock held. */
+static void zcache_shrink(void)
+{
+	unsigned long max_bytes;
+	struct zcache_entry *entry;
+
+	max_bytes = totalram_pages * zcache_max_pool_percent / 100 * PAGE_SIZE;
+	while (zcache_pool_bytes > max_bytes && !list_empty(&zcache_lru)) {
+		entry = list_entry(zcache_lru.prev, struct zcache_entry, lru);
+		zcache_erase_entry(entry);
+		zcache_evictions++;
+	}
+}
+
+static void zcache_invalidate_key(struct zcache_pool *pool, ino_t ino,
+				  pgoff_t index)
+{
+	struct zcache_entry *entry;
+	unsigned long flags;
+
+	spin_lock_irqsave(&zcache_lock, flags);
+	entry = zcache_rb_search(&pool->rbroot, ino, index);
+	if (entry)
+		zcache_erase_entry(entry);
+	spin_unlock_irqrestore(&zcache_lock, flags);
+}
+
+/*********************************
+* cleancache hooks
+**********************************/
+static int zcache_init_fs(size_t pagesize)
+{
+	struct zcache_pool *pool;
+	unsigned long flags;
+	int pool_id;
+
+	if (pagesize != PAGE_SIZE)
+		return -1;
+
+	pool = kmalloc(sizeof(*pool), GFP_KERNEL);
+	if (!pool)
+		return -1;
+	pool->rbroot = RB_ROOT;
+
+	spin_lock_irqsave(&zcache_lock, flags);
+	for (pool_id = 0; pool_id < ZCACHE_MAX_POOLS; pool_id++) {
+		if (!zcache_pools[pool_id]) {
+			zcache_pools[pool_id] = pool;
+			break;
+		}
+	}
+	spin_unlock_irqrestore(&zcache_lock, flags);
+
+	if (pool_id == ZCACHE_MAX_POOLS) {
+		kfree(pool);
+		return -1;
+	}
+	return pool_id;
+}
+
+static void zcache_put_page(int pool_id, ino_t ino, pgoff_t index,
+			    struct page *page)
+{
+	struct zcache_pool *pool = zcache_pools[pool_id];
+	struct zcache_entry *entry, *dup;
+	unsigned char *src, *dst;
+	unsigned long flags;
+	size_t dlen;
+	ktime_t start;
+	int ret;
+
+	start = ktime_get();
+	get_cpu();
+	dst = __get_cpu_var(zcache_dstmem);
+	src = kmap_atomic(page, KM_USER0);
+	ret = lzo1x_1_compress(src, PAGE_SIZE, dst, &dlen,
+			       __get_cpu_var(zcache_wrkmem));
+	kunmap_atomic(src, KM_USER0);
+	if (ret != LZO_E_OK || dlen > ZCACHE_MAX_COMPRESSED) {
+		put_cpu();
+		zcache_reject_compress_poor++;
+		goto reject;
+	}
+
+	entry = kmalloc(sizeof(*entry) + dlen, ZCACHE_GFP);
+	if (!entry) {
+		put_cpu();
+		zcache_reject_alloc_fail++;
+		goto reject;
+	}
+	entry->pool_id = pool_id;
+	entry->ino = ino;
+	entry->index = index;
+	entry->length = dlen;
+	memcpy(entry->data, dst, dlen);
+	put_cpu();
+
+	spin_lock_irqsave(&zcache_lock, flags);
+	dup = zcache_rb_insert(&pool->rbroot, entry);
+	if (dup)
+		zcache_drop_entry(dup);
+	list_add(&entry->lru, &zcache_lru);
+	zcache_stored_pages++;
+	zcache_pool_bytes += dlen;
+	zcache_shrink();
+	spin_unlock_irqrestore(&zcache_lock, flags);
+
+	zcache_puts++;
+	zcache_put_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+	return;
+
+reject:
+	/* an older copy of this page must not outlive the rejected one */
+	zcache_invalidate_key(pool, ino, index);
+}
+
+/* Gets are exclusive: the page cache owns the data from now on. */
+static int zcache_get_page(int pool_id, ino_t ino, pgoff_t index,
+			   struct page *page)
+{
+	struct zcache_pool *pool = zcache_pools[pool_id];
+	struct zcache_entry *entry;
+	unsigned char *dst;
+	unsigned long flags;
+	size_t dlen = PAGE_SIZE;
+	ktime_t start;
+	int ret;
+
+	start = ktime_get();
+	spin_lock_irqsave(&zcache_lock, flags);
+	entry = zcache_rb_search(&pool->rbroot, ino, index);
+	if (entry) {
+		rb_erase(&entry->rbnode, &pool->rbroot);
+		list_del(&entry->lru);
+		zcache_stored_pages--;
+		zcache_pool_bytes -= entry->length;
+	}
+	spin_unlock_irqrestore(&zcache_lock, flags);
+	if (!entry) {
+		zcache_get_misses++;
+		return -1;
+	}
+
+	dst = kmap_atomic(page, KM_USER0);
+	ret = lzo1x_decompress_safe(entry->data, entry->length, dst, &dlen);
+	kunmap_atomic(dst, KM_USER0);
+	kfree(entry);
+	BUG_ON(ret != LZO_E_OK || dlen != PAGE_SIZE);
+
+	zcache_gets++;
+	zcache_get_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+	return 0;
+}
+
+static void zcache_invalidate_page(int pool_id, ino_t ino, pgoff_t index)
+{
+	zcache_invalidate_key(zcache_pools[pool_id], ino, index);
+}
+
+static void zcache_invalidate_inode(int pool_id, ino_t ino)
+{
+	struct zcache_pool *pool = zcache_pools[pool_id];
+	struct zcache_entry *entry;
+	struct rb_node *next;
+	unsigned long flags;
+
+	spin_lock_irqsave(&zcache_lock, flags);
+	entry = zcache_rb_first_of(&pool->rbroot, ino);
+	while (entry) {
+		next = rb_next(&entry->rbnode);
+		zcache_erase_entry(entry);
+		entry = next ? rb_entry(next, struct zcache_entry, rbnode) : NULL;
+		if (entry && entry->ino != ino)
+			break;
+	}
+	spin_unlock_irqrestore(&zcache_lock, flags);
+}
+
+static void zcache_invalidate_fs(int pool_id)
+{
+	struct zcache_pool *pool = zcache_pools[pool_id];
+	struct zcache_entry *entry;
+	struct rb_node *node;
+	unsigned long flags;
+
+	spin_lock_irqsave(&zcache_lock, flags);
+	while ((node = rb_first(&pool->rbroot))) {
+		entry = rb_entry(node, struct zcache_entry, rbnode);
+		zcache_erase_entry(entry);
+	}
+	zcache_pools[pool_id] = NULL;
+	spin_unlock_irqrestore(&zcache_lock, flags);
+	kfree(pool);
+}
+
+static struct cleancache_ops zcache_cleancache_ops = {
+	.init_fs = zcache_init_fs,
+	.get_page = zcache_get_page,
+	.put_page = zcache_put_page,
+	.invalidate_page = zcache_invalidate_page,
+	.invalidate_inode = zcache_invalidate_inode,
+	.invalidate_fs = zcache_invalidate_fs,
+};
+
+/*********************************
+* debugfs
+**********************************/
+#ifdef CONFIG_DEBUG_FS
+static int stored_pages_get(void *data, u64 *val)
+{
+	*val = zcache_stored_pages;
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(stored_pages_fops, stored_pages_get, NULL, "%llu\n");
+
+static int pool_bytes_get(void *data, u64 *val)
+{
+	*val = zcache_pool_bytes;
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(pool_bytes_fops, pool_bytes_get, NULL, "%llu\n");
+
+static void __init zcache_debugfs_init(void)
+{
+	struct dentry *root = debugfs_create_dir("zcache", NULL);
+
+	if (!root)
+		return;
+	debugfs_create_u64("puts", S_IRUGO, root, &zcache_puts);
+	debugfs_create_u64("gets", S_IRUGO, root, &zcache_gets);
+	debugfs_create_u64("get_misses", S_IRUGO, root, &zcache_get_misses);
+	debugfs_create_u64("reject_compress_poor", S_IRUGO, root,
+			   &zcache_reject_compress_poor);
+	debugfs_create_u64("reject_alloc_fail", S_IRUGO, root,
+			   &zcache_reject_alloc_fail);
+	debugfs_create_u64("evictions", S_IRUGO, root, &zcache_evictions);
+	debugfs_create_u64("put_ns", S_IRUGO, root, &zcache_put_ns);
+	debugfs_create_u64("get_ns", S_IRUGO, root, &zcache_get_ns);
+	debugfs_create_file("stored_pages", S_IRUGO, root, NULL,
+			    &stored_pages_fops);
+	debugfs_create_file("pool_bytes", S_IRUGO, root, NULL,
+			    &pool_bytes_fops);
+}
+#else
+static inline void zcache_debugfs_init(void)
+{
+}
+#endif
+
+/*********************************
+* init
+**********************************/
+static int __init zcache_cpu_init(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		void *wrkmem = vmalloc(LZO1X_1_MEM_COMPRESS);
+		unsigned char *dst = vmalloc(lzo1x_worst_compress(PAGE_SIZE));
+
+		per_cpu(zcache_wrkmem, cpu) = wrkmem;
+		per_cpu(zcache_dstmem, cpu) = dst;
+		if (!wrkmem || !dst)
+			goto fail;
+	}
+	return 0;
+fail:
+	for_each_possible_cpu(cpu) {
+		vfree(per_cpu(zcache_wrkmem, cpu));
+		vfree(per_cpu(zcache_dstmem, cpu));
+		per_cpu(zcache_wrkmem, cpu) = NULL;
+		per_cpu(zcache_dstmem, cpu) = NULL;
+	}
+	return -ENOMEM;
+}
+
+static int __init init_zcache(void)
+{
+	if (!zcache_enabled)
+		return 0;
+
+	if (zcache_cpu_init()) {
+		printk(KERN_ERR "zcache: per-cpu buffer allocation failed\n");
+		return -ENOMEM;
+	}
+	cleancache_register_ops(&zcache_cleancache_ops);
+	zcache_debugfs_init();
+	printk(KERN_INFO "zcache: LZO compressed page cache enabled, "
+	       "pool limit %u%% of RAM\n", zcache_max_pool_percent);
+	return 0;
+}
+/* must run before the root filesystem is mounted so it gets a pool */
+late_initcall(init_zcache);
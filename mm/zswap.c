@@ -0,0 +1,379 @@
+/*
+ * zswap: an LZO compressed cache for swap pages.
+ *
+ * A frontswap backend: pages on their way to swap are compressed with
+ * lib/lzo and kept in memory, so a later swapin decompresses them
+ * instead of waiting for the swap device.  Pages that do not compress
+ * well, or that would grow the pool beyond max_pool_percent of RAM, are
+ * rejected and go to the device as before.
+ *
+ * Compressed pages are kmalloc'd and indexed by swap offset in one
+ * rbtree per swap type.  Allocations never sleep or dip into reserves:
+ * the caller is reclaim, and a failed store only costs a device write.
+ *
+ * See Documentation/vm/frontswap.txt.
+ */
+
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/highmem.h>
+#include <linux/rbtree.h>
+#include <linux/spinlock.h>
+#include <linux/percpu.h>
+#include <linux/swap.h>
+#include <linux/frontswap.h>
+#include <linux/lzo.h>
+#include <linux/ktime.h>
+#include <linux/debugfs.h>
+#include <linux/module.h>
+
+/* Enable zswap at boot: zswap.enabled=1 */
+static int zswap_enabled;
+module_param_named(enabled, zswap_enabled, bool, 0444);
+
+/* Upper bound on the compressed pool, as a percentage of total RAM */
+static unsigned int zswap_max_pool_percent = 20;
+module_param_named(max_pool_percent, zswap_max_pool_percent, uint, 0644);
+
+/* Pages that do not shrink below this are not worth keeping */
+#define ZSWAP_MAX_COMPRESSED	(PAGE_SIZE * 7 / 8)
+
+#define ZSWAP_GFP	(GFP_NOWAIT | __GFP_NORETRY | __GFP_NOWARN | \
+			 __GFP_NOMEMALLOC)
+
+struct zswap_entry {
+	struct rb_node rbnode;
+	pgoff_t offset;
+	unsigned int length;
+	unsigned char data[];
+};
+
+struct zswap_tree {
+	struct rb_root rbroot;
+	spinlock_t lock;
+};
+
+static struct zswap_tree *zswap_trees[MAX_SWAPFILES];
+
+/* LZO scratch memory and output buffer, used with preemption disabled */
+static DEFINE_PER_CPU(void *, zswap_wrkmem);
+static DEFINE_PER_CPU(unsigned char *, zswap_dstmem);
+
+static atomic_t zswap_stored_pages = ATOMIC_INIT(0);
+static atomic_long_t zswap_pool_bytes = ATOMIC_LONG_INIT(0);
+
+/* statistics, updated without locking */
+static u64 zswap_stores;
+static u64 zswap_loads;
+static u64 zswap_reject_compress_poor;
+static u64 zswap_reject_pool_limit;
+static u64 zswap_reject_alloc_fail;
+static u64 zswap_store_ns;
+static u64 zswap_load_ns;
+
+/*********************************
+* rbtree helpers
+**********************************/
+static struct zswap_entry *zswap_rb_search(struct rb_root *root,
+					   pgoff_t offset)
+{
+	struct rb_node *node = root->rb_node;
+	struct zswap_entry *entry;
+
+	while (node) {
+		entry = rb_entry(node, struct zswap_entry, rbnode);
+		if (offset < entry->offset)
+			node = node->rb_left;
+		else if (offset > entry->offset)
+			node = node->rb_right;
+		else
+			return entry;
+	}
+	return NULL;
+}
+
+/*
+ * Insert @entry, returning any entry already stored at its offset.  The
+ * old entry is replaced in the tree and left for the caller to free.
+ */
+static struct zswap_entry *zswap_rb_insert(struct rb_root *root,
+					   struct zswap_entry *entry)
+{
+	struct rb_node **link = &root->rb_node, *parent = NULL;
+	struct zswap_entry *this;
+
+	while (*link) {
+		parent = *link;
+		this = rb_entry(parent, struct zswap_entry, rbnode);
+		if (entry->offset < this->offset)
+			link = &parent->rb_left;
+		else if (entry->offset > this->offset)
+			link = &parent->rb_right;
+		else {
+			rb_replace_node(&this->rbnode, &entry->rbnode, root);
+			return this;
+		}
+	}
+	rb_link_node(&entry->rbnode, parent, link);
+	rb_insert_color(&entry->rbnode, root);
+	return NULL;
+}
+
+static void zswap_free_entry(struct zswap_entry *entry)
+{
+	atomic_dec(&zswap_stored_pages);
+	atomic_long_sub(entry->length, &zswap_pool_bytes);
+	kfree(entry);
+}
+
+static bool zswap_pool_full(void)
+{
+	unsigned long max_bytes;
+
+	max_bytes = totalram_pages * zswap_max_pool_percent / 100;
+	return atomic_long_read(&zswap_pool_bytes) > max_bytes * PAGE_SIZE;
+}
+
+/*********************************
+* frontswap hooks
+**********************************/
+static void zswap_frontswap_init(unsigned type)
+{
+	struct zswap_tree *tree;
+
+	tree = kmalloc(sizeof(*tree), GFP_KERNEL);
+	if (!tree) {
+		printk(KERN_ERR "zswap: no memory for swap type %u tree\n",
+		       type);
+		return;
+	}
+	tree->rbroot = RB_ROOT;
+	spin_lock_init(&tree->lock);
+	zswap_trees[type] = tree;
+}
+
+static int zswap_frontswap_store(unsigned type, pgoff_t offset,
+				 struct page *page)
+{
+	struct zswap_tree *tree = zswap_trees[type];
+	struct zswap_entry *entry, *dup;
+	unsigned char *src, *dst;
+	size_t dlen;
+	ktime_t start;
+	int ret;
+
+	if (!tree)
+		return -1;
+	if (zswap_pool_full()) {
+		zswap_reject_pool_limit++;
+		return -1;
+	}
+
+	start = ktime_get();
+	get_cpu();
+	dst = __get_cpu_var(zswap_dstmem);
+	src = kmap_atomic(page, KM_USER0);
+	ret = lzo1x_1_compress(src, PAGE_SIZE, dst, &dlen,
+			       __get_cpu_var(zswap_wrkmem));
+	kunmap_atomic(src, KM_USER0);
+	if (ret != LZO_E_OK || dlen > ZSWAP_MAX_COMPRESSED) {
+		put_cpu();
+		zswap_reject_compress_poor++;
+		return -1;
+	}
+
+	entry = kmalloc(sizeof(*entry) + dlen, ZSWAP_GFP);
+	if (!entry) {
+		put_cpu();
+		zswap_reject_alloc_fail++;
+		return -1;
+	}
+	entry->offset = offset;
+	entry->length = dlen;
+	memcpy(entry->data, dst, dlen);
+	put_cpu();
+
+	atomic_inc(&zswap_stored_pages);
+	atomic_long_add(dlen, &zswap_pool_bytes);
+
+	spin_lock(&tree->lock);
+	dup = zswap_rb_insert(&tree->rbroot, entry);
+	spin_unlock(&tree->lock);
+	if (dup)
+		zswap_free_entry(dup);
+
+	zswap_stores++;
+	zswap_store_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+	return 0;
+}
+
+/*
+ * The entry stays in the tree after a load: the swap slot is still
+ * allocated and frontswap invalidates it when the slot is freed.
+ */
+static int zswap_frontswap_load(unsigned type, pgoff_t offset,
+				struct page *page)
+{
+	struct zswap_tree *tree = zswap_trees[type];
+	struct zswap_entry *entry;
+	unsigned char *dst;
+	size_t dlen = PAGE_SIZE;
+	ktime_t start;
+	int ret;
+
+	if (!tree)
+		return -1;
+
+	start = ktime_get();
+	spin_lock(&tree->lock);
+	entry = zswap_rb_search(&tree->rbroot, offset);
+	if (!entry) {
+		spin_unlock(&tree->lock);
+		return -1;
+	}
+	dst = kmap_atomic(page, KM_USER0);
+	ret = lzo1x_decompress_safe(entry->data, entry->length, dst, &dlen);
+	kunmap_atomic(dst, KM_USER0);
+	spin_unlock(&tree->lock);
+	BUG_ON(ret != LZO_E_OK || dlen != PAGE_SIZE);
+
+	zswap_loads++;
+	zswap_load_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+	return 0;
+}
+
+static void zswap_frontswap_invalidate_page(unsigned type, pgoff_t offset)
+{
+	struct zswap_tree *tree = zswap_trees[type];
+	struct zswap_entry *entry;
+
+	if (!tree)
+		return;
+
+	spin_lock(&tree->lock);
+	entry = zswap_rb_search(&tree->rbroot, offset);
+	if (entry)
+		rb_erase(&entry->rbnode, &tree->rbroot);
+	spin_unlock(&tree->lock);
+	if (entry)
+		zswap_free_entry(entry);
+}
+
+static void zswap_frontswap_invalidate_area(unsigned type)
+{
+	struct zswap_tree *tree = zswap_trees[type];
+	struct zswap_entry *entry;
+	struct rb_node *node;
+
+	if (!tree)
+		return;
+
+	spin_lock(&tree->lock);
+	while ((node = rb_first(&tree->rbroot))) {
+		entry = rb_entry(node, struct zswap_entry, rbnode);
+		rb_erase(node, &tree->rbroot);
+		zswap_free_entry(entry);
+	}
+	spin_unlock(&tree->lock);
+	zswap_trees[type] = NULL;
+	kfree(tree);
+}
+
+static struct frontswap_ops zswap_frontswap_ops = {
+	.init = zswap_frontswap_init,
+	.store = zswap_frontswap_store,
+	.load = zswap_frontswap_load,
+	.invalidate_page = zswap_frontswap_invalidate_page,
+	.invalidate_area = zswap_frontswap_invalidate_area,
+};
+
+/*********************************
+* debugfs
+**********************************/
+#ifdef CONFIG_DEBUG_FS
+static int stored_pages_get(void *data, u64 *val)
+{
+	*val = atomic_read(&zswap_stored_pages);
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(stored_pages_fops, stored_pages_get, NULL, "%llu\n");
+
+static int pool_bytes_get(void *data, u64 *val)
+{
+	*val = atomic_long_read(&zswap_pool_bytes);
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(pool_bytes_fops, pool_bytes_get, NULL, "%llu\n");
+
+static void __init zswap_debugfs_init(void)
+{
+	struct dentry *root = debugfs_create_dir("zswap", NULL);
+
+	if (!root)
+		return;
+	debugfs_create_u64("stores", S_IRUGO, root, &zswap_stores);
+	debugfs_create_u64("loads", S_IRUGO, root, &zswap_loads);
+	debugfs_create_u64("reject_compress_poor", S_IRUGO, root,
+			   &zswap_reject_compress_poor);
+	debugfs_create_u64("reject_pool_limit", S_IRUGO, root,
+			   &zswap_reject_pool_limit);
+	debugfs_create_u64("reject_alloc_fail", S_IRUGO, root,
+			   &zswap_reject_alloc_fail);
+	debugfs_create_u64("store_ns", S_IRUGO, root, &zswap_store_ns);
+	debugfs_create_u64("load_ns", S_IRUGO, root, &zswap_load_ns);
+	debugfs_create_file("stored_pages", S_IRUGO, root, NULL,
+			    &stored_pages_fops);
+	debugfs_create_file("pool_bytes", S_IRUGO, root, NULL,
+			    &pool_bytes_fops);
+}
+#else
+static inline void zswap_debugfs_init(void)
+{
+}
+#endif
+
+/*********************************
+* init
+**********************************/
+static int __init zswap_cpu_init(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		void *wrkmem = vmalloc(LZO1X_1_MEM_COMPRESS);
+		unsigned char *dst = vmalloc(lzo1x_worst_compress(PAGE_SIZE));
+
+		per_cpu(zswap_wrkmem, cpu) = wrkmem;
+		per_cpu(zswap_dstmem, cpu) = dst;
+		if (!wrkmem || !dst)
+			goto fail;
+	}
+	return 0;
+fail:
+	for_each_possible_cpu(cpu) {
+		vfree(per_cpu(zswap_wrkmem, cpu));
+		vfree(per_cpu(zswap_dstmem, cpu));
+		per_cpu(zswap_wrkmem, cpu) = NULL;
+		per_cpu(zswap_dstmem, cpu) = NULL;
+	}
+	return -ENOMEM;
+}
+
+static int __init init_zswap(void)
+{
+	if (!zswap_enabled)
+		return 0;
+
+	if (zswap_cpu_init()) {
+		printk(KERN_ERR "zswap: per-cpu buffer allocation failed\n");
+		return -ENOMEM;
+	}
+	frontswap_register_ops(&zswap_frontswap_ops);
+	zswap_debugfs_init();
+	printk(KERN_INFO "zswap: LZO compressed swap cache enabled, "
+	       "pool limit %u%% of RAM\n", zswap_max_pool_percent);
+	return 0;
+}
+/* must run before swapon so the swap types get a frontswap_map */
+late_initcall(init_zswap);
@@ -2566,13 +2566,7 @@ static void net_tx_action(struct softirq_action *h)
 		sd->completion_queue = NULL;
 		local_irq_enable();
 
-		while (clist) {
-			struct sk_buff *skb = clist;
-			clist = clist->next;
-
-			WARN_ON(atomic_read(&skb->users));
-			__kfree_skb(skb);
-		}
+		__kfree_skb_list(clist);
 	}
 
 	if (sd->output_queue) {
@@ -430,6 +430,41 @@ void __kfree_skb(struct sk_buff *skb)
 }
 EXPORT_SYMBOL(__kfree_skb);
 
+#define KFREE_SKB_BULK	16
+
+/**
+ *	__kfree_skb_list - free a list of unreferenced buffers
+ *	@skb: first buffer, the others are chained through ->next
+ *
+ *	Same as __kfree_skb() on every buffer of the list, but sk_buff
+ *	heads that are not part of a fast clone go back to the slab in
+ *	batches through kmem_cache_free_bulk().
+ */
+void __kfree_skb_list(struct sk_buff *skb)
+{
+	void *heads[KFREE_SKB_BULK];
+	size_t n = 0;
+
+	while (skb) {
+		struct sk_buff *next = skb->next;
+
+		WARN_ON(atomic_read(&skb->users));
+		skb_release_all(skb);
+		if (skb->fclone == SKB_FCLONE_UNAVAILABLE) {
+			heads[n++] = skb;
+			if (n == KFREE_SKB_BULK) {
+				kmem_cache_free_bulk(skbuff_head_cache, n,
+						     heads);
+				n = 0;
+			}
+		} else
+			kfree_skbmem(skb);
+		skb = next;
+	}
+	if (n)
+		kmem_cache_free_bulk(skbuff_head_cache, n, heads);
+}
+
 /**
  *	kfree_skb - free an sk_buff
  *	@skb: buffer to free
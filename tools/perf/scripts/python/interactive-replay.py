@@ -0,0 +1,146 @@
+# interactive governor decision replay
+# Licensed under the terms of the GNU GPL License version 2
+#
+# Replays the loads recorded by the cpufreq_interactive_target trace
+# event against the default and the predictive decision logic of the
+# interactive cpufreq governor and reports, for each of them, how often
+# the speed picked for a window was too low for the load that followed
+# (late), by how much it fell short on average (shortfall), how much
+# capacity was left unused (overshoot) and how many speed transitions
+# were made.  Shortfall and overshoot are relative to the speed picked
+# and averaged over all windows.
+#
+# The frequency table is reconstructed from the frequencies seen in the
+# trace.  min_sample_time is honoured for ramping down; the long-term
+# load of the default mode is not, so the default mode replay is an
+# approximation that errs on the side of ramping down too early.
+
+import os
+import sys
+
+sys.path.append(os.environ['PERF_EXEC_PATH'] + \
+	'/scripts/python/Perf-Trace-Util/lib/Perf/Trace')
+
+from perf_trace_context import *
+from Core import *
+
+usage = "perf trace -s interactive-replay.py [go_maxspeed_load [min_sample_time_us]]\n";
+
+go_maxspeed_load = 85
+min_sample_time = 80000
+history_len = 4
+
+if len(sys.argv) > 3:
+	sys.exit(usage)
+
+if len(sys.argv) > 1:
+	go_maxspeed_load = int(sys.argv[1])
+
+if len(sys.argv) > 2:
+	min_sample_time = int(sys.argv[2])
+
+# per-cpu list of (timestamp in us, load, cur)
+samples = {}
+freqs = set()
+
+def trace_begin():
+	pass
+
+def trace_end():
+	table = sorted(freqs)
+	if not table:
+		print "no cpufreq_interactive_target events recorded"
+		return
+
+	print "%-12s %10s %10s %12s %12s %12s %12s" % ("mode", "windows", \
+		"late", "late %", "shortfall %", "overshoot %", "transitions")
+	print "%-12s %10s %10s %12s %12s %12s %12s" % ("------------", \
+		"----------", "----------", "------------", "------------", \
+		"------------", "------------")
+
+	for name, pick in (("default", pick_default), \
+			   ("predictive", pick_predictive)):
+		replay(name, pick, table)
+
+def cpufreq_interactive__cpufreq_interactive_target(event_name, context,
+	common_cpu, common_secs, common_nsecs, common_pid, common_comm,
+	cpu, load, predicted, cur, target):
+	now = common_secs * 1000000 + common_nsecs / 1000
+	samples.setdefault(cpu, []).append((now, load, cur))
+	freqs.add(cur)
+	freqs.add(target)
+
+def table_at_or_below(table, freq):
+	below = [f for f in table if f <= freq]
+	if below:
+		return below[-1]
+	return table[0]
+
+def table_at_or_above(table, freq):
+	above = [f for f in table if f >= freq]
+	if above:
+		return above[0]
+	return table[-1]
+
+def pick_default(table, load, cur, history):
+	fmax = table[-1]
+	if load >= go_maxspeed_load:
+		return fmax
+	return table_at_or_below(table, fmax * load / 100)
+
+def pick_predictive(table, load, cur, history):
+	fmax = table[-1]
+	if load >= go_maxspeed_load:
+		return fmax
+	n = len(history)
+	weights = range(n, 0, -1)
+	newest_first = history[::-1]
+	predicted = sum(w * l for w, l in zip(weights, newest_first)) / \
+		sum(weights)
+	if n > 1:
+		predicted += (newest_first[0] - newest_first[-1]) / (n - 1)
+	predicted = max(0, min(100, predicted))
+	if predicted >= go_maxspeed_load:
+		return fmax
+	return table_at_or_above(table, fmax * predicted / 100)
+
+def replay(name, pick, table):
+	fmax = table[-1]
+	windows = late = transitions = 0
+	shortfall = overshoot = 0.0
+
+	for cpu, trace in samples.iteritems():
+		history = []
+		freq = None
+		changed = 0
+		for i in range(len(trace) - 1):
+			now, load, cur = trace[i]
+			history.append(load * cur / fmax)
+			history = history[-history_len:]
+
+			new = pick(table, load, cur, history)
+			if freq is not None and new < freq and \
+			   now - changed < min_sample_time:
+				new = freq
+			if new != freq:
+				if freq is not None:
+					transitions += 1
+				freq = new
+				changed = now
+
+			# demand of the next window, in kHz
+			next_load, next_cur = trace[i + 1][1], trace[i + 1][2]
+			demand = next_load * next_cur / 100.0
+			windows += 1
+			if demand > freq:
+				late += 1
+				shortfall += (demand - freq) / freq
+			else:
+				overshoot += (freq - demand) / freq
+
+	if not windows:
+		return
+
+	print "%-12s %10d %10d %12.1f %12.1f %12.1f %12d" % (name, windows, \
+		late, 100.0 * late / windows, 100.0 * shortfall / windows, \
+		100.0 * overshoot / windows, transitions)